@@ -1,7 +1,9 @@
 #include "pch.h"
 #include "Apollo.h"
 
+#include "CrackCheck.h"
 #include "DDSTextureLoader12.h"
+#include "QuadSphereCache.h"
 #include "QuadSphereGenerator.h"
 #include "ReadData.h"
 
@@ -28,6 +30,11 @@ Apollo::Apollo() noexcept :
 
 Apollo::~Apollo()
 {
+    // Render stage records what was published, predicted cull still running is finished and dropped.
+    m_framePipeline.Close();
+    m_renderTask.reset();
+    m_cullingTask.reset();
+
     // Ensure that the GPU is no longer referencing resources that are about to be destroyed.
     WaitForGpu();
 
@@ -57,6 +64,56 @@ void Apollo::InitializeD3DResources(HWND window, int width, int height, UINT sub
     m_staticVertexCount = 0;
 
     m_culledQuadCount = 0;
+    m_cullingTime = 0.0f;
+    m_testedNodeCount = 0;
+    m_testedPlaneCount = 0;
+    m_drawRangeCount = 0;
+    m_shadowDrawRangeCount = 0;
+    m_cullingValid = false;
+    m_culledShadowView = false;
+    m_horizonCulling = true;
+    m_horizonCulledQuadCount = 0;
+    m_backFaceCulling = true;
+    m_backFaceCulledQuadCount = 0;
+    m_occlusionCulling = true;
+    m_occludedNodeCount = 0;
+    m_patchLod = true;
+    m_lodMetric = LodErrorMetric::Geometric;
+    m_lodPixelThreshold = 2.0f;
+    m_visiblePatchCount = 0;
+    m_lodRefinedNodeCount = 0;
+    m_detailNodeCount = 0;
+    m_splitBlockCount = 0;
+    m_evictedBlockCount = 0;
+    m_culledCameraPosition = XMFLOAT3(0.0f, 0.0f, 0.0f);
+    m_cullingMargin = 2.0f;
+    m_cullingBoundRadius = 0.0f;
+    m_cullingCount = 0;
+    m_skippedCullingCount = 0;
+    m_enteredLeafCount = 0;
+    m_leftLeafCount = 0;
+    m_patchedBytes = 0;
+    m_totalPatchedBytes = 0;
+    m_cullingKernel = FrustumCulling::GetBestKernel();
+    m_cullingMode = CullingMode::Hierarchy;
+    m_culledMargin = 0.0f;
+    m_predictedCulling = true;
+    m_predictedPose = {};
+    m_camStep = XMVectorZero();
+    m_camYawStep = 0.0f;
+    m_camPitchStep = 0.0f;
+    m_lightStep = 0.0f;
+    m_predictionMargin = 0.0f;
+    m_cullingWaitTime = 0.0f;
+    m_predictedCullingCount = 0;
+    m_predictionHitCount = 0;
+    m_fallbackCullingCount = 0;
+    m_deviceLost = false;
+    m_updateTime = 0.0f;
+    m_renderTime = 0.0f;
+    m_uploadRingUsedSize = 0;
+    m_uploadRingPeakSize = 0;
+    m_uploadRingWaitCount = 0;
 
 	m_renderShadow = true;
     m_lightRotation = true;
@@ -75,6 +132,9 @@ void Apollo::InitializeD3DResources(HWND window, int width, int height, UINT sub
     m_orbitMode = false;
     m_camMoveSpeed = 30.0f;
     m_camRotateSpeed = 0.5f;
+    m_lastCamPosition = m_camPosition;
+    m_lastCamYaw = m_camYaw;
+    m_lastCamPitch = m_camPitch;
 
     m_worldMatrix = XMMatrixIdentity();
     m_viewMatrix = XMMatrixLookAtLH(m_camPosition, m_camLookTarget, DEFAULT_UP_VECTOR);
@@ -98,17 +158,31 @@ void Apollo::InitializeD3DResources(HWND window, int width, int height, UINT sub
     CreateDeviceDependentResources();
     CreateWindowSizeDependentResources();
     CreateCommandListDependentResources();
+
+    StartRenderStage();
 }
 
 // Executes the basic game loop.
 void Apollo::Tick()
 {
+    // Render stage closes the pipeline when it stops by itself, device is rebuilt here once it is done.
+    if (m_framePipeline.IsClosed())
+    {
+        StopRenderStage();
+        if (m_deviceLost)
+            OnDeviceLost();
+        StartRenderStage();
+    }
+
+    // Update needs a free packet slot. While the render stage is behind, the window thread returns to its
+    // message loop every now and then, Present may need window messages handled in full screen mode.
+    if (!m_framePipeline.AcquireWrite(std::chrono::milliseconds(1)))
+        return;
+
     m_timer.Tick([&]()
     {
         Update(m_timer);
     });
-
-    Render();
 }
 
 void Apollo::OnKeyDown(UINT8 key)
@@ -159,6 +233,7 @@ void Apollo::OnMouseMove(int x, int y)
 // Updates the world.
 void Apollo::Update(DX::StepTimer const& timer)
 {
+    const auto updateStart = std::chrono::high_resolution_clock::now();
 	const auto elapsedTime = static_cast<float>(timer.GetElapsedSeconds());
 
     // Set view matrix based on camera position and orientation.
@@ -180,29 +255,6 @@ void Apollo::Update(DX::StepTimer const& timer)
     m_camLookTarget = m_camPosition + m_camLookTarget;
     m_viewMatrix = XMMatrixLookAtLH(m_camPosition, m_camLookTarget, m_camUp);
 
-    // Do frustum culling.
-    {
-        // Update projection matrix.
-        m_projectionMatrix = XMMatrixPerspectiveFovLH(
-            XM_PIDIV4, 
-            m_aspectRatio, 
-            0.01f, 
-            XMVector3Length(m_camPosition).m128_f32[0]);
-
-        // Update frustum.
-        BoundingFrustum bf;
-        auto det = XMMatrixDeterminant(m_viewMatrix);
-        BoundingFrustum(m_projectionMatrix).Transform(bf, XMMatrixInverse(&det, m_viewMatrix));
-
-        // Update index data each face tree.
-        m_culledQuadCount = 0;
-        for (int i = 0; i < 6; i++)
-        {
-	        const uint32_t culledQuadCount = m_faceTrees[i]->UpdateIndexData(bf, m_totalIndexData);
-            m_culledQuadCount += culledQuadCount;
-        }
-    }
-
     // Light rotation update.
     if (m_lightRotation)
         m_lightDirection = XMVector3TransformCoord(m_lightDirection, XMMatrixRotationY(elapsedTime / 24.0f));
@@ -215,8 +267,6 @@ void Apollo::Update(DX::StepTimer const& timer)
         XMVECTOR lightUp = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
         XMMATRIX lightView = XMMatrixLookAtLH(lightPos, targetPos, lightUp);
 
-        XMStoreFloat3(&m_lightPosition, lightPos);
-
         // Transform bounding sphere to light space.
         XMFLOAT3 sphereCenterLS;
         XMStoreFloat3(&sphereCenterLS, XMVector3TransformCoord(targetPos, lightView));
@@ -234,6 +284,9 @@ void Apollo::Update(DX::StepTimer const& timer)
 
         XMMATRIX lightProj = XMMatrixOrthographicOffCenterLH(l, r, b, t, n, f);
 
+        // Same volume in world space, shadow casters are culled against it.
+        GetLightVolume(m_lightDirection, m_lightPosition, m_lightVolume);
+
         // Transform NDC space [-1,+1]^2 to texture space [0,1]^2
         XMMATRIX T(
             0.5f, 0.0f, 0.0f, 0.0f,
@@ -246,38 +299,640 @@ void Apollo::Update(DX::StepTimer const& timer)
         XMStoreFloat4x4(&m_lightProj, lightProj);
         XMStoreFloat4x4(&m_shadowTransform, S);
     }
+
+    // Select patch LOD, then do frustum, horizon, normal cone & occlusion culling.
+    {
+        // Update projection matrix.
+        m_projectionMatrix = XMMatrixPerspectiveFovLH(
+            XM_PIDIV4, 
+            m_aspectRatio, 
+            0.01f, 
+            XMVector3Length(m_camPosition).m128_f32[0]);
+
+        const CullingPose pose = GetCullingPose(m_camPosition, m_camYaw, m_camPitch, m_lightDirection, m_cullingMargin);
+
+        // Cull predicted last frame is taken if it covers this frame, otherwise faces are culled again now.
+        const bool predicted = WaitForPredictedCulling();
+        if (predicted)
+            m_predictedCullingCount++;
+
+        if (IsCullingCovered(pose))
+        {
+            if (predicted)
+            {
+                m_predictionHitCount++;
+            }
+            else
+            {
+                m_skippedCullingCount++;
+                m_enteredLeafCount = 0;
+                m_leftLeafCount = 0;
+            }
+        }
+        else
+        {
+            if (predicted)
+                m_fallbackCullingCount++;
+
+            CullFaces(pose);
+            FinishCulling(pose);
+        }
+    }
+
+    // Pose change of this frame, the next one is predicted to move the same.
+    m_camStep = m_camPosition - m_lastCamPosition;
+    m_camYawStep = m_camYaw - m_lastCamYaw;
+    m_camPitchStep = m_camPitch - m_lastCamPitch;
+    m_lightStep = m_lightRotation ? elapsedTime / 24.0f : 0.0f;
+    m_lastCamPosition = m_camPosition;
+    m_lastCamYaw = m_camYaw;
+    m_lastCamPitch = m_camPitch;
+
+    // UI shows statistics of this frame, its changes take effect from the next one.
+    UpdateUi();
+
+    m_updateTime = std::chrono::duration<float, std::milli>(
+        std::chrono::high_resolution_clock::now() - updateStart).count();
+
+    // Slot was acquired by Tick. Updates past the first of a tick publish nothing, their draw arguments stay pending.
+    if (FramePacket* packet = m_framePipeline.TryAcquireWrite())
+    {
+        WriteFramePacket(*packet);
+        m_framePipeline.Publish();
+    }
+
+    // Face trees are done with this frame, next frame is culled while this one is recorded and presented.
+    StartPredictedCulling();
+}
+
+Apollo::CullingPose Apollo::GetCullingPose(FXMVECTOR camPosition, float yaw, float pitch, FXMVECTOR lightDirection, float margin) const
+{
+    CullingPose pose;
+
+    // Same view and projection as Update builds for drawing.
+    const XMMATRIX rotation = XMMatrixRotationRollPitchYaw(pitch, yaw, 0.0f);
+    const XMVECTOR forward = XMVector3Normalize(XMVector3TransformCoord(DEFAULT_FORWARD_VECTOR, rotation));
+    const XMVECTOR up = XMVector3TransformCoord(DEFAULT_UP_VECTOR, rotation);
+    const XMMATRIX view = XMMatrixLookAtLH(camPosition, camPosition + forward, up);
+    const XMMATRIX projection = XMMatrixPerspectiveFovLH(
+        XM_PIDIV4, m_aspectRatio, 0.01f, XMVectorGetX(XMVector3Length(camPosition)));
+
+    BoundingFrustum frustum;
+    BoundingFrustum(projection).Transform(frustum, XMMatrixInverse(nullptr, view));
+    pose.planes = FrustumCulling::LoadPlanes(frustum);
+    XMStoreFloat3(&pose.cameraPosition, camPosition);
+    XMStoreFloat4x4(&pose.viewProjection, view * projection);
+
+    BoundingOrientedBox lightVolume;
+    GetLightVolume(lightDirection, pose.lightPosition, lightVolume);
+    pose.shadowPlanes = FrustumCulling::LoadPlanes(lightVolume);
+    pose.renderShadow = m_renderShadow;
+    pose.margin = margin;
+
+    return pose;
+}
+
+void Apollo::GetLightVolume(FXMVECTOR lightDirection, XMFLOAT3& lightPosition, BoundingOrientedBox& lightVolume) const
+{
+    const XMVECTOR lightPos = -2.0f * m_sceneBounds.Radius * lightDirection;
+    const XMVECTOR targetPos = XMLoadFloat3(&m_sceneBounds.Center);
+    const XMMATRIX lightView = XMMatrixLookAtLH(lightPos, targetPos, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+    XMStoreFloat3(&lightPosition, lightPos);
+
+    // Ortho frustum of the shadow map encloses scene bounds, centered on them in light space.
+    XMFLOAT3 sphereCenterLS;
+    XMStoreFloat3(&sphereCenterLS, XMVector3TransformCoord(targetPos, lightView));
+
+    const BoundingOrientedBox lightSpaceVolume(
+        sphereCenterLS, XMFLOAT3(m_sceneBounds.Radius, m_sceneBounds.Radius, m_sceneBounds.Radius), XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+    lightSpaceVolume.Transform(lightVolume, XMMatrixInverse(nullptr, lightView));
+}
+
+bool Apollo::IsCullingCovered(const CullingPose& pose) const
+{
+    // Last cull used planes expanded by its margin, it stays valid until planes move further than that.
+    // Horizon and occlusion buffer used occluders shrunk by margin, which stay hidden while camera moves less than that.
+    const float cameraMovement = XMVectorGetX(XMVector3Length(
+        XMLoadFloat3(&pose.cameraPosition) - XMLoadFloat3(&m_culledCameraPosition)));
+
+    // Shadow casters are culled in the same traversal, so light volume must stay within margin as well.
+    const bool shadowCovered = m_culledShadowView == pose.renderShadow &&
+        (!pose.renderShadow || FrustumCulling::IsCoveredByMargin(m_culledShadowPlanes, pose.shadowPlanes, m_cullingBoundRadius, m_culledMargin));
+
+    return m_cullingValid && cameraMovement <= m_culledMargin && shadowCovered &&
+        FrustumCulling::IsCoveredByMargin(m_culledPlanes, pose.planes, m_cullingBoundRadius, m_culledMargin);
+}
+
+void Apollo::CullFaces(const CullingPose& pose)
+{
+    const auto cullingStart = std::chrono::high_resolution_clock::now();
+    FrustumCulling::View views[c_viewCount];
+    FrustumCulling::View& view = views[c_cameraView];
+    view.planes = FrustumCulling::ExpandPlanes(pose.planes, pose.margin);
+    view.horizon = FrustumCulling::LoadHorizon(
+        pose.cameraPosition, QUAD_SPHERE_RADIUS - pose.margin, m_horizonCulling);
+    view.cone.enabled = m_backFaceCulling;
+    view.cone.cameraPosition = pose.cameraPosition;
+    view.cone.margin = pose.margin;
+    view.occlusion = nullptr;
+    view.cameraPosition = pose.cameraPosition;
+
+    // Shadow casters are tested against light volume only, light has no horizon or occluder of its own here.
+    FrustumCulling::View& shadowView = views[c_shadowView];
+    shadowView.planes = FrustumCulling::ExpandPlanes(pose.shadowPlanes, pose.margin);
+    shadowView.horizon.enabled = false;
+    shadowView.cone.enabled = false;
+    shadowView.occlusion = nullptr;
+    shadowView.cameraPosition = pose.lightPosition;
+
+    // Faces select their LOD on their own, balance then splits nodes across face borders.
+    // Flat sweep draws base patches only, so it leaves every leaf at full detail.
+    const bool patchLod = m_patchLod && m_cullingMode == CullingMode::Hierarchy;
+    LodView lodView;
+    lodView.enabled = patchLod;
+    lodView.metric = m_lodMetric;
+    lodView.pixelThreshold = m_lodPixelThreshold;
+    lodView.cameraPosition = pose.cameraPosition;
+    lodView.pixelsPerUnit = m_outputHeight / (2.0f * tanf(XM_PIDIV4 / 2.0f));
+    WorkerPool::Counter lodCounter;
+    for (uint32_t i = 0; i < 6; i++)
+        m_workerPool->Spawn(lodCounter, [this, i, &lodView]() { m_faceTrees[i]->SelectLod(lodView); });
+
+    // Occluder proxy is drawn with culled view meanwhile, faces test their nodes against it once both are done.
+    WorkerPool::Counter prepareCounter;
+    m_workerPool->Spawn(prepareCounter, [this, patchLod]()
+    {
+        m_lodRefinedNodeCount = 0;
+        if (patchLod)
+        {
+            m_lodGrid.Balance(m_faceTrees);
+            m_lodRefinedNodeCount = m_lodGrid.GetRefinedNodeCount();
+        }
+    }, &lodCounter);
+
+    if (m_occlusionCulling)
+    {
+        m_workerPool->Spawn(prepareCounter, [this, &pose]()
+        {
+            m_occlusionBuffer->Rasterize(pose.viewProjection, pose.cameraPosition, *m_workerPool, pose.margin);
+        });
+        view.occlusion = m_occlusionBuffer.get();
+    }
+
+    // Faces are independent, each one is culled in its own job for camera and light at once.
+    // Every job writes state of its own face only, so results match a serial cull.
+    const uint32_t viewCount = pose.renderShadow ? c_viewCount : 1;
+    WorkerPool::Counter cullCounter;
+    for (uint32_t i = 0; i < 6; i++)
+    {
+        m_workerPool->Spawn(cullCounter, [this, i, &views, viewCount]()
+        {
+            m_faceCulledQuadCounts[i] = m_faceTrees[i]->UpdateIndexRanges(views, viewCount, m_cullingKernel, m_cullingMode);
+        }, &prepareCounter);
+    }
+
+    m_workerPool->Wait(cullCounter);
+    m_workerPool->Wait(prepareCounter);
+    m_workerPool->Wait(lodCounter);
+
+    m_cullingTime = std::chrono::duration<float, std::milli>(
+        std::chrono::high_resolution_clock::now() - cullingStart).count();
 }
 
-// Draws the scene.
-void Apollo::Render()
+void Apollo::FinishCulling(const CullingPose& pose)
 {
-    // Don't try to render anything before the first Update.
-    if (m_timer.GetFrameCount() == 0)
+    m_culledQuadCount = 0;
+    m_testedNodeCount = 0;
+    m_testedPlaneCount = 0;
+    m_drawRangeCount = 0;
+    m_shadowDrawRangeCount = 0;
+    m_horizonCulledQuadCount = 0;
+    m_backFaceCulledQuadCount = 0;
+    m_occludedNodeCount = 0;
+    m_visiblePatchCount = 0;
+    m_detailNodeCount = 0;
+    m_splitBlockCount = 0;
+    m_evictedBlockCount = 0;
+    m_enteredLeafCount = 0;
+    m_leftLeafCount = 0;
+    for (int i = 0; i < 6; i++)
     {
+        m_culledQuadCount += m_faceCulledQuadCounts[i];
+        m_horizonCulledQuadCount += m_faceTrees[i]->GetHorizonCulledQuadCount();
+        m_backFaceCulledQuadCount += m_faceTrees[i]->GetBackFaceCulledQuadCount();
+        m_occludedNodeCount += m_faceTrees[i]->GetOccludedNodeCount();
+        m_visiblePatchCount += m_faceTrees[i]->GetVisiblePatchCount();
+        m_detailNodeCount += m_faceTrees[i]->GetDetailNodeCount();
+        m_splitBlockCount += m_faceTrees[i]->GetSplitBlockCount();
+        m_evictedBlockCount += m_faceTrees[i]->GetEvictedBlockCount();
+        m_testedNodeCount += m_faceTrees[i]->GetTestedNodeCount();
+        m_testedPlaneCount += m_faceTrees[i]->GetTestedPlaneCount();
+        m_drawRangeCount += m_faceTrees[i]->GetIndexRanges(c_cameraView).GetRangeCount();
+        m_shadowDrawRangeCount += m_faceTrees[i]->GetIndexRanges(c_shadowView).GetRangeCount();
+        m_enteredLeafCount += m_faceTrees[i]->GetEnteredLeafCount();
+        m_leftLeafCount += m_faceTrees[i]->GetLeftLeafCount();
+    }
+
+    m_culledPlanes = pose.planes;
+    m_culledShadowPlanes = pose.shadowPlanes;
+    m_culledShadowView = pose.renderShadow;
+    m_culledCameraPosition = pose.cameraPosition;
+    m_culledMargin = pose.margin;
+    m_cullingValid = true;
+    m_cullingCount++;
+}
+
+void Apollo::StartPredictedCulling()
+{
+    if (!m_predictedCulling)
         return;
+
+    // Next frame is expected to move camera and light as much as this one did.
+    const CullingPose currentPose = GetCullingPose(m_camPosition, m_camYaw, m_camPitch, m_lightDirection, 0.0f);
+    CullingPose pose = GetCullingPose(
+        m_camPosition + m_camStep, m_camYaw + m_camYawStep, m_camPitch + m_camPitchStep,
+        XMVector3TransformCoord(m_lightDirection, XMMatrixRotationY(m_lightStep)), 0.0f);
+
+    // Margin covers one more step either way, from the camera stopping to it doubling its speed.
+    float predictionMargin = std::max(
+        XMVectorGetX(XMVector3Length(m_camStep)),
+        FrustumCulling::GetCoveringMargin(currentPose.planes, pose.planes, m_cullingBoundRadius));
+    if (pose.renderShadow)
+    {
+        predictionMargin = std::max(predictionMargin,
+            FrustumCulling::GetCoveringMargin(currentPose.shadowPlanes, pose.shadowPlanes, m_cullingBoundRadius));
     }
+    pose.margin = m_cullingMargin + predictionMargin;
+    m_predictionMargin = predictionMargin;
+
+    // Last cull may still cover the next frame.
+    if (IsCullingCovered(pose))
+        return;
 
-    // Upload index data to GPU.
+    m_predictedPose = pose;
+    m_cullingTask->Start([this]()
+    {
+        CullFaces(m_predictedPose);
+    });
+}
+
+bool Apollo::WaitForPredictedCulling()
+{
+    const auto waitStart = std::chrono::high_resolution_clock::now();
+    if (!m_cullingTask || !m_cullingTask->Wait())
     {
-        DX::ThrowIfFailed(m_commandAllocators[m_backBufferIndex]->Reset());
-        DX::ThrowIfFailed(m_commandList->Reset(m_commandAllocators[m_backBufferIndex].Get(), nullptr));
+        m_cullingWaitTime = 0.0f;
+        return false;
+    }
+
+    m_cullingWaitTime = std::chrono::duration<float, std::milli>(
+        std::chrono::high_resolution_clock::now() - waitStart).count();
+
+    FinishCulling(m_predictedPose);
+    return true;
+}
+
+// Builds the imgui frame on the update stage, the render stage draws a copy of it.
+void Apollo::UpdateUi()
+{
+    ImGui_ImplDX12_NewFrame();
+    ImGui_ImplWin32_NewFrame();
+    ImGui::NewFrame();
+
+    {
+        const auto io = ImGui::GetIO();
+        ImGui::Begin("apollo");
+        ImGui::SetWindowSize(ImVec2(450, 550), ImGuiCond_Always);
+
+        ImGui::Text("%d x %d (Resolution)", m_outputWidth, m_outputHeight);
+        ImGui::Text("%d x %d (Shadow Map Resolution)", m_shadowMapSize, m_shadowMapSize);
+        ImGui::TextColored(ImVec4(1, 1, 0, 1), "%.3f ms/frame (%.1f FPS)", 1000.0f / io.Framerate, io.Framerate);
+
+        ImGui::Dummy(ImVec2(0.0f, 20.0f));
 
-        // Update dynamic index buffer and upload to static index buffer.
+        ImGui::Text("Before Tessellation (Input of VS)");
+        ImGui::BulletText("Subdivision count: %d", m_subDivideCount);
+
+        ImGui::Dummy(ImVec2(0.0f, 5.0f));
+
+        ImGui::BulletText("QuadSphere initial quad count: %d", m_totalIndexCount / 4);
+        ImGui::BulletText("QuadSphere initial triangle count: %d (converted)", m_totalIndexCount * 2 / 4);
+
+        ImGui::Dummy(ImVec2(0.0f, 5.0f));
+
+        ImGui::BulletText("Render quad count: %d", (m_totalIndexCount - m_culledQuadCount) / 4);
+        ImGui::BulletText("Render triangle count: %d (converted)", (m_totalIndexCount - m_culledQuadCount) * 2 / 4);
+
+        ImGui::Dummy(ImVec2(0.0f, 10.0f));
+
+        ImGui::BulletText("Culled quad count: %d (%.3f %%)",
+            m_culledQuadCount, static_cast<float>(m_culledQuadCount) * 100 / (m_totalIndexCount / 4));
+        ImGui::BulletText("Horizon culled quad count: %d", m_horizonCulledQuadCount);
+        ImGui::BulletText("Normal cone culled quad count: %d", m_backFaceCulledQuadCount);
+        if (m_occlusionCulling)
         {
-            for (FaceTree* faceTree : m_faceTrees)
-                faceTree->Upload(m_commandList.Get());
+            ImGui::BulletText("Occluded node count: %d", m_occludedNodeCount);
+            ImGui::BulletText("Occlusion raster time: %.3f ms (%d triangles, %d x %d)",
+                m_occlusionBuffer->GetRasterizeTime(), m_occlusionBuffer->GetRasterizedTriangleCount(),
+                m_occlusionBuffer->GetWidth(), m_occlusionBuffer->GetHeight());
         }
+        if (m_patchLod)
+        {
+            ImGui::BulletText("Drawn patch count: %d (%d nodes split to balance LOD)",
+                m_visiblePatchCount, m_lodRefinedNodeCount);
+        }
+        ImGui::BulletText("Detail node count: %d / %d (%d blocks split, %d evicted)",
+            m_detailNodeCount, 6 * m_faceTrees[0]->GetDetailNodeCapacity(), m_splitBlockCount, m_evictedBlockCount);
+        ImGui::BulletText("Draw range count: %d (ExecuteIndirect)", m_drawRangeCount);
+        ImGui::BulletText("Shadow draw range count: %d", m_shadowDrawRangeCount);
+        ImGui::BulletText("Culling time: %.3f ms (%d nodes tested, %.1f nodes/us)",
+            m_cullingTime, m_testedNodeCount, m_cullingTime > 0.0f ? m_testedNodeCount / (m_cullingTime * 1000.0f) : 0.0f);
+        ImGui::BulletText("Tested plane count: %d (%.2f per node)",
+            m_testedPlaneCount, m_testedNodeCount > 0 ? m_testedPlaneCount / static_cast<float>(m_testedNodeCount) : 0.0f);
+        ImGui::BulletText("Jobs: %llu spawned, %llu stolen, %llu sleeps (%d workers)",
+            m_workerPool->GetSpawnedJobCount(), m_workerPool->GetStolenJobCount(),
+            m_workerPool->GetSleepCount(), m_workerPool->GetWorkerCount());
+
+        // Kernels wider than this CPU supports are not listed.
+        int cullingKernel = static_cast<int>(m_cullingKernel);
+        const int kernelCount = static_cast<int>(FrustumCulling::GetBestKernel()) + 1;
+        const char* const kernelNames[] =
+        {
+            FrustumCulling::GetKernelName(CullingKernel::Scalar),
+            FrustumCulling::GetKernelName(CullingKernel::SSE),
+            FrustumCulling::GetKernelName(CullingKernel::AVX),
+        };
+        ImGui::Combo("Culling kernel", &cullingKernel, kernelNames, kernelCount);
+        m_cullingKernel = static_cast<CullingKernel>(cullingKernel);
 
-        DX::ThrowIfFailed(m_commandList->Close());
-        m_commandQueue->ExecuteCommandLists(1, CommandListCast(m_commandList.GetAddressOf()));
+        // Flat sweep tests every tessellation group, finer than leaves but without hierarchy or LOD.
+        int cullingMode = static_cast<int>(m_cullingMode);
+        const char* const cullingModeNames[] =
+        {
+            FaceTree::GetCullingModeName(CullingMode::Hierarchy),
+            FaceTree::GetCullingModeName(CullingMode::FlatSweep),
+        };
+        if (ImGui::Combo("Culling mode", &cullingMode, cullingModeNames, _countof(cullingModeNames)))
+        {
+            m_cullingMode = static_cast<CullingMode>(cullingMode);
+            m_cullingValid = false;
+        }
+
+        ImGui::Dummy(ImVec2(0.0f, 5.0f));
+
+        ImGui::BulletText("Culling skipped: %llu / %llu frames",
+            m_skippedCullingCount, m_skippedCullingCount + m_cullingCount);
+        if (m_predictedCulling)
+        {
+            ImGui::BulletText("Predicted culls hit: %llu / %llu (%.1f %%), %llu fallback culls",
+                m_predictionHitCount, m_predictedCullingCount,
+                m_predictedCullingCount > 0 ? m_predictionHitCount * 100.0f / m_predictedCullingCount : 0.0f,
+                m_fallbackCullingCount);
+            ImGui::BulletText("Prediction margin: %.3f, culling wait: %.3f ms", m_predictionMargin, m_cullingWaitTime);
+        }
+        ImGui::BulletText("Leaf nodes entered / left: %d / %d", m_enteredLeafCount, m_leftLeafCount);
+        ImGui::BulletText("Patched argument bytes: %d (total %llu)", m_patchedBytes, m_totalPatchedBytes);
+        ImGui::BulletText("Upload ring: %llu / %llu bytes (peak %llu), %d waits",
+            m_uploadRingUsedSize.load(), m_uploadRing->GetBackend().GetSize(),
+            m_uploadRingPeakSize.load(), m_uploadRingWaitCount.load());
+        {
+            std::lock_guard<std::mutex> lock(m_argumentRingMutex);
+            ImGui::BulletText("Argument ring: %llu / %llu bytes (peak %llu), %d waits",
+                m_argumentRing->GetUsedSize(), m_argumentRing->GetBackend().GetSize(),
+                m_argumentRing->GetPeakUsedSize(), m_argumentRing->GetWaitCount());
+        }
+        ImGui::BulletText("Update / render stage: %.3f / %.3f ms, %d frames queued",
+            m_updateTime, m_renderTime.load(), m_framePipeline.GetQueuedCount());
+        ImGui::BulletText("Stage waits: update %d, render %d",
+            m_framePipeline.GetWriteWaitCount(), m_framePipeline.GetReadWaitCount());
+
+        // Larger margin skips more frames but draws more nodes near the frustum.
+        if (ImGui::SliderFloat("Culling margin", &m_cullingMargin, 0.0f, 10.0f))
+            m_cullingValid = false;
+
+        // Next frame is culled on a background thread with a frustum widened by camera motion.
+        ImGui::Checkbox("Predicted culling", &m_predictedCulling);
+        if (ImGui::Checkbox("Horizon culling", &m_horizonCulling))
+            m_cullingValid = false;
+        if (ImGui::Checkbox("Normal cone culling", &m_backFaceCulling))
+            m_cullingValid = false;
+        if (ImGui::Checkbox("Occlusion culling", &m_occlusionCulling))
+            m_cullingValid = false;
+
+        // Far nodes are drawn with one coarse quad per patch while their error stays under threshold.
+        if (ImGui::Checkbox("Patch LOD", &m_patchLod))
+            m_cullingValid = false;
+        int lodMetric = static_cast<int>(m_lodMetric);
+        const char* const lodMetricNames[] = { "Geometric", "Patch size" };
+        if (ImGui::Combo("LOD error metric", &lodMetric, lodMetricNames, _countof(lodMetricNames)))
+        {
+            m_lodMetric = static_cast<LodErrorMetric>(lodMetric);
+            m_cullingValid = false;
+        }
+        if (ImGui::SliderFloat("LOD pixel threshold", &m_lodPixelThreshold, 0.5f, 16.0f))
+            m_cullingValid = false;
+
+        ImGui::Dummy(ImVec2(0.0f, 20.0f));
+
+        ImGui::SliderInt("Max Tess 2^n", &m_tessMax, 5, 8);
+        ImGui::SliderFloat("Rotate speed", &m_camRotateSpeed, 0.0f, 1.0f);
+        ImGui::Text("Move speed: %.3f (Scroll to Adjust)", m_camMoveSpeed);
+
+        ImGui::Dummy(ImVec2(0.0f, 20.0f));
+
+        ImGui::Checkbox("Rotate Light", &m_lightRotation);
+        ImGui::Checkbox("Render Shadow", &m_renderShadow);
+        ImGui::Checkbox("Wireframe", &m_wireframe);
+
+        ImGui::Dummy(ImVec2(0.0f, 20.0f));
+
+        if (ImGui::Button("Reset Camera"))
+        {
+            m_camYaw = 0.0f;
+            m_camPitch = 0.0f;
+            m_camPosition = XMVectorSet(0.0f, 0.0f, -500.0f, 0.0f);
+            m_camLookTarget = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
+        }
+
+        // CrackSweep checks recorded poses for cracks.
+        if (ImGui::Button("Record Crack Check Pose"))
+        {
+            XMFLOAT3 pose;
+            XMStoreFloat3(&pose, m_camPosition);
+            CreateDirectoryW(L"Cache", nullptr);
+            CrackCheck::AppendPose(L"Cache\\CrackPoses.txt", pose);
+        }
+
+        ImGui::Dummy(ImVec2(0.0f, 20.0f));
+
+        ImGui::Text("Press X to Switch mouse mode");
+        ImGui::Text("(GUI Mode <-> Flight Mode)");
+
+        ImGui::End();
     }
 
-    WaitForGpu();
+    ImGui::Render();
+}
+
+Apollo::FramePacket::~FramePacket()
+{
+    for (ImDrawList* drawList : uiDrawLists)
+        IM_DELETE(drawList);
+}
+
+// Fills a packet with everything the render stage needs, so it never reads state the update stage changes.
+void Apollo::WriteFramePacket(FramePacket& packet)
+{
+    // ShadowCB data.
+    {
+        ShadowCB& cbShadow = packet.shadowCB;
+
+        const XMMATRIX lightWorld = XMLoadFloat4x4(&IDENTITY_MATRIX);
+        const XMMATRIX lightView = XMLoadFloat4x4(&m_lightView);
+        const XMMATRIX lightProj = XMLoadFloat4x4(&m_lightProj);
+
+        cbShadow.lightWorldMatrix = XMMatrixTranspose(lightWorld);
+        cbShadow.lightViewProjMatrix = XMMatrixTranspose(lightView * lightProj);
+        cbShadow.cameraPosition = m_camPosition;
+        cbShadow.parameters = XMFLOAT4(m_quadWidth, m_unitCount, m_tessMin, m_tessMax - 2);
+    }
+
+    // OpaqueCB data.
+    {
+        OpaqueCB& cbOpaque = packet.opaqueCB;
+
+        cbOpaque.worldMatrix = XMMatrixTranspose(m_worldMatrix);
+        cbOpaque.viewProjMatrix = XMMatrixTranspose(m_viewMatrix * m_projectionMatrix);
+        XMStoreFloat4(&cbOpaque.cameraPosition, m_camPosition);
+        XMStoreFloat4(&cbOpaque.lightDirection, m_lightDirection);
+        cbOpaque.lightColor = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+
+        cbOpaque.shadowTransform = XMMatrixTranspose(XMLoadFloat4x4(&m_shadowTransform));
+        cbOpaque.parameters = XMFLOAT4(m_quadWidth, m_unitCount, m_tessMin, m_tessMax);
+    }
+
+    packet.renderShadow = m_renderShadow;
+    packet.wireframe = m_wireframe;
+
+    // Changed draw arguments are emitted straight into upload memory allocated for the packet, along with the range
+    // counts they are drawn with, since the next cull changes face trees while this frame is recorded.
+    // Render stage only records the copies and retires the allocation with its frame.
+    uint64_t pendingSize = 0;
+    for (const FaceTree* faceTree : m_faceTrees)
+    {
+        for (uint32_t v = 0; v < c_viewCount; v++)
+            pendingSize += faceTree->GetPendingUploadSize(v);
+    }
+
+    packet.argumentAllocation = UploadRing::Allocation();
+    if (pendingSize > 0)
+    {
+        std::lock_guard<std::mutex> lock(m_argumentRingMutex);
+        packet.argumentAllocation = m_argumentRing->Allocate(pendingSize, alignof(FaceTree::DrawArguments));
+        if (!packet.argumentAllocation)
+            throw std::runtime_error("Upload ring is too small for draw arguments.");
+    }
+
+    packet.argumentSize = 0;
+    for (int i = 0; i < 6; i++)
+    {
+        for (uint32_t v = 0; v < c_viewCount; v++)
+        {
+            SpanUploadSink sink(
+                packet.argumentAllocation.cpuAddress + packet.argumentSize, pendingSize - packet.argumentSize,
+                alignof(FaceTree::DrawArguments));
+            m_faceTrees[i]->EmitDrawArguments(v, sink);
+
+            FaceViewDraws& draws = packet.faceDraws[i][v];
+            draws.rangeCount = m_faceTrees[i]->GetIndexRanges(v).GetRangeCount();
+            draws.argumentOffset = packet.argumentSize;
+            draws.argumentRegions.assign(sink.GetRegions().begin(), sink.GetRegions().end());
+            packet.argumentSize += sink.GetUsedSize();
+        }
+    }
+    m_patchedBytes = static_cast<uint32_t>(packet.argumentSize);
+    m_totalPatchedBytes += m_patchedBytes;
+
+    // imgui reuses its draw lists for the next frame, so the packet draws clones of them.
+    for (ImDrawList* drawList : packet.uiDrawLists)
+        IM_DELETE(drawList);
+    packet.uiDrawLists.clear();
+
+    const ImDrawData* drawData = ImGui::GetDrawData();
+    packet.uiDrawData = *drawData;
+    for (int n = 0; n < drawData->CmdListsCount; n++)
+    {
+        packet.uiDrawLists.push_back(drawData->CmdLists[n]->CloneOutput());
+        packet.uiDrawData.CmdLists[n] = packet.uiDrawLists.back();
+    }
+}
+
+void Apollo::StartRenderStage()
+{
+    m_framePipeline.Reset();
+    m_deviceLost = false;
+
+    m_renderTask->Start([this]()
+    {
+        // Pipeline is closed on every exit, so the update stage never waits for a slot that is not released.
+        try
+        {
+            while (const FramePacket* packet = m_framePipeline.AcquireRead())
+            {
+                const bool presented = Render(*packet);
+                m_framePipeline.Release();
+
+                if (!presented)
+                {
+                    m_deviceLost = true;
+                    break;
+                }
+            }
+        }
+        catch (...)
+        {
+            m_framePipeline.Close();
+            throw;
+        }
+
+        m_framePipeline.Close();
+    });
+}
+
+void Apollo::StopRenderStage()
+{
+    if (!m_renderTask)
+        return;
+
+    // Exceptions of the render stage are thrown here.
+    m_framePipeline.Close();
+    m_renderTask->Wait();
+}
+
+// Draws the scene of a frame packet.
+bool Apollo::Render(const FramePacket& packet)
+{
+    const auto renderStart = std::chrono::high_resolution_clock::now();
 
     // ----------> Prepare command list.
     DX::ThrowIfFailed(m_commandAllocators[m_backBufferIndex]->Reset());
     DX::ThrowIfFailed(m_commandList->Reset(m_commandAllocators[m_backBufferIndex].Get(), nullptr));
 
+    // Patch draw arguments changed by culling, the update stage emitted them into the packet allocation.
+    if (packet.argumentAllocation)
+    {
+        for (int i = 0; i < 6; i++)
+        {
+            for (uint32_t v = 0; v < c_viewCount; v++)
+            {
+                const FaceViewDraws& draws = packet.faceDraws[i][v];
+                m_faceTrees[i]->CopyDrawArguments(
+                    m_commandList.Get(), v, draws.argumentRegions, m_argumentRingBuffer,
+                    packet.argumentAllocation.offset + draws.argumentOffset);
+            }
+        }
+    }
+
     // Set descriptor heaps.
     m_commandList->SetDescriptorHeaps(1, m_srvDescriptorHeap.GetAddressOf());
 
@@ -286,26 +941,15 @@ void Apollo::Render()
     m_commandList->SetGraphicsRootDescriptorTable(0, m_srvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
 
     // PASS 1 - Shadow Map
-    if (m_renderShadow)
+    if (packet.renderShadow)
     {
         // Update ShadowCB Data
         {
-            ShadowCB cbShadow;
-
-            const XMMATRIX lightWorld = XMLoadFloat4x4(&IDENTITY_MATRIX);
-            const XMMATRIX lightView = XMLoadFloat4x4(&m_lightView);
-            const XMMATRIX lightProj = XMLoadFloat4x4(&m_lightProj);
-
-            cbShadow.lightWorldMatrix = XMMatrixTranspose(lightWorld);
-            cbShadow.lightViewProjMatrix = XMMatrixTranspose(lightView * lightProj);
-            cbShadow.cameraPosition = m_camPosition;
-            cbShadow.parameters = XMFLOAT4(m_quadWidth, m_unitCount, m_tessMin, m_tessMax - 2);
-
-            memcpy(&m_cbShadowMappedData[m_backBufferIndex], &cbShadow, sizeof(ShadowCB));
+            const auto cbAllocation = AllocateConstantBuffer(sizeof(ShadowCB));
+            memcpy(cbAllocation.cpuAddress, &packet.shadowCB, sizeof(ShadowCB));
 
             // Bind the constants to the shader.
-            const auto baseGpuAddress = m_cbShadowGpuAddress + m_backBufferIndex * sizeof(ShadowCB);
-            m_commandList->SetGraphicsRootConstantBufferView(2, baseGpuAddress);
+            m_commandList->SetGraphicsRootConstantBufferView(2, cbAllocation.gpuAddress);
         }
 
         // Set render target as nullptr.
@@ -333,14 +977,16 @@ void Apollo::Render()
             m_commandList->ClearDepthStencilView(
                 m_shadowMap->Dsv(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
 
-            // Set Topology and VB.
+            // Set Topology, VB and IB.
             m_commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
             m_commandList->IASetVertexBuffers(0, 1, &m_staticVBV);
+            m_commandList->IASetIndexBuffer(&m_staticIBV);
 
-            // Set index buffer & draw all face trees.
-            for (const FaceTree* faceTree : m_faceTrees)
+            // Draw visible index ranges of all face trees.
+            for (int i = 0; i < 6; i++)
             {
-                faceTree->Draw(m_commandList.Get());
+                m_faceTrees[i]->Draw(
+                    m_commandList.Get(), m_drawCommandSignature.Get(), c_shadowView, packet.faceDraws[i][c_shadowView].rangeCount);
             }
         }
         // <--- GENERIC_READ
@@ -356,22 +1002,11 @@ void Apollo::Render()
     {
         // Update OpaqueCB data.
         {
-            OpaqueCB cbOpaque;
-
-            cbOpaque.worldMatrix = XMMatrixTranspose(m_worldMatrix);
-            cbOpaque.viewProjMatrix = XMMatrixTranspose(m_viewMatrix * m_projectionMatrix);
-            XMStoreFloat4(&cbOpaque.cameraPosition, m_camPosition);
-            XMStoreFloat4(&cbOpaque.lightDirection, m_lightDirection);
-            cbOpaque.lightColor = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-
-            cbOpaque.shadowTransform = XMMatrixTranspose(XMLoadFloat4x4(&m_shadowTransform));
-            cbOpaque.parameters = XMFLOAT4(m_quadWidth, m_unitCount, m_tessMin, m_tessMax);
-
-            memcpy(&m_cbOpaqueMappedData[m_backBufferIndex], &cbOpaque, sizeof(OpaqueCB));
+            const auto cbAllocation = AllocateConstantBuffer(sizeof(OpaqueCB));
+            memcpy(cbAllocation.cpuAddress, &packet.opaqueCB, sizeof(OpaqueCB));
 
             // Bind OpaqueCB data to the shader.
-            const auto baseGPUAddress = m_cbOpaqueGpuAddress + m_backBufferIndex * sizeof(OpaqueCB);
-            m_commandList->SetGraphicsRootConstantBufferView(1, baseGPUAddress);
+            m_commandList->SetGraphicsRootConstantBufferView(1, cbAllocation.gpuAddress);
         }
 
         // Get handle of RTV, DSV.
@@ -385,7 +1020,7 @@ void Apollo::Render()
 
         // Set PSO.
         m_commandList->SetPipelineState(
-            m_wireframe ? m_wireframePSO.Get() : m_renderShadow ? m_opaquePSO.Get() : m_noShadowPSO.Get());
+            packet.wireframe ? m_wireframePSO.Get() : packet.renderShadow ? m_opaquePSO.Get() : m_noShadowPSO.Get());
 
         // Set the viewport and scissor rect.
         m_commandList->RSSetViewports(1, &m_viewport);
@@ -403,84 +1038,20 @@ void Apollo::Render()
             m_commandList->ClearRenderTargetView(rtvHandle, Colors::Black, 0, nullptr);
             m_commandList->ClearDepthStencilView(dsvHandle, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
 
-            // Set Topology and VB.
+            // Set Topology, VB and IB.
             m_commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
             m_commandList->IASetVertexBuffers(0, 1, &m_staticVBV);
+            m_commandList->IASetIndexBuffer(&m_staticIBV);
 
-            // Set index buffer & draw all face trees.
-            for (const FaceTree* faceTree : m_faceTrees)
+            // Draw visible index ranges of all face trees.
+            for (int i = 0; i < 6; i++)
             {
-                faceTree->Draw(m_commandList.Get());
+                m_faceTrees[i]->Draw(
+                    m_commandList.Get(), m_drawCommandSignature.Get(), c_cameraView, packet.faceDraws[i][c_cameraView].rangeCount);
             }
 
-            // Draw imgui.
-            {
-                ImGui_ImplDX12_NewFrame();
-                ImGui_ImplWin32_NewFrame();
-                ImGui::NewFrame();
-
-                {
-                    const auto io = ImGui::GetIO();
-                    ImGui::Begin("apollo");
-                    ImGui::SetWindowSize(ImVec2(450, 550), ImGuiCond_Always);
-
-                    ImGui::Text("%d x %d (Resolution)", m_outputWidth, m_outputHeight);
-                    ImGui::Text("%d x %d (Shadow Map Resolution)", m_shadowMapSize, m_shadowMapSize);
-                    ImGui::TextColored(ImVec4(1, 1, 0, 1), "%.3f ms/frame (%.1f FPS)", 1000.0f / io.Framerate, io.Framerate);
-
-                    ImGui::Dummy(ImVec2(0.0f, 20.0f));
-
-                    ImGui::Text("Before Tessellation (Input of VS)");
-                    ImGui::BulletText("Subdivision count: %d", m_subDivideCount);
-
-                    ImGui::Dummy(ImVec2(0.0f, 5.0f));
-
-                    ImGui::BulletText("QuadSphere initial quad count: %d", m_totalIndexCount / 4);
-                    ImGui::BulletText("QuadSphere initial triangle count: %d (converted)", m_totalIndexCount * 2 / 4);
-
-                    ImGui::Dummy(ImVec2(0.0f, 5.0f));
-
-                    ImGui::BulletText("Render quad count: %d", (m_totalIndexCount - m_culledQuadCount) / 4);
-                    ImGui::BulletText("Render triangle count: %d (converted)", (m_totalIndexCount - m_culledQuadCount) * 2 / 4);
-
-                    ImGui::Dummy(ImVec2(0.0f, 10.0f));
-
-                    ImGui::BulletText("Culled quad count: %d (%.3f %%)",
-                        m_culledQuadCount, static_cast<float>(m_culledQuadCount) * 100 / (m_totalIndexCount / 4));
-
-                    ImGui::Dummy(ImVec2(0.0f, 20.0f));
-
-                    ImGui::SliderInt("Max Tess 2^n", &m_tessMax, 5, 8);
-                    ImGui::SliderFloat("Rotate speed", &m_camRotateSpeed, 0.0f, 1.0f);
-                    ImGui::Text("Move speed: %.3f (Scroll to Adjust)", m_camMoveSpeed);
-
-                    ImGui::Dummy(ImVec2(0.0f, 20.0f));
-
-                    ImGui::Checkbox("Rotate Light", &m_lightRotation);
-                    ImGui::Checkbox("Render Shadow", &m_renderShadow);
-                    ImGui::Checkbox("Wireframe", &m_wireframe);
-
-                    ImGui::Dummy(ImVec2(0.0f, 20.0f));
-
-                    if (ImGui::Button("Reset Camera"))
-                    {
-                        m_camYaw = 0.0f;
-                        m_camPitch = 0.0f;
-                        m_camPosition = XMVectorSet(0.0f, 0.0f, -500.0f, 0.0f);
-                        m_camLookTarget = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
-                    }
-
-                    ImGui::Dummy(ImVec2(0.0f, 20.0f));
-
-                    ImGui::Text("Press X to Switch mouse mode");
-                    ImGui::Text("(GUI Mode <-> Flight Mode)");
-
-                    ImGui::End();
-                }
-
-                ImGui::Render();
-                ImGui_ImplDX12_RenderDrawData(ImGui::GetDrawData(), m_commandList.Get());
-            }
+            // Draw imgui frame built by the update stage.
+            ImGui_ImplDX12_RenderDrawData(const_cast<ImDrawData*>(&packet.uiDrawData), m_commandList.Get());
         }
         // <--- D3D12_RESOURCE_STATE_PRESENT
 
@@ -495,19 +1066,31 @@ void Apollo::Render()
     DX::ThrowIfFailed(m_commandList->Close());
     m_commandQueue->ExecuteCommandLists(1, CommandListCast(m_commandList.GetAddressOf()));
 
+    m_renderTime = std::chrono::duration<float, std::milli>(
+        std::chrono::high_resolution_clock::now() - renderStart).count();
+
     // Present back buffer.
     const HRESULT hr = m_swapChain->Present(0, m_fullScreenMode ? 0 : DXGI_PRESENT_ALLOW_TEARING);
 
-    // If the device was reset we must completely reinitialize the renderer.
+    // If the device was reset we must completely reinitialize the renderer, the update stage does it on its thread.
     if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET)
+        return false;
+
+    DX::ThrowIfFailed(hr);
+
+    // Uploads of this frame are free again once its fence is signaled.
+    m_uploadRing->FinishFrame(m_fenceValues[m_backBufferIndex]);
+    if (packet.argumentAllocation)
     {
-        OnDeviceLost();
-    }
-    else
-    {
-        DX::ThrowIfFailed(hr);
-        MoveToNextFrame();
+        std::lock_guard<std::mutex> lock(m_argumentRingMutex);
+        m_argumentRing->FinishFrame(m_fenceValues[m_backBufferIndex], packet.argumentAllocation);
     }
+    m_uploadRingUsedSize = m_uploadRing->GetUsedSize();
+    m_uploadRingPeakSize = m_uploadRing->GetPeakUsedSize();
+    m_uploadRingWaitCount = m_uploadRing->GetWaitCount();
+    MoveToNextFrame();
+
+    return true;
 }
 
 // Message handlers
@@ -538,11 +1121,17 @@ void Apollo::OnWindowSizeChanged(int width, int height)
     if (!m_window)
         return;
 
+    // Frames in flight use the swap chain buffers about to be resized, and predicted cull reads output size.
+    StopRenderStage();
+    WaitForGpu();
+    WaitForPredictedCulling();
+
     m_outputWidth = std::max(width, 1);
     m_outputHeight = std::max(height, 1);
     m_aspectRatio = static_cast<float>(m_outputWidth) / static_cast<float>(m_outputHeight);
 
     CreateWindowSizeDependentResources();
+    StartRenderStage();
 }
 
 // These are the resources that depend on the device.
@@ -720,10 +1309,11 @@ void Apollo::CreateDeviceDependentResources()
         CD3DX12_DESCRIPTOR_RANGE srvTable;
         srvTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 6, 0);
 
-        CD3DX12_ROOT_PARAMETER rootParameters[3] = {};
+        CD3DX12_ROOT_PARAMETER rootParameters[4] = {};
         rootParameters[0].InitAsDescriptorTable(1, &srvTable);  // register (t0)
         rootParameters[1].InitAsConstantBufferView(0);          // register (c0)
         rootParameters[2].InitAsConstantBufferView(1);          // register (c1)
+        rootParameters[3].InitAsConstants(1, 2);                // register (c2), patch LOD of each indirect draw
 
         // Define samplers.
         const CD3DX12_STATIC_SAMPLER_DESC anisotropicClamp(
@@ -882,44 +1472,27 @@ void Apollo::CreateDeviceDependentResources()
     }
 
     // ================================================================================================================
-    // #04. Create constant buffer and map.
+    // #04. Create command signature.
     // ================================================================================================================
+    // Each indirect draw sets its patch LOD root constant first, so the root signature is needed.
     {
-        // Create opaque constant buffer.
-        {
-            CD3DX12_HEAP_PROPERTIES uploadHeapProp(D3D12_HEAP_TYPE_UPLOAD);
-            CD3DX12_RESOURCE_DESC resDesc = CD3DX12_RESOURCE_DESC::Buffer(c_swapBufferCount * sizeof(OpaqueCB));
-            DX::ThrowIfFailed(
-                m_d3dDevice->CreateCommittedResource(
-                    &uploadHeapProp,
-                    D3D12_HEAP_FLAG_NONE,
-                    &resDesc,
-                    D3D12_RESOURCE_STATE_GENERIC_READ,
-                    nullptr,
-                    IID_PPV_ARGS(m_cbOpaqueUploadHeap.ReleaseAndGetAddressOf())));
-
-            // Mapping.
-            DX::ThrowIfFailed(m_cbOpaqueUploadHeap->Map(0, nullptr, reinterpret_cast<void**>(&m_cbOpaqueMappedData)));
-            m_cbOpaqueGpuAddress = m_cbOpaqueUploadHeap->GetGPUVirtualAddress();
-        }
+        D3D12_INDIRECT_ARGUMENT_DESC argumentDescs[2] = {};
+        argumentDescs[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+        argumentDescs[0].Constant.RootParameterIndex = 3;
+        argumentDescs[0].Constant.DestOffsetIn32BitValues = 0;
+        argumentDescs[0].Constant.Num32BitValuesToSet = 1;
+        argumentDescs[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+
+        D3D12_COMMAND_SIGNATURE_DESC commandSignatureDesc = {};
+        commandSignatureDesc.ByteStride = sizeof(FaceTree::DrawArguments);
+        commandSignatureDesc.NumArgumentDescs = _countof(argumentDescs);
+        commandSignatureDesc.pArgumentDescs = argumentDescs;
 
-        // Create shadow constant buffer.
-        {
-            CD3DX12_HEAP_PROPERTIES uploadHeapProp(D3D12_HEAP_TYPE_UPLOAD);
-            CD3DX12_RESOURCE_DESC resDesc = CD3DX12_RESOURCE_DESC::Buffer(c_swapBufferCount * sizeof(OpaqueCB));
-            DX::ThrowIfFailed(
-                m_d3dDevice->CreateCommittedResource(
-                    &uploadHeapProp,
-                    D3D12_HEAP_FLAG_NONE,
-                    &resDesc,
-                    D3D12_RESOURCE_STATE_GENERIC_READ,
-                    nullptr,
-                    IID_PPV_ARGS(m_cbShadowUploadHeap.ReleaseAndGetAddressOf())));
-
-            // Mapping.
-            DX::ThrowIfFailed(m_cbShadowUploadHeap->Map(0, nullptr, reinterpret_cast<void**>(&m_cbShadowMappedData)));
-            m_cbShadowGpuAddress = m_cbShadowUploadHeap->GetGPUVirtualAddress();
-        }
+        DX::ThrowIfFailed(
+            m_d3dDevice->CreateCommandSignature(
+                &commandSignatureDesc,
+                m_rootSignature.Get(),
+                IID_PPV_ARGS(m_drawCommandSignature.ReleaseAndGetAddressOf())));
     }
 
     // ================================================================================================================
@@ -1127,57 +1700,154 @@ void Apollo::CreateCommandListDependentResources()
     // Pre-declare upload heap.
     // Because they must be alive until GPU work (upload) is done.
     ComPtr<ID3D12Resource> textureUploadHeaps[4];
+    HeightMap::Source heightSources[2];
 	ComPtr<ID3D12Resource> vertexUploadHeap;
+	ComPtr<ID3D12Resource> indexUploadHeap;
+
+    // Calling thread culls one face too, so five workers cover all six faces.
+    const uint32_t hardwareThreadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    m_workerPool = std::make_unique<WorkerPool>(std::min(hardwareThreadCount, 6u) - 1);
+    m_cullingTask = std::make_unique<BackgroundTask>();
+    m_renderTask = std::make_unique<BackgroundTask>();
 
     // ================================================================================================================
     // #01. Create texture resources & views.
     // ================================================================================================================
     {
-        CreateTextureResource(
-	        L"Textures\\colormap_l.dds", 
-	        m_colorLTexResource.ReleaseAndGetAddressOf(), 
-	        textureUploadHeaps[0].ReleaseAndGetAddressOf(), 
-	        0);
-        CreateTextureResource(
-	        L"Textures\\colormap_r.dds", 
-	        m_colorRTexResource.ReleaseAndGetAddressOf(), 
-	        textureUploadHeaps[1].ReleaseAndGetAddressOf(), 
-	        1);
-        CreateTextureResource(
-            L"Textures\\displacement_l.dds", 
-            m_heightLTexResource.ReleaseAndGetAddressOf(), 
-            textureUploadHeaps[2].ReleaseAndGetAddressOf(), 
-            2);
-        CreateTextureResource(
-            L"Textures\\displacement_r.dds", 
-            m_heightRTexResource.ReleaseAndGetAddressOf(), 
-            textureUploadHeaps[3].ReleaseAndGetAddressOf(), 
-            3);
+        struct TextureFile
+        {
+            const wchar_t*          fileName;
+            ComPtr<ID3D12Resource>* texture;
+            HeightMap::Source*      heightSource;
+        };
+        const TextureFile textureFiles[4] =
+        {
+            { L"Textures\\colormap_l.dds",     &m_colorLTexResource,   nullptr },
+            { L"Textures\\colormap_r.dds",     &m_colorRTexResource,   nullptr },
+            { L"Textures\\displacement_l.dds", &m_heightLTexResource,  &heightSources[0] },
+            { L"Textures\\displacement_r.dds", &m_heightRTexResource,  &heightSources[1] },
+        };
+
+        // Files are read and staged in their upload heaps by jobs, copies are recorded in order after that.
+        std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> textureLayouts[4];
+        m_workerPool->ParallelFor(4, [&](uint32_t i)
+        {
+            LoadTextureResource(
+                textureFiles[i].fileName,
+                textureFiles[i].texture->ReleaseAndGetAddressOf(),
+                textureUploadHeaps[i].ReleaseAndGetAddressOf(),
+                i,
+                textureLayouts[i],
+                textureFiles[i].heightSource);
+        });
+
+        for (uint32_t i = 0; i < 4; i++)
+            RecordTextureUpload(textureFiles[i].texture->Get(), textureUploadHeaps[i].Get(), textureLayouts[i]);
     }
 
     // ================================================================================================================
     // #02. Compute sphere vertices and indices.
     // ================================================================================================================
-    // Generate quad sphere.
-	const auto geoInfo = QuadSphereGenerator::CreateQuadSphere(300.0f, 300.0f, 300.0f, m_subDivideCount);
+    // Load quad sphere from cache, or generate it and write the cache for next run.
+    wchar_t cacheFileName[64] = {};
+    swprintf_s(cacheFileName, L"Cache\\QuadSphere_%u.bin", m_subDivideCount);
 
-    m_faceTrees = geoInfo->faceTrees;
-    for (FaceTree* faceTree : m_faceTrees)
+    QuadSphereCache quadSphereCache;
+    std::unique_ptr<QuadSphereGenerator::QuadSphereInfo> geoInfo;
+    const VertexTess* staticVertexData = nullptr;
+
+    if (quadSphereCache.Open(cacheFileName, m_subDivideCount))
     {
-        // Index buffer & view is initialized inside Init function.
-        faceTree->Init(m_d3dDevice.Get());
+        // Vertices stay in the mapped file until they are copied into the upload heap.
+        m_faceTrees = quadSphereCache.CreateFaceTrees();
+        staticVertexData = quadSphereCache.GetVertices();
+        m_staticVertexCount = quadSphereCache.GetVertexCount();
+        m_totalIndexData.assign(
+            quadSphereCache.GetIndices(),
+            quadSphereCache.GetIndices() + quadSphereCache.GetIndexCount());
     }
+    else
+    {
+        geoInfo.reset(QuadSphereGenerator::CreateQuadSphere(
+            300.0f, 300.0f, 300.0f, m_subDivideCount, QuadSphereGenerator::GenerateMode::DirectGrid, m_workerPool.get()));
+
+        // Failing to write the cache only costs the next startup.
+        CreateDirectoryW(L"Cache", nullptr);
+        QuadSphereCache::Save(cacheFileName, m_subDivideCount, *geoInfo);
 
-    // Copy vertex data.
-    const auto staticVertexData = std::vector<VertexTess>(geoInfo->vertices);
-    m_totalIndexData = std::vector<uint32_t>(geoInfo->indices);
+        m_faceTrees = geoInfo->faceTrees;
+        staticVertexData = geoInfo->vertices.data();
+        m_staticVertexCount = geoInfo->vertices.size();
+        m_totalIndexData = std::move(geoInfo->indices);
+    }
     m_totalIndexCount = m_totalIndexData.size();
 
-    delete geoInfo;
+    // Coarse patches of inner nodes follow the base indices, they are derived from them on every load.
+    std::vector<uint32_t> coarseIndexData;
+    for (FaceTree* faceTree : m_faceTrees)
+        faceTree->CreateCoarseIndices(m_totalIndexData, m_totalIndexCount + static_cast<uint32_t>(coarseIndexData.size()), coarseIndexData);
+    m_totalIndexData.insert(m_totalIndexData.end(), coarseIndexData.begin(), coarseIndexData.end());
+
+    for (FaceTree* faceTree : m_faceTrees)
+        faceTree->InitDetail(staticVertexData, m_totalIndexData);
+
+    // Node bounds follow the heights under each node. Unsupported height formats keep the full displacement range.
+    const wchar_t* heightFileNames[2] = { L"Textures\\displacement_l.dds", L"Textures\\displacement_r.dds" };
+    const bool heightMapBuilt = m_heightMap.Init(
+        std::move(heightSources[0]), std::move(heightSources[1]),
+        heightFileNames, L"Cache\\HeightPyramid.bin", m_workerPool.get());
+    for (FaceTree* faceTree : m_faceTrees)
+        faceTree->InitHeightBounds(heightMapBuilt ? &m_heightMap : nullptr);
+
+    m_heightMap.ReleaseSources();
+
+    m_lodGrid.Init(m_faceTrees);
+
+    // Occluder proxy follows the lowest heights of the terrain with one quad per leaf node, it never rises above the surface.
+    // Without height map it is the undisplaced sphere.
+    std::vector<XMFLOAT3> occluderVertices;
+    std::vector<uint32_t> occluderIndices;
+    OcclusionBuffer::CreateTerrainOccluder(
+        1u << QUAD_NODE_MAX_LEVEL, QUAD_SPHERE_RADIUS, MAX_HEIGHT_DISPLACEMENT, m_heightMap,
+        occluderVertices, occluderIndices);
+
+    m_occlusionBuffer = std::make_unique<OcclusionBuffer>(256, 144);
+    m_occlusionBuffer->SetOccluder(std::move(occluderVertices), std::move(occluderIndices));
+
+    m_cullingBoundRadius = 0.0f;
+    for (FaceTree* faceTree : m_faceTrees)
+    {
+        // Draw argument buffer is initialized inside Init function.
+        faceTree->Init(m_d3dDevice.Get(), c_viewCount);
+        m_cullingBoundRadius = std::max(m_cullingBoundRadius, faceTree->GetCullingBoundRadius());
+    }
+
+    // Upload ring holds every frame in flight with both CBs, alignment padding included.
+    // One more frame covers the end of the ring skipped when an allocation does not fit there.
+    {
+        const uint64_t frameUploadSize = 4 * c_constantBufferAlignment + sizeof(OpaqueCB) + sizeof(ShadowCB);
+        auto backend = std::make_unique<GpuUploadRingBackend>(
+            m_d3dDevice.Get(), (c_swapBufferCount + 1) * frameUploadSize, m_fence.Get());
+        m_uploadRingBuffer = backend->GetResource();
+        m_uploadRing = std::make_unique<UploadRing>(std::move(backend));
+    }
+
+    // Argument ring holds all draw arguments changed for every frame in flight and every packet queued ahead of them.
+    {
+        uint64_t packetUploadSize = 0;
+        for (const FaceTree* faceTree : m_faceTrees)
+            packetUploadSize += faceTree->GetMaxUploadSize() + sizeof(FaceTree::DrawArguments);
+
+        auto backend = std::make_unique<GpuUploadRingBackend>(
+            m_d3dDevice.Get(), (2 * c_swapBufferCount + 1) * packetUploadSize, m_fence.Get());
+        m_argumentRingBuffer = backend->GetResource();
+        m_argumentRing = std::make_unique<UploadRing>(std::move(backend));
+    }
+
+    m_cullingValid = false;
 
-    m_staticVertexCount = staticVertexData.size();
     m_staticVBSize = sizeof(VertexTess) * m_staticVertexCount;
-    m_totalIBSize = sizeof(uint32_t) * m_totalIndexCount;
+    m_totalIBSize = sizeof(uint32_t) * m_totalIndexData.size();
 
     // ================================================================================================================
     // #03. Create vertex buffer & view.
@@ -1214,7 +1884,7 @@ void Apollo::CreateCommandListDependentResources()
 
         // Define sub-resource data.
         D3D12_SUBRESOURCE_DATA subResourceData = {};
-        subResourceData.pData = staticVertexData.data();
+        subResourceData.pData = staticVertexData;
         subResourceData.RowPitch = m_staticVBSize;
     	subResourceData.SlicePitch = m_staticVBSize;
 
@@ -1228,6 +1898,56 @@ void Apollo::CreateCommandListDependentResources()
         m_commandList->ResourceBarrier(1, &barrier);
     }
 
+    // ================================================================================================================
+    // #04. Create index buffer & view.
+    // ================================================================================================================
+    // Whole index data is uploaded once, culling only selects ranges of it.
+    {
+        // Create default heap.
+        CD3DX12_HEAP_PROPERTIES defaultHeapProp(D3D12_HEAP_TYPE_DEFAULT);
+        auto resDesc = CD3DX12_RESOURCE_DESC::Buffer(m_totalIBSize);
+        DX::ThrowIfFailed(
+            m_d3dDevice->CreateCommittedResource(
+                &defaultHeapProp,
+                D3D12_HEAP_FLAG_NONE,
+                &resDesc,
+                D3D12_RESOURCE_STATE_COPY_DEST,
+                nullptr,
+                IID_PPV_ARGS(m_staticIB.ReleaseAndGetAddressOf())));
+
+        // Initialize index buffer view.
+        m_staticIBV.BufferLocation = m_staticIB->GetGPUVirtualAddress();
+        m_staticIBV.Format = DXGI_FORMAT_R32_UINT;
+        m_staticIBV.SizeInBytes = m_totalIBSize;
+
+        // Create upload heap.
+        CD3DX12_HEAP_PROPERTIES uploadHeapProp(D3D12_HEAP_TYPE_UPLOAD);
+        auto uploadHeapDesc = CD3DX12_RESOURCE_DESC::Buffer(m_totalIBSize);
+        DX::ThrowIfFailed(
+            m_d3dDevice->CreateCommittedResource(
+                &uploadHeapProp,
+                D3D12_HEAP_FLAG_NONE,
+                &uploadHeapDesc,
+                D3D12_RESOURCE_STATE_GENERIC_READ,
+                nullptr,
+                IID_PPV_ARGS(indexUploadHeap.ReleaseAndGetAddressOf())));
+
+        // Define sub-resource data.
+        D3D12_SUBRESOURCE_DATA subResourceData = {};
+        subResourceData.pData = m_totalIndexData.data();
+        subResourceData.RowPitch = m_totalIBSize;
+        subResourceData.SlicePitch = m_totalIBSize;
+
+        // Copy the index data to the default heap.
+        UpdateSubresources(m_commandList.Get(), m_staticIB.Get(), indexUploadHeap.Get(), 0, 0, 1, &subResourceData);
+
+        // Translate index buffer state.
+        const D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(
+            m_staticIB.Get(),
+            D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_INDEX_BUFFER);
+        m_commandList->ResourceBarrier(1, &barrier);
+    }
+
     // <---------- Close command list.
     DX::ThrowIfFailed(m_commandList->Close());
     m_commandQueue->ExecuteCommandLists(1, CommandListCast(m_commandList.GetAddressOf()));
@@ -1240,6 +1960,7 @@ void Apollo::CreateCommandListDependentResources()
         textureUploadHeaps[i].Reset();
     }
     vertexUploadHeap.Reset();
+    indexUploadHeap.Reset();
 }
 
 void Apollo::WaitForGpu() noexcept
@@ -1262,6 +1983,17 @@ void Apollo::WaitForGpu() noexcept
     }
 }
 
+// CBV addresses must be aligned, size is rounded up so no later allocation shares the aligned block.
+UploadRing::Allocation Apollo::AllocateConstantBuffer(uint64_t size)
+{
+    const uint64_t alignedSize = (size + c_constantBufferAlignment - 1) & ~(c_constantBufferAlignment - 1);
+    const UploadRing::Allocation allocation = m_uploadRing->Allocate(alignedSize, c_constantBufferAlignment);
+    if (!allocation)
+        throw std::runtime_error("Upload ring is too small for constant buffers.");
+
+    return allocation;
+}
+
 void Apollo::MoveToNextFrame()
 {
     // Schedule a Signal command in the queue.
@@ -1327,8 +2059,13 @@ void Apollo::GetAdapter(IDXGIAdapter1** ppAdapter) const
     *ppAdapter = adapter.Detach();
 }
 
+// Render stage must be stopped.
 void Apollo::OnDeviceLost()
 {
+    // Predicted cull works on face trees about to be deleted.
+    m_cullingTask->Wait();
+    m_cullingValid = false;
+
     // imgui
     ImGui_ImplDX12_Shutdown();
     ImGui_ImplWin32_Shutdown();
@@ -1343,6 +2080,7 @@ void Apollo::OnDeviceLost()
 
     // Static VB/IB
     m_staticVB.Reset();
+    m_staticIB.Reset();
     m_totalIndexData.clear();
 
     // Textures
@@ -1360,11 +2098,11 @@ void Apollo::OnDeviceLost()
     // Shadow map
     m_shadowMap.reset();
 
-    // CB
-    m_cbOpaqueUploadHeap.Reset();
-    m_cbShadowUploadHeap.Reset();
-    m_cbOpaqueMappedData = nullptr;
-    m_cbShadowMappedData = nullptr;
+    // Upload ring
+    m_uploadRing.reset();
+    m_uploadRingBuffer = nullptr;
+    m_argumentRing.reset();
+    m_argumentRingBuffer = nullptr;
 
     // Descriptor heaps
     m_rtvDescriptorHeap.Reset();
@@ -1376,6 +2114,7 @@ void Apollo::OnDeviceLost()
     for (UINT n = 0; n < c_swapBufferCount; n++)
         m_commandAllocators[n].Reset();
     m_commandList.Reset();
+    m_drawCommandSignature.Reset();
 
     // Fence objects
     m_fence.Reset();
@@ -1390,8 +2129,9 @@ void Apollo::OnDeviceLost()
     CreateCommandListDependentResources();
 }
 
-void Apollo::CreateTextureResource(
-    const wchar_t* fileName, ID3D12Resource** texture, ID3D12Resource** uploadHeap, UINT index) const
+void Apollo::LoadTextureResource(
+    const wchar_t* fileName, ID3D12Resource** texture, ID3D12Resource** uploadHeap, UINT index,
+    std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT>& layouts, HeightMap::Source* heightSource) const
 {
     std::unique_ptr<uint8_t[]> ddsData;
     std::vector<D3D12_SUBRESOURCE_DATA> subResourceDataVec;
@@ -1415,8 +2155,16 @@ void Apollo::CreateTextureResource(
         m_srvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(), index, m_cbvSrvDescriptorSize);
     m_d3dDevice->CreateShaderResourceView(*texture, &srvDesc, srvHandle);
 
-    // Calculate upload buffer size.
-    const UINT64 uploadBufferSize = GetRequiredIntermediateSize(*texture, 0, static_cast<UINT>(subResourceDataVec.size()));
+    // Calculate upload buffer layout.
+    const D3D12_RESOURCE_DESC textureDesc = (*texture)->GetDesc();
+    const UINT subResourceCount = static_cast<UINT>(subResourceDataVec.size());
+    std::vector<UINT> rowCounts(subResourceCount);
+    std::vector<UINT64> rowSizes(subResourceCount);
+    UINT64 uploadBufferSize = 0;
+    layouts.resize(subResourceCount);
+    m_d3dDevice->GetCopyableFootprints(
+        &textureDesc, 0, subResourceCount, 0,
+        layouts.data(), rowCounts.data(), rowSizes.data(), &uploadBufferSize);
 
     // Create upload heap.
     CD3DX12_HEAP_PROPERTIES uploadHeapProp(D3D12_HEAP_TYPE_UPLOAD);
@@ -1430,14 +2178,47 @@ void Apollo::CreateTextureResource(
             nullptr,
             IID_PPV_ARGS(uploadHeap)));
 
+    // Copy texels into upload heap, rows padded to the layout pitch.
+    BYTE* uploadData = nullptr;
+    DX::ThrowIfFailed((*uploadHeap)->Map(0, nullptr, reinterpret_cast<void**>(&uploadData)));
+    for (UINT i = 0; i < subResourceCount; i++)
+    {
+        const D3D12_MEMCPY_DEST destData =
+        {
+            uploadData + layouts[i].Offset,
+            layouts[i].Footprint.RowPitch,
+            SIZE_T(layouts[i].Footprint.RowPitch) * SIZE_T(rowCounts[i])
+        };
+        MemcpySubresource(
+            &destData, &subResourceDataVec[i], static_cast<SIZE_T>(rowSizes[i]), rowCounts[i], layouts[i].Footprint.Depth);
+    }
+    (*uploadHeap)->Unmap(0, nullptr);
+
+    // Subresource data points into ddsData, so both move together.
+    if (heightSource)
+    {
+        heightSource->data = std::move(ddsData);
+        heightSource->mips = std::move(subResourceDataVec);
+        heightSource->format = textureDesc.Format;
+        heightSource->width = static_cast<uint32_t>(textureDesc.Width);
+        heightSource->height = textureDesc.Height;
+    }
+}
+
+void Apollo::RecordTextureUpload(
+    ID3D12Resource* texture, ID3D12Resource* uploadHeap, const std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT>& layouts) const
+{
     // Upload resources.
-    UpdateSubresources(
-        m_commandList.Get(), *texture, *uploadHeap, 0, 0,
-        static_cast<UINT>(subResourceDataVec.size()), subResourceDataVec.data());
+    for (UINT i = 0; i < static_cast<UINT>(layouts.size()); i++)
+    {
+        const CD3DX12_TEXTURE_COPY_LOCATION dest(texture, i);
+        const CD3DX12_TEXTURE_COPY_LOCATION source(uploadHeap, layouts[i]);
+        m_commandList->CopyTextureRegion(&dest, 0, 0, 0, &source, nullptr);
+    }
 
     // Translate state.
     const D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(
-        *texture,
+        texture,
         D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
     m_commandList->ResourceBarrier(1, &barrier);
 }
\ No newline at end of file
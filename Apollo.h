@@ -1,8 +1,17 @@
 #pragma once
 
+#include "BackgroundTask.h"
 #include "FaceTree.h"
+#include "FramePipeline.h"
+#include "GpuUploadRingBackend.h"
+#include "HeightMap.h"
+#include "LodGrid.h"
+#include "OcclusionBuffer.h"
 #include "ShadowMap.h"
 #include "StepTimer.h"
+#include "WorkerPool.h"
+
+#include "imgui.h"
 
 class Apollo
 {
@@ -58,8 +67,72 @@ private:
         uint8_t             padding[88];
     };
 
+    // Camera and light a cull is made for, current or predicted one frame ahead.
+    struct CullingPose
+    {
+        FrustumCulling::Planes  planes;
+        FrustumCulling::Planes  shadowPlanes;
+        DirectX::XMFLOAT3       cameraPosition;
+        DirectX::XMFLOAT4X4     viewProjection;     // Occlusion buffer is drawn with it.
+        DirectX::XMFLOAT3       lightPosition;
+        bool                    renderShadow;
+        float                   margin;             // Planes and normal cones are widened by it, horizon and occluder shrunk.
+    };
+
+    // Changed draw arguments of one face and view, emitted into the packet allocation from argumentOffset on.
+    struct FaceViewDraws
+    {
+        uint32_t                                rangeCount;
+        uint64_t                                argumentOffset;
+        std::vector<SpanUploadSink::Region>     argumentRegions;
+    };
+
+    // Everything the render stage records a frame from. The update stage fills it, the render stage only reads it.
+    struct FramePacket
+    {
+        OpaqueCB                                opaqueCB;
+        ShadowCB                                shadowCB;
+        bool                                    renderShadow;
+        bool                                    wireframe;
+
+        UploadRing::Allocation                  argumentAllocation;
+        uint64_t                                argumentSize;
+        FaceViewDraws                           faceDraws[6][FaceTree::MAX_VIEWS];
+
+        // imgui draw lists are rebuilt every frame, the packet owns copies of them.
+        ImDrawData                              uiDrawData;
+        std::vector<ImDrawList*>                uiDrawLists;
+
+        FramePacket() = default;
+        ~FramePacket();
+
+        FramePacket(FramePacket const&) = delete;
+        FramePacket& operator= (FramePacket const&) = delete;
+    };
+
+    // Update stage runs on the window thread and publishes a frame packet, render stage records and presents packets
+    // on its own thread. Render returns false when the device is lost.
     void Update(DX::StepTimer const& timer);
-    void Render();
+    void UpdateUi();
+    void WriteFramePacket(FramePacket& packet);
+    bool Render(const FramePacket& packet);
+
+    // Render stage stops by itself on device loss or an error. Stop drains published packets first.
+    void StartRenderStage();
+    void StopRenderStage();
+
+    CullingPose GetCullingPose(DirectX::FXMVECTOR camPosition, float yaw, float pitch, DirectX::FXMVECTOR lightDirection, float margin) const;
+    void GetLightVolume(DirectX::FXMVECTOR lightDirection, DirectX::XMFLOAT3& lightPosition, DirectX::BoundingOrientedBox& lightVolume) const;
+    bool IsCullingCovered(const CullingPose& pose) const;
+
+    // Cull faces for a pose, may run on the culling thread. FinishCulling then gathers statistics on the main thread.
+    void CullFaces(const CullingPose& pose);
+    void FinishCulling(const CullingPose& pose);
+
+    // Start culling the next frame with the pose change of this one.
+    // Wait finishes a started cull and returns true, its pose then stands for the last cull.
+    void StartPredictedCulling();
+    bool WaitForPredictedCulling();
 
     void CreateDeviceResources();
     void CreateDeviceDependentResources();
@@ -68,12 +141,21 @@ private:
 
     void WaitForGpu() noexcept;
     void MoveToNextFrame();
+    UploadRing::Allocation AllocateConstantBuffer(uint64_t size);
     void GetAdapter(IDXGIAdapter1** ppAdapter) const;
 
     void OnDeviceLost();
 
     // Helper functions
-    void CreateTextureResource(const wchar_t* fileName, ID3D12Resource** texture, ID3D12Resource** uploadHeap, UINT index) const;
+    // Loads a texture, creates its view and copies its texels into a new upload heap laid out as layouts.
+    // Records nothing, so several textures may load on worker threads at once.
+    // Texel data is moved into heightSource when given, after it is copied to the upload heap.
+    void LoadTextureResource(
+        const wchar_t* fileName, ID3D12Resource** texture, ID3D12Resource** uploadHeap, UINT index,
+        std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT>& layouts, HeightMap::Source* heightSource = nullptr) const;
+    // Records the copy of a loaded texture from its upload heap and its transition to a shader resource.
+    void RecordTextureUpload(
+        ID3D12Resource* texture, ID3D12Resource* uploadHeap, const std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT>& layouts) const;
 
     // Constants
     const DirectX::XMVECTORF32                          DEFAULT_UP_VECTOR       = { 0.f, 1.f, 0.f, 0.f };
@@ -99,6 +181,12 @@ private:
     static constexpr DXGI_FORMAT                        c_depthBufferFormat = DXGI_FORMAT_D32_FLOAT;
     static constexpr UINT                               c_swapBufferCount = 3;
 
+    // Views culled together, each face tree keeps a draw list per view.
+    static constexpr uint32_t                           c_cameraView = 0;
+    static constexpr uint32_t                           c_shadowView = 1;
+    static constexpr uint32_t                           c_viewCount = 2;
+    static constexpr UINT64                             c_constantBufferAlignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+
     // Back buffer index
     UINT                                                m_backBufferIndex;
 
@@ -136,13 +224,14 @@ private:
     Microsoft::WRL::ComPtr<ID3D12PipelineState>         m_wireframePSO;
     Microsoft::WRL::ComPtr<ID3D12PipelineState>         m_shadowPSO;
 
-    // CB
-    Microsoft::WRL::ComPtr<ID3D12Resource>              m_cbOpaqueUploadHeap;
-    Microsoft::WRL::ComPtr<ID3D12Resource>              m_cbShadowUploadHeap;
-    OpaqueCB*                                           m_cbOpaqueMappedData;
-    ShadowCB*                                           m_cbShadowMappedData;
-    D3D12_GPU_VIRTUAL_ADDRESS						    m_cbOpaqueGpuAddress;
-    D3D12_GPU_VIRTUAL_ADDRESS						    m_cbShadowGpuAddress;
+    // Per frame upload data, retired by frame fence. CBs are allocated by the render stage while it records a frame.
+    // Draw arguments are allocated by the update stage packets ahead of the frame that copies them, so they have
+    // a ring of their own retired per packet. Its mutex is held for every call, both stages use it.
+    std::unique_ptr<UploadRing>                         m_uploadRing;
+    ID3D12Resource*                                     m_uploadRingBuffer;
+    std::unique_ptr<UploadRing>                         m_argumentRing;
+    ID3D12Resource*                                     m_argumentRingBuffer;
+    std::mutex                                          m_argumentRingMutex;
 
     // Resources
     Microsoft::WRL::ComPtr<IDXGISwapChain3>             m_swapChain;
@@ -164,6 +253,10 @@ private:
     size_t											    m_totalIBSize;
     uint32_t										    m_totalIndexCount;
 
+    // Static IB
+    Microsoft::WRL::ComPtr<ID3D12Resource>              m_staticIB;
+    D3D12_INDEX_BUFFER_VIEW                             m_staticIBV;
+
     // Static VB
     Microsoft::WRL::ComPtr<ID3D12Resource>              m_staticVB;
     D3D12_VERTEX_BUFFER_VIEW                            m_staticVBV;
@@ -173,9 +266,81 @@ private:
     // QuadBox
     UINT        			                            m_subDivideCount;
     uint32_t										    m_culledQuadCount;
+    float                                               m_cullingTime;
+    uint32_t                                            m_testedNodeCount;
+    uint32_t                                            m_testedPlaneCount;
+    uint32_t                                            m_drawRangeCount;
+    uint32_t                                            m_shadowDrawRangeCount;
+
+    // Temporal culling, last cull is reused while the frustum stays within margin.
+    FrustumCulling::Planes                              m_culledPlanes;
+    FrustumCulling::Planes                              m_culledShadowPlanes;
+    bool                                                m_culledShadowView;
+    DirectX::XMFLOAT3                                   m_culledCameraPosition;
+    float                                               m_culledMargin;
+    bool                                                m_cullingValid;
+    float                                               m_cullingMargin;
+    float                                               m_cullingBoundRadius;
+    uint64_t                                            m_cullingCount;
+    uint64_t                                            m_skippedCullingCount;
+    uint32_t                                            m_enteredLeafCount;
+    uint32_t                                            m_leftLeafCount;
+    bool                                                m_horizonCulling;
+    uint32_t                                            m_horizonCulledQuadCount;
+    bool                                                m_backFaceCulling;
+    uint32_t                                            m_backFaceCulledQuadCount;
+    bool                                                m_occlusionCulling;
+    uint32_t                                            m_occludedNodeCount;
+    bool                                                m_patchLod;
+    LodErrorMetric                                      m_lodMetric;
+    float                                               m_lodPixelThreshold;
+    uint32_t                                            m_visiblePatchCount;
+    uint32_t                                            m_lodRefinedNodeCount;
+    uint32_t                                            m_detailNodeCount;
+    uint32_t                                            m_splitBlockCount;
+    uint32_t                                            m_evictedBlockCount;
+    uint32_t                                            m_patchedBytes;
+    uint64_t                                            m_totalPatchedBytes;
+    CullingKernel                                       m_cullingKernel;
+    CullingMode                                         m_cullingMode;
+    uint32_t                                            m_faceCulledQuadCounts[6];
+
+    // Predicted culling, faces are culled for the next frame on a background thread while this one is presented.
+    // Pose steps are changes over the last frame, the next frame is expected to repeat them.
+    bool                                                m_predictedCulling;
+    std::unique_ptr<BackgroundTask>                     m_cullingTask;
+    CullingPose                                         m_predictedPose;
+    DirectX::XMVECTOR                                   m_camStep;
+    float                                               m_camYawStep;
+    float                                               m_camPitchStep;
+    float                                               m_lightStep;
+    DirectX::XMVECTOR                                   m_lastCamPosition;
+    float                                               m_lastCamYaw;
+    float                                               m_lastCamPitch;
+    float                                               m_predictionMargin;
+    float                                               m_cullingWaitTime;
+    uint64_t                                            m_predictedCullingCount;
+    uint64_t                                            m_predictionHitCount;
+    uint64_t                                            m_fallbackCullingCount;
+
+    // Frame pipeline, the update stage works on the next frame while the render stage records this one.
+    // CB upload ring is used by the render stage only, its statistics are passed back for the UI.
+    FramePipeline<FramePacket, c_swapBufferCount>       m_framePipeline;
+    std::unique_ptr<BackgroundTask>                     m_renderTask;
+    std::atomic<bool>                                   m_deviceLost;
+    float                                               m_updateTime;
+    std::atomic<float>                                  m_renderTime;
+    std::atomic<uint64_t>                               m_uploadRingUsedSize;
+    std::atomic<uint64_t>                               m_uploadRingPeakSize;
+    std::atomic<uint32_t>                               m_uploadRingWaitCount;
 
     // QuadTree instances
     std::vector<FaceTree*>                              m_faceTrees;
+    std::unique_ptr<WorkerPool>                         m_workerPool;
+    std::unique_ptr<OcclusionBuffer>                    m_occlusionBuffer;
+    LodGrid                                             m_lodGrid;
+    HeightMap                                           m_heightMap;
+    Microsoft::WRL::ComPtr<ID3D12CommandSignature>      m_drawCommandSignature;
 
     // Shadow
     std::unique_ptr<ShadowMap>  			            m_shadowMap;
@@ -218,6 +383,7 @@ private:
     DirectX::XMFLOAT3                                   m_lightPosition;
     DirectX::XMFLOAT4X4                                 m_lightView;
     DirectX::XMFLOAT4X4                                 m_lightProj;
+    DirectX::BoundingOrientedBox                        m_lightVolume;
 
     // Tessellation states
     float										        m_quadWidth;
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+// Minimal benchmark registry of the CPU benchmark target. BENCHMARK defines a named benchmark,
+// ApolloBench runs every benchmark, or only those named on its command line, and prints one line per result.
+namespace Bench
+{
+	typedef void (*Function)();
+
+	bool Register(const char* name, Function function);
+
+	// Median wall time of one run of function, in microseconds. One untimed run warms caches first.
+	double MeasureMicroseconds(uint32_t runCount, const std::function<void()>& function);
+
+	void Report(const char* benchmark, const char* measurement, double value, const char* unit);
+}
+
+#define BENCHMARK(name) \
+	static void Benchmark_##name(); \
+	static const bool Benchmark_##name##_registered = Bench::Register(#name, &Benchmark_##name); \
+	static void Benchmark_##name()
@@ -0,0 +1,66 @@
+#include "Bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	struct Benchmark
+	{
+		const char*		name;
+		Bench::Function	function;
+	};
+
+	// Filled by static initializers of the benchmark files, so it must exist before the first of them runs.
+	std::vector<Benchmark>& GetBenchmarks()
+	{
+		static std::vector<Benchmark> benchmarks;
+		return benchmarks;
+	}
+}
+
+bool Bench::Register(const char* name, Function function)
+{
+	GetBenchmarks().push_back({ name, function });
+	return true;
+}
+
+double Bench::MeasureMicroseconds(uint32_t runCount, const std::function<void()>& function)
+{
+	function();
+
+	std::vector<double> times(std::max(runCount, 1u));
+	for (double& time : times)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		function();
+		time = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+	return times[times.size() / 2];
+}
+
+void Bench::Report(const char* benchmark, const char* measurement, double value, const char* unit)
+{
+	printf("%-24s %-48s %12.3f %s\n", benchmark, measurement, value, unit);
+	fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+	for (const Benchmark& benchmark : GetBenchmarks())
+	{
+		bool selected = argc < 2;
+		for (int a = 1; a < argc; a++)
+			selected |= strcmp(argv[a], benchmark.name) == 0;
+
+		if (selected)
+			benchmark.function();
+	}
+
+	return 0;
+}
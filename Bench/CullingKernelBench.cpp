@@ -0,0 +1,67 @@
+#include "pch.h"
+#include "Bench.h"
+
+#include "FrustumCulling.h"
+
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+// Throughput of the box classification kernels on random boxes around a frustum,
+// with every plane and with plane masks and inside planes as the hierarchy uses them.
+BENCHMARK(CullingKernels)
+{
+	constexpr uint32_t BOX_COUNT = 64 * 1024;
+	constexpr uint32_t RUN_COUNT = 200;
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> position(-150.0f, 150.0f);
+	std::uniform_real_distribution<float> extent(0.5f, 20.0f);
+	std::normal_distribution<float> quaternion(0.0f, 1.0f);
+
+	OrientedBoxArray boxes;
+	boxes.Resize(BOX_COUNT);
+	for (uint32_t b = 0; b < BOX_COUNT; b++)
+	{
+		XMFLOAT4 orientation;
+		XMStoreFloat4(&orientation, XMQuaternionNormalize(
+			XMVectorSet(quaternion(random), quaternion(random), quaternion(random), quaternion(random))));
+		boxes.Set(b, BoundingOrientedBox(
+			XMFLOAT3(position(random), position(random), position(random)),
+			XMFLOAT3(extent(random), extent(random), extent(random)), orientation));
+	}
+
+	const XMMATRIX view = XMMatrixLookAtLH(
+		XMVectorSet(0.0f, 50.0f, -300.0f, 0.0f), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	BoundingFrustum frustum;
+	BoundingFrustum(XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.01f, 600.0f)).Transform(
+		frustum, XMMatrixInverse(nullptr, view));
+	const FrustumCulling::Planes planes = FrustumCulling::LoadPlanes(frustum);
+
+	std::vector<uint8_t> results(BOX_COUNT);
+	std::vector<uint8_t> insidePlanes(BOX_COUNT);
+
+	const CullingKernel kernels[] = { CullingKernel::Scalar, CullingKernel::SSE, CullingKernel::AVX };
+	const uint32_t kernelCount = FrustumCulling::GetBestKernel() == CullingKernel::AVX ? 3 : 2;
+	for (uint32_t k = 0; k < kernelCount; k++)
+	{
+		const CullingKernel kernel = kernels[k];
+		const double allPlanes = Bench::MeasureMicroseconds(RUN_COUNT, [&]()
+		{
+			FrustumCulling::ClassifyBoxes(kernel, planes, boxes, 0, BOX_COUNT, results.data());
+		});
+
+		// Three planes left, as below a node inside the other three.
+		const double maskedPlanes = Bench::MeasureMicroseconds(RUN_COUNT, [&]()
+		{
+			FrustumCulling::ClassifyBoxes(kernel, planes, boxes, 0, BOX_COUNT, results.data(), 0x2A, insidePlanes.data());
+		});
+
+		char measurement[64];
+		snprintf(measurement, sizeof(measurement), "%s, 6 planes", FrustumCulling::GetKernelName(kernel));
+		Bench::Report("CullingKernels", measurement, BOX_COUNT / allPlanes, "nodes/us");
+		snprintf(measurement, sizeof(measurement), "%s, 3 planes + inside planes", FrustumCulling::GetKernelName(kernel));
+		Bench::Report("CullingKernels", measurement, BOX_COUNT / maskedPlanes, "nodes/us");
+	}
+}
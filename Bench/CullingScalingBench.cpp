@@ -0,0 +1,43 @@
+#include "pch.h"
+#include "Bench.h"
+
+#include "HeadlessScene.h"
+#include "WorkerPool.h"
+
+#include <thread>
+
+// Face tree culling with 1 to 6 threads including the calling one, over the same camera poses.
+// Each cull runs the job graph of Apollo: LOD selection, balance and occluder, then one culling job per face,
+// so six threads is as wide as it gets. Speedup is against one thread, it can not exceed the hardware thread count.
+BENCHMARK(CullingScaling)
+{
+	constexpr uint32_t SUB_DIVIDE_COUNT = 8;	// Default of Apollo.
+	constexpr uint32_t POSE_COUNT = 32;
+	constexpr uint32_t RUN_COUNT = 5;
+
+	HeadlessScene scene(SUB_DIVIDE_COUNT, nullptr);
+	const std::vector<HeadlessScene::Pose> poses = HeadlessScene::CreateRandomPoses(POSE_COUNT, 1, 0.5f, 350.0f);
+	const HeadlessScene::Settings settings;
+
+	Bench::Report("CullingScaling", "hardware threads", std::thread::hardware_concurrency(), "");
+
+	double singleThreadTime = 0.0;
+	for (uint32_t threadCount : { 1u, 2u, 4u, 6u })
+	{
+		WorkerPool pool(threadCount - 1);
+		const double time = Bench::MeasureMicroseconds(RUN_COUNT, [&]()
+		{
+			for (const HeadlessScene::Pose& pose : poses)
+				scene.Cull(pose, settings, pool);
+		}) / POSE_COUNT;
+
+		if (threadCount == 1)
+			singleThreadTime = time;
+
+		char measurement[64];
+		snprintf(measurement, sizeof(measurement), "%u threads, per cull", threadCount);
+		Bench::Report("CullingScaling", measurement, time / 1000.0, "ms");
+		snprintf(measurement, sizeof(measurement), "%u threads, speedup", threadCount);
+		Bench::Report("CullingScaling", measurement, singleThreadTime / time, "x");
+	}
+}
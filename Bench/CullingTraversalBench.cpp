@@ -0,0 +1,193 @@
+#include "pch.h"
+#include "Bench.h"
+
+#include "HeadlessScene.h"
+#include "WorkerPool.h"
+
+#include <memory>
+
+using namespace DirectX;
+
+namespace
+{
+	// Quad tree as it was before the face trees were flattened: one heap node per quad with child pointers,
+	// each visited node tested with BoundingFrustum::Contains on all planes, indices of visible leaves copied.
+	struct PointerNode
+	{
+		BoundingOrientedBox						box;
+		uint32_t								level;
+		uint32_t								baseAddress;
+		uint32_t								indexCount;
+		std::unique_ptr<PointerNode>			children[4];
+	};
+
+	std::unique_ptr<PointerNode> CreatePointerTree(const FaceTree& faceTree, uint32_t node, uint32_t level)
+	{
+		std::unique_ptr<PointerNode> pointerNode(new PointerNode);
+		pointerNode->box = faceTree.GetNodeBounds(node).box;
+		pointerNode->level = level;
+		pointerNode->baseAddress = faceTree.GetNodeBaseAddress(node);
+		pointerNode->indexCount = faceTree.GetNodeIndexCount(node);
+		if (level < faceTree.GetMaxLevel())
+		{
+			for (uint32_t c = 0; c < 4; c++)
+				pointerNode->children[c] = CreatePointerTree(faceTree, 4 * node + 1 + c, level + 1);
+		}
+		return pointerNode;
+	}
+
+	void RenderPointerTree(
+		const PointerNode& node, const BoundingFrustum& frustum, const std::vector<uint32_t>& indices,
+		std::vector<uint32_t>& drawIndices, uint32_t& testedNodeCount)
+	{
+		testedNodeCount++;
+		if (frustum.Contains(node.box) == DISJOINT && node.level >= 1)
+			return;
+
+		if (node.children[0])
+		{
+			for (const std::unique_ptr<PointerNode>& child : node.children)
+				RenderPointerTree(*child, frustum, indices, drawIndices, testedNodeCount);
+		}
+		else
+		{
+			drawIndices.insert(drawIndices.end(), &indices[node.baseAddress], &indices[node.baseAddress] + node.indexCount);
+		}
+	}
+
+	// Camera circling the moon at given distance, looking at its center.
+	std::vector<HeadlessScene::Pose> CreateOrbitPoses(uint32_t count, float distance)
+	{
+		std::vector<HeadlessScene::Pose> poses;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const float angle = XM_2PI * i / count;
+			const XMFLOAT3 position(distance * sinf(angle), 0.3f * distance * sinf(2.0f * angle), -distance * cosf(angle));
+			poses.push_back(HeadlessScene::CreatePose(
+				position, XMFLOAT3(-position.x, -position.y, -position.z), XMFLOAT3(0.6f, -0.5f, 0.6f)));
+		}
+		return poses;
+	}
+}
+
+// Culling of the camera view over three pose sets, each measured on the same poses:
+// - pointer tree: the recursive walk over heap nodes the face trees replaced, frustum only
+// - hierarchy, flat sweep: the current culling modes with frustum only, as the pointer tree culls,
+//   then with every test Apollo starts with (horizon, normal cone, occlusion, patch LOD)
+// Node tests count boxes tested against the frustum, tessellation groups for the flat sweep.
+// Plane tests drop below 6 per node tested where plane masks skip planes a parent lies inside.
+BENCHMARK(CullingTraversal)
+{
+	constexpr uint32_t SUB_DIVIDE_COUNT = 8;
+	constexpr uint32_t POSE_COUNT = 64;
+	constexpr uint32_t RUN_COUNT = 5;
+
+	WorkerPool pool(0);
+	HeadlessScene scene(SUB_DIVIDE_COUNT, &pool);
+
+	std::vector<std::unique_ptr<PointerNode>> pointerTrees;
+	for (const FaceTree* faceTree : scene.GetFaceTrees())
+		pointerTrees.push_back(CreatePointerTree(*faceTree, 0, 0));
+
+	const struct
+	{
+		const char*							name;
+		std::vector<HeadlessScene::Pose>	poses;
+	} poseSets[] =
+	{
+		{ "orbit at 500", CreateOrbitPoses(POSE_COUNT, 500.0f) },
+		{ "near orbit at 220", CreateOrbitPoses(POSE_COUNT, 220.0f) },
+		{ "low altitude", HeadlessScene::CreateRandomPoses(POSE_COUNT, 2, 0.5f, 5.0f) },
+	};
+
+	HeadlessScene::Settings frustumOnly;
+	frustumOnly.horizonCulling = false;
+	frustumOnly.backFaceCulling = false;
+	frustumOnly.occlusionCulling = false;
+	frustumOnly.patchLod = false;
+	frustumOnly.renderShadow = false;
+	frustumOnly.margin = 0.0f;
+
+	const HeadlessScene::Settings defaults;
+
+	for (const auto& poseSet : poseSets)
+	{
+		char measurement[96];
+		const std::vector<HeadlessScene::Pose>& poses = poseSet.poses;
+
+		std::vector<uint32_t> drawIndices;
+		uint64_t testedNodeCount = 0;
+		uint64_t drawnIndexCount = 0;
+		const double pointerTime = Bench::MeasureMicroseconds(RUN_COUNT, [&]()
+		{
+			testedNodeCount = 0;
+			drawnIndexCount = 0;
+			for (const HeadlessScene::Pose& pose : poses)
+			{
+				BoundingFrustum frustum;
+				XMFLOAT4X4 viewProjection;
+				HeadlessScene::GetCamera(pose, frustumOnly.aspectRatio, frustum, viewProjection);
+				uint32_t poseTestedNodeCount = 0;
+				drawIndices.clear();
+				for (const std::unique_ptr<PointerNode>& tree : pointerTrees)
+					RenderPointerTree(*tree, frustum, scene.GetIndices(), drawIndices, poseTestedNodeCount);
+				testedNodeCount += poseTestedNodeCount;
+				drawnIndexCount += drawIndices.size();
+			}
+		}) / POSE_COUNT;
+
+		snprintf(measurement, sizeof(measurement), "%s, pointer tree, per cull", poseSet.name);
+		Bench::Report("CullingTraversal", measurement, pointerTime, "us");
+		snprintf(measurement, sizeof(measurement), "%s, pointer tree, node tests", poseSet.name);
+		Bench::Report("CullingTraversal", measurement, static_cast<double>(testedNodeCount) / POSE_COUNT, "per cull");
+		snprintf(measurement, sizeof(measurement), "%s, pointer tree, plane tests", poseSet.name);
+		Bench::Report("CullingTraversal", measurement, 6.0 * testedNodeCount / POSE_COUNT, "per cull");
+		snprintf(measurement, sizeof(measurement), "%s, pointer tree, drawn patches", poseSet.name);
+		Bench::Report("CullingTraversal", measurement, static_cast<double>(drawnIndexCount) / (4 * POSE_COUNT), "per cull");
+
+		const struct
+		{
+			const char*						name;
+			CullingMode						mode;
+			const HeadlessScene::Settings*	settings;
+		} variants[] =
+		{
+			{ "hierarchy, frustum only", CullingMode::Hierarchy, &frustumOnly },
+			{ "flat sweep, frustum only", CullingMode::FlatSweep, &frustumOnly },
+			{ "hierarchy, every test", CullingMode::Hierarchy, &defaults },
+			{ "flat sweep, every test", CullingMode::FlatSweep, &defaults },
+		};
+
+		for (const auto& variant : variants)
+		{
+			HeadlessScene::Settings settings = *variant.settings;
+			settings.mode = variant.mode;
+
+			uint64_t testedPlaneCount = 0;
+			uint64_t visiblePatchCount = 0;
+			const double time = Bench::MeasureMicroseconds(RUN_COUNT, [&]()
+			{
+				testedNodeCount = 0;
+				testedPlaneCount = 0;
+				visiblePatchCount = 0;
+				for (const HeadlessScene::Pose& pose : poses)
+				{
+					scene.Cull(pose, settings, pool);
+					testedNodeCount += scene.GetTestedNodeCount();
+					for (const FaceTree* faceTree : scene.GetFaceTrees())
+						testedPlaneCount += faceTree->GetTestedPlaneCount();
+					visiblePatchCount += scene.GetVisiblePatchCount();
+				}
+			}) / POSE_COUNT;
+
+			snprintf(measurement, sizeof(measurement), "%s, %s, per cull", poseSet.name, variant.name);
+			Bench::Report("CullingTraversal", measurement, time, "us");
+			snprintf(measurement, sizeof(measurement), "%s, %s, node tests", poseSet.name, variant.name);
+			Bench::Report("CullingTraversal", measurement, static_cast<double>(testedNodeCount) / POSE_COUNT, "per cull");
+			snprintf(measurement, sizeof(measurement), "%s, %s, plane tests", poseSet.name, variant.name);
+			Bench::Report("CullingTraversal", measurement, static_cast<double>(testedPlaneCount) / POSE_COUNT, "per cull");
+			snprintf(measurement, sizeof(measurement), "%s, %s, drawn patches", poseSet.name, variant.name);
+			Bench::Report("CullingTraversal", measurement, static_cast<double>(visiblePatchCount) / POSE_COUNT, "per cull");
+		}
+	}
+}
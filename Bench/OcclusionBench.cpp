@@ -0,0 +1,109 @@
+#include "pch.h"
+#include "Bench.h"
+
+#include "HeadlessScene.h"
+#include "WorkerPool.h"
+
+using namespace DirectX;
+
+// Software occlusion over the same random poses at three altitude ranges: rasterizing the occluder proxy,
+// testing the bounding sphere of every face tree node against it, and nodes a cull rejects by occlusion
+// with default settings and with horizon culling off.
+// Without height map the proxy is the undisplaced sphere, as Apollo builds it then, 256 x 144 pixels.
+BENCHMARK(Occlusion)
+{
+	constexpr uint32_t SUB_DIVIDE_COUNT = 8;
+	constexpr uint32_t POSE_COUNT = 64;
+	constexpr uint32_t RUN_COUNT = 20;
+
+	WorkerPool pool(0);
+	HeadlessScene scene(SUB_DIVIDE_COUNT, &pool);
+	const HeadlessScene::Settings settings;
+
+	// Horizon culling rejects most of what the sphere proxy hides, so occlusion is also counted without it.
+	HeadlessScene::Settings noHorizon;
+	noHorizon.horizonCulling = false;
+
+	std::vector<BoundingSphere> nodeSpheres;
+	for (const FaceTree* faceTree : scene.GetFaceTrees())
+	{
+		for (uint32_t node = 0; node < faceTree->GetNodeCount(); node++)
+			nodeSpheres.push_back(faceTree->GetNodeBounds(node).sphere);
+	}
+
+	const struct
+	{
+		const char*							name;
+		std::vector<HeadlessScene::Pose>	poses;
+	} poseSets[] =
+	{
+		{ "low altitude", HeadlessScene::CreateRandomPoses(POSE_COUNT, 3, 0.5f, 5.0f) },
+		{ "mid altitude", HeadlessScene::CreateRandomPoses(POSE_COUNT, 4, 5.0f, 50.0f) },
+		{ "high altitude", HeadlessScene::CreateRandomPoses(POSE_COUNT, 5, 50.0f, 350.0f) },
+	};
+
+	OcclusionBuffer& occlusionBuffer = scene.GetOcclusionBuffer();
+	for (const auto& poseSet : poseSets)
+	{
+		std::vector<XMFLOAT4X4> viewProjections(POSE_COUNT);
+		for (uint32_t p = 0; p < POSE_COUNT; p++)
+		{
+			BoundingFrustum frustum;
+			HeadlessScene::GetCamera(poseSet.poses[p], settings.aspectRatio, frustum, viewProjections[p]);
+		}
+
+		uint64_t triangleCount = 0;
+		const double rasterizeTime = Bench::MeasureMicroseconds(RUN_COUNT, [&]()
+		{
+			triangleCount = 0;
+			for (uint32_t p = 0; p < POSE_COUNT; p++)
+			{
+				occlusionBuffer.Rasterize(viewProjections[p], poseSet.poses[p].cameraPosition, pool);
+				triangleCount += occlusionBuffer.GetRasterizedTriangleCount();
+			}
+		}) / POSE_COUNT;
+
+		// Each pose is drawn once, then its tests are timed on their own.
+		double testTime = 0.0;
+		uint64_t occludedCount = 0;
+		for (uint32_t p = 0; p < POSE_COUNT; p++)
+		{
+			occlusionBuffer.Rasterize(viewProjections[p], poseSet.poses[p].cameraPosition, pool);
+			uint32_t poseOccludedCount = 0;
+			testTime += Bench::MeasureMicroseconds(RUN_COUNT, [&]()
+			{
+				poseOccludedCount = 0;
+				for (const BoundingSphere& sphere : nodeSpheres)
+					poseOccludedCount += occlusionBuffer.IsSphereOccluded(sphere.Center, sphere.Radius) ? 1 : 0;
+			});
+			occludedCount += poseOccludedCount;
+		}
+
+		uint64_t culledOccludedCount = 0;
+		uint64_t noHorizonOccludedCount = 0;
+		for (const HeadlessScene::Pose& pose : poseSet.poses)
+		{
+			scene.Cull(pose, settings, pool);
+			for (const FaceTree* faceTree : scene.GetFaceTrees())
+				culledOccludedCount += faceTree->GetOccludedNodeCount();
+
+			scene.Cull(pose, noHorizon, pool);
+			for (const FaceTree* faceTree : scene.GetFaceTrees())
+				noHorizonOccludedCount += faceTree->GetOccludedNodeCount();
+		}
+
+		char measurement[96];
+		snprintf(measurement, sizeof(measurement), "%s, rasterize", poseSet.name);
+		Bench::Report("Occlusion", measurement, rasterizeTime, "us");
+		snprintf(measurement, sizeof(measurement), "%s, rasterized triangles", poseSet.name);
+		Bench::Report("Occlusion", measurement, static_cast<double>(triangleCount) / POSE_COUNT, "per pose");
+		snprintf(measurement, sizeof(measurement), "%s, sphere test", poseSet.name);
+		Bench::Report("Occlusion", measurement, 1000.0 * testTime / (POSE_COUNT * nodeSpheres.size()), "ns");
+		snprintf(measurement, sizeof(measurement), "%s, occluded tree nodes", poseSet.name);
+		Bench::Report("Occlusion", measurement, 100.0 * occludedCount / (POSE_COUNT * nodeSpheres.size()), "%");
+		snprintf(measurement, sizeof(measurement), "%s, nodes occluded in default cull", poseSet.name);
+		Bench::Report("Occlusion", measurement, static_cast<double>(culledOccludedCount) / POSE_COUNT, "per cull");
+		snprintf(measurement, sizeof(measurement), "%s, nodes occluded in cull without horizon", poseSet.name);
+		Bench::Report("Occlusion", measurement, static_cast<double>(noHorizonOccludedCount) / POSE_COUNT, "per cull");
+	}
+}
@@ -0,0 +1,109 @@
+#include "pch.h"
+#include "Bench.h"
+
+#include "HeadlessScene.h"
+#include "TessFactor.h"
+#include "WorkerPool.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// Factor linear in inverse distance, 2^tessMax at the near distance of the shader down to 1 at its far distance,
+	// without rounding to powers of two.
+	float CalcInverseDistanceFactor(const XMFLOAT3& planePos, const TessParameters& parameters)
+	{
+		constexpr float NEAR_DISTANCE = 10.0f;
+		constexpr float FAR_DISTANCE = 150.0f;
+
+		const XMVECTOR spherePos = XMVector3Normalize(XMLoadFloat3(&planePos)) * QUAD_SPHERE_RADIUS;
+		const float distance = XMVectorGetX(XMVector3Length(spherePos - XMLoadFloat3(&parameters.cameraPosition)));
+		const float t = (1.0f / std::min(std::max(distance, NEAR_DISTANCE), FAR_DISTANCE) - 1.0f / FAR_DISTANCE) /
+			(1.0f / NEAR_DISTANCE - 1.0f / FAR_DISTANCE);
+		return 1.0f + (powf(2.0f, parameters.tessMax) - 1.0f) * t;
+	}
+}
+
+// Triangles the tessellator emits for the camera view of a default cull, predicted from the hull shader factors
+// of every drawn patch, with the factor formula of the shader and an inverse distance one.
+// Poses as in Occlusion, tess factors as Apollo starts with.
+BENCHMARK(TessTriangles)
+{
+	constexpr uint32_t SUB_DIVIDE_COUNT = 8;	// Default of Apollo.
+	constexpr uint32_t POSE_COUNT = 16;
+	constexpr uint32_t RUN_COUNT = 3;
+
+	WorkerPool pool(0);
+	HeadlessScene scene(SUB_DIVIDE_COUNT, &pool);
+	const HeadlessScene::Settings settings;
+
+	TessParameters parameters;
+	parameters.quadWidth = 300.0f / powf(2.0f, TESS_GROUP_QUAD_LEVEL);
+	parameters.unitCount = powf(2.0f, static_cast<float>(SUB_DIVIDE_COUNT - TESS_GROUP_QUAD_LEVEL));
+	parameters.tessMax = 8.0f;
+
+	const struct
+	{
+		const char*						name;
+		TessFactor::FactorFunction		factor;
+	} factors[] =
+	{
+		{ "shader factor", TessFactor::CalcDistanceFactor },
+		{ "inverse distance factor", CalcInverseDistanceFactor },
+	};
+
+	const struct
+	{
+		const char*							name;
+		std::vector<HeadlessScene::Pose>	poses;
+	} poseSets[] =
+	{
+		{ "low altitude", HeadlessScene::CreateRandomPoses(POSE_COUNT, 3, 0.5f, 5.0f) },
+		{ "high altitude", HeadlessScene::CreateRandomPoses(POSE_COUNT, 5, 50.0f, 350.0f) },
+	};
+
+	const VertexTess* vertices = scene.GetVertices().data();
+	const uint32_t* indices = scene.GetIndices().data();
+	for (const auto& poseSet : poseSets)
+	{
+		// Each pose is culled once, counting only reads the ranges.
+		std::vector<std::vector<IndexRange>> poseRanges;
+		for (const HeadlessScene::Pose& pose : poseSet.poses)
+		{
+			scene.Cull(pose, settings, pool);
+
+			std::vector<IndexRange> ranges;
+			for (const FaceTree* faceTree : scene.GetFaceTrees())
+			{
+				const std::vector<IndexRange>& faceRanges = faceTree->GetIndexRanges(HeadlessScene::CAMERA_VIEW).GetRanges();
+				ranges.insert(ranges.end(), faceRanges.begin(), faceRanges.end());
+			}
+			poseRanges.push_back(std::move(ranges));
+		}
+
+		for (const auto& factor : factors)
+		{
+			uint64_t triangleCount = 0;
+			const double time = Bench::MeasureMicroseconds(RUN_COUNT, [&]()
+			{
+				triangleCount = 0;
+				for (uint32_t p = 0; p < POSE_COUNT; p++)
+				{
+					TessParameters poseParameters = parameters;
+					poseParameters.cameraPosition = poseSet.poses[p].cameraPosition;
+					for (const IndexRange& range : poseRanges[p])
+					{
+						triangleCount += TessFactor::CountTriangles(
+							vertices, indices + range.start, range.count, range.lod, poseParameters, factor.factor);
+					}
+				}
+			}) / POSE_COUNT;
+
+			char measurement[96];
+			snprintf(measurement, sizeof(measurement), "%s, %s, triangles", poseSet.name, factor.name);
+			Bench::Report("TessTriangles", measurement, static_cast<double>(triangleCount) / POSE_COUNT, "per frame");
+			snprintf(measurement, sizeof(measurement), "%s, %s, count time", poseSet.name, factor.name);
+			Bench::Report("TessTriangles", measurement, time / 1000.0, "ms");
+		}
+	}
+}
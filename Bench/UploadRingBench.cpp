@@ -0,0 +1,50 @@
+#include "pch.h"
+#include "Bench.h"
+
+#include "UploadRing.h"
+
+#include <random>
+
+// Allocation cost of the upload ring with three frames in flight, where the fence lags two frames behind
+// as with the swap chain, and how often a frame has to wait when the ring is sized tightly.
+BENCHMARK(UploadRing)
+{
+	constexpr uint32_t FRAME_COUNT = 2000;
+	constexpr uint32_t ALLOCATIONS_PER_FRAME = 64;
+	constexpr uint64_t FRAME_LAG = 2;
+
+	const uint64_t ringSizes[] = { 4u << 20, 1u << 20, 512u << 10, 256u << 10 };
+	for (uint64_t ringSize : ringSizes)
+	{
+		std::mt19937 random(1);
+		std::uniform_int_distribution<uint64_t> size(64, 4096);
+
+		UploadRing ring(std::unique_ptr<UploadRingBackend>(new CpuUploadRingBackend(ringSize)));
+		CpuUploadRingBackend& backend = static_cast<CpuUploadRingBackend&>(ring.GetBackend());
+
+		uint64_t fenceValue = 0;
+		const double time = Bench::MeasureMicroseconds(1, [&]()
+		{
+			for (uint32_t frame = 0; frame < FRAME_COUNT; frame++)
+			{
+				for (uint32_t a = 0; a < ALLOCATIONS_PER_FRAME; a++)
+				{
+					ring.Allocate(size(random), 256);
+				}
+
+				ring.FinishFrame(++fenceValue);
+				if (fenceValue > FRAME_LAG)
+					backend.SetCompletedFenceValue(std::max(backend.GetCompletedFenceValue(), fenceValue - FRAME_LAG));
+			}
+		});
+
+		// Ring state also holds the untimed warm-up run.
+		char measurement[64];
+		snprintf(measurement, sizeof(measurement), "%llu KB ring, time per allocation", static_cast<unsigned long long>(ringSize >> 10));
+		Bench::Report("UploadRing", measurement, 1000.0 * time / (FRAME_COUNT * ALLOCATIONS_PER_FRAME), "ns");
+		snprintf(measurement, sizeof(measurement), "%llu KB ring, waits per frame", static_cast<unsigned long long>(ringSize >> 10));
+		Bench::Report("UploadRing", measurement, ring.GetWaitCount() / (2.0 * FRAME_COUNT), "");
+		snprintf(measurement, sizeof(measurement), "%llu KB ring, peak use", static_cast<unsigned long long>(ringSize >> 10));
+		Bench::Report("UploadRing", measurement, ring.GetPeakUsedSize() / 1024.0, "KB");
+	}
+}
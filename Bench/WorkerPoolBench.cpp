@@ -0,0 +1,52 @@
+#include "pch.h"
+#include "Bench.h"
+
+#include "WorkerPool.h"
+
+#include <vector>
+
+// Cost of the job system itself: one empty job, an empty ParallelFor over the six faces,
+// and a reduce of 6144 small tasks with a grain of 1 and 64, for 1 to 6 threads including the calling one.
+BENCHMARK(WorkerPool)
+{
+	constexpr uint32_t RUN_COUNT = 2000;
+	constexpr uint32_t TASK_COUNT = 6 * 1024;
+
+	for (uint32_t threadCount : { 1u, 2u, 4u, 6u })
+	{
+		WorkerPool pool(threadCount - 1);
+
+		const double spawn = Bench::MeasureMicroseconds(RUN_COUNT, [&]()
+		{
+			WorkerPool::Counter counter;
+			pool.Spawn(counter, []() {});
+			pool.Wait(counter);
+		});
+
+		const double emptyLoop = Bench::MeasureMicroseconds(RUN_COUNT, [&]()
+		{
+			pool.ParallelFor(6, [](uint32_t) {});
+		});
+
+		std::vector<float> partial(TASK_COUNT);
+		const auto task = [&](uint32_t i)
+		{
+			float sum = 0.0f;
+			for (uint32_t k = 0; k < 200; k++)
+				sum += sinf(static_cast<float>(i * 200 + k) * 0.001f) * 1e-3f;
+			partial[i] = sum;
+		};
+		const double reduce = Bench::MeasureMicroseconds(20, [&]() { pool.ParallelFor(TASK_COUNT, task); });
+		const double grainedReduce = Bench::MeasureMicroseconds(20, [&]() { pool.ParallelFor(TASK_COUNT, task, 64); });
+
+		char measurement[64];
+		snprintf(measurement, sizeof(measurement), "%u threads, spawn and wait one empty job", threadCount);
+		Bench::Report("WorkerPool", measurement, spawn, "us");
+		snprintf(measurement, sizeof(measurement), "%u threads, empty ParallelFor(6)", threadCount);
+		Bench::Report("WorkerPool", measurement, emptyLoop, "us");
+		snprintf(measurement, sizeof(measurement), "%u threads, reduce of 6144 tasks, grain 1", threadCount);
+		Bench::Report("WorkerPool", measurement, reduce, "us");
+		snprintf(measurement, sizeof(measurement), "%u threads, reduce of 6144 tasks, grain 64", threadCount);
+		Bench::Report("WorkerPool", measurement, grainedReduce, "us");
+	}
+}
@@ -0,0 +1,80 @@
+#include "pch.h"
+#include "BackgroundTask.h"
+
+#include <utility>
+
+BackgroundTask::BackgroundTask()
+{
+	m_thread = std::thread(&BackgroundTask::ThreadMain, this);
+}
+
+BackgroundTask::~BackgroundTask()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_exit = true;
+	}
+	m_startCondition.notify_one();
+
+	// Thread finishes a running task first.
+	m_thread.join();
+}
+
+void BackgroundTask::Start(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_task = std::move(task);
+		m_exception = nullptr;
+		m_done = false;
+	}
+	m_startCondition.notify_one();
+
+	m_started = true;
+}
+
+bool BackgroundTask::Wait()
+{
+	if (!m_started)
+		return false;
+
+	m_started = false;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_doneCondition.wait(lock, [this]() { return m_done; });
+
+	if (m_exception)
+		std::rethrow_exception(std::exchange(m_exception, nullptr));
+
+	return true;
+}
+
+void BackgroundTask::ThreadMain()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		m_startCondition.wait(lock, [this]() { return m_exit || m_task; });
+		if (!m_task)
+			return;
+
+		std::function<void()> task = std::move(m_task);
+		m_task = nullptr;
+
+		lock.unlock();
+		std::exception_ptr exception;
+		try
+		{
+			task();
+		}
+		catch (...)
+		{
+			exception = std::current_exception();
+		}
+		lock.lock();
+
+		m_exception = exception;
+		m_done = true;
+		m_doneCondition.notify_one();
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// One persistent thread running one task at a time, for work that overlaps the frame loop.
+// Thread is created once and sleeps between tasks.
+class BackgroundTask
+{
+public:
+	BackgroundTask();
+	~BackgroundTask();
+
+	BackgroundTask(const BackgroundTask&) = delete;
+	BackgroundTask& operator=(const BackgroundTask&) = delete;
+
+	// Run task on the thread. A started task must be waited for before the next one.
+	void Start(std::function<void()> task);
+
+	// Block until the started task is done, exceptions of the task are thrown here.
+	// Returns false at once when no task was started since last wait.
+	bool Wait();
+
+	bool									IsStarted() const { return m_started; }
+
+private:
+	void ThreadMain();
+
+	std::thread								m_thread;
+
+	std::mutex								m_mutex;
+	std::condition_variable					m_startCondition;
+	std::condition_variable					m_doneCondition;
+
+	// Current task, guarded by m_mutex.
+	std::function<void()>					m_task;
+	std::exception_ptr						m_exception;
+	bool									m_done = true;
+	bool									m_exit = false;
+
+	// Only touched by the thread calling Start and Wait.
+	bool									m_started = false;
+};
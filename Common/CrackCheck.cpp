@@ -0,0 +1,328 @@
+#include "pch.h"
+#include "CrackCheck.h"
+
+#include "FaceTree.h"
+#include "FileName.h"
+#include "WorkerPool.h"
+
+#include <fstream>
+#include <random>
+#include <string>
+
+using namespace DirectX;
+
+namespace
+{
+	// Snapped coordinates are offset to stay positive in 20 bits.
+	constexpr int32_t COORDINATE_OFFSET = 1 << 19;
+	constexpr uint64_t COORDINATE_MASK = (1ull << 20) - 1;
+
+	// Spans and points closer than this in snapped units are the same.
+	constexpr double POINT_TOLERANCE = 0.5;
+
+	// Corners of DS edges 0 ~ 3, at u = 0, v = 0, u = 1 and v = 1.
+	constexpr uint32_t EDGE_CORNERS[4][2] = { { 0, 2 }, { 0, 1 }, { 1, 3 }, { 2, 3 } };
+
+	int32_t Snap(float value)
+	{
+		return static_cast<int32_t>(lroundf(value * CrackCheck::POSITION_SCALE));
+	}
+
+	uint64_t ToKeyBits(int32_t coordinate)
+	{
+		return static_cast<uint64_t>(coordinate + COORDINATE_OFFSET) & COORDINATE_MASK;
+	}
+
+	float FromKeyBits(uint64_t bits)
+	{
+		return static_cast<float>(static_cast<int32_t>(bits & COORDINATE_MASK) - COORDINATE_OFFSET) / CrackCheck::POSITION_SCALE;
+	}
+
+	// CalcLevel of the domain shader.
+	uint32_t CalcLevel(float tess, float tessMax)
+	{
+		return static_cast<uint32_t>(std::max(0.0f, (tessMax - 2.0f) - static_cast<float>(static_cast<int>(log2f(tess)))));
+	}
+}
+
+CrackCheck::CrackCheck(const VertexTess* vertices, const std::vector<uint32_t>& indices, WorkerPool* workerPool) :
+	m_vertices(vertices),
+	m_indices(indices),
+	m_workerPool(workerPool),
+	m_bucketSpans(BUCKET_COUNT)
+{
+}
+
+void CrackCheck::CheckRanges(
+	const std::vector<IndexRange>& ranges, const TessParameters& parameters, uint32_t poseIndex, Report& report,
+	TessFactor::FactorFunction factor)
+{
+	// Ranges are cut into chunks of at most CHUNK_PATCH_COUNT patches, each keeps the LOD of its range.
+	std::vector<IndexRange> chunks;
+	for (const IndexRange& range : ranges)
+	{
+		for (uint32_t offset = 0; offset < range.count; offset += 4 * CHUNK_PATCH_COUNT)
+			chunks.push_back({ range.start + offset, std::min(range.count - offset, 4 * CHUNK_PATCH_COUNT), range.lod });
+
+		report.patchCount += range.count / 4;
+	}
+
+	if (m_chunkSpans.size() < chunks.size() * BUCKET_COUNT)
+		m_chunkSpans.resize(chunks.size() * BUCKET_COUNT);
+
+	const auto buildChunk = [&](uint32_t c)
+	{
+		const IndexRange& chunk = chunks[c];
+		std::vector<EdgeSpan>* buckets = &m_chunkSpans[c * BUCKET_COUNT];
+		for (uint32_t b = 0; b < BUCKET_COUNT; b++)
+			buckets[b].clear();
+
+		// Coarse patches sample mip 0 everywhere.
+		const bool coarse = (chunk.lod & 0xF) > 0;
+
+		for (uint32_t i = chunk.start; i < chunk.start + chunk.count; i += 4)
+		{
+			const VertexTess patch[4] =
+			{
+				m_vertices[m_indices[i + 0]],
+				m_vertices[m_indices[i + 1]],
+				m_vertices[m_indices[i + 2]],
+				m_vertices[m_indices[i + 3]]
+			};
+			const PatchTess tess = TessFactor::CalcPatchTess(patch, chunk.lod, parameters, factor);
+
+			for (uint32_t e = 0; e < 4; e++)
+			{
+				const XMFLOAT3& a = patch[EDGE_CORNERS[e][0]].position;
+				const XMFLOAT3& b = patch[EDGE_CORNERS[e][1]].position;
+				const int32_t pa[3] = { Snap(a.x), Snap(a.y), Snap(a.z) };
+				const int32_t pb[3] = { Snap(b.x), Snap(b.y), Snap(b.z) };
+
+				// Patch edges run along one axis of their face.
+				uint32_t axis = 0;
+				uint32_t changedAxisCount = 0;
+				for (uint32_t k = 0; k < 3; k++)
+				{
+					if (pa[k] != pb[k])
+					{
+						axis = k;
+						changedAxisCount++;
+					}
+				}
+				if (changedAxisCount != 1)
+					continue;
+
+				EdgeSpan span;
+				span.t0 = std::min(pa[axis], pb[axis]);
+				span.t1 = std::max(pa[axis], pb[axis]);
+				span.key =
+					(static_cast<uint64_t>(axis) << 60) |
+					(ToKeyBits(pa[(axis + 1) % 3]) << 40) |
+					(ToKeyBits(pa[(axis + 2) % 3]) << 20) |
+					ToKeyBits(span.t0);
+				span.patch = i;
+				span.segmentCount = static_cast<uint16_t>(TessFactor::GetSegmentCount(tess.edgeTess[e]));
+				span.mipLevel = static_cast<uint16_t>(coarse ? 0 : CalcLevel(tess.edgeTess[e], parameters.tessMax));
+				buckets[span.key >> 56].push_back(span);
+			}
+		}
+	};
+
+	// Lines never cross buckets, so every bucket is checked into its own report.
+	Report bucketReports[BUCKET_COUNT];
+	const auto checkBucket = [&](uint32_t b)
+	{
+		std::vector<EdgeSpan>& spans = m_bucketSpans[b];
+		spans.clear();
+		for (uint32_t c = 0; c < chunks.size(); c++)
+			spans.insert(spans.end(), m_chunkSpans[c * BUCKET_COUNT + b].begin(), m_chunkSpans[c * BUCKET_COUNT + b].end());
+
+		CheckBucket(b, poseIndex, parameters.tessMax, bucketReports[b]);
+	};
+
+	if (m_workerPool)
+	{
+		m_workerPool->ParallelFor(static_cast<uint32_t>(chunks.size()), buildChunk);
+		m_workerPool->ParallelFor(BUCKET_COUNT, checkBucket);
+	}
+	else
+	{
+		for (uint32_t c = 0; c < chunks.size(); c++)
+			buildChunk(c);
+		for (uint32_t b = 0; b < BUCKET_COUNT; b++)
+			checkBucket(b);
+	}
+
+	for (const Report& bucketReport : bucketReports)
+	{
+		report.sharedEdgeCount += bucketReport.sharedEdgeCount;
+		report.crackCount += bucketReport.crackCount;
+		for (const Crack& crack : bucketReport.cracks)
+		{
+			if (report.cracks.size() < MAX_REPORTED_CRACKS)
+				report.cracks.push_back(crack);
+		}
+	}
+}
+
+void CrackCheck::CheckBucket(uint32_t bucket, uint32_t poseIndex, float tessMax, Report& report)
+{
+	std::vector<EdgeSpan>& spans = m_bucketSpans[bucket];
+	std::sort(spans.begin(), spans.end(), [](const EdgeSpan& a, const EdgeSpan& b) { return a.key < b.key; });
+
+	// Spans of one side only touch at their ends, so overlapping spans belong to patches on both sides of an edge.
+	for (size_t i = 0; i < spans.size(); i++)
+	{
+		const uint64_t line = spans[i].key >> 20;
+		for (size_t j = i + 1; j < spans.size() && (spans[j].key >> 20) == line && spans[j].t0 < spans[i].t1; j++)
+		{
+			if (spans[j].patch == spans[i].patch)
+				continue;
+
+			report.sharedEdgeCount++;
+			CheckSpans(spans[i], spans[j], poseIndex, tessMax, report);
+		}
+	}
+}
+
+void CrackCheck::CheckSpans(const EdgeSpan& a, const EdgeSpan& b, uint32_t poseIndex, float tessMax, Report& report) const
+{
+	const double overlapStart = std::max(a.t0, b.t0) - POINT_TOLERANCE;
+	const double overlapEnd = std::min(a.t1, b.t1) + POINT_TOLERANCE;
+
+	// Mips are compared once, from the first span.
+	const auto checkPoints = [&](const EdgeSpan& from, const EdgeSpan& to, bool compareMips)
+	{
+		const double fromStep = static_cast<double>(from.t1 - from.t0) / from.segmentCount;
+		const double toStep = static_cast<double>(to.t1 - to.t0) / to.segmentCount;
+
+		for (uint32_t k = 0; k <= from.segmentCount; k++)
+		{
+			const double t = from.t0 + k * fromStep;
+			if (t < overlapStart || t > overlapEnd)
+				continue;
+
+			const double j = std::round((t - to.t0) / toStep);
+			if (fabs(to.t0 + j * toStep - t) > POINT_TOLERANCE)
+			{
+				AddCrack(CrackType::TJunction, from, to, t, poseIndex, tessMax, report);
+				continue;
+			}
+
+			if (compareMips)
+			{
+				const uint32_t fromMip = k == 0 || k == from.segmentCount ? 0 : from.mipLevel;
+				const uint32_t toMip = j == 0 || j == to.segmentCount ? 0 : to.mipLevel;
+				if (fromMip != toMip)
+					AddCrack(CrackType::MipMismatch, from, to, t, poseIndex, tessMax, report);
+			}
+		}
+	};
+
+	checkPoints(a, b, true);
+	checkPoints(b, a, false);
+}
+
+void CrackCheck::AddCrack(
+	CrackType type, const EdgeSpan& a, const EdgeSpan& b, double t, uint32_t poseIndex, float tessMax,
+	Report& report) const
+{
+	report.crackCount++;
+	if (report.cracks.size() >= MAX_REPORTED_CRACKS)
+		return;
+
+	const uint32_t axis = static_cast<uint32_t>(a.key >> 60);
+	float position[3];
+	position[axis] = static_cast<float>(t) / POSITION_SCALE;
+	position[(axis + 1) % 3] = FromKeyBits(a.key >> 40);
+	position[(axis + 2) % 3] = FromKeyBits(a.key >> 20);
+
+	Crack crack;
+	crack.type = type;
+	crack.position = XMFLOAT3(position[0], position[1], position[2]);
+	crack.patches[0] = a.patch;
+	crack.patches[1] = b.patch;
+	crack.poseIndex = poseIndex;
+	crack.tessMax = tessMax;
+	report.cracks.push_back(crack);
+}
+
+CrackCheck::Report CrackCheck::Sweep(
+	const std::vector<XMFLOAT3>& poses, const std::vector<FaceTree*>& faceTrees, LodGrid& lodGrid,
+	const LodView& lodView, const TessParameters& parameters, const std::vector<float>& tessMaxes,
+	TessFactor::FactorFunction factor)
+{
+	Report report;
+	report.poseCount = static_cast<uint32_t>(poses.size());
+
+	IndexRangeList ranges;
+	for (uint32_t p = 0; p < poses.size(); p++)
+	{
+		LodView view = lodView;
+		view.cameraPosition = poses[p];
+		for (FaceTree* faceTree : faceTrees)
+			faceTree->SelectLod(view);
+		if (view.enabled)
+			lodGrid.Balance(faceTrees);
+
+		ranges.Clear();
+		for (const FaceTree* faceTree : faceTrees)
+			faceTree->AppendSelectedRanges(ranges);
+
+		for (const float tessMax : tessMaxes)
+		{
+			TessParameters poseParameters = parameters;
+			poseParameters.cameraPosition = poses[p];
+			poseParameters.tessMax = tessMax;
+			CheckRanges(ranges.GetRanges(), poseParameters, p, report, factor);
+		}
+	}
+
+	return report;
+}
+
+std::vector<XMFLOAT3> CrackCheck::CreateRandomPoses(uint32_t count, uint32_t seed, float minAltitude, float maxAltitude)
+{
+	std::mt19937 random(seed);
+	std::normal_distribution<float> normal;
+	std::uniform_real_distribution<float> uniform;
+
+	std::vector<XMFLOAT3> poses(count);
+	for (XMFLOAT3& pose : poses)
+	{
+		// Normal components give uniform directions.
+		XMFLOAT3 direction;
+		do
+		{
+			direction = XMFLOAT3(normal(random), normal(random), normal(random));
+		} while (direction.x * direction.x + direction.y * direction.y + direction.z * direction.z < 1e-6f);
+
+		const float altitude = minAltitude * powf(maxAltitude / minAltitude, uniform(random));
+		const float radius = QUAD_SPHERE_RADIUS + MAX_HEIGHT_DISPLACEMENT + altitude;
+		XMStoreFloat3(&pose, XMVector3Normalize(XMLoadFloat3(&direction)) * radius);
+	}
+
+	return poses;
+}
+
+bool CrackCheck::LoadPoses(const wchar_t* fileName, std::vector<XMFLOAT3>& poses)
+{
+	std::ifstream file(FileName::ToNative(fileName));
+	if (!file)
+		return false;
+
+	XMFLOAT3 pose;
+	while (file >> pose.x >> pose.y >> pose.z)
+		poses.push_back(pose);
+
+	return true;
+}
+
+bool CrackCheck::AppendPose(const wchar_t* fileName, const XMFLOAT3& pose)
+{
+	std::ofstream file(FileName::ToNative(fileName), std::ios::out | std::ios::app);
+	file.precision(9);
+	file << pose.x << ' ' << pose.y << ' ' << pose.z << '\n';
+
+	return file.good();
+}
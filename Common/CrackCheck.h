@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <DirectXMath.h>
+
+#include "IndexRange.h"
+#include "LodGrid.h"
+#include "TessFactor.h"
+
+class FaceTree;
+class WorkerPool;
+struct VertexTess;
+
+// Finds cracks between drawn patches from hull shader factors computed on CPU.
+// Patch edges are split into spans on the axis aligned lines of the cube faces, so edges of neighbouring nodes,
+// coarse patches and cube seams meet on one line. Where spans of two patches overlap, every tessellated point of one
+// must be a point of the other sampling the same mip level in the domain shader, else the surface opens there.
+// Spans are built in patch chunks and checked in line buckets on the worker pool.
+class CrackCheck
+{
+public:
+	enum class CrackType
+	{
+		TJunction,		// Point on one side only.
+		MipMismatch,	// Same point, displaced from different mip levels.
+	};
+
+	struct Crack
+	{
+		CrackType							type;
+		DirectX::XMFLOAT3					position;		// On cube face.
+		uint32_t							patches[2];		// First index of both patches.
+		uint32_t							poseIndex;
+		float								tessMax;
+	};
+
+	struct Report
+	{
+		uint32_t							poseCount = 0;
+		uint64_t							patchCount = 0;
+		uint64_t							sharedEdgeCount = 0;	// Overlapping span pairs.
+		uint64_t							crackCount = 0;
+		std::vector<Crack>					cracks;					// First MAX_REPORTED_CRACKS.
+	};
+
+	static constexpr uint32_t				MAX_REPORTED_CRACKS = 64;
+
+	// Positions on cube face are snapped to 1 / POSITION_SCALE, far below the smallest tessellated segment.
+	static constexpr float					POSITION_SCALE = 2048.0f;
+
+	static constexpr uint32_t				CHUNK_PATCH_COUNT = 16384;
+	static constexpr uint32_t				BUCKET_COUNT = 64;		// Top bits of the span key.
+
+	// Vertices and indices of the static buffers, coarse indices included.
+	CrackCheck(const VertexTess* vertices, const std::vector<uint32_t>& indices, WorkerPool* workerPool = nullptr);
+
+	// Check patches of given draw ranges as drawn with given parameters, adds to report.
+	// Factor function is called from several threads at once.
+	void CheckRanges(
+		const std::vector<IndexRange>& ranges, const TessParameters& parameters, uint32_t poseIndex, Report& report,
+		TessFactor::FactorFunction factor = TessFactor::CalcDistanceFactor);
+
+	// Select and balance LOD at every pose, then check the selected nodes with each tessMax.
+	// LOD selection of the face trees is left at the last pose.
+	Report Sweep(
+		const std::vector<DirectX::XMFLOAT3>& poses, const std::vector<FaceTree*>& faceTrees, LodGrid& lodGrid,
+		const LodView& lodView, const TessParameters& parameters, const std::vector<float>& tessMaxes,
+		TessFactor::FactorFunction factor = TessFactor::CalcDistanceFactor);
+
+	// Camera positions in random directions, altitude above the highest surface log uniform in [minAltitude, maxAltitude].
+	static std::vector<DirectX::XMFLOAT3> CreateRandomPoses(uint32_t count, uint32_t seed, float minAltitude, float maxAltitude);
+
+	// Recorded poses are text, one "x y z" camera position per line.
+	static bool LoadPoses(const wchar_t* fileName, std::vector<DirectX::XMFLOAT3>& poses);
+	static bool AppendPose(const wchar_t* fileName, const DirectX::XMFLOAT3& pose);
+
+private:
+	// One patch edge on a cube face line, t0 < t1 in snapped units along the line.
+	// Key is axis, the two fixed coordinates and t0, 2 + 3 x 20 bits, so sorted keys group lines.
+	struct EdgeSpan
+	{
+		uint64_t							key;
+		int32_t								t0;
+		int32_t								t1;
+		uint32_t							patch;
+		uint16_t							segmentCount;
+		uint16_t							mipLevel;		// Of points between the corners, corners sample mip 0.
+	};
+
+	void CheckBucket(uint32_t bucket, uint32_t poseIndex, float tessMax, Report& report);
+	void CheckSpans(const EdgeSpan& a, const EdgeSpan& b, uint32_t poseIndex, float tessMax, Report& report) const;
+	void AddCrack(
+		CrackType type, const EdgeSpan& a, const EdgeSpan& b, double t, uint32_t poseIndex, float tessMax,
+		Report& report) const;
+
+	const VertexTess*						m_vertices;
+	const std::vector<uint32_t>&			m_indices;
+	WorkerPool*								m_workerPool;
+
+	// BUCKET_COUNT span lists per chunk, then every bucket gathered and sorted on its own.
+	std::vector<std::vector<EdgeSpan>>		m_chunkSpans;
+	std::vector<std::vector<EdgeSpan>>		m_bucketSpans;
+};
@@ -1,88 +1,1098 @@
 #include "pch.h"
 #include "FaceTree.h"
 
-FaceTree::FaceTree(QuadNode* rootNode, UINT32 faceIndexCount)
+#include "OcclusionBuffer.h"
+
+using namespace DirectX;
+
+// NodePool lives in its header only, its constant is passed by reference here.
+constexpr uint32_t NodePool::INVALID_BLOCK;
+
+FaceTree::FaceTree(uint32_t baseAddress, uint32_t faceIndexCount, uint32_t maxLevel)
 {
-	m_rootNode = rootNode;
 	m_faceIndexCount = faceIndexCount;
-	m_renderIndexData = std::vector<uint32_t>(m_faceIndexCount);
+	m_maxLevel = maxLevel;
+
+	m_leafCount = 1u << (2 * m_maxLevel);
+
+	// Tessellation groups are quads of TESS_GROUP_QUAD_LEVEL, or leaves when the face grid is too coarse for them.
+	const uint32_t groupLevel = m_faceIndexCount >= (4u << (2 * TESS_GROUP_QUAD_LEVEL)) ? TESS_GROUP_QUAD_LEVEL : m_maxLevel;
+	m_groupCount = 1u << (2 * groupLevel);
+	m_groupIndexCount = m_faceIndexCount / m_groupCount;
+
+	// Visible nodes are merged when adjacent, so leaf count bounds the range count.
+	// Every split block replaces one drawn node with up to four. Flat sweep draws at most every other group.
+	m_maxRangeCount = std::max(m_leafCount + 3 * DETAIL_BLOCK_CAPACITY, (m_groupCount + 1) / 2);
+	for (ViewDraws& viewDraws : m_views)
+	{
+		viewDraws.indexRanges = IndexRangeList(m_maxRangeCount);
+		viewDraws.uploadedRanges.resize(m_maxRangeCount, {});
+		viewDraws.dirtyArgumentRuns.reserve(m_maxRangeCount);
+	}
+
+	const uint32_t leafMaskSize = (m_leafCount + 63) / 64;
+	m_visibleLeafMask.resize(leafMaskSize, 0);
+	m_prevVisibleLeafMask.resize(leafMaskSize, 0);
+
+	m_leafLodLevels.resize(m_leafCount, static_cast<uint8_t>(m_maxLevel));
+	m_leafLodEdges.resize(m_leafCount, 0);
+
+	// Detail node memory is taken once, nodes only move between pool and tree later.
+	m_nodePool = NodePool(DETAIL_BLOCK_CAPACITY);
+	const uint32_t detailNodeCapacity = m_nodePool.GetNodeCapacity();
+	m_leafChildBlocks.resize(m_leafCount, NodePool::INVALID_BLOCK);
+	m_detailLevels.resize(detailNodeCapacity);
+	m_detailBaseAddresses.resize(detailNodeCapacity);
+	m_detailIndexCounts.resize(detailNodeCapacity);
+	m_detailCorners.resize(4 * detailNodeCapacity);
+	m_detailSphereCenters.resize(detailNodeCapacity);
+	m_detailSphereRadii.resize(detailNodeCapacity);
+	m_detailConeAxes.resize(detailNodeCapacity);
+	m_detailConeSinHalfAngles.resize(detailNodeCapacity);
+	m_detailConeCosHalfAngles.resize(detailNodeCapacity);
+	m_detailChildBlocks.resize(detailNodeCapacity, NodePool::INVALID_BLOCK);
+	m_detailCullingBounds.Resize(detailNodeCapacity);
+	m_blockParents.resize(DETAIL_BLOCK_CAPACITY, NodePool::INVALID_BLOCK);
+	m_blockLastUsedCulls.resize(DETAIL_BLOCK_CAPACITY, 0);
+	m_splitRequests.reserve(MAX_SPLITS_PER_CULL);
+
+	// Whole tree is allocated up front, node address and size only depend on position in tree.
+	const uint32_t nodeCount = GetNodeCount(m_maxLevel);
+	m_nodeLevels.resize(nodeCount);
+	m_nodeBaseAddresses.resize(nodeCount);
+	m_nodeIndexCounts.resize(nodeCount);
+	m_obbCenters.resize(nodeCount);
+	m_obbExtents.resize(nodeCount);
+	m_obbOrientations.resize(nodeCount);
+	m_sphereCenters.resize(nodeCount);
+	m_sphereRadii.resize(nodeCount);
+	m_coneAxes.resize(nodeCount);
+	m_coneSinHalfAngles.resize(nodeCount);
+	m_coneCosHalfAngles.resize(nodeCount);
+	m_heightRanges.resize(nodeCount, XMFLOAT2(0.0f, MAX_HEIGHT_DISPLACEMENT));
+	m_nodeCorners.resize(4 * nodeCount);
+	m_cullingBounds.Resize(nodeCount);
+
+	m_groupCorners.resize(4 * m_groupCount);
+	m_groupSphereCenters.resize(m_groupCount);
+	m_groupSphereRadii.resize(m_groupCount);
+	m_groupConeAxes.resize(m_groupCount);
+	m_groupConeSinHalfAngles.resize(m_groupCount);
+	m_groupConeCosHalfAngles.resize(m_groupCount);
+	m_groupCullingBounds.Resize(m_groupCount);
+	m_groupViewMasks.resize(m_groupCount);
+	m_groupResults.resize(m_groupCount);
+
+	m_nodeLevels[0] = 0;
+	m_nodeBaseAddresses[0] = baseAddress;
+	m_nodeIndexCounts[0] = faceIndexCount;
+	for (uint32_t node = 1; node < nodeCount; node++)
+	{
+		const uint32_t parent = (node - 1) / 4;
+		const uint32_t c = (node - 1) % 4;
+		const uint32_t qic = m_nodeIndexCounts[parent] / 4;
+
+		m_nodeLevels[node] = m_nodeLevels[parent] + 1;
+		m_nodeBaseAddresses[node] = m_nodeBaseAddresses[parent] + c * qic;
+		m_nodeIndexCounts[node] = qic;
+	}
+
+	// Coarse node is drawn with as many patches as a leaf.
+	m_coarseIndexCount = m_nodeIndexCounts[nodeCount - 1];
 }
 
 FaceTree::~FaceTree()
 {
-	m_staticIB.Reset();
-	m_uploadIB.Reset();
-	delete m_rootNode;
+#if !defined(APOLLO_HEADLESS)
+	for (ViewDraws& viewDraws : m_views)
+		viewDraws.argumentBuffer.Reset();
+#endif
+}
+
+void FaceTree::Build(
+	const uint32_t corner[4], float width,
+	std::vector<VertexTess>& vertices,
+	const std::vector<uint32_t>& indices)
+{
+	// Build nodes level by level, so every node is written in its breadth-first slot.
+	std::vector<QuadNode> levelNodes;
+	levelNodes.emplace_back(0, m_faceIndexCount, corner, m_nodeBaseAddresses[0], width);
+
+	uint32_t node = 0;
+	for (uint32_t level = 0; level <= m_maxLevel; level++)
+	{
+		std::vector<QuadNode> nextLevelNodes;
+		nextLevelNodes.reserve(levelNodes.size() * 4);
+
+		for (QuadNode& quadNode : levelNodes)
+		{
+			quadNode.CalcCenter(vertices, indices);
+			SetNodeBounds(node++, { quadNode.GetBounds(), quadNode.GetBoundingSphere(), quadNode.GetNormalCone() });
+
+			if (level < m_maxLevel)
+			{
+				for (int c = 0; c < 4; c++)
+					nextLevelNodes.push_back(quadNode.CreateChild(c, indices));
+			}
+		}
+
+		levelNodes.swap(nextLevelNodes);
+	}
+}
+
+FaceTree::NodeBounds FaceTree::GetNodeBounds(uint32_t node) const
+{
+	NodeBounds bounds;
+	bounds.box = BoundingOrientedBox(m_obbCenters[node], m_obbExtents[node], m_obbOrientations[node]);
+	bounds.sphere = BoundingSphere(m_sphereCenters[node], m_sphereRadii[node]);
+	bounds.normalCone = XMFLOAT4(
+		m_coneAxes[node].x, m_coneAxes[node].y, m_coneAxes[node].z,
+		atan2(m_coneSinHalfAngles[node], m_coneCosHalfAngles[node]));
+	return bounds;
+}
+
+void FaceTree::SetNodeBounds(uint32_t node, const NodeBounds& bounds)
+{
+	m_obbCenters[node] = bounds.box.Center;
+	m_obbExtents[node] = bounds.box.Extents;
+	m_obbOrientations[node] = bounds.box.Orientation;
+	m_sphereCenters[node] = bounds.sphere.Center;
+	m_sphereRadii[node] = bounds.sphere.Radius;
+	m_coneAxes[node] = XMFLOAT3(bounds.normalCone.x, bounds.normalCone.y, bounds.normalCone.z);
+	m_coneSinHalfAngles[node] = sin(bounds.normalCone.w);
+	m_coneCosHalfAngles[node] = cos(bounds.normalCone.w);
+	m_cullingBounds.Set(node, bounds.box);
+}
+
+const char* FaceTree::GetCullingModeName(CullingMode mode)
+{
+	switch (mode)
+	{
+	case CullingMode::FlatSweep:
+		return "Flat sweep";
+	default:
+		return "Hierarchy";
+	}
+}
+
+uint32_t FaceTree::GetNodeCount(uint32_t maxLevel)
+{
+	return ((1u << (2 * (maxLevel + 1))) - 1) / 3;
+}
+
+void FaceTree::CreateCoarseIndices(
+	const std::vector<uint32_t>& indices, uint32_t coarseBaseAddress,
+	std::vector<uint32_t>& coarseIndices)
+{
+	m_coarseBaseAddress = coarseBaseAddress;
+
+	// Corner k of a block is the first index of its k-th quarter, see QuadNode::CreateChild.
+	const uint32_t patchCount = m_coarseIndexCount / 4;
+	for (uint32_t node = 0; node < GetFirstLeafNode(); node++)
+	{
+		const uint32_t blockIndexCount = m_nodeIndexCounts[node] / patchCount;
+		for (uint32_t patch = 0; patch < patchCount; patch++)
+		{
+			const uint32_t blockBase = m_nodeBaseAddresses[node] + patch * blockIndexCount;
+			for (uint32_t k = 0; k < 4; k++)
+				coarseIndices.push_back(indices[blockBase + k * blockIndexCount / 4]);
+		}
+	}
+}
+
+void FaceTree::SelectLod(IN const LodView& view)
+{
+	std::fill(m_leafLodEdges.begin(), m_leafLodEdges.end(), 0);
+
+	if (!view.enabled)
+	{
+		std::fill(m_leafLodLevels.begin(), m_leafLodLevels.end(), static_cast<uint8_t>(m_maxLevel));
+		return;
+	}
+
+	// Depth-first walk, the first accepted node covers all of its leaves.
+	uint32_t stack[4 * QUAD_NODE_MAX_LEVEL + 1];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const uint32_t node = stack[--stackSize];
+		const uint32_t level = m_nodeLevels[node];
+
+		if (level == m_maxLevel || IsLodAccepted(node, view))
+		{
+			// Leaves of a node are contiguous in breadth-first order.
+			uint32_t firstLeaf = node;
+			for (uint32_t l = level; l < m_maxLevel; l++)
+				firstLeaf = 4 * firstLeaf + 1;
+			firstLeaf -= GetFirstLeafNode();
+
+			const uint32_t leafCount = 1u << (2 * (m_maxLevel - level));
+			std::fill_n(m_leafLodLevels.begin() + firstLeaf, leafCount, static_cast<uint8_t>(level));
+			continue;
+		}
+
+		for (uint32_t c = 0; c < 4; c++)
+			stack[stackSize++] = 4 * node + 1 + c;
+	}
+}
+
+void FaceTree::AppendSelectedRanges(IndexRangeList& ranges) const
+{
+	const uint32_t firstLeaf = GetFirstLeafNode();
+	for (uint32_t node = 0; node < GetNodeCount(); node++)
+	{
+		const uint32_t level = m_nodeLevels[node];
+
+		uint32_t nodeFirstLeaf = node;
+		for (uint32_t l = level; l < m_maxLevel; l++)
+			nodeFirstLeaf = 4 * nodeFirstLeaf + 1;
+		nodeFirstLeaf -= firstLeaf;
+
+		// Leaves below a selected node carry its level, so only the selected node matches its own.
+		if (m_leafLodLevels[nodeFirstLeaf] != level)
+			continue;
+
+		const uint32_t edges = m_leafLodEdges[nodeFirstLeaf];
+		const uint32_t patchLod = LodGrid::EncodePatchLod(m_maxLevel - level, level, edges & 0xF, edges >> 4);
+		if (level < m_maxLevel)
+			ranges.Append(m_coarseBaseAddress + node * m_coarseIndexCount, m_coarseIndexCount, patchLod);
+		else
+			ranges.Append(m_nodeBaseAddresses[node], m_nodeIndexCounts[node], patchLod);
+	}
+}
+
+void FaceTree::InitDetail(const VertexTess* vertices, const std::vector<uint32_t>& indices)
+{
+	// Corner k of a node is the first index of its k-th quarter, see QuadNode::CreateChild.
+	for (uint32_t node = 0; node < GetNodeCount(); node++)
+	{
+		const uint32_t quarterIndexCount = m_nodeIndexCounts[node] / 4;
+		for (uint32_t k = 0; k < 4; k++)
+			m_nodeCorners[4 * node + k] = vertices[indices[m_nodeBaseAddresses[node] + k * quarterIndexCount]].position;
+	}
+
+	const uint32_t groupQuarterIndexCount = m_groupIndexCount / 4;
+	for (uint32_t group = 0; group < m_groupCount; group++)
+	{
+		const uint32_t baseAddress = m_nodeBaseAddresses[0] + group * m_groupIndexCount;
+		for (uint32_t k = 0; k < 4; k++)
+			m_groupCorners[4 * group + k] = vertices[indices[baseAddress + k * groupQuarterIndexCount]].position;
+	}
+}
+
+float FaceTree::GetMaxSlope(const XMFLOAT3 corners[4]) const
+{
+	// Heights per radian of the map, over the radians of the undisplaced sphere.
+	if (!m_heightMap)
+		return FLT_MAX;
+	return m_heightMap->GetMaxSlope(corners) * MAX_HEIGHT_DISPLACEMENT / QUAD_SPHERE_RADIUS;
+}
+
+void FaceTree::InitHeightBounds(const HeightMap* heightMap)
+{
+	m_heightMap = heightMap;
+
+	for (uint32_t node = 0; node < GetNodeCount(); node++)
+	{
+		float minHeight = 0.0f;
+		float maxHeight = 1.0f;
+		if (m_heightMap)
+			m_heightMap->GetHeightRange(&m_nodeCorners[4 * node], minHeight, maxHeight);
+
+		m_heightRanges[node] = XMFLOAT2(minHeight * MAX_HEIGHT_DISPLACEMENT, maxHeight * MAX_HEIGHT_DISPLACEMENT);
+
+		NodeBounds bounds;
+		QuadNode::CalcBounds(
+			&m_nodeCorners[4 * node], m_heightRanges[node].x, m_heightRanges[node].y, GetMaxSlope(&m_nodeCorners[4 * node]),
+			bounds.box, bounds.sphere, bounds.normalCone);
+		SetNodeBounds(node, bounds);
+	}
+
+	for (uint32_t group = 0; group < m_groupCount; group++)
+	{
+		float minHeight = 0.0f;
+		float maxHeight = 1.0f;
+		if (m_heightMap)
+			m_heightMap->GetHeightRange(&m_groupCorners[4 * group], minHeight, maxHeight);
+
+		NodeBounds bounds;
+		QuadNode::CalcBounds(
+			&m_groupCorners[4 * group], minHeight * MAX_HEIGHT_DISPLACEMENT, maxHeight * MAX_HEIGHT_DISPLACEMENT,
+			GetMaxSlope(&m_groupCorners[4 * group]), bounds.box, bounds.sphere, bounds.normalCone);
+
+		m_groupSphereCenters[group] = bounds.sphere.Center;
+		m_groupSphereRadii[group] = bounds.sphere.Radius;
+		m_groupConeAxes[group] = XMFLOAT3(bounds.normalCone.x, bounds.normalCone.y, bounds.normalCone.z);
+		m_groupConeSinHalfAngles[group] = sin(bounds.normalCone.w);
+		m_groupConeCosHalfAngles[group] = cos(bounds.normalCone.w);
+		m_groupCullingBounds.Set(group, bounds.box);
+	}
+}
+
+void FaceTree::ValidateBounds(
+	const std::vector<XMFLOAT3>& patchGrids, uint32_t segmentCount, uint32_t gridCount, BoundsReport& report) const
+{
+	// Triangle normals do not depend on the node, 2 per grid cell split along its 0 - 3 diagonal like a base patch.
+	// Winding is not relied on, normals are turned away from the sphere center.
+	const uint32_t rowSize = segmentCount + 1;
+	const size_t gridTotal = patchGrids.size() / (rowSize * rowSize);
+	std::vector<XMFLOAT3> patchNormals(gridTotal * 2 * segmentCount * segmentCount);
+	for (size_t grid = 0; grid < gridTotal; grid++)
+	{
+		const XMFLOAT3* points = &patchGrids[grid * rowSize * rowSize];
+		XMFLOAT3* normals = &patchNormals[grid * 2 * segmentCount * segmentCount];
+		for (uint32_t j = 0; j < segmentCount; j++)
+		{
+			for (uint32_t i = 0; i < segmentCount; i++)
+			{
+				const XMVECTOR p0 = XMLoadFloat3(&points[j * rowSize + i]);
+				const XMVECTOR p1 = XMLoadFloat3(&points[j * rowSize + i + 1]);
+				const XMVECTOR p2 = XMLoadFloat3(&points[(j + 1) * rowSize + i]);
+				const XMVECTOR p3 = XMLoadFloat3(&points[(j + 1) * rowSize + i + 1]);
+
+				const XMVECTOR triangles[2][3] = { { p0, p1, p3 }, { p0, p3, p2 } };
+				for (uint32_t t = 0; t < 2; t++)
+				{
+					const XMVECTOR* p = triangles[t];
+					XMVECTOR normal = XMVector3Normalize(XMVector3Cross(p[1] - p[0], p[2] - p[0]));
+					if (XMVectorGetX(XMVector3Dot(normal, p[0] + p[1] + p[2])) < 0.0f)
+						normal = -normal;
+					XMStoreFloat3(&normals[2 * (j * segmentCount + i) + t], normal);
+				}
+			}
+		}
+	}
+
+	for (uint32_t node = 0; node < GetNodeCount(); node++)
+	{
+		ValidatePatches(
+			GetNodeBounds(node), m_nodeBaseAddresses[node], m_nodeIndexCounts[node],
+			patchGrids, patchNormals, segmentCount, gridCount, report);
+	}
+
+	for (uint32_t leaf = 0; leaf < m_leafCount; leaf++)
+	{
+		const uint32_t node = GetFirstLeafNode() + leaf;
+		ValidateDetailBounds(
+			&m_nodeCorners[4 * node], m_nodeBaseAddresses[node], m_nodeIndexCounts[node], m_maxLevel,
+			patchGrids, patchNormals, segmentCount, gridCount, report);
+	}
+}
+
+void FaceTree::ValidatePatches(
+	const NodeBounds& bounds, uint32_t baseAddress, uint32_t indexCount,
+	const std::vector<XMFLOAT3>& patchGrids, const std::vector<XMFLOAT3>& patchNormals,
+	uint32_t segmentCount, uint32_t gridCount, BoundsReport& report) const
+{
+	const XMVECTOR boxCenter = XMLoadFloat3(&bounds.box.Center);
+	const XMVECTOR boxExtents = XMLoadFloat3(&bounds.box.Extents);
+	const XMVECTOR boxOrientation = XMLoadFloat4(&bounds.box.Orientation);
+	const XMVECTOR sphereCenter = XMLoadFloat3(&bounds.sphere.Center);
+
+	// Patches of the node are consecutive in the face, so are their grids.
+	const uint32_t pointsPerPatch = gridCount * (segmentCount + 1) * (segmentCount + 1);
+	const uint32_t trianglesPerPatch = gridCount * 2 * segmentCount * segmentCount;
+	const uint32_t firstPatch = (baseAddress - m_nodeBaseAddresses[0]) / 4;
+	const uint32_t patchCount = indexCount / 4;
+
+	const XMFLOAT3* points = &patchGrids[static_cast<size_t>(firstPatch) * pointsPerPatch];
+	for (uint32_t i = 0; i < patchCount * pointsPerPatch; i++)
+	{
+		const XMVECTOR position = XMLoadFloat3(&points[i]);
+
+		// Distance outside the box along its axes, and outside the sphere.
+		const XMVECTOR local = XMVector3InverseRotate(position - boxCenter, boxOrientation);
+		const float boxExcess = XMVectorGetX(XMVector3Length(XMVectorMax(XMVectorAbs(local) - boxExtents, XMVectorZero())));
+		const float sphereExcess = XMVectorGetX(XMVector3Length(position - sphereCenter)) - bounds.sphere.Radius;
+
+		const float excess = std::max(boxExcess, sphereExcess);
+		if (excess > 0.0f)
+		{
+			report.outsideCount++;
+			report.maxExcess = std::max(report.maxExcess, excess);
+		}
+	}
+	report.pointCount += patchCount * pointsPerPatch;
+
+	// A wide cone never culls, nothing to check.
+	if (bounds.normalCone.w >= XM_PIDIV2)
+		return;
+
+	const XMVECTOR coneAxis = XMVectorSet(bounds.normalCone.x, bounds.normalCone.y, bounds.normalCone.z, 0.0f);
+	const float coneCosHalfAngle = cos(bounds.normalCone.w);
+	const XMFLOAT3* normals = &patchNormals[static_cast<size_t>(firstPatch) * trianglesPerPatch];
+	for (uint32_t i = 0; i < patchCount * trianglesPerPatch; i++)
+	{
+		const XMVECTOR normal = XMLoadFloat3(&normals[i]);
+		if (XMVectorGetX(XMVector3Dot(normal, coneAxis)) >= coneCosHalfAngle)
+			continue;
+
+		const float coneExcess = XMVectorGetX(XMVector3AngleBetweenNormals(normal, coneAxis)) - bounds.normalCone.w;
+		if (coneExcess > 0.0f)
+		{
+			report.coneOutsideCount++;
+			report.maxConeExcess = std::max(report.maxConeExcess, coneExcess);
+		}
+	}
+	report.triangleCount += patchCount * trianglesPerPatch;
+}
+
+void FaceTree::ValidateDetailBounds(
+	const XMFLOAT3 corners[4], uint32_t baseAddress, uint32_t indexCount, uint32_t level,
+	const std::vector<XMFLOAT3>& patchGrids, const std::vector<XMFLOAT3>& patchNormals,
+	uint32_t segmentCount, uint32_t gridCount, BoundsReport& report) const
+{
+	if (!CanSplit(level, indexCount))
+		return;
+
+	for (uint32_t c = 0; c < 4; c++)
+	{
+		XMFLOAT3 childCorners[4];
+		NodeBounds bounds;
+		CalcDetailChild(corners, c, childCorners, bounds);
+
+		const uint32_t childBaseAddress = baseAddress + c * indexCount / 4;
+		ValidatePatches(bounds, childBaseAddress, indexCount / 4, patchGrids, patchNormals, segmentCount, gridCount, report);
+		ValidateDetailBounds(
+			childCorners, childBaseAddress, indexCount / 4, level + 1,
+			patchGrids, patchNormals, segmentCount, gridCount, report);
+	}
+}
+
+bool FaceTree::IsLodAccepted(uint32_t node, const LodView& view) const
+{
+	// Base patch width on cube face, coarse patches of the node are wider by its level difference.
+	const float basePatchWidth = 2.0f * QUAD_SPHERE_RADIUS / (1u << m_maxLevel) / sqrtf(static_cast<float>(m_coarseIndexCount / 4));
+	const float patchWidth = basePatchWidth * static_cast<float>(1u << (m_maxLevel - m_nodeLevels[node]));
+
+	float error;
+	if (view.metric == LodErrorMetric::Geometric)
+	{
+		// Chord sag over half diagonal of a coarse patch, plus heights skipped between its corners.
+		const float halfDiagonal = std::min(0.70710678f * patchWidth, QUAD_SPHERE_RADIUS);
+		error = QUAD_SPHERE_RADIUS - sqrtf(QUAD_SPHERE_RADIUS * QUAD_SPHERE_RADIUS - halfDiagonal * halfDiagonal) +
+			m_heightRanges[node].y - m_heightRanges[node].x;
+	}
+	else
+	{
+		error = patchWidth;
+	}
+
+	const XMVECTOR toNode = XMLoadFloat3(&m_sphereCenters[node]) - XMLoadFloat3(&view.cameraPosition);
+	const float distance = std::max(XMVectorGetX(XMVector3Length(toNode)) - m_sphereRadii[node], 1e-3f);
+
+	return error * view.pixelsPerUnit <= view.pixelThreshold * distance;
+}
+
+float FaceTree::GetCullingBoundRadius() const
+{
+	// Root node is never culled.
+	float boundRadius = 0.0f;
+	for (uint32_t node = 1; node < GetNodeCount(); node++)
+	{
+		const XMFLOAT3& center = m_obbCenters[node];
+		const XMFLOAT3& extents = m_obbExtents[node];
+
+		const float radius =
+			sqrtf(center.x * center.x + center.y * center.y + center.z * center.z) +
+			extents.x + extents.y + extents.z;
+		boundRadius = std::max(boundRadius, radius);
+	}
+
+	// Groups of the flat sweep, their axes are scaled by extents.
+	const float* c[OrientedBoxArray::COMPONENT_COUNT];
+	for (int i = 0; i < OrientedBoxArray::COMPONENT_COUNT; i++)
+		c[i] = m_groupCullingBounds.Get(static_cast<OrientedBoxArray::Component>(i));
+
+	for (uint32_t group = 0; group < m_groupCount; group++)
+	{
+		float radius = sqrtf(
+			c[OrientedBoxArray::CENTER_X][group] * c[OrientedBoxArray::CENTER_X][group] +
+			c[OrientedBoxArray::CENTER_Y][group] * c[OrientedBoxArray::CENTER_Y][group] +
+			c[OrientedBoxArray::CENTER_Z][group] * c[OrientedBoxArray::CENTER_Z][group]);
+		for (int axis = OrientedBoxArray::AXIS0_X; axis <= OrientedBoxArray::AXIS2_X; axis += 3)
+		{
+			radius += sqrtf(
+				c[axis][group] * c[axis][group] + c[axis + 1][group] * c[axis + 1][group] + c[axis + 2][group] * c[axis + 2][group]);
+		}
+		boundRadius = std::max(boundRadius, radius);
+	}
+
+	return boundRadius;
+}
+
+void FaceTree::Init(ID3D12Device* device, uint32_t viewCount)
+{
+	m_viewCount = std::min(viewCount, MAX_VIEWS);
+	for (uint32_t v = 0; v < m_viewCount; v++)
+	{
+		ViewDraws& viewDraws = m_views[v];
+
+#if defined(APOLLO_HEADLESS)
+		(void)device;
+#else
+		// Create default heap.
+		CD3DX12_HEAP_PROPERTIES defaultHeapProp(D3D12_HEAP_TYPE_DEFAULT);
+		auto resDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(DrawArguments) * m_maxRangeCount);
+		DX::ThrowIfFailed(
+			device->CreateCommittedResource(
+				&defaultHeapProp,
+				D3D12_HEAP_FLAG_NONE,
+				&resDesc,
+				D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
+				nullptr,
+				IID_PPV_ARGS(viewDraws.argumentBuffer.ReleaseAndGetAddressOf())));
+#endif
+
+		// Content of new default heap is unknown, every argument is patched on first upload.
+		std::fill(viewDraws.uploadedRanges.begin(), viewDraws.uploadedRanges.end(), IndexRange {});
+		viewDraws.dirtyArgumentRuns.clear();
+	}
 }
 
-void FaceTree::Init(ID3D12Device* device)
+uint32_t FaceTree::UpdateIndexRanges(
+	IN const FrustumCulling::View* views, IN uint32_t viewCount, IN CullingKernel kernel, IN CullingMode mode)
 {
-	m_staticIndexCount = m_rootNode->GetIndexCount();
-	m_staticIBSize = sizeof(uint32_t) * m_staticIndexCount;
+	viewCount = std::min(viewCount, m_viewCount);
+	for (ViewDraws& viewDraws : m_views)
+		viewDraws.indexRanges.Clear();
+	std::fill(m_visibleLeafMask.begin(), m_visibleLeafMask.end(), 0);
+
+	m_testedNodeCount = 0;
+	m_testedPlaneCount = 0;
+	m_horizonCulledQuadCount = 0;
+	m_backFaceCulledQuadCount = 0;
+	m_occludedNodeCount = 0;
+	m_visiblePatchCount = 0;
+	m_splitRequests.clear();
 
-    // Create default heap.
-    CD3DX12_HEAP_PROPERTIES defaultHeapProp(D3D12_HEAP_TYPE_DEFAULT);
-    auto resDesc = CD3DX12_RESOURCE_DESC::Buffer(m_staticIBSize);
-    DX::ThrowIfFailed(
-        device->CreateCommittedResource(
-            &defaultHeapProp,
-            D3D12_HEAP_FLAG_NONE,
-            &resDesc,
-            D3D12_RESOURCE_STATE_COPY_DEST,
-            nullptr,
-            IID_PPV_ARGS(m_staticIB.ReleaseAndGetAddressOf())));
+	uint32_t culledQuadCount;
+	if (mode == CullingMode::FlatSweep)
+		culledQuadCount = SweepGroups(views, viewCount, kernel);
+	else
+		culledQuadCount = TraverseNodes(views, viewCount, kernel);
 
-    // Initialize the index buffer view.
-    m_ibv.BufferLocation = m_staticIB->GetGPUVirtualAddress();
-    m_ibv.Format = DXGI_FORMAT_R32_UINT;
-    m_ibv.SizeInBytes = m_staticIBSize;
+	// Split a bounded number of near nodes, their children are drawn from next cull on.
+	m_splitBlockCount = 0;
+	for (const uint32_t node : m_splitRequests)
+		SplitNode(node);
 
-    // Create upload heap.
-    CD3DX12_HEAP_PROPERTIES uploadHeapProp(D3D12_HEAP_TYPE_UPLOAD);
-    auto uploadHeapDesc = CD3DX12_RESOURCE_DESC::Buffer(m_staticIBSize);
-    DX::ThrowIfFailed(
-        device->CreateCommittedResource(
-            &uploadHeapProp,
-            D3D12_HEAP_FLAG_NONE,
-            &uploadHeapDesc,
-            D3D12_RESOURCE_STATE_GENERIC_READ,
-            nullptr,
-            IID_PPV_ARGS(m_uploadIB.ReleaseAndGetAddressOf())));
+	EvictUnusedBlocks();
+	m_cullIndex++;
+
+	// Leaves that entered or left the visible set.
+	m_enteredLeafCount = 0;
+	m_leftLeafCount = 0;
+	for (size_t i = 0; i < m_visibleLeafMask.size(); i++)
+	{
+		m_enteredLeafCount += static_cast<uint32_t>(std::bitset<64>(m_visibleLeafMask[i] & ~m_prevVisibleLeafMask[i]).count());
+		m_leftLeafCount += static_cast<uint32_t>(std::bitset<64>(m_prevVisibleLeafMask[i] & ~m_visibleLeafMask[i]).count());
+	}
+	m_prevVisibleLeafMask.swap(m_visibleLeafMask);
+
+	// Record arguments that differ from default heap content, grouped in contiguous runs.
+	// Runs refused by the last emission are found again, the uploaded ranges still differ there.
+	for (uint32_t v = 0; v < m_viewCount; v++)
+	{
+		ViewDraws& viewDraws = m_views[v];
+		FindChangedRuns(viewDraws.indexRanges.GetRanges(), viewDraws.uploadedRanges, viewDraws.dirtyArgumentRuns);
+	}
+
+	return culledQuadCount;
 }
 
-uint32_t FaceTree::UpdateIndexData(IN DirectX::BoundingFrustum& frustum, IN const std::vector<uint32_t>& indices)
+uint32_t FaceTree::TraverseNodes(const FrustumCulling::View* views, uint32_t viewCount, CullingKernel kernel)
 {
-	m_renderIndexData.clear();
+	uint32_t culledQuadCount = 0;
+
+	// Depth-first walk with explicit stack, only nodes visible in some view are pushed.
+	// Root node is never culled, other nodes are tested with their siblings in one batch.
+	// Root may cross every plane of every view.
+	uint32_t stack[4 * (QUAD_NODE_MAX_LEVEL + MAX_DETAIL_DEPTH) + 1];
+	uint32_t stackMasks[4 * (QUAD_NODE_MAX_LEVEL + MAX_DETAIL_DEPTH) + 1];
+	uint32_t stackSize = 0;
+	stack[stackSize] = 0;
+	stackMasks[stackSize] = 0;
+	for (uint32_t v = 0; v < viewCount; v++)
+		stackMasks[stackSize] |= GetViewBits(v);
+	stackSize++;
+
+	const uint32_t firstLeaf = GetFirstLeafNode();
+
+	// Detail nodes are popped right after their leaf, so they draw with its patch LOD.
+	uint32_t leafPatchLod = 0;
+
+	while (stackSize > 0)
+	{
+		const uint32_t node = stack[--stackSize];
+		const uint32_t mask = stackMasks[stackSize];
+		const bool cameraVisible = (mask & 1) != 0;
+
+		if (node & DETAIL_NODE_BIT)
+		{
+			const uint32_t detail = node & ~DETAIL_NODE_BIT;
+			if (m_detailChildBlocks[detail] != NodePool::INVALID_BLOCK)
+			{
+				PushDetailChildren(
+					m_detailChildBlocks[detail], views, kernel, mask, stack, stackMasks, stackSize, culledQuadCount);
+				continue;
+			}
+
+			AppendRange(mask, m_detailBaseAddresses[detail], m_detailIndexCounts[detail], leafPatchLod);
+
+			if (cameraVisible)
+			{
+				m_visiblePatchCount += m_detailIndexCounts[detail] / 4;
+				RequestSplit(
+					node, views[0], m_detailSphereCenters[detail], m_detailSphereRadii[detail],
+					m_detailLevels[detail], m_detailIndexCounts[detail]);
+			}
+			continue;
+		}
+
+		const uint32_t level = m_nodeLevels[node];
+
+		// Leaves of a node are contiguous in breadth-first order.
+		uint32_t nodeFirstLeaf = node;
+		for (uint32_t l = level; l < m_maxLevel; l++)
+			nodeFirstLeaf = 4 * nodeFirstLeaf + 1;
+		nodeFirstLeaf -= firstLeaf;
+
+		// Node at its selected LOD is drawn whole, leaves with their base patches and inner nodes with coarse patches.
+		if (m_leafLodLevels[nodeFirstLeaf] == level)
+		{
+			if (cameraVisible)
+			{
+				const uint32_t leafCount = 1u << (2 * (m_maxLevel - level));
+				for (uint32_t leaf = nodeFirstLeaf; leaf < nodeFirstLeaf + leafCount; leaf++)
+					m_visibleLeafMask[leaf / 64] |= 1ull << (leaf % 64);
+			}
+
+			const uint32_t edges = m_leafLodEdges[nodeFirstLeaf];
+			const uint32_t patchLod = LodGrid::EncodePatchLod(m_maxLevel - level, level, edges & 0xF, edges >> 4);
+
+			if (level < m_maxLevel)
+			{
+				AppendRange(mask, m_coarseBaseAddress + node * m_coarseIndexCount, m_coarseIndexCount, patchLod);
+				if (cameraVisible)
+					m_visiblePatchCount += m_coarseIndexCount / 4;
+			}
+			else if (m_leafChildBlocks[nodeFirstLeaf] != NodePool::INVALID_BLOCK)
+			{
+				leafPatchLod = patchLod;
+				PushDetailChildren(
+					m_leafChildBlocks[nodeFirstLeaf], views, kernel, mask, stack, stackMasks, stackSize, culledQuadCount);
+			}
+			else
+			{
+				AppendRange(mask, m_nodeBaseAddresses[node], m_nodeIndexCounts[node], patchLod);
+				if (cameraVisible)
+				{
+					m_visiblePatchCount += m_nodeIndexCounts[node] / 4;
+					RequestSplit(node, views[0], m_sphereCenters[node], m_sphereRadii[node], level, m_nodeIndexCounts[node]);
+				}
+			}
+			continue;
+		}
+
+		const uint32_t firstChild = 4 * node + 1;
+
+		uint32_t childMasks[4];
+		ClassifySiblings(m_cullingBounds, firstChild, views, kernel, mask, childMasks);
 
+		// Children are pushed in reverse to keep index order, so adjacent ranges can be merged.
+		for (int c = 3; c >= 0; c--)
+		{
+			const uint32_t child = firstChild + c;
+			const uint32_t childMask = CullHiddenViews(
+				views, childMasks[c], m_sphereCenters[child], m_sphereRadii[child],
+				m_coneAxes[child], m_coneSinHalfAngles[child], m_coneCosHalfAngles[child],
+				m_nodeIndexCounts[child] / 4);
+
+			if (cameraVisible && !(childMask & 1))
+				culledQuadCount += m_nodeIndexCounts[child] / 4;
+
+			if (childMask & VISIBLE_VIEWS)
+			{
+				stack[stackSize] = child;
+				stackMasks[stackSize++] = childMask;
+			}
+		}
+	}
+
+	return culledQuadCount;
+}
+
+uint32_t FaceTree::SweepGroups(const FrustumCulling::View* views, uint32_t viewCount, CullingKernel kernel)
+{
+	// Every group is tested in one batch per view, views a group may be visible in gather in its mask.
+	std::fill(m_groupViewMasks.begin(), m_groupViewMasks.end(), 0);
+	for (uint32_t v = 0; v < viewCount; v++)
+	{
+		FrustumCulling::ClassifyBoxes(kernel, views[v].planes, m_groupCullingBounds, 0, m_groupCount, m_groupResults.data());
+		m_testedNodeCount += m_groupCount;
+		m_testedPlaneCount += 6 * m_groupCount;
+
+		for (uint32_t group = 0; group < m_groupCount; group++)
+		{
+			if (m_groupResults[group] != DISJOINT)
+				m_groupViewMasks[group] |= 1u << v;
+		}
+	}
+
+	// Groups are in index order, adjacent visible groups merge into one range.
+	const uint32_t groupsPerLeaf = m_groupCount / m_leafCount;
+	const uint32_t groupQuadCount = m_groupIndexCount / 4;
+	const uint32_t patchLod = LodGrid::EncodePatchLod(0, m_maxLevel, 0, 0);
 	uint32_t culledQuadCount = 0;
-	m_rootNode->Render(frustum, indices, m_renderIndexData, culledQuadCount);
+	for (uint32_t group = 0; group < m_groupCount; group++)
+	{
+		uint32_t mask = m_groupViewMasks[group];
+		if (mask != 0)
+		{
+			mask = CullHiddenViews(
+				views, mask, m_groupSphereCenters[group], m_groupSphereRadii[group],
+				m_groupConeAxes[group], m_groupConeSinHalfAngles[group], m_groupConeCosHalfAngles[group],
+				groupQuadCount);
+		}
+
+		if (!(mask & 1))
+		{
+			culledQuadCount += groupQuadCount;
+		}
+		else
+		{
+			const uint32_t leaf = group / groupsPerLeaf;
+			m_visibleLeafMask[leaf / 64] |= 1ull << (leaf % 64);
+			m_visiblePatchCount += groupQuadCount;
+		}
 
-	m_renderIndexCount = m_renderIndexData.size();
-	m_renderIBSize = sizeof(uint32_t) * m_renderIndexCount;
+		if (mask & VISIBLE_VIEWS)
+			AppendRange(mask, m_nodeBaseAddresses[0] + group * m_groupIndexCount, m_groupIndexCount, patchLod);
+	}
 
 	return culledQuadCount;
 }
 
-void FaceTree::Upload(ID3D12GraphicsCommandList* commandList)
+void FaceTree::ClassifySiblings(
+	const OrientedBoxArray& bounds, uint32_t firstChild, const FrustumCulling::View* views, CullingKernel kernel,
+	uint32_t parentMask, uint32_t childMasks[4])
 {
-    // Define sub-resource data.
-    D3D12_SUBRESOURCE_DATA subResourceData = {};
-    subResourceData.pData = m_renderIndexData.data();
-    subResourceData.RowPitch = m_renderIBSize;
-    subResourceData.SlicePitch = m_renderIBSize;
+	for (uint32_t c = 0; c < 4; c++)
+		childMasks[c] = parentMask;
 
-    // Copy the index data to the default heap.
-    UpdateSubresources(commandList, m_staticIB.Get(), m_uploadIB.Get(), 0, 0, 1, &subResourceData);
+	// Children lie inside every plane their parent lies inside, a view with no plane left contains them.
+	for (uint32_t v = 0; v < MAX_VIEWS; v++)
+	{
+		const uint8_t planeMask = static_cast<uint8_t>((parentMask >> GetPlaneShift(v)) & FrustumCulling::ALL_PLANES);
+		if (!(parentMask & (1u << v)) || planeMask == 0)
+			continue;
 
-    // Translate vertex buffer state.
-    const D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(
-        m_staticIB.Get(),
-        D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_INDEX_BUFFER);
-	commandList->ResourceBarrier(1, &barrier);
+		uint8_t results[4];
+		uint8_t insidePlanes[4];
+		FrustumCulling::ClassifyBoxes(kernel, views[v].planes, bounds, firstChild, 4, results, planeMask, insidePlanes);
+		m_testedNodeCount += 4;
+		m_testedPlaneCount += 4 * static_cast<uint32_t>(std::bitset<6>(planeMask).count());
+
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			if (results[c] == DISJOINT)
+				childMasks[c] &= ~GetViewBits(v);
+			else
+				childMasks[c] &= ~(static_cast<uint32_t>(insidePlanes[c]) << GetPlaneShift(v));
+		}
+	}
 }
 
-void FaceTree::Draw(ID3D12GraphicsCommandList* commandList) const
+uint32_t FaceTree::CullHiddenViews(
+	const FrustumCulling::View* views, uint32_t mask, const XMFLOAT3& center, float radius,
+	const XMFLOAT3& coneAxis, float sinHalfAngle, float cosHalfAngle, uint32_t quadCount)
 {
-	commandList->IASetIndexBuffer(&m_ibv);
-	commandList->DrawIndexedInstanced(m_renderIndexCount, 1, 0, 0, 0);
-}
\ No newline at end of file
+	for (uint32_t v = 0; v < MAX_VIEWS; v++)
+	{
+		if ((mask & (1u << v)) && IsNodeHidden(views[v], center, radius, coneAxis, sinHalfAngle, cosHalfAngle, quadCount))
+			mask &= ~GetViewBits(v);
+	}
+
+	return mask;
+}
+
+void FaceTree::AppendRange(uint32_t mask, uint32_t start, uint32_t count, uint32_t lod)
+{
+	for (uint32_t v = 0; v < MAX_VIEWS; v++)
+	{
+		if (mask & (1u << v))
+			m_views[v].indexRanges.Append(start, count, lod);
+	}
+}
+
+bool FaceTree::IsNodeHidden(
+	const FrustumCulling::View& view, const XMFLOAT3& center, float radius,
+	const XMFLOAT3& coneAxis, float sinHalfAngle, float cosHalfAngle, uint32_t quadCount)
+{
+	if (FrustumCulling::IsSphereBeyondHorizon(view.horizon, center, radius))
+	{
+		m_horizonCulledQuadCount += quadCount;
+		return true;
+	}
+
+	if (FrustumCulling::IsConeBackFacing(view.cone, center, radius, coneAxis, sinHalfAngle, cosHalfAngle))
+	{
+		m_backFaceCulledQuadCount += quadCount;
+		return true;
+	}
+
+	if (view.occlusion != nullptr && view.occlusion->IsSphereOccluded(center, radius))
+	{
+		m_occludedNodeCount++;
+		return true;
+	}
+
+	return false;
+}
+
+void FaceTree::PushDetailChildren(
+	uint32_t block, const FrustumCulling::View* views, CullingKernel kernel, uint32_t mask,
+	uint32_t* stack, uint32_t* stackMasks, uint32_t& stackSize, uint32_t& culledQuadCount)
+{
+	m_blockLastUsedCulls[block] = m_cullIndex;
+
+	const uint32_t firstChild = 4 * block;
+
+	uint32_t childMasks[4];
+	ClassifySiblings(m_detailCullingBounds, firstChild, views, kernel, mask, childMasks);
+
+	// Same order as tree children, so detail ranges of one leaf merge too.
+	for (int c = 3; c >= 0; c--)
+	{
+		const uint32_t child = firstChild + c;
+		const uint32_t childMask = CullHiddenViews(
+			views, childMasks[c], m_detailSphereCenters[child], m_detailSphereRadii[child],
+			m_detailConeAxes[child], m_detailConeSinHalfAngles[child], m_detailConeCosHalfAngles[child],
+			m_detailIndexCounts[child] / 4);
+
+		if ((mask & 1) && !(childMask & 1))
+			culledQuadCount += m_detailIndexCounts[child] / 4;
+
+		if (childMask & VISIBLE_VIEWS)
+		{
+			stack[stackSize] = DETAIL_NODE_BIT | child;
+			stackMasks[stackSize++] = childMask;
+		}
+	}
+}
+
+void FaceTree::RequestSplit(
+	uint32_t node, const FrustumCulling::View& view, const XMFLOAT3& center, float radius,
+	uint32_t level, uint32_t indexCount)
+{
+	if (m_splitRequests.size() >= MAX_SPLITS_PER_CULL || !CanSplit(level, indexCount))
+		return;
+
+	const float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&center) - XMLoadFloat3(&view.cameraPosition)));
+	if (distance < DETAIL_SPLIT_DISTANCE * radius)
+		m_splitRequests.push_back(node);
+}
+
+void FaceTree::SplitNode(uint32_t node)
+{
+	const uint32_t block = m_nodePool.Allocate();
+	if (block == NodePool::INVALID_BLOCK)
+		return;
+
+	const XMFLOAT3* corners;
+	uint32_t baseAddress;
+	uint32_t indexCount;
+	uint32_t level;
+	if (node & DETAIL_NODE_BIT)
+	{
+		const uint32_t detail = node & ~DETAIL_NODE_BIT;
+		corners = &m_detailCorners[4 * detail];
+		baseAddress = m_detailBaseAddresses[detail];
+		indexCount = m_detailIndexCounts[detail];
+		level = m_detailLevels[detail];
+		m_detailChildBlocks[detail] = block;
+	}
+	else
+	{
+		const uint32_t leaf = node - GetFirstLeafNode();
+		corners = &m_nodeCorners[4 * node];
+		baseAddress = m_nodeBaseAddresses[node];
+		indexCount = m_nodeIndexCounts[node];
+		level = m_maxLevel;
+		m_leafChildBlocks[leaf] = block;
+	}
+
+	for (uint32_t c = 0; c < 4; c++)
+	{
+		const uint32_t child = 4 * block + c;
+
+		NodeBounds bounds;
+		CalcDetailChild(corners, c, &m_detailCorners[4 * child], bounds);
+
+		m_detailLevels[child] = static_cast<uint8_t>(level + 1);
+		m_detailBaseAddresses[child] = baseAddress + c * indexCount / 4;
+		m_detailIndexCounts[child] = indexCount / 4;
+		m_detailSphereCenters[child] = bounds.sphere.Center;
+		m_detailSphereRadii[child] = bounds.sphere.Radius;
+		m_detailConeAxes[child] = XMFLOAT3(bounds.normalCone.x, bounds.normalCone.y, bounds.normalCone.z);
+		m_detailConeSinHalfAngles[child] = sin(bounds.normalCone.w);
+		m_detailConeCosHalfAngles[child] = cos(bounds.normalCone.w);
+		m_detailChildBlocks[child] = NodePool::INVALID_BLOCK;
+		m_detailCullingBounds.Set(child, bounds.box);
+	}
+
+	m_blockParents[block] = node;
+	m_blockLastUsedCulls[block] = m_cullIndex;
+	m_splitBlockCount++;
+}
+
+void FaceTree::CalcDetailChild(const XMFLOAT3 corners[4], uint32_t c, XMFLOAT3 childCorners[4], NodeBounds& bounds) const
+{
+	// Child c starts at parent corner c and meets the others at edge midpoints and the center,
+	// see QuadSphereGenerator::EmitGridQuads. Face grid is planar, so midpoints are exact grid points.
+	const uint32_t edgeCorners[4][2] = { { 1, 2 }, { 3, 0 }, { 0, 3 }, { 2, 1 } };
+	const XMVECTOR origin = XMLoadFloat3(&corners[c]);
+
+	childCorners[0] = corners[c];
+	XMStoreFloat3(&childCorners[1], 0.5f * (origin + XMLoadFloat3(&corners[edgeCorners[c][0]])));
+	XMStoreFloat3(&childCorners[2], 0.5f * (origin + XMLoadFloat3(&corners[edgeCorners[c][1]])));
+	XMStoreFloat3(&childCorners[3], 0.5f * (origin + XMLoadFloat3(&corners[3 - c])));
+
+	float minHeight = 0.0f;
+	float maxHeight = 1.0f;
+	if (m_heightMap)
+		m_heightMap->GetHeightRange(childCorners, minHeight, maxHeight);
+
+	QuadNode::CalcBounds(
+		childCorners, minHeight * MAX_HEIGHT_DISPLACEMENT, maxHeight * MAX_HEIGHT_DISPLACEMENT,
+		GetMaxSlope(childCorners), bounds.box, bounds.sphere, bounds.normalCone);
+}
+
+void FaceTree::EvictUnusedBlocks()
+{
+	// Blocks go back to the pool bottom up, a block with split children waits for them first.
+	m_evictedBlockCount = 0;
+	for (uint32_t block = 0; block < m_nodePool.GetBlockCapacity(); block++)
+	{
+		const uint32_t parent = m_blockParents[block];
+		if (parent == NodePool::INVALID_BLOCK || m_cullIndex - m_blockLastUsedCulls[block] < DETAIL_EVICTION_CULL_COUNT)
+			continue;
+
+		bool hasChildren = false;
+		for (uint32_t c = 0; c < 4; c++)
+			hasChildren |= m_detailChildBlocks[4 * block + c] != NodePool::INVALID_BLOCK;
+		if (hasChildren)
+			continue;
+
+		if (parent & DETAIL_NODE_BIT)
+			m_detailChildBlocks[parent & ~DETAIL_NODE_BIT] = NodePool::INVALID_BLOCK;
+		else
+			m_leafChildBlocks[parent - GetFirstLeafNode()] = NodePool::INVALID_BLOCK;
+
+		m_blockParents[block] = NodePool::INVALID_BLOCK;
+		m_nodePool.Free(block);
+		m_evictedBlockCount++;
+	}
+}
+
+uint64_t FaceTree::GetPendingUploadSize(uint32_t view) const
+{
+	uint64_t size = 0;
+	for (const IndexRange& run : m_views[view].dirtyArgumentRuns)
+		size += sizeof(DrawArguments) * run.count;
+
+	return size;
+}
+
+uint64_t FaceTree::EmitDrawArguments(uint32_t view, UploadSink& sink)
+{
+	ViewDraws& viewDraws = m_views[view];
+	uint64_t emittedBytes = 0;
+
+	// Arguments are built in sink memory, runs are clipped to ranges drawn now.
+	const std::vector<IndexRange>& ranges = viewDraws.indexRanges.GetRanges();
+	const uint32_t rangeCount = static_cast<uint32_t>(ranges.size());
+	uint32_t emittedRunCount = 0;
+	for (const IndexRange& run : viewDraws.dirtyArgumentRuns)
+	{
+		const uint32_t count = std::min(run.start + run.count, std::max(rangeCount, run.start)) - run.start;
+		if (count > 0)
+		{
+			const uint64_t size = sizeof(DrawArguments) * count;
+			DrawArguments* arguments = reinterpret_cast<DrawArguments*>(sink.Reserve(sizeof(DrawArguments) * run.start, size));
+			if (!arguments)
+				break;
+
+			for (uint32_t i = 0; i < count; i++)
+			{
+				const IndexRange& range = ranges[run.start + i];
+				arguments[i].patchLod = range.lod;
+				arguments[i].draw.IndexCountPerInstance = range.count;
+				arguments[i].draw.InstanceCount = 1;
+				arguments[i].draw.StartIndexLocation = range.start;
+				arguments[i].draw.BaseVertexLocation = 0;
+				arguments[i].draw.StartInstanceLocation = 0;
+				viewDraws.uploadedRanges[run.start + i] = range;
+			}
+			sink.Commit();
+
+			emittedBytes += size;
+		}
+		emittedRunCount++;
+	}
+
+	viewDraws.dirtyArgumentRuns.erase(
+		viewDraws.dirtyArgumentRuns.begin(), viewDraws.dirtyArgumentRuns.begin() + emittedRunCount);
+	return emittedBytes;
+}
+
+#if !defined(APOLLO_HEADLESS)
+void FaceTree::CopyDrawArguments(
+	ID3D12GraphicsCommandList* commandList, uint32_t view,
+	const std::vector<SpanUploadSink::Region>& regions, ID3D12Resource* sourceBuffer, uint64_t sourceOffset) const
+{
+	const ViewDraws& viewDraws = m_views[view];
+	if (regions.empty())
+		return;
+
+	// Translate argument buffer state.
+	const D3D12_RESOURCE_BARRIER toCopy = CD3DX12_RESOURCE_BARRIER::Transition(
+		viewDraws.argumentBuffer.Get(),
+		D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_COPY_DEST);
+	commandList->ResourceBarrier(1, &toCopy);
+
+	// Copy changed runs only.
+	for (const SpanUploadSink::Region& region : regions)
+	{
+		commandList->CopyBufferRegion(
+			viewDraws.argumentBuffer.Get(), region.destinationOffset,
+			sourceBuffer, sourceOffset + region.sourceOffset,
+			region.size);
+	}
+
+	// Translate argument buffer state.
+	const D3D12_RESOURCE_BARRIER toIndirect = CD3DX12_RESOURCE_BARRIER::Transition(
+		viewDraws.argumentBuffer.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+	commandList->ResourceBarrier(1, &toIndirect);
+}
+
+void FaceTree::Draw(
+	ID3D12GraphicsCommandList* commandList, ID3D12CommandSignature* commandSignature,
+	uint32_t view, uint32_t rangeCount) const
+{
+	if (rangeCount == 0)
+		return;
+
+	commandList->ExecuteIndirect(
+		commandSignature,
+		rangeCount,
+		m_views[view].argumentBuffer.Get(),
+		0,
+		nullptr,
+		0);
+}
+#endif
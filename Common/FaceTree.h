@@ -1,33 +1,338 @@
 #pragma once
 
+#include "FrustumCulling.h"
+#include "HeightMap.h"
+#include "IndexRange.h"
+#include "LodGrid.h"
+#include "NodePool.h"
 #include "QuadNode.h"
+#include "UploadSink.h"
+
+// How UpdateIndexRanges finds visible patches.
+enum class CullingMode
+{
+	Hierarchy,	// Quad tree walk down to nodes at their selected LOD and resident detail nodes.
+	FlatSweep,	// Every tessellation group tested in flat batches, drawn with base patches.
+};
 
 class FaceTree
 {
 public:
-	FaceTree(QuadNode* rootNode, UINT32 faceIndexCount);
+	// Leaves are split on demand into pooled detail nodes, down to blocks of MIN_DETAIL_QUAD_COUNT base patches.
+	static constexpr uint32_t				DETAIL_BLOCK_CAPACITY = 1024;		// Per face, 4 nodes each.
+	static constexpr uint32_t				MAX_DETAIL_DEPTH = 4;				// Levels below leaves.
+	static constexpr uint32_t				MIN_DETAIL_QUAD_COUNT = 16;
+	static constexpr uint32_t				MAX_SPLITS_PER_CULL = 32;
+	static constexpr uint32_t				DETAIL_EVICTION_CULL_COUNT = 120;	// Culls a block may stay unused.
+	static constexpr float					DETAIL_SPLIT_DISTANCE = 2.0f;		// Camera distance to split, in node radii.
+
+	// Views culled in one traversal, each gets its own draw list. View 0 is the camera,
+	// it alone decides LOD statistics, visible leaves and splits.
+	static constexpr uint32_t				MAX_VIEWS = 4;
+
+	// Culling bounds of one node.
+	struct NodeBounds
+	{
+		DirectX::BoundingOrientedBox		box;
+		DirectX::BoundingSphere				sphere;
+		DirectX::XMFLOAT4					normalCone;		// xyz axis, w half angle
+	};
+
+	// Points of tessellated base patches found outside bounds of their nodes, summed over faces.
+	struct BoundsReport
+	{
+		uint32_t							pointCount = 0;		// Point references checked.
+		uint32_t							outsideCount = 0;
+		float								maxExcess = 0.0f;	// Largest distance outside box or sphere.
+
+		uint32_t							triangleCount = 0;	// Triangles between the points checked against normal cones.
+		uint32_t							coneOutsideCount = 0;
+		float								maxConeExcess = 0.0f;	// Largest angle outside a cone, in radians.
+	};
+
+	// Indirect argument of one visible range, patch LOD is set as root constant before the draw.
+	struct DrawArguments
+	{
+		uint32_t							patchLod;
+		D3D12_DRAW_INDEXED_ARGUMENTS		draw;
+	};
+
+	FaceTree(uint32_t baseAddress, uint32_t faceIndexCount, uint32_t maxLevel);
 	~FaceTree();
 
-	QuadNode*								GetRootNode() const { return m_rootNode; }
+	// Build node bounds from generated mesh. Also writes quadPos of the vertices.
+	void Build(
+		const uint32_t corner[4], float width,
+		std::vector<VertexTess>& vertices,
+		const std::vector<uint32_t>& indices);
+
+	uint32_t								GetNodeCount() const { return static_cast<uint32_t>(m_nodeLevels.size()); }
+	NodeBounds								GetNodeBounds(uint32_t node) const;
+	void									SetNodeBounds(uint32_t node, const NodeBounds& bounds);
+
+	// Base patches under a node in the static index buffer.
+	uint32_t								GetNodeBaseAddress(uint32_t node) const { return m_nodeBaseAddresses[node]; }
+	uint32_t								GetNodeIndexCount(uint32_t node) const { return m_nodeIndexCounts[node]; }
+
+	static const char*						GetCullingModeName(CullingMode mode);
+
+	// Node count of a full quad tree with given depth.
+	static uint32_t							GetNodeCount(uint32_t maxLevel);
+
+	// Append coarse patches of every inner node, each node gets as many patches as a leaf.
+	// Coarse patch corners are corners of aligned blocks of base patches, so they keep the patch orientation.
+	void CreateCoarseIndices(
+		const std::vector<uint32_t>& indices, uint32_t coarseBaseAddress,
+		std::vector<uint32_t>& coarseIndices);
+
+	uint32_t								GetMaxLevel() const { return m_maxLevel; }
+	uint32_t								GetLeafCount() const { return m_leafCount; }
+	uint32_t								GetGroupCount() const { return m_groupCount; }
+	const DirectX::XMFLOAT3&				GetLeafCenter(uint32_t leaf) const { return m_sphereCenters[GetFirstLeafNode() + leaf]; }
+
+	// Drawn level of every leaf, and edges of its drawn node next to finer (low bits) or coarser (high bits) nodes.
+	std::vector<uint8_t>&					GetLeafLodLevels() { return m_leafLodLevels; }
+	std::vector<uint8_t>&					GetLeafLodEdges() { return m_leafLodEdges; }
+
+	// Select drawn node of every leaf by screen space error. Edges are left for LodGrid::Balance.
+	void SelectLod(IN const LodView& view);
+
+	// Append every node at its selected LOD the way UpdateIndexRanges draws it, without culling.
+	// Detail nodes draw the patches of their leaf, so leaves stand for them.
+	void AppendSelectedRanges(IndexRangeList& ranges) const;
+
+	// Keep node corners on cube face, height bounds and detail nodes are built from them later.
+	void InitDetail(const VertexTess* vertices, const std::vector<uint32_t>& indices);
+
+	// Rebuild bounds of every node from heights under it, detail nodes split later use the same map.
+	// Without height map bounds cover the whole displacement range.
+	void InitHeightBounds(const HeightMap* heightMap);
+
+	// Add points of tessellated base patches lying outside box or sphere of a node they belong to, and triangles between
+	// them facing outside its normal cone. Tree nodes and every detail node a leaf can be split into are checked,
+	// detail bounds are built the way SplitNode builds them.
+	// Every base patch of the face gives gridCount grids of (segmentCount + 1)^2 displaced points in index order,
+	// rows run from corner 0 to 1 and step towards corners 2 and 3, as the domain shader interpolates.
+	void ValidateBounds(
+		const std::vector<DirectX::XMFLOAT3>& patchGrids, uint32_t segmentCount, uint32_t gridCount, BoundsReport& report) const;
+
+	// Bound of |center| + sum of extents over every node that can be culled.
+	float									GetCullingBoundRadius() const;
+
+	// Statistics of last UpdateIndexRanges and emission.
+	uint32_t								GetTestedNodeCount() const { return m_testedNodeCount; }
+	uint32_t								GetTestedPlaneCount() const { return m_testedPlaneCount; }
+	uint32_t								GetHorizonCulledQuadCount() const { return m_horizonCulledQuadCount; }
+	uint32_t								GetBackFaceCulledQuadCount() const { return m_backFaceCulledQuadCount; }
+	uint32_t								GetOccludedNodeCount() const { return m_occludedNodeCount; }
+	uint32_t								GetEnteredLeafCount() const { return m_enteredLeafCount; }
+	uint32_t								GetLeftLeafCount() const { return m_leftLeafCount; }
+	uint32_t								GetVisiblePatchCount() const { return m_visiblePatchCount; }
+	uint32_t								GetDetailNodeCount() const { return 4 * m_nodePool.GetAllocatedBlockCount(); }
+	uint32_t								GetDetailNodeCapacity() const { return m_nodePool.GetNodeCapacity(); }
+	uint32_t								GetSplitBlockCount() const { return m_splitBlockCount; }
+	uint32_t								GetEvictedBlockCount() const { return m_evictedBlockCount; }
+	const IndexRangeList&					GetIndexRanges(uint32_t view = 0) const { return m_views[view].indexRanges; }
+
+	// Create a draw argument buffer per view, changed arguments are emitted into upload memory and copied.
+	// CPU-only builds create no buffer and take no device, they only set up the draw lists.
+	void Init(ID3D12Device* device, uint32_t viewCount = 1);
+
+	// Largest upload of one frame, every argument of every view changed.
+	uint64_t								GetMaxUploadSize() const { return sizeof(DrawArguments) * m_maxRangeCount * m_viewCount; }
 
-	void Init(ID3D12Device* device);
-	uint32_t UpdateIndexData(IN DirectX::BoundingFrustum& frustum, IN const std::vector<uint32_t>& indices);
-	void Upload(ID3D12GraphicsCommandList* commandList);
-	void Draw(ID3D12GraphicsCommandList* commandList) const;
+	// Cull nodes against frustum, horizon, normal cone and occlusion buffer of every view in one traversal,
+	// collect index ranges of nodes visible in each view. Returns quad count culled for the camera view.
+	// Nodes carry a mask of views they may be visible in, and of frustum planes they still cross in each view.
+	// Nodes at their selected LOD are drawn with coarse patches instead of their leaves.
+	// Leaves drawn at full detail continue into their resident detail nodes. Near nodes are split afterwards,
+	// a few per cull, and detail blocks unused for a while are evicted.
+	// Changed draw arguments are recorded for the next upload. Views past viewCount draw nothing.
+	// Flat sweep skips the tree and tests every tessellation group instead. It ignores selected LOD and detail nodes,
+	// but a partly visible leaf only draws its visible groups.
+	uint32_t UpdateIndexRanges(
+		IN const FrustumCulling::View* views, IN uint32_t viewCount, IN CullingKernel kernel,
+		IN CullingMode mode = CullingMode::Hierarchy);
+
+	// Bytes of draw arguments of a view that differ from its argument buffer.
+	uint64_t GetPendingUploadSize(uint32_t view) const;
+
+	// Write changed draw arguments of a view straight into sink memory, at their offset in its argument buffer.
+	// Runs the sink refuses stay pending for the next emission, until then those draws use stale arguments.
+	// Returns emitted bytes.
+	uint64_t EmitDrawArguments(uint32_t view, UploadSink& sink);
+
+#if !defined(APOLLO_HEADLESS)
+	// Copy draw arguments emitted through a SpanUploadSink into the argument buffer of a view.
+	// Span of the sink starts at sourceOffset of sourceBuffer.
+	void CopyDrawArguments(
+		ID3D12GraphicsCommandList* commandList, uint32_t view,
+		const std::vector<SpanUploadSink::Region>& regions, ID3D12Resource* sourceBuffer, uint64_t sourceOffset) const;
+
+	// Draw first rangeCount arguments of a view with one ExecuteIndirect. Static index buffer must be set.
+	// Range count is taken when arguments are emitted, so the draw matches them while the next cull runs.
+	void Draw(
+		ID3D12GraphicsCommandList* commandList, ID3D12CommandSignature* commandSignature,
+		uint32_t view, uint32_t rangeCount) const;
+#endif
 
 private:
-	QuadNode*								m_rootNode;
+	// Detail nodes share the stack and parent links with tree nodes, marked by this bit.
+	static constexpr uint32_t				DETAIL_NODE_BIT = 1u << 31;
+
+	uint32_t								GetFirstLeafNode() const { return GetNodeCount() - m_leafCount; }
+	bool									IsLodAccepted(uint32_t node, const LodView& view) const;
+
+	// Steepest rise over run of the displaced surface inside given corners, FLT_MAX without height map.
+	float									GetMaxSlope(const DirectX::XMFLOAT3 corners[4]) const;
+
+	// Views a node may be visible in are the low MAX_VIEWS bits of its mask. Above them each view has 6 bits
+	// of frustum planes the node may still cross, planes an ancestor lies fully inside are cleared.
+	static constexpr uint32_t				VISIBLE_VIEWS = (1u << MAX_VIEWS) - 1;
+
+	static constexpr uint32_t				GetPlaneShift(uint32_t view) { return MAX_VIEWS + 6 * view; }
+	static constexpr uint32_t				GetViewBits(uint32_t view) { return (1u << view) | (FrustumCulling::ALL_PLANES << GetPlaneShift(view)); }
+
+	// Walks of UpdateIndexRanges, return quad count culled for the camera view.
+	uint32_t TraverseNodes(const FrustumCulling::View* views, uint32_t viewCount, CullingKernel kernel);
+	uint32_t SweepGroups(const FrustumCulling::View* views, uint32_t viewCount, CullingKernel kernel);
+
+	// Plane tests of 4 siblings in every view the parent is visible in, against planes the parent crosses. Gives child masks.
+	void ClassifySiblings(
+		const OrientedBoxArray& bounds, uint32_t firstChild, const FrustumCulling::View* views, CullingKernel kernel,
+		uint32_t parentMask, uint32_t childMasks[4]);
+
+	// Drop views a node is hidden in by horizon, normal cone or occlusion.
+	uint32_t CullHiddenViews(
+		const FrustumCulling::View* views, uint32_t mask, const DirectX::XMFLOAT3& center, float radius,
+		const DirectX::XMFLOAT3& coneAxis, float sinHalfAngle, float cosHalfAngle, uint32_t quadCount);
+
+	// Append a range to the draw list of every view in mask.
+	void AppendRange(uint32_t mask, uint32_t start, uint32_t count, uint32_t lod);
+
+	// Horizon, normal cone and occlusion tests of a node inside the frustum. Counts the test that rejects it.
+	bool IsNodeHidden(
+		const FrustumCulling::View& view, const DirectX::XMFLOAT3& center, float radius,
+		const DirectX::XMFLOAT3& coneAxis, float sinHalfAngle, float cosHalfAngle, uint32_t quadCount);
+
+	void PushDetailChildren(
+		uint32_t block, const FrustumCulling::View* views, CullingKernel kernel, uint32_t mask,
+		uint32_t* stack, uint32_t* stackMasks, uint32_t& stackSize, uint32_t& culledQuadCount);
+	void RequestSplit(
+		uint32_t node, const FrustumCulling::View& view, const DirectX::XMFLOAT3& center, float radius,
+		uint32_t level, uint32_t indexCount);
+	bool									CanSplit(uint32_t level, uint32_t indexCount) const
+	{
+		return level < m_maxLevel + MAX_DETAIL_DEPTH && indexCount / 16 >= MIN_DETAIL_QUAD_COUNT;
+	}
+	void SplitNode(uint32_t node);
+
+	// Corners and bounds of child c of a node with given corners.
+	void CalcDetailChild(const DirectX::XMFLOAT3 corners[4], uint32_t c, DirectX::XMFLOAT3 childCorners[4], NodeBounds& bounds) const;
+
+	// Check points and triangles of base patches in an index range against bounds, see ValidateBounds.
+	void ValidatePatches(
+		const NodeBounds& bounds, uint32_t baseAddress, uint32_t indexCount,
+		const std::vector<DirectX::XMFLOAT3>& patchGrids, const std::vector<DirectX::XMFLOAT3>& patchNormals,
+		uint32_t segmentCount, uint32_t gridCount, BoundsReport& report) const;
+
+	// Check children of a node down to the deepest split, as if every one was split.
+	void ValidateDetailBounds(
+		const DirectX::XMFLOAT3 corners[4], uint32_t baseAddress, uint32_t indexCount, uint32_t level,
+		const std::vector<DirectX::XMFLOAT3>& patchGrids, const std::vector<DirectX::XMFLOAT3>& patchNormals,
+		uint32_t segmentCount, uint32_t gridCount, BoundsReport& report) const;
+	void EvictUnusedBlocks();
+
 	uint32_t								m_faceIndexCount;
+	uint32_t								m_maxLevel;
+	uint32_t								m_leafCount;
+
+	// Nodes in breadth-first order, children of node i are 4i+1 ~ 4i+4.
+	std::vector<uint8_t>					m_nodeLevels;
+	std::vector<uint32_t>					m_nodeBaseAddresses;
+	std::vector<uint32_t>					m_nodeIndexCounts;
+	std::vector<DirectX::XMFLOAT3>			m_obbCenters;
+	std::vector<DirectX::XMFLOAT3>			m_obbExtents;
+	std::vector<DirectX::XMFLOAT4>			m_obbOrientations;
+	std::vector<DirectX::XMFLOAT3>			m_sphereCenters;
+	std::vector<float>						m_sphereRadii;
+	std::vector<DirectX::XMFLOAT3>			m_coneAxes;
+	std::vector<float>						m_coneSinHalfAngles;
+	std::vector<float>						m_coneCosHalfAngles;
+	std::vector<DirectX::XMFLOAT2>			m_heightRanges;				// Displacement under node, min and max.
+	std::vector<DirectX::XMFLOAT3>			m_nodeCorners;				// 4 per node.
+	const HeightMap*						m_heightMap = nullptr;
+
+	// Node bounds prepared for batched frustum tests.
+	OrientedBoxArray						m_cullingBounds;
+	uint32_t								m_testedNodeCount = 0;
+	uint32_t								m_testedPlaneCount = 0;		// Box plane tests, 6 per node without plane masks.
+	uint32_t								m_horizonCulledQuadCount = 0;
+	uint32_t								m_backFaceCulledQuadCount = 0;
+	uint32_t								m_occludedNodeCount = 0;
+
+	// Tessellation groups in index order for the flat sweep, bounds only. A leaf holds m_groupCount / m_leafCount of them.
+	uint32_t								m_groupCount = 0;
+	uint32_t								m_groupIndexCount = 0;
+	std::vector<DirectX::XMFLOAT3>			m_groupCorners;				// 4 per group.
+	std::vector<DirectX::XMFLOAT3>			m_groupSphereCenters;
+	std::vector<float>						m_groupSphereRadii;
+	std::vector<DirectX::XMFLOAT3>			m_groupConeAxes;
+	std::vector<float>						m_groupConeSinHalfAngles;
+	std::vector<float>						m_groupConeCosHalfAngles;
+	OrientedBoxArray						m_groupCullingBounds;
+	std::vector<uint8_t>					m_groupViewMasks;
+	std::vector<uint8_t>					m_groupResults;
+
+	// Coarse patches of inner nodes follow the base index data, m_coarseIndexCount per node.
+	uint32_t								m_coarseBaseAddress = 0;
+	uint32_t								m_coarseIndexCount = 0;
+
+	// Selected LOD, one entry per leaf.
+	std::vector<uint8_t>					m_leafLodLevels;
+	std::vector<uint8_t>					m_leafLodEdges;
+	uint32_t								m_visiblePatchCount = 0;
 
-	std::vector<uint32_t>					m_renderIndexData;
+	// Detail nodes below leaves, children of a split node take one pool block.
+	NodePool								m_nodePool;
+	std::vector<uint32_t>					m_leafChildBlocks;
+	std::vector<uint8_t>					m_detailLevels;
+	std::vector<uint32_t>					m_detailBaseAddresses;
+	std::vector<uint32_t>					m_detailIndexCounts;
+	std::vector<DirectX::XMFLOAT3>			m_detailCorners;			// 4 per node.
+	std::vector<DirectX::XMFLOAT3>			m_detailSphereCenters;
+	std::vector<float>						m_detailSphereRadii;
+	std::vector<DirectX::XMFLOAT3>			m_detailConeAxes;
+	std::vector<float>						m_detailConeSinHalfAngles;
+	std::vector<float>						m_detailConeCosHalfAngles;
+	std::vector<uint32_t>					m_detailChildBlocks;
+	OrientedBoxArray						m_detailCullingBounds;
+	std::vector<uint32_t>					m_blockParents;				// Tree leaf or DETAIL_NODE_BIT | detail node.
+	std::vector<uint32_t>					m_blockLastUsedCulls;
+	std::vector<uint32_t>					m_splitRequests;
+	uint32_t								m_cullIndex = 0;
+	uint32_t								m_splitBlockCount = 0;
+	uint32_t								m_evictedBlockCount = 0;
 
-	uint32_t								m_staticIndexCount = 0;
-	uint32_t								m_staticIBSize = 0;
+	// Visible leaves of last two culls, one bit per leaf.
+	std::vector<uint64_t>					m_visibleLeafMask;
+	std::vector<uint64_t>					m_prevVisibleLeafMask;
+	uint32_t								m_enteredLeafCount = 0;
+	uint32_t								m_leftLeafCount = 0;
 
-	uint32_t								m_renderIndexCount = 0;
-	uint32_t								m_renderIBSize = 0;
+	// Draw list of one view. Draw arguments stay in default heap, only runs that differ from uploadedRanges are copied.
+	struct ViewDraws
+	{
+		IndexRangeList							indexRanges;
+		std::vector<IndexRange>					uploadedRanges;
+		std::vector<IndexRange>					dirtyArgumentRuns;
+#if !defined(APOLLO_HEADLESS)
+		Microsoft::WRL::ComPtr<ID3D12Resource>	argumentBuffer;
+#endif
+	};
 
-	D3D12_INDEX_BUFFER_VIEW					m_ibv;
-	Microsoft::WRL::ComPtr<ID3D12Resource>  m_staticIB;
-	Microsoft::WRL::ComPtr<ID3D12Resource>  m_uploadIB;
+	// Every visible leaf or detail node adds at most one range to a view.
+	uint32_t								m_maxRangeCount = 0;
+	uint32_t								m_viewCount = 0;			// Views with an argument buffer.
+	ViewDraws								m_views[MAX_VIEWS];
 };
\ No newline at end of file
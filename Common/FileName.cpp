@@ -0,0 +1,92 @@
+#include "pch.h"
+#include "FileName.h"
+
+#if defined(_WIN32) && defined(APOLLO_HEADLESS)
+	#define NOMINMAX
+	#define WIN32_LEAN_AND_MEAN
+	#include <Windows.h>
+#elif !defined(_WIN32)
+	#include <cstdio>
+	#include <sys/stat.h>
+#endif
+
+#if defined(_WIN32)
+
+bool FileName::GetStamp(const wchar_t* fileName, uint64_t& size, uint64_t& writeTime)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExW(fileName, GetFileExInfoStandard, &attributes))
+		return false;
+
+	size = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+	writeTime = (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+
+bool FileName::Replace(const wchar_t* source, const wchar_t* destination)
+{
+	return MoveFileExW(source, destination, MOVEFILE_REPLACE_EXISTING) != FALSE;
+}
+
+bool FileName::Remove(const wchar_t* fileName)
+{
+	return DeleteFileW(fileName) != FALSE;
+}
+
+#else
+
+std::string FileName::ToNative(const wchar_t* fileName)
+{
+	// Code points to UTF-8, wchar_t holds whole code points here.
+	std::string name;
+	for (; *fileName; fileName++)
+	{
+		const uint32_t c = static_cast<uint32_t>(*fileName);
+		if (c < 0x80)
+		{
+			name += static_cast<char>(c);
+		}
+		else if (c < 0x800)
+		{
+			name += static_cast<char>(0xC0 | (c >> 6));
+			name += static_cast<char>(0x80 | (c & 0x3F));
+		}
+		else if (c < 0x10000)
+		{
+			name += static_cast<char>(0xE0 | (c >> 12));
+			name += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+			name += static_cast<char>(0x80 | (c & 0x3F));
+		}
+		else
+		{
+			name += static_cast<char>(0xF0 | (c >> 18));
+			name += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+			name += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+			name += static_cast<char>(0x80 | (c & 0x3F));
+		}
+	}
+	return name;
+}
+
+bool FileName::GetStamp(const wchar_t* fileName, uint64_t& size, uint64_t& writeTime)
+{
+	struct stat status;
+	if (stat(ToNative(fileName).c_str(), &status) != 0)
+		return false;
+
+	size = static_cast<uint64_t>(status.st_size);
+	writeTime = static_cast<uint64_t>(status.st_mtime);
+	return true;
+}
+
+bool FileName::Replace(const wchar_t* source, const wchar_t* destination)
+{
+	return std::rename(ToNative(source).c_str(), ToNative(destination).c_str()) == 0;
+}
+
+bool FileName::Remove(const wchar_t* fileName)
+{
+	return std::remove(ToNative(fileName).c_str()) == 0;
+}
+
+#endif
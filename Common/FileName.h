@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// File names are wide strings, as the app gets them from Windows.
+// Elsewhere they are converted to UTF-8 for the standard library, so CPU-only tools and tests share the file code.
+namespace FileName
+{
+#if defined(_WIN32)
+	// File streams of MSVC take wide names as they are.
+	inline const wchar_t*					ToNative(const wchar_t* fileName) { return fileName; }
+#else
+	std::string								ToNative(const wchar_t* fileName);
+#endif
+
+	// Size and last write time of a file, false if it can not be read. Times only compare on the same platform.
+	bool GetStamp(const wchar_t* fileName, uint64_t& size, uint64_t& writeTime);
+
+	// Move source over destination, replacing it in one step.
+	bool Replace(const wchar_t* source, const wchar_t* destination);
+
+	// Delete a file, false if it is missing or can not be deleted.
+	bool Remove(const wchar_t* fileName);
+}
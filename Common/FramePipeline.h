@@ -0,0 +1,163 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+// Fixed ring of frame packets handed from one producer stage to one consumer stage, each on its own thread.
+// Producer fills the next free slot and publishes it, consumer reads published slots in order and releases them.
+// Hand-off is a pair of atomic counters. TryAcquire, Publish and Release are lock-free while no stage is parked.
+// The ring as a whole is not: a blocking acquire parks on a mutex and condition variable when its side stays empty
+// or full for a while, and the other stage then takes the mutex to wake it. C++14 has no atomic wait to park on instead.
+// Slots are reused, a packet keeps what its last frame left in it. Has no graphics API dependency.
+template <typename Packet, uint32_t SlotCount>
+class FramePipeline
+{
+public:
+	static constexpr uint32_t				SPIN_COUNT = 64;		// Yields before a stage parks.
+	static constexpr std::chrono::microseconds	NO_TIMEOUT = std::chrono::microseconds::max();
+
+	FramePipeline() = default;
+
+	FramePipeline(const FramePipeline&) = delete;
+	FramePipeline& operator=(const FramePipeline&) = delete;
+
+	// Producer. Next free slot, nullptr while every slot is published and not released yet, or once closed.
+	Packet* TryAcquireWrite()
+	{
+		const uint64_t write = m_writeCount.load();
+		if (m_closed.load() || write - m_readCount.load() == SlotCount)
+			return nullptr;
+
+		return &m_slots[write % SlotCount];
+	}
+
+	// Producer. Blocks while the ring is full, at most for timeout. nullptr once closed or timed out.
+	Packet* AcquireWrite(std::chrono::microseconds timeout = NO_TIMEOUT)
+	{
+		return Acquire([this]() { return TryAcquireWrite(); }, m_writeWaitCount, timeout);
+	}
+
+	// Producer. Slot of the last acquire is written, the consumer may read it.
+	void Publish()
+	{
+		m_writeCount.fetch_add(1);
+		Wake();
+	}
+
+	// Consumer. Oldest published slot, nullptr while none is published, or once closed and drained.
+	const Packet* TryAcquireRead()
+	{
+		const uint64_t read = m_readCount.load();
+		if (m_writeCount.load() == read)
+			return nullptr;
+
+		return &m_slots[read % SlotCount];
+	}
+
+	// Consumer. Blocks while the ring is empty, at most for timeout. Packets published before Close are still handed out.
+	const Packet* AcquireRead(std::chrono::microseconds timeout = NO_TIMEOUT)
+	{
+		return Acquire([this]() { return TryAcquireRead(); }, m_readWaitCount, timeout);
+	}
+
+	// Consumer. Slot of the last acquire is read, the producer may reuse it.
+	void Release()
+	{
+		m_readCount.fetch_add(1);
+		Wake();
+	}
+
+	// No more packets are written. Parked stages wake up, the consumer drains what was published.
+	void Close()
+	{
+		m_closed.store(true);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+		}
+		m_condition.notify_all();
+	}
+
+	// Drop unread packets and open again. Neither stage may be running.
+	void Reset()
+	{
+		m_writeCount.store(0);
+		m_readCount.store(0);
+		m_closed.store(false);
+	}
+
+	bool									IsClosed() const { return m_closed.load(); }
+	uint32_t								GetQueuedCount() const { return static_cast<uint32_t>(m_writeCount.load() - m_readCount.load()); }
+
+	// Times a stage found its side of the ring full or empty and had to wait.
+	uint32_t								GetWriteWaitCount() const { return m_writeWaitCount.load(std::memory_order_relaxed); }
+	uint32_t								GetReadWaitCount() const { return m_readWaitCount.load(std::memory_order_relaxed); }
+
+private:
+	template <typename TryAcquire>
+	auto Acquire(TryAcquire tryAcquire, std::atomic<uint32_t>& waitCount, std::chrono::microseconds timeout) -> decltype(tryAcquire())
+	{
+		auto slot = tryAcquire();
+		if (slot || m_closed.load())
+			return slot;
+
+		waitCount.fetch_add(1, std::memory_order_relaxed);
+		for (uint32_t i = 0; i < SPIN_COUNT; i++)
+		{
+			std::this_thread::yield();
+			slot = tryAcquire();
+			if (slot || m_closed.load())
+				return slot;
+		}
+
+		// Parked count is raised before the counters are checked again under the mutex, and the other stage
+		// reads it after moving its counter, so one of both always sees the other. Every access is sequentially consistent.
+		std::unique_lock<std::mutex> lock(m_mutex);
+		const auto ready = [&]()
+		{
+			slot = tryAcquire();
+			return slot || m_closed.load();
+		};
+
+		m_parkedCount.fetch_add(1);
+		if (timeout == NO_TIMEOUT)
+			m_condition.wait(lock, ready);
+		else
+			m_condition.wait_for(lock, timeout, ready);
+		m_parkedCount.fetch_sub(1);
+
+		return slot;
+	}
+
+	void Wake()
+	{
+		if (m_parkedCount.load() == 0)
+			return;
+
+		// Parked stage holds the mutex from its last check until it sleeps, taking it here cannot slip in between.
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+		}
+		m_condition.notify_all();
+	}
+
+	Packet									m_slots[SlotCount];
+
+	// Counters grow without bound, slot is counter modulo SlotCount. Published but unread packets are [read, write).
+	std::atomic<uint64_t>					m_writeCount { 0 };
+	std::atomic<uint64_t>					m_readCount { 0 };
+	std::atomic<bool>						m_closed { false };
+
+	std::mutex								m_mutex;
+	std::condition_variable					m_condition;
+	std::atomic<uint32_t>					m_parkedCount { 0 };
+
+	std::atomic<uint32_t>					m_writeWaitCount { 0 };
+	std::atomic<uint32_t>					m_readWaitCount { 0 };
+};
+
+template <typename Packet, uint32_t SlotCount>
+constexpr std::chrono::microseconds FramePipeline<Packet, SlotCount>::NO_TIMEOUT;
@@ -0,0 +1,466 @@
+#include "pch.h"
+#include "FrustumCulling.h"
+
+#include <immintrin.h>
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#else
+	#include <cpuid.h>
+#endif
+
+// GCC and Clang only emit AVX in functions marked for it, MSVC in any function.
+#if defined(_MSC_VER)
+	#define AVX_FUNCTION
+#else
+	#define AVX_FUNCTION __attribute__((target("avx")))
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+	// ECX of CPUID leaf 1.
+	uint32_t GetFeatureFlags()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		return static_cast<uint32_t>(info[2]);
+#else
+		unsigned int eax, ebx, ecx, edx;
+		return __get_cpuid(1, &eax, &ebx, &ecx, &edx) ? ecx : 0;
+#endif
+	}
+
+	// Register states saved by the OS, only valid with OSXSAVE set.
+	uint64_t GetEnabledStates()
+	{
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		uint32_t eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+	}
+}
+
+void OrientedBoxArray::Resize(uint32_t count)
+{
+	m_count = count;
+	for (std::vector<float>& component : m_components)
+		component.resize(count);
+}
+
+void OrientedBoxArray::Set(uint32_t index, const BoundingOrientedBox& box)
+{
+	// Same axes as BoundingOrientedBox uses for its plane tests.
+	const XMMATRIX rotation = XMMatrixRotationQuaternion(XMLoadFloat4(&box.Orientation));
+	const float extents[3] = { box.Extents.x, box.Extents.y, box.Extents.z };
+
+	m_components[CENTER_X][index] = box.Center.x;
+	m_components[CENTER_Y][index] = box.Center.y;
+	m_components[CENTER_Z][index] = box.Center.z;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		XMFLOAT3 scaledAxis;
+		XMStoreFloat3(&scaledAxis, rotation.r[axis] * extents[axis]);
+
+		m_components[AXIS0_X + axis * 3][index] = scaledAxis.x;
+		m_components[AXIS0_Y + axis * 3][index] = scaledAxis.y;
+		m_components[AXIS0_Z + axis * 3][index] = scaledAxis.z;
+	}
+}
+
+FrustumCulling::Planes FrustumCulling::LoadPlanes(const BoundingFrustum& frustum)
+{
+	XMVECTOR planeVectors[6];
+	frustum.GetPlanes(
+		&planeVectors[0], &planeVectors[1], &planeVectors[2],
+		&planeVectors[3], &planeVectors[4], &planeVectors[5]);
+
+	Planes planes;
+	for (int p = 0; p < 6; p++)
+	{
+		XMFLOAT4 plane;
+		XMStoreFloat4(&plane, planeVectors[p]);
+
+		planes.normalX[p] = plane.x;
+		planes.normalY[p] = plane.y;
+		planes.normalZ[p] = plane.z;
+		planes.distance[p] = plane.w;
+	}
+
+	return planes;
+}
+
+FrustumCulling::Planes FrustumCulling::LoadPlanes(const BoundingOrientedBox& box)
+{
+	const XMMATRIX rotation = XMMatrixRotationQuaternion(XMLoadFloat4(&box.Orientation));
+	const XMVECTOR center = XMLoadFloat3(&box.Center);
+	const float extents[3] = { box.Extents.x, box.Extents.y, box.Extents.z };
+
+	// Two planes per box axis, inside is where dot(normal, p) + distance <= 0.
+	Planes planes;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		XMFLOAT3 normal;
+		XMStoreFloat3(&normal, rotation.r[axis]);
+		const float centerDistance = XMVectorGetX(XMVector3Dot(rotation.r[axis], center));
+
+		for (int side = 0; side < 2; side++)
+		{
+			const int p = 2 * axis + side;
+			const float sign = side == 0 ? 1.0f : -1.0f;
+			planes.normalX[p] = sign * normal.x;
+			planes.normalY[p] = sign * normal.y;
+			planes.normalZ[p] = sign * normal.z;
+			planes.distance[p] = -sign * centerDistance - extents[axis];
+		}
+	}
+
+	return planes;
+}
+
+FrustumCulling::Planes FrustumCulling::ExpandPlanes(const Planes& planes, float margin)
+{
+	Planes expanded = planes;
+	for (float& distance : expanded.distance)
+		distance -= margin;
+
+	return expanded;
+}
+
+bool FrustumCulling::IsCoveredByMargin(const Planes& culledPlanes, const Planes& planes, float boundRadius, float margin)
+{
+	return GetCoveringMargin(culledPlanes, planes, boundRadius) <= margin;
+}
+
+float FrustumCulling::GetCoveringMargin(const Planes& culledPlanes, const Planes& planes, float boundRadius)
+{
+	// Signed distance of a box changes at most |dn| * |center| + |dd|, projected radius at most |dn| * sum of extents.
+	float margin = 0.0f;
+	for (int p = 0; p < 6; p++)
+	{
+		const float dx = planes.normalX[p] - culledPlanes.normalX[p];
+		const float dy = planes.normalY[p] - culledPlanes.normalY[p];
+		const float dz = planes.normalZ[p] - culledPlanes.normalZ[p];
+		const float normalDelta = sqrtf(dx * dx + dy * dy + dz * dz);
+		const float distanceDelta = fabsf(planes.distance[p] - culledPlanes.distance[p]);
+
+		margin = std::max(margin, normalDelta * boundRadius + distanceDelta);
+	}
+
+	return margin;
+}
+
+FrustumCulling::Horizon FrustumCulling::LoadHorizon(const XMFLOAT3& cameraPosition, float occluderRadius, bool enabled)
+{
+	Horizon horizon = {};
+	horizon.cameraPosition = cameraPosition;
+
+	const float cameraDistance = sqrtf(
+		cameraPosition.x * cameraPosition.x + cameraPosition.y * cameraPosition.y + cameraPosition.z * cameraPosition.z);
+	horizon.enabled = enabled && occluderRadius > 0.0f && cameraDistance > occluderRadius;
+	if (!horizon.enabled)
+		return horizon;
+
+	horizon.axis = XMFLOAT3(
+		-cameraPosition.x / cameraDistance, -cameraPosition.y / cameraDistance, -cameraPosition.z / cameraDistance);
+	horizon.sinHalfAngle = occluderRadius / cameraDistance;
+	horizon.cosHalfAngle = sqrtf(1.0f - horizon.sinHalfAngle * horizon.sinHalfAngle);
+	horizon.planeDistance = (cameraDistance * cameraDistance - occluderRadius * occluderRadius) / cameraDistance;
+
+	return horizon;
+}
+
+bool FrustumCulling::IsSphereBeyondHorizon(const Horizon& horizon, const XMFLOAT3& center, float radius)
+{
+	if (!horizon.enabled)
+		return false;
+
+	const float wx = center.x - horizon.cameraPosition.x;
+	const float wy = center.y - horizon.cameraPosition.y;
+	const float wz = center.z - horizon.cameraPosition.z;
+
+	// Behind horizon plane.
+	const float axial = wx * horizon.axis.x + wy * horizon.axis.y + wz * horizon.axis.z;
+	if (axial - horizon.planeDistance < radius)
+		return false;
+
+	// Inside shadow cone, distance to cone surface is axial * sin - perpendicular * cos.
+	const float perpendicular = sqrtf(std::max(wx * wx + wy * wy + wz * wz - axial * axial, 0.0f));
+	return axial * horizon.sinHalfAngle - perpendicular * horizon.cosHalfAngle >= radius;
+}
+
+bool FrustumCulling::IsConeBackFacing(
+	const ConeView& view, const XMFLOAT3& center, float radius,
+	const XMFLOAT3& coneAxis, float sinHalfAngle, float cosHalfAngle)
+{
+	if (!view.enabled)
+		return false;
+
+	const float vx = center.x - view.cameraPosition.x;
+	const float vy = center.y - view.cameraPosition.y;
+	const float vz = center.z - view.cameraPosition.z;
+	const float distance = sqrtf(vx * vx + vy * vy + vz * vz);
+	if (distance <= radius + view.margin)
+		return false;
+
+	// Angle between view direction and cone axis.
+	const float cosAngle = (vx * coneAxis.x + vy * coneAxis.y + vz * coneAxis.z) / distance;
+	const float sinAngle = sqrtf(std::max(1.0f - cosAngle * cosAngle, 0.0f));
+
+	// Normal closest to camera is cone half angle nearer, cos(angle + halfAngle) must stay positive.
+	const float cosClosest = cosAngle * cosHalfAngle - sinAngle * sinHalfAngle;
+	if (cosAngle <= 0.0f || cosClosest <= 0.0f)
+		return false;
+
+	// Any point within radius, seen from any camera within margin, still faces away.
+	return distance * cosClosest > radius + view.margin;
+}
+
+CullingKernel FrustumCulling::GetBestKernel()
+{
+	static const CullingKernel bestKernel = []()
+	{
+		const uint32_t features = GetFeatureFlags();
+
+		// AVX needs CPU support and the OS saving YMM registers.
+		const bool osxsave = (features & (1u << 27)) != 0;
+		const bool avx = (features & (1u << 28)) != 0;
+		if (osxsave && avx && (GetEnabledStates() & 0x6) == 0x6)
+			return CullingKernel::AVX;
+
+		// SSE2 is part of x64.
+		return CullingKernel::SSE;
+	}();
+
+	return bestKernel;
+}
+
+const char* FrustumCulling::GetKernelName(CullingKernel kernel)
+{
+	switch (kernel)
+	{
+	case CullingKernel::Scalar:	return "Scalar";
+	case CullingKernel::SSE:	return "SSE (4 nodes)";
+	case CullingKernel::AVX:	return "AVX (8 nodes)";
+	default:					return "Unknown";
+	}
+}
+
+void FrustumCulling::ClassifyBoxes(
+	CullingKernel kernel, const Planes& planes,
+	const OrientedBoxArray& boxes, uint32_t first, uint32_t count,
+	uint8_t* results, uint8_t planeMask, uint8_t* insidePlanes)
+{
+	switch (kernel)
+	{
+	case CullingKernel::AVX:
+		ClassifyAVX(planes, boxes, first, count, results, planeMask, insidePlanes);
+		break;
+	case CullingKernel::SSE:
+		ClassifySSE(planes, boxes, first, count, results, planeMask, insidePlanes);
+		break;
+	default:
+		ClassifyScalar(planes, boxes, first, count, results, planeMask, insidePlanes);
+		break;
+	}
+}
+
+void FrustumCulling::ClassifyScalar(
+	const Planes& planes, const OrientedBoxArray& boxes, uint32_t first, uint32_t count,
+	uint8_t* results, uint8_t planeMask, uint8_t* insidePlanes)
+{
+	const float* c[OrientedBoxArray::COMPONENT_COUNT];
+	for (int i = 0; i < OrientedBoxArray::COMPONENT_COUNT; i++)
+		c[i] = boxes.Get(static_cast<OrientedBoxArray::Component>(i));
+
+	for (uint32_t b = first; b < first + count; b++)
+	{
+		bool anyOutside = false;
+		uint8_t inside = 0;
+
+		for (int p = 0; p < 6; p++)
+		{
+			if (!(planeMask & (1u << p)))
+				continue;
+
+			const float nx = planes.normalX[p];
+			const float ny = planes.normalY[p];
+			const float nz = planes.normalZ[p];
+
+			// Signed distance of center and projected radius of box on plane normal.
+			const float dist = c[OrientedBoxArray::CENTER_X][b] * nx + c[OrientedBoxArray::CENTER_Y][b] * ny + c[OrientedBoxArray::CENTER_Z][b] * nz + planes.distance[p];
+			const float radius =
+				fabsf(c[OrientedBoxArray::AXIS0_X][b] * nx + c[OrientedBoxArray::AXIS0_Y][b] * ny + c[OrientedBoxArray::AXIS0_Z][b] * nz) +
+				fabsf(c[OrientedBoxArray::AXIS1_X][b] * nx + c[OrientedBoxArray::AXIS1_Y][b] * ny + c[OrientedBoxArray::AXIS1_Z][b] * nz) +
+				fabsf(c[OrientedBoxArray::AXIS2_X][b] * nx + c[OrientedBoxArray::AXIS2_Y][b] * ny + c[OrientedBoxArray::AXIS2_Z][b] * nz);
+
+			anyOutside |= dist > radius;
+			if (dist < -radius)
+				inside |= 1u << p;
+		}
+
+		results[b - first] = static_cast<uint8_t>(anyOutside ? DISJOINT : inside == planeMask ? CONTAINS : INTERSECTS);
+		if (insidePlanes)
+			insidePlanes[b - first] = inside;
+	}
+}
+
+void FrustumCulling::ClassifySSE(
+	const Planes& planes, const OrientedBoxArray& boxes, uint32_t first, uint32_t count,
+	uint8_t* results, uint8_t planeMask, uint8_t* insidePlanes)
+{
+	const float* c[OrientedBoxArray::COMPONENT_COUNT];
+	for (int i = 0; i < OrientedBoxArray::COMPONENT_COUNT; i++)
+		c[i] = boxes.Get(static_cast<OrientedBoxArray::Component>(i));
+
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+
+	uint32_t b = first;
+	for (; b + 4 <= first + count; b += 4)
+	{
+		__m128 v[OrientedBoxArray::COMPONENT_COUNT];
+		for (int i = 0; i < OrientedBoxArray::COMPONENT_COUNT; i++)
+			v[i] = _mm_loadu_ps(c[i] + b);
+
+		__m128 anyOutside = _mm_setzero_ps();
+		__m128 allInside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		uint8_t laneInside[4] = {};
+
+		for (int p = 0; p < 6; p++)
+		{
+			if (!(planeMask & (1u << p)))
+				continue;
+
+			const __m128 nx = _mm_set1_ps(planes.normalX[p]);
+			const __m128 ny = _mm_set1_ps(planes.normalY[p]);
+			const __m128 nz = _mm_set1_ps(planes.normalZ[p]);
+
+			const __m128 dist = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(v[OrientedBoxArray::CENTER_X], nx), _mm_mul_ps(v[OrientedBoxArray::CENTER_Y], ny)),
+				_mm_add_ps(_mm_mul_ps(v[OrientedBoxArray::CENTER_Z], nz), _mm_set1_ps(planes.distance[p])));
+
+			__m128 radius = _mm_setzero_ps();
+			for (int axis = 0; axis < 3; axis++)
+			{
+				const __m128 projected = _mm_add_ps(
+					_mm_add_ps(
+						_mm_mul_ps(v[OrientedBoxArray::AXIS0_X + axis * 3], nx),
+						_mm_mul_ps(v[OrientedBoxArray::AXIS0_Y + axis * 3], ny)),
+					_mm_mul_ps(v[OrientedBoxArray::AXIS0_Z + axis * 3], nz));
+				radius = _mm_add_ps(radius, _mm_andnot_ps(signMask, projected));
+			}
+
+			const __m128 planeInside = _mm_cmplt_ps(dist, _mm_xor_ps(radius, signMask));
+			anyOutside = _mm_or_ps(anyOutside, _mm_cmpgt_ps(dist, radius));
+			allInside = _mm_and_ps(allInside, planeInside);
+
+			if (insidePlanes)
+			{
+				const int planeInsideBits = _mm_movemask_ps(planeInside);
+				for (int lane = 0; lane < 4; lane++)
+					laneInside[lane] |= static_cast<uint8_t>(((planeInsideBits >> lane) & 1) << p);
+			}
+		}
+
+		const int outsideBits = _mm_movemask_ps(anyOutside);
+		const int insideBits = _mm_movemask_ps(allInside);
+		for (int lane = 0; lane < 4; lane++)
+		{
+			results[b - first + lane] = static_cast<uint8_t>(
+				(outsideBits >> lane) & 1 ? DISJOINT : (insideBits >> lane) & 1 ? CONTAINS : INTERSECTS);
+		}
+
+		if (insidePlanes)
+			memcpy(insidePlanes + (b - first), laneInside, sizeof(laneInside));
+	}
+
+	// Remaining boxes that do not fill a batch.
+	if (b < first + count)
+		ClassifyScalar(
+			planes, boxes, b, first + count - b, results + (b - first), planeMask,
+			insidePlanes ? insidePlanes + (b - first) : nullptr);
+}
+
+AVX_FUNCTION void FrustumCulling::ClassifyAVX(
+	const Planes& planes, const OrientedBoxArray& boxes, uint32_t first, uint32_t count,
+	uint8_t* results, uint8_t planeMask, uint8_t* insidePlanes)
+{
+	const float* c[OrientedBoxArray::COMPONENT_COUNT];
+	for (int i = 0; i < OrientedBoxArray::COMPONENT_COUNT; i++)
+		c[i] = boxes.Get(static_cast<OrientedBoxArray::Component>(i));
+
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+
+	uint32_t b = first;
+	for (; b + 8 <= first + count; b += 8)
+	{
+		__m256 v[OrientedBoxArray::COMPONENT_COUNT];
+		for (int i = 0; i < OrientedBoxArray::COMPONENT_COUNT; i++)
+			v[i] = _mm256_loadu_ps(c[i] + b);
+
+		__m256 anyOutside = _mm256_setzero_ps();
+		__m256 allInside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		uint8_t laneInside[8] = {};
+
+		for (int p = 0; p < 6; p++)
+		{
+			if (!(planeMask & (1u << p)))
+				continue;
+
+			const __m256 nx = _mm256_set1_ps(planes.normalX[p]);
+			const __m256 ny = _mm256_set1_ps(planes.normalY[p]);
+			const __m256 nz = _mm256_set1_ps(planes.normalZ[p]);
+
+			const __m256 dist = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(v[OrientedBoxArray::CENTER_X], nx), _mm256_mul_ps(v[OrientedBoxArray::CENTER_Y], ny)),
+				_mm256_add_ps(_mm256_mul_ps(v[OrientedBoxArray::CENTER_Z], nz), _mm256_set1_ps(planes.distance[p])));
+
+			__m256 radius = _mm256_setzero_ps();
+			for (int axis = 0; axis < 3; axis++)
+			{
+				const __m256 projected = _mm256_add_ps(
+					_mm256_add_ps(
+						_mm256_mul_ps(v[OrientedBoxArray::AXIS0_X + axis * 3], nx),
+						_mm256_mul_ps(v[OrientedBoxArray::AXIS0_Y + axis * 3], ny)),
+					_mm256_mul_ps(v[OrientedBoxArray::AXIS0_Z + axis * 3], nz));
+				radius = _mm256_add_ps(radius, _mm256_andnot_ps(signMask, projected));
+			}
+
+			const __m256 planeInside = _mm256_cmp_ps(dist, _mm256_xor_ps(radius, signMask), _CMP_LT_OQ);
+			anyOutside = _mm256_or_ps(anyOutside, _mm256_cmp_ps(dist, radius, _CMP_GT_OQ));
+			allInside = _mm256_and_ps(allInside, planeInside);
+
+			if (insidePlanes)
+			{
+				const int planeInsideBits = _mm256_movemask_ps(planeInside);
+				for (int lane = 0; lane < 8; lane++)
+					laneInside[lane] |= static_cast<uint8_t>(((planeInsideBits >> lane) & 1) << p);
+			}
+		}
+
+		const int outsideBits = _mm256_movemask_ps(anyOutside);
+		const int insideBits = _mm256_movemask_ps(allInside);
+		for (int lane = 0; lane < 8; lane++)
+		{
+			results[b - first + lane] = static_cast<uint8_t>(
+				(outsideBits >> lane) & 1 ? DISJOINT : (insideBits >> lane) & 1 ? CONTAINS : INTERSECTS);
+		}
+
+		if (insidePlanes)
+			memcpy(insidePlanes + (b - first), laneInside, sizeof(laneInside));
+	}
+
+	// Avoid AVX to SSE transition penalty in following code.
+	_mm256_zeroupper();
+
+	// Remaining boxes that do not fill a batch.
+	if (b < first + count)
+		ClassifySSE(
+			planes, boxes, b, first + count - b, results + (b - first), planeMask,
+			insidePlanes ? insidePlanes + (b - first) : nullptr);
+}
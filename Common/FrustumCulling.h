@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <DirectXCollision.h>
+
+class OcclusionBuffer;
+
+// Oriented boxes in structure of arrays form for batched plane tests.
+// Box axes are stored pre-scaled by extents.
+class OrientedBoxArray
+{
+public:
+	enum Component
+	{
+		CENTER_X, CENTER_Y, CENTER_Z,
+		AXIS0_X, AXIS0_Y, AXIS0_Z,
+		AXIS1_X, AXIS1_Y, AXIS1_Z,
+		AXIS2_X, AXIS2_Y, AXIS2_Z,
+		COMPONENT_COUNT
+	};
+
+	void Resize(uint32_t count);
+	void Set(uint32_t index, const DirectX::BoundingOrientedBox& box);
+
+	uint32_t		GetCount() const { return m_count; }
+	const float*	Get(Component component) const { return m_components[component].data(); }
+
+private:
+	uint32_t				m_count = 0;
+	std::vector<float>		m_components[COMPONENT_COUNT];
+};
+
+enum class CullingKernel
+{
+	Scalar,
+	SSE,
+	AVX,
+};
+
+// Batched oriented box vs frustum classification.
+// Results match DirectX::BoundingFrustum::Contains (DISJOINT, INTERSECTS, CONTAINS).
+class FrustumCulling
+{
+public:
+	// World space frustum planes, normals point outward.
+	struct Planes
+	{
+		float	normalX[6];
+		float	normalY[6];
+		float	normalZ[6];
+		float	distance[6];
+	};
+
+	static Planes LoadPlanes(const DirectX::BoundingFrustum& frustum);
+
+	// Planes of a box, such as the volume of an orthographic projection.
+	static Planes LoadPlanes(const DirectX::BoundingOrientedBox& box);
+
+	// Push every plane outward by margin, so boxes near the frustum stay visible.
+	static Planes ExpandPlanes(const Planes& planes, float margin);
+
+	// True if boxes visible with planes are a subset of boxes visible with culledPlanes expanded by margin.
+	// boundRadius must bound length of center plus sum of extents of every tested box.
+	static bool IsCoveredByMargin(const Planes& culledPlanes, const Planes& planes, float boundRadius, float margin);
+
+	// Smallest margin for which IsCoveredByMargin holds.
+	static float GetCoveringMargin(const Planes& culledPlanes, const Planes& planes, float boundRadius);
+
+	// Occluder sphere at origin seen from camera, with shadow cone terms precomputed.
+	struct Horizon
+	{
+		bool				enabled;
+		DirectX::XMFLOAT3	cameraPosition;
+		DirectX::XMFLOAT3	axis;				// Camera to sphere center, normalized.
+		float				sinHalfAngle;
+		float				cosHalfAngle;
+		float				planeDistance;		// Camera to horizon plane along axis.
+	};
+
+	// Horizon is disabled when camera is inside the occluder.
+	static Horizon LoadHorizon(const DirectX::XMFLOAT3& cameraPosition, float occluderRadius, bool enabled);
+
+	// True if sphere lies entirely inside shadow cone of occluder and beyond horizon plane.
+	static bool IsSphereBeyondHorizon(const Horizon& horizon, const DirectX::XMFLOAT3& center, float radius);
+
+	// Camera for normal cone tests, margin covers camera movement until next cull.
+	struct ConeView
+	{
+		bool				enabled;
+		DirectX::XMFLOAT3	cameraPosition;
+		float				margin;
+	};
+
+	// True if every normal inside cone faces away from camera at every point of sphere.
+	static bool IsConeBackFacing(
+		const ConeView& view, const DirectX::XMFLOAT3& center, float radius,
+		const DirectX::XMFLOAT3& coneAxis, float sinHalfAngle, float cosHalfAngle);
+
+	// Every test of one cull.
+	struct View
+	{
+		Planes				planes;
+		Horizon				horizon;
+		ConeView			cone;
+		const OcclusionBuffer*	occlusion;		// Null when occlusion culling is off.
+		DirectX::XMFLOAT3	cameraPosition;	// Camera of this cull, decides which nodes are split.
+	};
+
+	// Widest kernel supported by this CPU and OS.
+	static CullingKernel GetBestKernel();
+	static const char* GetKernelName(CullingKernel kernel);
+
+	// One bit per plane, in Planes order.
+	static constexpr uint8_t ALL_PLANES = 0x3F;
+
+	// Classify boxes [first, first + count), one ContainmentType value per box.
+	// Only planes in planeMask are tested, a box inside all of them is CONTAINS. Planes a box lies fully inside
+	// go to insidePlanes when given, so children of the box can leave them out.
+	static void ClassifyBoxes(
+		CullingKernel kernel, const Planes& planes,
+		const OrientedBoxArray& boxes, uint32_t first, uint32_t count,
+		uint8_t* results, uint8_t planeMask = ALL_PLANES, uint8_t* insidePlanes = nullptr);
+
+private:
+	static void ClassifyScalar(
+		const Planes& planes, const OrientedBoxArray& boxes, uint32_t first, uint32_t count,
+		uint8_t* results, uint8_t planeMask, uint8_t* insidePlanes);
+	static void ClassifySSE(
+		const Planes& planes, const OrientedBoxArray& boxes, uint32_t first, uint32_t count,
+		uint8_t* results, uint8_t planeMask, uint8_t* insidePlanes);
+	static void ClassifyAVX(
+		const Planes& planes, const OrientedBoxArray& boxes, uint32_t first, uint32_t count,
+		uint8_t* results, uint8_t planeMask, uint8_t* insidePlanes);
+};
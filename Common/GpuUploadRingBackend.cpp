@@ -0,0 +1,41 @@
+#include "pch.h"
+#include "GpuUploadRingBackend.h"
+
+GpuUploadRingBackend::GpuUploadRingBackend(ID3D12Device* device, uint64_t size, ID3D12Fence* fence) :
+	m_fence(fence), m_size(size)
+{
+	// Create upload heap.
+	CD3DX12_HEAP_PROPERTIES uploadHeapProp(D3D12_HEAP_TYPE_UPLOAD);
+	auto resDesc = CD3DX12_RESOURCE_DESC::Buffer(size);
+	DX::ThrowIfFailed(
+		device->CreateCommittedResource(
+			&uploadHeapProp,
+			D3D12_HEAP_FLAG_NONE,
+			&resDesc,
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+			nullptr,
+			IID_PPV_ARGS(m_uploadHeap.ReleaseAndGetAddressOf())));
+
+	// Mapping, kept until destruction.
+	DX::ThrowIfFailed(m_uploadHeap->Map(0, nullptr, reinterpret_cast<void**>(&m_mappedData)));
+	m_gpuAddress = m_uploadHeap->GetGPUVirtualAddress();
+
+	m_fenceEvent.Attach(CreateEventEx(nullptr, nullptr, 0, EVENT_MODIFY_STATE | SYNCHRONIZE));
+	if (!m_fenceEvent.IsValid())
+		throw std::system_error(std::error_code(static_cast<int>(GetLastError()), std::system_category()), "CreateEventEx");
+}
+
+GpuUploadRingBackend::~GpuUploadRingBackend()
+{
+	if (m_uploadHeap)
+		m_uploadHeap->Unmap(0, nullptr);
+}
+
+void GpuUploadRingBackend::WaitForFenceValue(uint64_t value)
+{
+	if (m_fence->GetCompletedValue() >= value)
+		return;
+
+	DX::ThrowIfFailed(m_fence->SetEventOnCompletion(value, m_fenceEvent.Get()));
+	std::ignore = WaitForSingleObjectEx(m_fenceEvent.Get(), INFINITE, FALSE);
+}
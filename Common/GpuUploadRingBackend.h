@@ -0,0 +1,31 @@
+#pragma once
+
+#include "UploadRing.h"
+
+// Upload heap mapped for its whole lifetime, retired by the frame fence of the command queue.
+class GpuUploadRingBackend : public UploadRingBackend
+{
+public:
+	GpuUploadRingBackend(ID3D12Device* device, uint64_t size, ID3D12Fence* fence);
+	~GpuUploadRingBackend() override;
+
+	GpuUploadRingBackend(const GpuUploadRingBackend& rhs) = delete;
+	GpuUploadRingBackend& operator=(const GpuUploadRingBackend& rhs) = delete;
+
+	uint8_t*								GetCpuAddress() const override { return m_mappedData; }
+	uint64_t								GetGpuAddress() const override { return m_gpuAddress; }
+	uint64_t								GetSize() const override { return m_size; }
+
+	uint64_t								GetCompletedFenceValue() override { return m_fence->GetCompletedValue(); }
+	void									WaitForFenceValue(uint64_t value) override;
+
+	ID3D12Resource*							GetResource() const { return m_uploadHeap.Get(); }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Resource>	m_uploadHeap;
+	Microsoft::WRL::ComPtr<ID3D12Fence>		m_fence;
+	Microsoft::WRL::Wrappers::Event			m_fenceEvent;
+	uint8_t*								m_mappedData = nullptr;
+	uint64_t								m_gpuAddress = 0;
+	uint64_t								m_size;
+};
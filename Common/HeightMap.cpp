@@ -0,0 +1,653 @@
+#include "pch.h"
+#include "HeightMap.h"
+
+#include "FileName.h"
+
+#include <cfloat>
+#include <fstream>
+#include <string>
+#include <DirectXPackedVector.h>
+
+using namespace DirectX;
+
+namespace
+{
+	// File layout of DDS.h in DDSTextureLoader.
+	struct DdsPixelFormat
+	{
+		uint32_t	size;
+		uint32_t	flags;
+		uint32_t	fourCC;
+		uint32_t	rgbBitCount;
+		uint32_t	rBitMask;
+		uint32_t	gBitMask;
+		uint32_t	bBitMask;
+		uint32_t	aBitMask;
+	};
+
+	struct DdsHeader
+	{
+		uint32_t		size;
+		uint32_t		flags;
+		uint32_t		height;
+		uint32_t		width;
+		uint32_t		pitchOrLinearSize;
+		uint32_t		depth;
+		uint32_t		mipMapCount;
+		uint32_t		reserved1[11];
+		DdsPixelFormat	pixelFormat;
+		uint32_t		caps;
+		uint32_t		caps2;
+		uint32_t		caps3;
+		uint32_t		caps4;
+		uint32_t		reserved2;
+	};
+
+	struct DdsHeaderDxt10
+	{
+		uint32_t	dxgiFormat;
+		uint32_t	resourceDimension;
+		uint32_t	miscFlag;
+		uint32_t	arraySize;
+		uint32_t	miscFlags2;
+	};
+
+	constexpr uint32_t DDS_MAGIC = 0x20534444u;					// 'DDS '
+	constexpr uint32_t DDS_FOURCC = 0x4u;
+	constexpr uint32_t DDS_RGB = 0x40u;
+	constexpr uint32_t DDS_LUMINANCE = 0x20000u;
+	constexpr uint32_t DDS_CUBEMAP = 0x200u;
+	constexpr uint32_t DDS_TEXTURE2D = 3u;
+
+	constexpr uint32_t MakeFourCC(char a, char b, char c, char d)
+	{
+		return static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8) | (static_cast<uint32_t>(c) << 16) | (static_cast<uint32_t>(d) << 24);
+	}
+
+	// Legacy pixel formats of the single channel and 8 bit RGBA formats HeightMap reads, as GetDXGIFormat maps them.
+	DXGI_FORMAT GetLegacyFormat(const DdsPixelFormat& pixelFormat)
+	{
+		if (pixelFormat.flags & DDS_FOURCC)
+		{
+			switch (pixelFormat.fourCC)
+			{
+			case MakeFourCC('A', 'T', 'I', '1'):
+			case MakeFourCC('B', 'C', '4', 'U'):
+				return DXGI_FORMAT_BC4_UNORM;
+			case 111:
+				return DXGI_FORMAT_R16_FLOAT;
+			case 114:
+				return DXGI_FORMAT_R32_FLOAT;
+			default:
+				return DXGI_FORMAT_UNKNOWN;
+			}
+		}
+
+		if ((pixelFormat.flags & DDS_RGB) && pixelFormat.rgbBitCount == 32)
+		{
+			if (pixelFormat.rBitMask == 0x000000ffu && pixelFormat.gBitMask == 0x0000ff00u && pixelFormat.bBitMask == 0x00ff0000u)
+				return DXGI_FORMAT_R8G8B8A8_UNORM;
+			if (pixelFormat.rBitMask == 0x00ff0000u && pixelFormat.gBitMask == 0x0000ff00u && pixelFormat.bBitMask == 0x000000ffu)
+				return DXGI_FORMAT_B8G8R8A8_UNORM;
+			if (pixelFormat.rBitMask == 0xffffffffu)
+				return DXGI_FORMAT_R32_FLOAT;
+		}
+
+		if (pixelFormat.flags & DDS_LUMINANCE)
+		{
+			if (pixelFormat.rgbBitCount == 8 && pixelFormat.rBitMask == 0xffu)
+				return DXGI_FORMAT_R8_UNORM;
+			if (pixelFormat.rgbBitCount == 16 && pixelFormat.rBitMask == 0xffffu)
+				return DXGI_FORMAT_R16_UNORM;
+		}
+
+		return DXGI_FORMAT_UNKNOWN;
+	}
+
+	// Bytes per row and row count of one mip, rows of BC4 are rows of 4x4 blocks. Zero for other formats.
+	void GetSurfaceInfo(DXGI_FORMAT format, uint32_t width, uint32_t height, uint64_t& rowPitch, uint32_t& rowCount)
+	{
+		rowPitch = 0;
+		rowCount = height;
+		switch (format)
+		{
+		case DXGI_FORMAT_BC4_UNORM:
+			rowPitch = 8ull * std::max(1u, (width + 3) / 4);
+			rowCount = std::max(1u, (height + 3) / 4);
+			break;
+		case DXGI_FORMAT_R8_UNORM:
+			rowPitch = width;
+			break;
+		case DXGI_FORMAT_R16_UNORM:
+		case DXGI_FORMAT_R16_FLOAT:
+			rowPitch = 2ull * width;
+			break;
+		case DXGI_FORMAT_R32_FLOAT:
+		case DXGI_FORMAT_R8G8B8A8_UNORM:
+		case DXGI_FORMAT_B8G8R8A8_UNORM:
+			rowPitch = 4ull * width;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+bool HeightMap::LoadSource(const wchar_t* fileName, Source& source)
+{
+	source = Source();
+
+	std::ifstream file(FileName::ToNative(fileName), std::ios::in | std::ios::binary | std::ios::ate);
+	if (!file)
+		return false;
+
+	const std::streamoff fileSize = file.tellg();
+	if (fileSize < static_cast<std::streamoff>(sizeof(uint32_t) + sizeof(DdsHeader)))
+		return false;
+
+	std::unique_ptr<uint8_t[]> data(new uint8_t[static_cast<size_t>(fileSize)]);
+	file.seekg(0);
+	if (!file.read(reinterpret_cast<char*>(data.get()), fileSize))
+		return false;
+
+	uint32_t magic;
+	DdsHeader header;
+	memcpy(&magic, data.get(), sizeof(uint32_t));
+	memcpy(&header, data.get() + sizeof(uint32_t), sizeof(DdsHeader));
+	if (magic != DDS_MAGIC || header.size != sizeof(DdsHeader) || header.pixelFormat.size != sizeof(DdsPixelFormat) ||
+		(header.caps2 & DDS_CUBEMAP) || header.width == 0 || header.height == 0)
+		return false;
+
+	size_t offset = sizeof(uint32_t) + sizeof(DdsHeader);
+	DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+	if ((header.pixelFormat.flags & DDS_FOURCC) && header.pixelFormat.fourCC == MakeFourCC('D', 'X', '1', '0'))
+	{
+		DdsHeaderDxt10 dxt10;
+		if (static_cast<size_t>(fileSize) < offset + sizeof(DdsHeaderDxt10))
+			return false;
+
+		memcpy(&dxt10, data.get() + offset, sizeof(DdsHeaderDxt10));
+		offset += sizeof(DdsHeaderDxt10);
+		if (dxt10.resourceDimension != DDS_TEXTURE2D || dxt10.arraySize != 1 || (dxt10.miscFlag & 0x4u))
+			return false;
+
+		format = static_cast<DXGI_FORMAT>(dxt10.dxgiFormat);
+	}
+	else
+	{
+		format = GetLegacyFormat(header.pixelFormat);
+	}
+
+	// Mips follow each other without padding.
+	const uint32_t mipCount = std::max(header.mipMapCount, 1u);
+	for (uint32_t mip = 0; mip < mipCount; mip++)
+	{
+		uint64_t rowPitch;
+		uint32_t rowCount;
+		GetSurfaceInfo(format, std::max(header.width >> mip, 1u), std::max(header.height >> mip, 1u), rowPitch, rowCount);
+
+		const uint64_t slicePitch = rowPitch * rowCount;
+		if (rowPitch == 0 || offset + slicePitch > static_cast<uint64_t>(fileSize))
+		{
+			source = Source();
+			return false;
+		}
+
+		D3D12_SUBRESOURCE_DATA mipData;
+		mipData.pData = data.get() + offset;
+		mipData.RowPitch = static_cast<intptr_t>(rowPitch);
+		mipData.SlicePitch = static_cast<intptr_t>(slicePitch);
+		source.mips.push_back(mipData);
+		offset += static_cast<size_t>(slicePitch);
+	}
+
+	source.data = std::move(data);
+	source.format = format;
+	source.width = header.width;
+	source.height = header.height;
+	return true;
+}
+
+bool HeightMap::Init(
+	Source&& left, Source&& right, const wchar_t* const sourceFileNames[2], const wchar_t* cacheFileName,
+	WorkerPool* workerPool)
+{
+	m_pyramidCount = 0;
+	m_minHeight = 0.0f;
+
+	if (!IsSupportedFormat(left.format) || left.format != right.format ||
+		left.width != right.width || left.height != right.height || left.mips.size() != right.mips.size() || left.mips.empty())
+		return false;
+
+	// Missing mips are never sampled, the shader clamps to the last one.
+	// Texels of every pyramid must line up with mip 0 texels.
+	const uint32_t pyramidCount = std::min(static_cast<uint32_t>(left.mips.size()), MAX_SAMPLED_MIP + 1);
+	const uint32_t coarsestSampleSize = 1u << (pyramidCount - 1);
+	if (left.width % coarsestSampleSize != 0 || left.height % coarsestSampleSize != 0)
+		return false;
+
+	m_sources[0] = std::move(left);
+	m_sources[1] = std::move(right);
+	m_width = 2 * m_sources[0].width;
+	m_height = m_sources[0].height;
+	m_pyramidCount = pyramidCount;
+
+	// Textures that can not be stamped never match a cache.
+	SourceStamp stamp = {};
+	for (uint32_t half = 0; half < 2; half++)
+	{
+		uint64_t size = 0;
+		uint64_t writeTime = 0;
+		if (FileName::GetStamp(sourceFileNames[half], size, writeTime))
+		{
+			stamp.sizes[half] = size;
+			stamp.writeTimes[half] = writeTime;
+		}
+	}
+
+	// Failing to write the cache only costs the next startup.
+	if (stamp.sizes[0] == 0 || !LoadPyramids(cacheFileName, stamp))
+	{
+		BuildPyramids(workerPool);
+		if (stamp.sizes[0] != 0)
+			SavePyramids(cacheFileName, stamp);
+	}
+
+	m_minHeight = FLT_MAX;
+	for (uint32_t mip = 0; mip < m_pyramidCount; mip++)
+		m_minHeight = std::min(m_minHeight, m_pyramids[mip].GetMinHeight());
+
+	return true;
+}
+
+void HeightMap::BuildPyramids(WorkerPool* workerPool)
+{
+	for (uint32_t mip = 0; mip < m_pyramidCount; mip++)
+	{
+		// Sample rows of a mip hold the left half, then the right half.
+		const uint32_t mipWidth = m_sources[0].width >> mip;
+		const auto readRow = [this, mip, mipWidth](uint32_t y, float* heights)
+		{
+			for (uint32_t half = 0; half < 2; half++)
+			{
+				for (uint32_t x = 0; x < mipWidth; x++)
+					heights[half * mipWidth + x] = ReadTexel(m_sources[half], mip, x, y);
+			}
+		};
+
+		// Bilinear taps reach up to one and a half mip texels from the sample point.
+		const uint32_t tileSize = std::max(MIN_TILE_SIZE, 2u << mip);
+		m_pyramids[mip].Build(2 * mipWidth, m_height >> mip, 1u << mip, tileSize >> mip, readRow, workerPool);
+
+		// Bilinear derivative along an axis inside a cell is at most the larger difference of its texels along it,
+		// so a sample keeps its steepest neighbour difference per axis, in heights per radian of longitude or latitude.
+		const uint32_t mapColumns = 2 * mipWidth;
+		const uint32_t mipHeight = m_height >> mip;
+		const auto readHeight = [this, mip, mipWidth](uint32_t x, uint32_t y)
+		{
+			return ReadTexel(m_sources[x / mipWidth], mip, x % mipWidth, y);
+		};
+
+		const float columnAngle = XM_2PI / mapColumns;
+		const auto readLongitudeSlopeRow = [readHeight, mapColumns, columnAngle](uint32_t y, float* slopes)
+		{
+			for (uint32_t x = 0; x < mapColumns; x++)
+			{
+				const float h = readHeight(x, y);
+				slopes[x] = std::max(
+					fabsf(readHeight((x + 1) % mapColumns, y) - h),
+					fabsf(h - readHeight((x + mapColumns - 1) % mapColumns, y))) / columnAngle;
+			}
+		};
+
+		const float rowAngle = XM_PI / mipHeight;
+		const auto readLatitudeSlopeRow = [readHeight, mapColumns, mipHeight, rowAngle](uint32_t y, float* slopes)
+		{
+			const uint32_t up = y > 0 ? y - 1 : y;
+			const uint32_t down = y + 1 < mipHeight ? y + 1 : y;
+			for (uint32_t x = 0; x < mapColumns; x++)
+			{
+				const float h = readHeight(x, y);
+				slopes[x] = std::max(fabsf(readHeight(x, down) - h), fabsf(h - readHeight(x, up))) / rowAngle;
+			}
+		};
+
+		m_longitudeSlopePyramids[mip].Build(mapColumns, mipHeight, 1u << mip, tileSize >> mip, readLongitudeSlopeRow, workerPool);
+		m_latitudeSlopePyramids[mip].Build(mapColumns, mipHeight, 1u << mip, tileSize >> mip, readLatitudeSlopeRow, workerPool);
+	}
+}
+
+bool HeightMap::LoadPyramids(const wchar_t* cacheFileName, const SourceStamp& stamp)
+{
+	std::ifstream file(FileName::ToNative(cacheFileName), std::ios::in | std::ios::binary | std::ios::ate);
+	if (!file)
+		return false;
+
+	const std::streamoff fileSize = file.tellg();
+	if (fileSize < static_cast<std::streamoff>(sizeof(CacheHeader)))
+		return false;
+
+	std::vector<uint8_t> data(static_cast<size_t>(fileSize));
+	file.seekg(0);
+	if (!file.read(reinterpret_cast<char*>(data.data()), fileSize))
+		return false;
+
+	// Check the header against the loaded textures.
+	CacheHeader header;
+	memcpy(&header, data.data(), sizeof(CacheHeader));
+
+	const bool valid =
+		header.magic == CACHE_FILE_MAGIC &&
+		header.formatVersion == CACHE_FORMAT_VERSION &&
+		header.mapWidth == m_width &&
+		header.mapHeight == m_height &&
+		header.pyramidCount == m_pyramidCount &&
+		memcmp(&header.stamp, &stamp, sizeof(SourceStamp)) == 0 &&
+		header.fileSize == static_cast<uint64_t>(fileSize);
+	if (!valid)
+		return false;
+
+	const uint8_t* cursor = data.data() + sizeof(CacheHeader);
+	const uint8_t* end = data.data() + data.size();
+	for (uint32_t mip = 0; mip < m_pyramidCount; mip++)
+	{
+		if (!m_pyramids[mip].Read(cursor, end) ||
+			!m_longitudeSlopePyramids[mip].Read(cursor, end) || !m_latitudeSlopePyramids[mip].Read(cursor, end))
+			return false;
+	}
+
+	return cursor == end;
+}
+
+bool HeightMap::SavePyramids(const wchar_t* cacheFileName, const SourceStamp& stamp) const
+{
+	std::vector<uint8_t> payload;
+	for (uint32_t mip = 0; mip < m_pyramidCount; mip++)
+	{
+		m_pyramids[mip].Write(payload);
+		m_longitudeSlopePyramids[mip].Write(payload);
+		m_latitudeSlopePyramids[mip].Write(payload);
+	}
+
+	CacheHeader header = {};
+	header.magic = CACHE_FILE_MAGIC;
+	header.formatVersion = CACHE_FORMAT_VERSION;
+	header.mapWidth = m_width;
+	header.mapHeight = m_height;
+	header.pyramidCount = m_pyramidCount;
+	header.stamp = stamp;
+	header.fileSize = sizeof(CacheHeader) + payload.size();
+
+	// Write to temporary file first, so a crash never leaves a half written cache.
+	const std::wstring tempFileName = std::wstring(cacheFileName) + L".tmp";
+	{
+		std::ofstream file(FileName::ToNative(tempFileName.c_str()), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+		file.write(reinterpret_cast<const char*>(payload.data()), static_cast<std::streamsize>(payload.size()));
+		if (!file)
+			return false;
+	}
+
+	return FileName::Replace(tempFileName.c_str(), cacheFileName);
+}
+
+void HeightMap::GetHeightRange(const XMFLOAT3 corners[4], float& minHeight, float& maxHeight) const
+{
+	minHeight = 0.0f;
+	maxHeight = 1.0f;
+	if (!IsBuilt())
+		return;
+
+	minHeight = FLT_MAX;
+	maxHeight = -FLT_MAX;
+	float minY;
+	float maxY;
+	AccumulateNodeRange(m_pyramids, corners, minHeight, maxHeight, minY, maxY);
+}
+
+float HeightMap::GetMaxSlope(const XMFLOAT3 corners[4]) const
+{
+	if (!IsBuilt())
+		return MAX_SLOPE;
+
+	float minValue = FLT_MAX;
+	float longitudeSlope = 0.0f;
+	float latitudeSlope = 0.0f;
+	float minY;
+	float maxY;
+	AccumulateNodeRange(m_longitudeSlopePyramids, corners, minValue, longitudeSlope, minY, maxY);
+	AccumulateNodeRange(m_latitudeSlopePyramids, corners, minValue, latitudeSlope, minY, maxY);
+
+	// A radian of longitude is shortest where the node comes closest to a pole, at the pole the map pinches.
+	const float poleLatitude = XM_PIDIV2 - XM_PI * std::max(std::min(minY, m_height - maxY), 0.0f) / m_height;
+	const float longitudeScale = cosf(poleLatitude);
+	if (longitudeSlope >= longitudeScale * MAX_SLOPE)
+		return MAX_SLOPE;
+
+	longitudeSlope /= longitudeScale;
+	return std::min(sqrtf(longitudeSlope * longitudeSlope + latitudeSlope * latitudeSlope), MAX_SLOPE);
+}
+
+void HeightMap::AccumulateNodeRange(
+	const HeightPyramid* pyramids, const XMFLOAT3 corners[4], float& minValue, float& maxValue, float& minY, float& maxY) const
+{
+	// Sample a grid over the planar node, corner 3 is opposite to corner 0.
+	constexpr uint32_t S = RANGE_SAMPLE_COUNT;
+	float texelX[S * S];
+	float texelY[S * S];
+
+	const XMVECTOR origin = XMLoadFloat3(&corners[0]);
+	const XMVECTOR u = XMLoadFloat3(&corners[1]) - origin;
+	const XMVECTOR v = XMLoadFloat3(&corners[2]) - origin;
+	for (uint32_t j = 0; j < S; j++)
+	{
+		for (uint32_t i = 0; i < S; i++)
+		{
+			XMFLOAT3 position;
+			XMStoreFloat3(&position, origin + u * (i / static_cast<float>(S - 1)) + v * (j / static_cast<float>(S - 1)));
+			ToTexel(position, texelX[j * S + i], texelY[j * S + i]);
+		}
+	}
+
+	// Texel extent of every grid cell, any point inside a cell is about that close to each of its corners.
+	float cellExtents[(S - 1) * (S - 1)];
+	for (uint32_t j = 0; j + 1 < S; j++)
+	{
+		for (uint32_t i = 0; i + 1 < S; i++)
+		{
+			const uint32_t cellCorners[4] = { j * S + i, j * S + i + 1, (j + 1) * S + i, (j + 1) * S + i + 1 };
+
+			float extent = 0.0f;
+			for (uint32_t a = 0; a < 4; a++)
+			{
+				for (uint32_t b = a + 1; b < 4; b++)
+				{
+					const float dx = fabsf(texelX[cellCorners[a]] - texelX[cellCorners[b]]);
+					const float dy = fabsf(texelY[cellCorners[a]] - texelY[cellCorners[b]]);
+					extent = std::max(extent, std::max(std::min(dx, m_width - dx), dy));
+				}
+			}
+
+			cellExtents[j * (S - 1) + i] = extent;
+		}
+	}
+
+	minY = FLT_MAX;
+	maxY = -FLT_MAX;
+	for (uint32_t j = 0; j < S; j++)
+	{
+		for (uint32_t i = 0; i < S; i++)
+		{
+			float extent = 0.0f;
+			for (uint32_t cj = j > 0 ? j - 1 : 0; cj <= std::min(j, S - 2); cj++)
+			{
+				for (uint32_t ci = i > 0 ? i - 1 : 0; ci <= std::min(i, S - 2); ci++)
+					extent = std::max(extent, cellExtents[cj * (S - 1) + ci]);
+			}
+
+			const float x = texelX[j * S + i];
+			const float y = texelY[j * S + i];
+			minY = std::min(minY, y - 1.25f * extent);
+			maxY = std::max(maxY, y + 1.25f * extent);
+
+			for (uint32_t mip = 0; mip < m_pyramidCount; mip++)
+			{
+				// Cells curve on the map, leave some room for that on top of the filter footprint.
+				const float reach = 1.25f * extent + static_cast<float>(pyramids[mip].GetBaseTileSize());
+				pyramids[mip].AccumulateRange(x - reach, x + reach, y - reach, y + reach, minValue, maxValue);
+			}
+		}
+	}
+}
+
+void HeightMap::GetHeightRange(
+	float minLongitude, float maxLongitude, float minLatitude, float maxLatitude,
+	float& minHeight, float& maxHeight) const
+{
+	minHeight = 0.0f;
+	maxHeight = 1.0f;
+	if (!IsBuilt())
+		return;
+
+	// Rows run from the north pole down, as phi of the domain shader.
+	const float x0 = minLongitude / XM_2PI * m_width;
+	const float x1 = maxLongitude / XM_2PI * m_width;
+	const float y0 = (XM_PIDIV2 - maxLatitude) / XM_PI * m_height;
+	const float y1 = (XM_PIDIV2 - minLatitude) / XM_PI * m_height;
+
+	minHeight = FLT_MAX;
+	maxHeight = -FLT_MAX;
+	m_pyramids[0].AccumulateRange(x0, x1, y0, y1, minHeight, maxHeight);
+}
+
+float HeightMap::Sample(const XMFLOAT3& direction, uint32_t mip) const
+{
+	float x, y;
+	ToTexel(direction, x, y);
+
+	// Left half below the middle of the map, each half clamps at its borders.
+	const float gx = x / m_width;
+	const uint32_t half = gx < 0.5f ? 0 : 1;
+	const float sx = std::min(std::max(half == 0 ? gx * 2.0f : (gx - 0.5f) * 2.0f, 0.0f), 1.0f);
+	const float sy = y / m_height;
+
+	const Source& source = m_sources[half];
+	const uint32_t mipWidth = source.width >> mip;
+	const uint32_t mipHeight = source.height >> mip;
+	const float fx = sx * mipWidth - 0.5f;
+	const float fy = sy * mipHeight - 0.5f;
+	const float x0 = floorf(fx);
+	const float y0 = floorf(fy);
+	const float tx = fx - x0;
+	const float ty = fy - y0;
+
+	const int32_t lastX = static_cast<int32_t>(mipWidth) - 1;
+	const int32_t lastY = static_cast<int32_t>(mipHeight) - 1;
+	const uint32_t xs[2] =
+	{
+		static_cast<uint32_t>(std::min(std::max(static_cast<int32_t>(x0), 0), lastX)),
+		static_cast<uint32_t>(std::min(std::max(static_cast<int32_t>(x0) + 1, 0), lastX)),
+	};
+	const uint32_t ys[2] =
+	{
+		static_cast<uint32_t>(std::min(std::max(static_cast<int32_t>(y0), 0), lastY)),
+		static_cast<uint32_t>(std::min(std::max(static_cast<int32_t>(y0) + 1, 0), lastY)),
+	};
+
+	const float top = ReadTexel(source, mip, xs[0], ys[0]) * (1.0f - tx) + ReadTexel(source, mip, xs[1], ys[0]) * tx;
+	const float bottom = ReadTexel(source, mip, xs[0], ys[1]) * (1.0f - tx) + ReadTexel(source, mip, xs[1], ys[1]) * tx;
+	return top * (1.0f - ty) + bottom * ty;
+}
+
+void HeightMap::ReleaseSources()
+{
+	for (Source& source : m_sources)
+	{
+		source.data.reset();
+		source.mips.clear();
+		source.mips.shrink_to_fit();
+	}
+}
+
+bool HeightMap::IsSupportedFormat(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_R8_UNORM:
+	case DXGI_FORMAT_R16_UNORM:
+	case DXGI_FORMAT_R16_FLOAT:
+	case DXGI_FORMAT_R32_FLOAT:
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_BC4_UNORM:
+		return true;
+	default:
+		return false;
+	}
+}
+
+float HeightMap::ReadTexel(const Source& source, uint32_t mip, uint32_t x, uint32_t y)
+{
+	const D3D12_SUBRESOURCE_DATA& data = source.mips[mip];
+	const uint8_t* bytes = static_cast<const uint8_t*>(data.pData);
+
+	// Red channel, as read by the domain shader.
+	switch (source.format)
+	{
+	case DXGI_FORMAT_R8_UNORM:
+		return bytes[y * data.RowPitch + x] / 255.0f;
+	case DXGI_FORMAT_R16_UNORM:
+		return reinterpret_cast<const uint16_t*>(bytes + y * data.RowPitch)[x] / 65535.0f;
+	case DXGI_FORMAT_R16_FLOAT:
+		return PackedVector::XMConvertHalfToFloat(reinterpret_cast<const PackedVector::HALF*>(bytes + y * data.RowPitch)[x]);
+	case DXGI_FORMAT_R32_FLOAT:
+		return reinterpret_cast<const float*>(bytes + y * data.RowPitch)[x];
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+		return bytes[y * data.RowPitch + 4 * x] / 255.0f;
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+		return bytes[y * data.RowPitch + 4 * x + 2] / 255.0f;
+	case DXGI_FORMAT_BC4_UNORM:
+	{
+		// Two endpoints, then 3 bit palette indices of 4x4 texels.
+		const uint8_t* block = bytes + (y / 4) * data.RowPitch + (x / 4) * 8;
+		const uint32_t r0 = block[0];
+		const uint32_t r1 = block[1];
+
+		uint64_t bits = 0;
+		for (int k = 0; k < 6; k++)
+			bits |= static_cast<uint64_t>(block[2 + k]) << (8 * k);
+		const uint32_t index = static_cast<uint32_t>(bits >> (3 * ((y % 4) * 4 + x % 4))) & 7u;
+
+		if (index == 0)
+			return r0 / 255.0f;
+		if (index == 1)
+			return r1 / 255.0f;
+		if (r0 > r1)
+			return ((8 - index) * r0 + (index - 1) * r1) / (7.0f * 255.0f);
+		if (index == 6)
+			return 0.0f;
+		if (index == 7)
+			return 1.0f;
+		return ((6 - index) * r0 + (index - 1) * r1) / (5.0f * 255.0f);
+	}
+	default:
+		return 0.0f;
+	}
+}
+
+void HeightMap::ToTexel(const XMFLOAT3& position, float& x, float& y) const
+{
+	// Same polar mapping as the domain shader.
+	XMFLOAT3 n;
+	XMStoreFloat3(&n, XMVector3Normalize(XMLoadFloat3(&position)));
+
+	float theta = atan2f(n.z, n.x);
+	theta = theta < 0.0f ? XM_2PI + theta : theta;
+	const float phi = acosf(std::min(std::max(n.y, -1.0f), 1.0f));
+
+	x = theta / XM_2PI * m_width;
+	y = phi / XM_PI * m_height;
+}
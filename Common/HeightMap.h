@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <DirectXMath.h>
+
+#include "HeightPyramid.h"
+
+class WorkerPool;
+
+// CPU side of displacement_l/r, read as one equirectangular map the same way the domain shader does.
+// Min and max heights of texel tiles are kept in a HeightPyramid per sampled mip, so the height range under a node
+// takes a few tile reads. Two more pyramids per mip keep the steepest differences between neighbour texels
+// along longitude and latitude, which bound the gradient of the filtered map.
+// Pyramids are cached next to the quad sphere, keyed by size and write time of both textures.
+class HeightMap
+{
+public:
+	// One half of the map as loaded from DDS, with every mip level.
+	struct Source
+	{
+		std::unique_ptr<uint8_t[]>				data;
+		std::vector<D3D12_SUBRESOURCE_DATA>		mips;
+		DXGI_FORMAT								format = DXGI_FORMAT_UNKNOWN;
+		uint32_t								width = 0;
+		uint32_t								height = 0;
+	};
+
+	// Domain shader samples mip 0 ~ 6, see CalcLevel in Shader.hlsli.
+	static constexpr uint32_t				MAX_SAMPLED_MIP = 6;
+	static constexpr uint32_t				MIN_TILE_SIZE = 8;				// In mip 0 texels.
+
+	// Positions sampled per node edge while collecting its tiles.
+	static constexpr uint32_t				RANGE_SAMPLE_COUNT = 9;
+
+	// Gradients are clamped here, reached at the poles where columns shrink to nothing.
+	static constexpr float					MAX_SLOPE = 1e5f;
+
+	// Read one half from a DDS file without a device, texels laid out as DDSTextureLoader gives them.
+	// Returns false for missing or malformed files, arrays, cube maps and volumes. Format is not checked here.
+	static bool LoadSource(const wchar_t* fileName, Source& source);
+
+	// Load pyramids from cache file, or build them on the worker pool and write the cache.
+	// Returns false if the halves differ in size, are not a multiple of the coarsest sampled mip or use an unsupported format,
+	// heights stay unknown then.
+	bool Init(
+		Source&& left, Source&& right, const wchar_t* const sourceFileNames[2], const wchar_t* cacheFileName,
+		WorkerPool* workerPool);
+
+	bool									IsBuilt() const { return m_pyramidCount > 0; }
+
+	// Range of heights in [0, 1] the domain shader can read inside a node with given corners on cube face,
+	// over every sampled mip level.
+	void GetHeightRange(const DirectX::XMFLOAT3 corners[4], float& minHeight, float& maxHeight) const;
+
+	// Bound on the gradient of the bilinear filtered heights the domain shader can read inside a node with given corners,
+	// over every sampled mip, in heights per radian of arc. MAX_SLOPE if not built.
+	float GetMaxSlope(const DirectX::XMFLOAT3 corners[4]) const;
+
+	// Range of mip 0 heights in a longitude x latitude rectangle, in radians. Longitude runs along theta of the
+	// domain shader from 0 to 2 pi and may wrap past it, latitude from -pi / 2 at the south pole to pi / 2.
+	void GetHeightRange(
+		float minLongitude, float maxLongitude, float minLatitude, float maxLatitude,
+		float& minHeight, float& maxHeight) const;
+
+	// Lowest height of the whole map over every sampled mip, 0 if not built.
+	float									GetMinHeight() const { return m_minHeight; }
+
+	// Mip levels the domain shader can sample and pyramids are kept for, 0 if not built.
+	uint32_t								GetSampledMipCount() const { return m_pyramidCount; }
+
+	// Height the domain shader reads in given direction at given mip, bilinear filtered. Valid until ReleaseSources.
+	float Sample(const DirectX::XMFLOAT3& direction, uint32_t mip) const;
+
+	// Drop texel data, tiles are kept.
+	void ReleaseSources();
+
+private:
+	// Size and last write time of both textures.
+	struct SourceStamp
+	{
+		uint64_t							sizes[2];
+		uint64_t							writeTimes[2];
+	};
+
+	struct CacheHeader
+	{
+		uint32_t							magic;
+		uint32_t							formatVersion;
+		uint32_t							mapWidth;
+		uint32_t							mapHeight;
+		uint32_t							pyramidCount;
+		uint32_t							reserved;
+		SourceStamp							stamp;
+		uint64_t							fileSize;
+	};
+
+	static constexpr uint32_t				CACHE_FILE_MAGIC = 0x52595048u;	// 'HPYR'
+	static constexpr uint32_t				CACHE_FORMAT_VERSION = 2u;
+
+	bool LoadPyramids(const wchar_t* cacheFileName, const SourceStamp& stamp);
+	bool SavePyramids(const wchar_t* cacheFileName, const SourceStamp& stamp) const;
+	void BuildPyramids(WorkerPool* workerPool);
+
+	// Widen range by tiles of every sampled mip that the domain shader can read inside a node with given corners.
+	// Also gives the mip 0 texel rows the node spans.
+	void AccumulateNodeRange(
+		const HeightPyramid* pyramids, const DirectX::XMFLOAT3 corners[4], float& minValue, float& maxValue,
+		float& minY, float& maxY) const;
+
+	static bool IsSupportedFormat(DXGI_FORMAT format);
+	static float ReadTexel(const Source& source, uint32_t mip, uint32_t x, uint32_t y);
+
+	// Texel position of a direction on the whole map, 2 * source width wide.
+	void ToTexel(const DirectX::XMFLOAT3& position, float& x, float& y) const;
+
+	Source									m_sources[2];
+	uint32_t								m_width = 0;
+	uint32_t								m_height = 0;
+
+	// One per sampled mip, base tiles of a mip cover its bilinear footprint.
+	HeightPyramid							m_pyramids[MAX_SAMPLED_MIP + 1];
+	HeightPyramid							m_longitudeSlopePyramids[MAX_SAMPLED_MIP + 1];
+	HeightPyramid							m_latitudeSlopePyramids[MAX_SAMPLED_MIP + 1];
+	uint32_t								m_pyramidCount = 0;
+	float									m_minHeight = 0.0f;
+};
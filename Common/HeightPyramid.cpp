@@ -0,0 +1,257 @@
+#include "pch.h"
+#include "HeightPyramid.h"
+
+#include "WorkerPool.h"
+
+#include <cfloat>
+#include <emmintrin.h>
+
+namespace
+{
+	template <typename T>
+	void Append(std::vector<uint8_t>& data, const T* values, size_t count)
+	{
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(values);
+		data.insert(data.end(), bytes, bytes + sizeof(T) * count);
+	}
+
+	template <typename T>
+	bool Take(const uint8_t*& data, const uint8_t* end, T* values, size_t count)
+	{
+		if (static_cast<size_t>(end - data) < sizeof(T) * count)
+			return false;
+
+		memcpy(values, data, sizeof(T) * count);
+		data += sizeof(T) * count;
+		return true;
+	}
+}
+
+void HeightPyramid::Build(
+	uint32_t sampleWidth, uint32_t sampleHeight, uint32_t sampleSize, uint32_t tileSamples,
+	const RowReader& reader, WorkerPool* workerPool)
+{
+	m_mapWidth = sampleWidth * sampleSize;
+	m_mapHeight = sampleHeight * sampleSize;
+	m_levels.clear();
+
+	TileLevel base;
+	base.width = (sampleWidth + tileSamples - 1) / tileSamples;
+	base.height = (sampleHeight + tileSamples - 1) / tileSamples;
+	base.tileSize = tileSamples * sampleSize;
+	base.mins.resize(base.width * base.height);
+	base.maxs.resize(base.width * base.height);
+
+	// Columns are reduced over the rows of a tile four at a time, then tiles over their columns.
+	const uint32_t paddedWidth = (sampleWidth + 3) & ~3u;
+	const auto reduceTileRow = [&](uint32_t ty)
+	{
+		std::vector<float> heights(paddedWidth, 0.0f);
+		std::vector<float> columnMins(paddedWidth, FLT_MAX);
+		std::vector<float> columnMaxs(paddedWidth, -FLT_MAX);
+
+		const uint32_t lastRow = std::min((ty + 1) * tileSamples, sampleHeight);
+		for (uint32_t y = ty * tileSamples; y < lastRow; y++)
+		{
+			reader(y, heights.data());
+
+			// Padding repeats the last sample, so it never widens a range.
+			for (uint32_t x = sampleWidth; x < paddedWidth; x++)
+				heights[x] = heights[sampleWidth - 1];
+
+			for (uint32_t x = 0; x < paddedWidth; x += 4)
+			{
+				const __m128 h = _mm_loadu_ps(&heights[x]);
+				_mm_storeu_ps(&columnMins[x], _mm_min_ps(_mm_loadu_ps(&columnMins[x]), h));
+				_mm_storeu_ps(&columnMaxs[x], _mm_max_ps(_mm_loadu_ps(&columnMaxs[x]), h));
+			}
+		}
+
+		for (uint32_t tx = 0; tx < base.width; tx++)
+		{
+			const uint32_t lastColumn = std::min((tx + 1) * tileSamples, sampleWidth);
+
+			float tileMin = FLT_MAX;
+			float tileMax = -FLT_MAX;
+			for (uint32_t x = tx * tileSamples; x < lastColumn; x++)
+			{
+				tileMin = std::min(tileMin, columnMins[x]);
+				tileMax = std::max(tileMax, columnMaxs[x]);
+			}
+
+			base.mins[ty * base.width + tx] = tileMin;
+			base.maxs[ty * base.width + tx] = tileMax;
+		}
+	};
+
+	if (workerPool)
+	{
+		workerPool->ParallelFor(base.height, reduceTileRow);
+	}
+	else
+	{
+		for (uint32_t ty = 0; ty < base.height; ty++)
+			reduceTileRow(ty);
+	}
+
+	m_levels.push_back(std::move(base));
+	BuildCoarseLevels();
+}
+
+void HeightPyramid::BuildCoarseLevels()
+{
+	// Each coarser tile covers 2x2 tiles of the level below.
+	while (m_levels.back().width > 1 || m_levels.back().height > 1)
+	{
+		const TileLevel& fine = m_levels.back();
+
+		TileLevel coarse;
+		coarse.width = (fine.width + 1) / 2;
+		coarse.height = (fine.height + 1) / 2;
+		coarse.tileSize = 2 * fine.tileSize;
+		coarse.mins.assign(coarse.width * coarse.height, FLT_MAX);
+		coarse.maxs.assign(coarse.width * coarse.height, -FLT_MAX);
+
+		for (uint32_t y = 0; y < fine.height; y++)
+		{
+			for (uint32_t x = 0; x < fine.width; x++)
+			{
+				const uint32_t tile = (y / 2) * coarse.width + x / 2;
+				coarse.mins[tile] = std::min(coarse.mins[tile], fine.mins[y * fine.width + x]);
+				coarse.maxs[tile] = std::max(coarse.maxs[tile], fine.maxs[y * fine.width + x]);
+			}
+		}
+
+		m_levels.push_back(std::move(coarse));
+	}
+}
+
+void HeightPyramid::AccumulateRange(float x0, float x1, float y0, float y1, float& minHeight, float& maxHeight) const
+{
+	// Finest level where the rectangle spans at most three tiles per axis.
+	const float extent = std::max(x1 - x0, y1 - y0);
+	uint32_t levelIndex = 0;
+	while (levelIndex + 1 < m_levels.size() && 2.0f * static_cast<float>(m_levels[levelIndex].tileSize) < extent)
+		levelIndex++;
+
+	const TileLevel& level = m_levels[levelIndex];
+	const float tileSize = static_cast<float>(level.tileSize);
+	const int32_t lastColumn = static_cast<int32_t>(level.width) - 1;
+	const int32_t tileY0 = std::max(static_cast<int32_t>(floorf(y0 / tileSize)), 0);
+	const int32_t tileY1 = std::min(static_cast<int32_t>(floorf(y1 / tileSize)), static_cast<int32_t>(level.height) - 1);
+
+	// Columns wrap around the map, the rectangle is split at the right border.
+	int32_t columnRanges[2][2] = { { 0, lastColumn }, { 0, -1 } };
+	const float mapWidth = static_cast<float>(m_mapWidth);
+	if (x1 - x0 < mapWidth)
+	{
+		const float shift = floorf(x0 / mapWidth) * mapWidth;
+		x0 -= shift;
+		x1 -= shift;
+
+		columnRanges[0][0] = std::min(static_cast<int32_t>(x0 / tileSize), lastColumn);
+		columnRanges[0][1] = std::min(static_cast<int32_t>(std::min(x1, mapWidth - 1.0f) / tileSize), lastColumn);
+		if (x1 >= mapWidth)
+		{
+			columnRanges[1][0] = 0;
+			columnRanges[1][1] = std::min(static_cast<int32_t>((x1 - mapWidth) / tileSize), lastColumn);
+		}
+	}
+
+	for (const auto& columns : columnRanges)
+	{
+		for (int32_t ty = tileY0; ty <= tileY1; ty++)
+		{
+			for (int32_t tx = columns[0]; tx <= columns[1]; tx++)
+			{
+				const uint32_t tile = ty * level.width + tx;
+				minHeight = std::min(minHeight, level.mins[tile]);
+				maxHeight = std::max(maxHeight, level.maxs[tile]);
+			}
+		}
+	}
+}
+
+void HeightPyramid::Write(std::vector<uint8_t>& data) const
+{
+	const uint32_t header[3] = { static_cast<uint32_t>(m_levels.size()), m_mapWidth, m_mapHeight };
+	const float range[2] = { m_levels.back().mins[0], m_levels.back().maxs[0] };
+	Append(data, header, 3);
+	Append(data, range, 2);
+
+	const float scale = range[1] > range[0] ? 65535.0f / (range[1] - range[0]) : 0.0f;
+	std::vector<uint16_t> codes;
+	for (const TileLevel& level : m_levels)
+	{
+		const uint32_t levelHeader[3] = { level.width, level.height, level.tileSize };
+		Append(data, levelHeader, 3);
+
+		// Minimums round down and maximums round up.
+		codes.resize(2 * level.mins.size());
+		for (size_t tile = 0; tile < level.mins.size(); tile++)
+		{
+			codes[2 * tile + 0] = static_cast<uint16_t>(std::min(floorf((level.mins[tile] - range[0]) * scale), 65535.0f));
+			codes[2 * tile + 1] = static_cast<uint16_t>(std::min(ceilf((level.maxs[tile] - range[0]) * scale), 65535.0f));
+		}
+		Append(data, codes.data(), codes.size());
+	}
+}
+
+bool HeightPyramid::Read(const uint8_t*& data, const uint8_t* end)
+{
+	m_levels.clear();
+
+	uint32_t header[3];
+	float range[2];
+	if (!Take(data, end, header, 3) || !Take(data, end, range, 2) || header[0] == 0 || header[0] > 32)
+		return false;
+
+	m_mapWidth = header[1];
+	m_mapHeight = header[2];
+
+	// Half a code of slack keeps decoded ranges outside the stored ones.
+	const float step = (range[1] - range[0]) / 65535.0f;
+	std::vector<uint16_t> codes;
+	for (uint32_t l = 0; l < header[0]; l++)
+	{
+		uint32_t levelHeader[3];
+		if (!Take(data, end, levelHeader, 3) ||
+			levelHeader[0] == 0 || levelHeader[1] == 0 || levelHeader[2] == 0 ||
+			static_cast<uint64_t>(levelHeader[0]) * levelHeader[1] > static_cast<uint64_t>(end - data))
+		{
+			m_levels.clear();
+			return false;
+		}
+
+		TileLevel level;
+		level.width = levelHeader[0];
+		level.height = levelHeader[1];
+		level.tileSize = levelHeader[2];
+
+		const size_t tileCount = static_cast<size_t>(level.width) * level.height;
+		codes.resize(2 * tileCount);
+		if (!Take(data, end, codes.data(), codes.size()))
+		{
+			m_levels.clear();
+			return false;
+		}
+
+		level.mins.resize(tileCount);
+		level.maxs.resize(tileCount);
+		for (size_t tile = 0; tile < tileCount; tile++)
+		{
+			level.mins[tile] = range[0] + (codes[2 * tile + 0] - 0.5f) * step;
+			level.maxs[tile] = range[0] + (codes[2 * tile + 1] + 0.5f) * step;
+		}
+
+		m_levels.push_back(std::move(level));
+	}
+
+	if (m_levels.back().width != 1 || m_levels.back().height != 1)
+	{
+		m_levels.clear();
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class WorkerPool;
+
+// Min/max pyramid over one mip of an equirectangular height map, columns wrap around.
+// Rectangles are given in mip 0 texels of the whole map, so pyramids of every mip answer the same queries.
+// Has no graphics API dependency.
+class HeightPyramid
+{
+public:
+	// Writes sampleWidth heights of sample row y. Called from several threads at once.
+	using RowReader = std::function<void(uint32_t y, float* heights)>;
+
+	// Each sample covers sampleSize x sampleSize mip 0 texels, a base tile tileSamples x tileSamples samples.
+	// Rows of base tiles are reduced in parallel with SSE, coarser levels halve the tile count until one is left.
+	void Build(
+		uint32_t sampleWidth, uint32_t sampleHeight, uint32_t sampleSize, uint32_t tileSamples,
+		const RowReader& reader, WorkerPool* workerPool);
+
+	bool									IsBuilt() const { return !m_levels.empty(); }
+	uint32_t								GetBaseTileSize() const { return m_levels[0].tileSize; }
+	float									GetMinHeight() const { return m_levels.back().mins[0]; }
+
+	// Widen minHeight and maxHeight by every tile overlapping texel rectangle [x0, x1] x [y0, y1].
+	// Picks the level where the rectangle spans at most three tiles per axis, so the cost is O(log n).
+	void AccumulateRange(float x0, float x1, float y0, float y1, float& minHeight, float& maxHeight) const;
+
+	// Compact form, 16 bit codes rounded outwards over the height range of the pyramid.
+	void Write(std::vector<uint8_t>& data) const;
+
+	// Advances data past the pyramid. Returns false if it is truncated or malformed.
+	bool Read(const uint8_t*& data, const uint8_t* end);
+
+private:
+	struct TileLevel
+	{
+		uint32_t							width;
+		uint32_t							height;
+		uint32_t							tileSize;		// In mip 0 texels.
+		std::vector<float>					mins;
+		std::vector<float>					maxs;
+	};
+
+	void BuildCoarseLevels();
+
+	uint32_t								m_mapWidth = 0;
+	uint32_t								m_mapHeight = 0;
+
+	// Finest tiles first, the last level is a single tile.
+	std::vector<TileLevel>					m_levels;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Contiguous slice of the static index buffer.
+struct IndexRange
+{
+	uint32_t	start;
+	uint32_t	count;
+	uint32_t	lod;		// Patch LOD constant of the draw.
+};
+
+// Visible index ranges of one frame in emission order.
+// A range that continues the last one with same LOD extends it, so adjacent visible nodes become one draw.
+// Has no graphics API dependency.
+class IndexRangeList
+{
+public:
+	explicit IndexRangeList(uint32_t capacity = 0) { m_ranges.reserve(capacity); }
+
+	void Clear()
+	{
+		m_ranges.clear();
+		m_indexCount = 0;
+	}
+
+	void Append(uint32_t start, uint32_t count, uint32_t lod = 0)
+	{
+		if (!m_ranges.empty() && m_ranges.back().start + m_ranges.back().count == start && m_ranges.back().lod == lod)
+			m_ranges.back().count += count;
+		else
+			m_ranges.push_back({ start, count, lod });
+
+		m_indexCount += count;
+	}
+
+	const std::vector<IndexRange>&	GetRanges() const { return m_ranges; }
+	uint32_t						GetRangeCount() const { return static_cast<uint32_t>(m_ranges.size()); }
+	uint32_t						GetIndexCount() const { return m_indexCount; }
+
+private:
+	std::vector<IndexRange>			m_ranges;
+	uint32_t						m_indexCount = 0;
+};
+
+// Positions of ranges that differ from previous, as runs of consecutive positions (start and count, lod unused).
+// Previous must hold at least as many ranges.
+inline void FindChangedRuns(
+	const std::vector<IndexRange>& ranges, const std::vector<IndexRange>& previous, std::vector<IndexRange>& runs)
+{
+	runs.clear();
+	for (uint32_t i = 0; i < ranges.size(); i++)
+	{
+		if (previous[i].count == ranges[i].count && previous[i].start == ranges[i].start && previous[i].lod == ranges[i].lod)
+			continue;
+
+		if (!runs.empty() && runs.back().start + runs.back().count == i)
+			runs.back().count++;
+		else
+			runs.push_back({ i, 1, 0 });
+	}
+}
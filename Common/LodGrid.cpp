@@ -0,0 +1,205 @@
+#include "pch.h"
+#include "LodGrid.h"
+
+#include "FaceTree.h"
+
+using namespace DirectX;
+
+void LodGrid::Init(const std::vector<FaceTree*>& faceTrees)
+{
+	m_maxLevel = faceTrees[0]->GetMaxLevel();
+	m_gridSize = 1u << m_maxLevel;
+	m_faceCellCount = m_gridSize * m_gridSize;
+
+	// Face axes same as face detection in the hull shader.
+	for (uint32_t f = 0; f < 6; f++)
+	{
+		const XMFLOAT3 center = faceTrees[f]->GetNodeBounds(0).sphere.Center;
+		const float c[3] = { center.x, center.y, center.z };
+
+		uint32_t axis = 0;
+		for (uint32_t k = 1; k < 3; k++)
+		{
+			if (fabsf(c[k]) > fabsf(c[axis]))
+				axis = k;
+		}
+
+		const float s = c[axis] < 0.0f ? -1.0f : 1.0f;
+		m_axisFaces[axis * 2 + (s < 0.0f ? 1 : 0)] = f;
+
+		if (axis == 0)
+		{
+			m_faceNormals[f] = XMFLOAT3(s, 0, 0);
+			m_faceRights[f] = XMFLOAT3(0, 0, s);
+			m_faceUps[f] = XMFLOAT3(0, 1, 0);
+		}
+		else if (axis == 1)
+		{
+			m_faceNormals[f] = XMFLOAT3(0, s, 0);
+			m_faceRights[f] = XMFLOAT3(1, 0, 0);
+			m_faceUps[f] = XMFLOAT3(0, 0, s);
+		}
+		else
+		{
+			m_faceNormals[f] = XMFLOAT3(0, 0, s);
+			m_faceRights[f] = XMFLOAT3(-s, 0, 0);
+			m_faceUps[f] = XMFLOAT3(0, 1, 0);
+		}
+	}
+
+	// Leaf centers lie above their cell centers.
+	m_cellLeaves.assign(6 * m_faceCellCount, 0);
+	for (uint32_t f = 0; f < 6; f++)
+	{
+		for (uint32_t leaf = 0; leaf < faceTrees[f]->GetLeafCount(); leaf++)
+			m_cellLeaves[Locate(faceTrees[f]->GetLeafCenter(leaf))] = leaf;
+	}
+
+	// Neighbour is the cell just across each edge, possibly on another face.
+	const float cellWidth = 2.0f * QUAD_SPHERE_RADIUS / m_gridSize;
+	const float edgeSteps[EDGE_COUNT][2] = { { 0.0f, -1.0f }, { -1.0f, 0.0f }, { 0.0f, 1.0f }, { 1.0f, 0.0f } };
+
+	m_cellNeighbors.resize(6 * m_faceCellCount * EDGE_COUNT);
+	for (uint32_t cell = 0; cell < 6 * m_faceCellCount; cell++)
+	{
+		const uint32_t f = cell / m_faceCellCount;
+		const uint32_t row = (cell % m_faceCellCount) / m_gridSize;
+		const uint32_t column = cell % m_gridSize;
+
+		for (uint32_t e = 0; e < EDGE_COUNT; e++)
+		{
+			const float r = -QUAD_SPHERE_RADIUS + (column + 0.5f + 0.51f * edgeSteps[e][0]) * cellWidth;
+			const float u = -QUAD_SPHERE_RADIUS + (row + 0.5f + 0.51f * edgeSteps[e][1]) * cellWidth;
+
+			XMFLOAT3 position;
+			XMStoreFloat3(&position,
+				XMLoadFloat3(&m_faceNormals[f]) * QUAD_SPHERE_RADIUS +
+				XMLoadFloat3(&m_faceRights[f]) * r +
+				XMLoadFloat3(&m_faceUps[f]) * u);
+
+			m_cellNeighbors[cell * EDGE_COUNT + e] = Locate(position);
+		}
+	}
+
+	m_cellLevels.assign(6 * m_faceCellCount, static_cast<uint8_t>(m_maxLevel));
+}
+
+void LodGrid::Balance(const std::vector<FaceTree*>& faceTrees)
+{
+	const uint32_t cellCount = 6 * m_faceCellCount;
+	for (uint32_t cell = 0; cell < cellCount; cell++)
+		m_cellLevels[cell] = faceTrees[cell / m_faceCellCount]->GetLeafLodLevels()[m_cellLeaves[cell]];
+
+	// Splitting a node can unbalance its other neighbours, so repeat until nothing changes.
+	m_refinedNodeCount = 0;
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (uint32_t cell = 0; cell < cellCount; cell++)
+		{
+			for (uint32_t e = 0; e < EDGE_COUNT; e++)
+			{
+				const uint32_t neighbor = m_cellNeighbors[cell * EDGE_COUNT + e];
+				if (m_cellLevels[neighbor] + 1 < m_cellLevels[cell])
+				{
+					RefineNode(neighbor);
+					changed = true;
+				}
+			}
+		}
+	}
+
+	// Edge masks of every node, written to all of its leaves.
+	for (uint32_t cell = 0; cell < cellCount; cell++)
+	{
+		const uint32_t f = cell / m_faceCellCount;
+		const uint32_t row = (cell % m_faceCellCount) / m_gridSize;
+		const uint32_t column = cell % m_gridSize;
+
+		const uint32_t level = m_cellLevels[cell];
+		const uint32_t size = 1u << (m_maxLevel - level);
+		if (row % size != 0 || column % size != 0)
+			continue;
+
+		uint32_t finerEdges = 0;
+		uint32_t coarserEdges = 0;
+		for (uint32_t t = 0; t < size; t++)
+		{
+			// Border cells of the node on bottom, left, top and right edge.
+			const uint32_t borderCells[EDGE_COUNT] =
+			{
+				cell + t,
+				cell + t * m_gridSize,
+				cell + (size - 1) * m_gridSize + t,
+				cell + t * m_gridSize + size - 1,
+			};
+
+			for (uint32_t e = 0; e < EDGE_COUNT; e++)
+			{
+				const uint32_t neighborLevel = m_cellLevels[m_cellNeighbors[borderCells[e] * EDGE_COUNT + e]];
+				if (neighborLevel > level)
+					finerEdges |= 1u << e;
+				else if (neighborLevel < level)
+					coarserEdges |= 1u << e;
+			}
+		}
+
+		std::vector<uint8_t>& leafLevels = faceTrees[f]->GetLeafLodLevels();
+		std::vector<uint8_t>& leafEdges = faceTrees[f]->GetLeafLodEdges();
+		for (uint32_t y = 0; y < size; y++)
+		{
+			for (uint32_t x = 0; x < size; x++)
+			{
+				const uint32_t leaf = m_cellLeaves[cell + y * m_gridSize + x];
+				leafLevels[leaf] = static_cast<uint8_t>(level);
+				leafEdges[leaf] = static_cast<uint8_t>(finerEdges | (coarserEdges << 4));
+			}
+		}
+	}
+}
+
+uint32_t LodGrid::Locate(const XMFLOAT3& position) const
+{
+	const float p[3] = { position.x, position.y, position.z };
+
+	uint32_t axis = 0;
+	for (uint32_t k = 1; k < 3; k++)
+	{
+		if (fabsf(p[k]) > fabsf(p[axis]))
+			axis = k;
+	}
+
+	const uint32_t f = m_axisFaces[axis * 2 + (p[axis] < 0.0f ? 1 : 0)];
+
+	// Project on the cube face, then find the cell on face axes.
+	const float scale = QUAD_SPHERE_RADIUS / fabsf(p[axis]);
+	const XMVECTOR projected = XMLoadFloat3(&position) * scale;
+	const float r = XMVectorGetX(XMVector3Dot(projected, XMLoadFloat3(&m_faceRights[f])));
+	const float u = XMVectorGetX(XMVector3Dot(projected, XMLoadFloat3(&m_faceUps[f])));
+
+	const float cellWidth = 2.0f * QUAD_SPHERE_RADIUS / m_gridSize;
+	const int32_t lastCell = static_cast<int32_t>(m_gridSize) - 1;
+	const int32_t column = std::min(std::max(static_cast<int32_t>(floorf((r + QUAD_SPHERE_RADIUS) / cellWidth)), 0), lastCell);
+	const int32_t row = std::min(std::max(static_cast<int32_t>(floorf((u + QUAD_SPHERE_RADIUS) / cellWidth)), 0), lastCell);
+
+	return f * m_faceCellCount + static_cast<uint32_t>(row) * m_gridSize + static_cast<uint32_t>(column);
+}
+
+void LodGrid::RefineNode(uint32_t cell)
+{
+	// Every cell of the node covering this cell moves one level down.
+	const uint32_t level = m_cellLevels[cell];
+	const uint32_t size = 1u << (m_maxLevel - level);
+	const uint32_t faceBase = cell - cell % m_faceCellCount;
+	const uint32_t row = (cell % m_faceCellCount) / m_gridSize / size * size;
+	const uint32_t column = cell % m_gridSize / size * size;
+
+	for (uint32_t y = 0; y < size; y++)
+	{
+		for (uint32_t x = 0; x < size; x++)
+			m_cellLevels[faceBase + (row + y) * m_gridSize + column + x] = static_cast<uint8_t>(level + 1);
+	}
+
+	m_refinedNodeCount++;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <DirectXMath.h>
+
+class FaceTree;
+
+enum class LodErrorMetric
+{
+	Geometric,	// Chord sag of coarse patches plus height range.
+	PatchSize,	// Edge length of coarse patches.
+};
+
+// Camera terms for screen space error of one LOD selection.
+struct LodView
+{
+	bool					enabled;
+	LodErrorMetric			metric;
+	float					pixelThreshold;
+	DirectX::XMFLOAT3		cameraPosition;
+	float					pixelsPerUnit;		// Pixels covered by unit length at unit distance.
+};
+
+// Leaf cells of the six face trees on one grid per cube face.
+// Balances LOD levels so that neighbouring nodes differ by at most one level, also across cube edges,
+// and writes which node edges meet finer or coarser nodes.
+class LodGrid
+{
+public:
+	// Edge bits follow face axes of the hull shader: bottom, left, top, right.
+	static constexpr uint32_t EDGE_COUNT = 4;
+
+	// Patch LOD root constant read by hull and domain shaders.
+	// Bits 0-3 coarse scale log2 (0 for base patches), 4-7 edges next to finer nodes,
+	// 8-11 edges next to coarser nodes, 12-15 node level.
+	static uint32_t EncodePatchLod(uint32_t coarseScale, uint32_t nodeLevel, uint32_t finerEdges, uint32_t coarserEdges)
+	{
+		return coarseScale | (finerEdges << 4) | (coarserEdges << 8) | (nodeLevel << 12);
+	}
+
+	// Locate leaf cells of every face tree and their neighbours.
+	void Init(const std::vector<FaceTree*>& faceTrees);
+
+	// Refine coarse nodes until the tree is balanced, then write edge masks to face trees.
+	void Balance(const std::vector<FaceTree*>& faceTrees);
+
+	// Nodes split by last Balance.
+	uint32_t								GetRefinedNodeCount() const { return m_refinedNodeCount; }
+
+private:
+	uint32_t Locate(const DirectX::XMFLOAT3& position) const;
+	void RefineNode(uint32_t cell);
+
+	uint32_t								m_maxLevel = 0;
+	uint32_t								m_gridSize = 0;
+	uint32_t								m_faceCellCount = 0;
+
+	// Face axes of every face tree, and face tree of every cube axis (+x, -x, +y, -y, +z, -z).
+	DirectX::XMFLOAT3						m_faceNormals[6];
+	DirectX::XMFLOAT3						m_faceRights[6];
+	DirectX::XMFLOAT3						m_faceUps[6];
+	uint32_t								m_axisFaces[6];
+
+	// Cells are face * m_faceCellCount + row * m_gridSize + column.
+	std::vector<uint32_t>					m_cellLeaves;
+	std::vector<uint32_t>					m_cellNeighbors;	// EDGE_COUNT per cell.
+	std::vector<uint8_t>					m_cellLevels;
+
+	uint32_t								m_refinedNodeCount = 0;
+};
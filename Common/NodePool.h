@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Fixed capacity pool of node blocks, one block holds the 4 children of a split node.
+// Only block slots are handed out, node data lives in arrays of the owner sized to GetNodeCapacity.
+// Has no graphics API dependency.
+class NodePool
+{
+public:
+	static constexpr uint32_t INVALID_BLOCK = UINT32_MAX;
+
+	explicit NodePool(uint32_t blockCapacity = 0)
+	{
+		m_blockCapacity = blockCapacity;
+
+		// Lowest slots are handed out first.
+		m_freeBlocks.reserve(blockCapacity);
+		for (uint32_t block = blockCapacity; block > 0; block--)
+			m_freeBlocks.push_back(block - 1);
+	}
+
+	// Returns INVALID_BLOCK when every block is in use.
+	uint32_t Allocate()
+	{
+		if (m_freeBlocks.empty())
+			return INVALID_BLOCK;
+
+		const uint32_t block = m_freeBlocks.back();
+		m_freeBlocks.pop_back();
+		return block;
+	}
+
+	void Free(uint32_t block) { m_freeBlocks.push_back(block); }
+
+	uint32_t						GetBlockCapacity() const { return m_blockCapacity; }
+	uint32_t						GetNodeCapacity() const { return 4 * m_blockCapacity; }
+	uint32_t						GetAllocatedBlockCount() const { return m_blockCapacity - static_cast<uint32_t>(m_freeBlocks.size()); }
+
+private:
+	uint32_t						m_blockCapacity;
+	std::vector<uint32_t>			m_freeBlocks;
+};
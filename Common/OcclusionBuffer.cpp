@@ -0,0 +1,516 @@
+#include "pch.h"
+#include "OcclusionBuffer.h"
+
+#include "HeightMap.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <emmintrin.h>
+#include <numeric>
+
+using namespace DirectX;
+
+namespace
+{
+	// Occluder parts nearer than this are clipped away, occludees crossing it are visible.
+	constexpr float NEAR_W = 0.01f;
+
+	// Relative depth slack against rounding in triangle setup.
+	constexpr float DEPTH_EPSILON = 1e-3f;
+
+	XMFLOAT3 TransformClip(const XMFLOAT4X4& m, const XMFLOAT3& v)
+	{
+		return XMFLOAT3(
+			v.x * m._11 + v.y * m._21 + v.z * m._31 + m._41,
+			v.x * m._12 + v.y * m._22 + v.z * m._32 + m._42,
+			v.x * m._14 + v.y * m._24 + v.z * m._34 + m._44);
+	}
+
+	XMFLOAT3 LerpClip(const XMFLOAT3& a, const XMFLOAT3& b, float t)
+	{
+		return XMFLOAT3(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t);
+	}
+
+	float HorizontalMin(__m128 v)
+	{
+		v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+		v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtss_f32(v);
+	}
+
+	// Point (i, j) of a grid with gridSize quads per edge on cube face -x, +x, -y, +y, -z or +z.
+	XMFLOAT3 GetCubeFacePoint(uint32_t face, uint32_t i, uint32_t j, uint32_t gridSize)
+	{
+		const uint32_t axis = face / 2;
+		float p[3];
+		p[axis] = face % 2 ? 1.0f : -1.0f;
+		p[(axis + 1) % 3] = -1.0f + 2.0f * i / gridSize;
+		p[(axis + 2) % 3] = -1.0f + 2.0f * j / gridSize;
+		return XMFLOAT3(p[0], p[1], p[2]);
+	}
+
+	// Give vertices repeated at the same position, as along face seams, the lowest of their values.
+	void TakeSharedMin(const std::vector<XMFLOAT3>& vertices, std::vector<float>& values)
+	{
+		auto isLess = [&vertices](uint32_t a, uint32_t b)
+		{
+			const XMFLOAT3& va = vertices[a];
+			const XMFLOAT3& vb = vertices[b];
+			return va.x != vb.x ? va.x < vb.x : va.y != vb.y ? va.y < vb.y : va.z < vb.z;
+		};
+
+		std::vector<uint32_t> order(vertices.size());
+		std::iota(order.begin(), order.end(), 0u);
+		std::sort(order.begin(), order.end(), isLess);
+
+		for (size_t first = 0; first < order.size();)
+		{
+			size_t last = first + 1;
+			float minValue = values[order[first]];
+			for (; last < order.size() && !isLess(order[first], order[last]); last++)
+				minValue = std::min(minValue, values[order[last]]);
+
+			for (size_t k = first; k < last; k++)
+				values[order[k]] = minValue;
+			first = last;
+		}
+	}
+}
+
+OcclusionBuffer::OcclusionBuffer(uint32_t width, uint32_t height)
+{
+	m_width = width;
+	m_height = height;
+	m_tileCountX = width / TILE_SIZE;
+	m_tileCountY = height / TILE_SIZE;
+
+	m_depth.assign(static_cast<size_t>(width) * height, 0.0f);
+	m_tileDepth.assign(static_cast<size_t>(m_tileCountX) * m_tileCountY, 0.0f);
+
+	XMStoreFloat4x4(&m_viewProj, XMMatrixIdentity());
+}
+
+void OcclusionBuffer::SetOccluder(std::vector<XMFLOAT3> vertices, std::vector<uint32_t> indices)
+{
+	m_vertices = std::move(vertices);
+	m_indices = std::move(indices);
+	m_clipVertices.resize(m_vertices.size());
+	m_frameVertices.resize(m_vertices.size());
+
+	// Plane of every face, and the cap of directions it covers, around the mean direction of its corners.
+	const size_t faceCount = m_indices.size() / 3;
+	std::vector<float> planeDistances(faceCount);
+	std::vector<XMFLOAT3> capAxes(faceCount);
+	std::vector<float> capAngles(faceCount);
+	float maxCapAngle = 0.0f;
+	m_innerRadius = FLT_MAX;
+	for (size_t t = 0; t < faceCount; t++)
+	{
+		const XMVECTOR v[3] =
+		{
+			XMLoadFloat3(&m_vertices[m_indices[t * 3 + 0]]),
+			XMLoadFloat3(&m_vertices[m_indices[t * 3 + 1]]),
+			XMLoadFloat3(&m_vertices[m_indices[t * 3 + 2]]),
+		};
+
+		// Triangle is no nearer to the origin than its plane.
+		const XMVECTOR normal = XMVector3Normalize(XMVector3Cross(v[1] - v[0], v[2] - v[0]));
+		planeDistances[t] = fabsf(XMVectorGetX(XMVector3Dot(normal, v[0])));
+		m_innerRadius = std::min(m_innerRadius, planeDistances[t]);
+
+		const XMVECTOR axis = XMVector3Normalize(XMVector3Normalize(v[0]) + XMVector3Normalize(v[1]) + XMVector3Normalize(v[2]));
+		XMStoreFloat3(&capAxes[t], axis);
+		capAngles[t] = 0.0f;
+		for (int k = 0; k < 3; k++)
+			capAngles[t] = std::max(capAngles[t], XMVectorGetX(XMVector3AngleBetweenVectors(axis, v[k])));
+		maxCapAngle = std::max(maxCapAngle, capAngles[t]);
+	}
+
+	// Directions within LOCAL_SHRINK_ANGLE of a face lie in the caps of faces near it, along them the occluder
+	// reaches at least as far as the lowest plane of those faces.
+	std::vector<float> nearPlaneDistances(faceCount);
+	for (size_t t = 0; t < faceCount; t++)
+	{
+		const XMVECTOR axis = XMLoadFloat3(&capAxes[t]);
+		const float reach = capAngles[t] + LOCAL_SHRINK_ANGLE;
+		const float minCos = cosf(std::min(reach + maxCapAngle, XM_PI));
+
+		nearPlaneDistances[t] = planeDistances[t];
+		for (size_t u = 0; u < faceCount; u++)
+		{
+			const float cosAngle = XMVectorGetX(XMVector3Dot(axis, XMLoadFloat3(&capAxes[u])));
+			if (cosAngle >= minCos && acosf(std::min(cosAngle, 1.0f)) <= reach + capAngles[u])
+				nearPlaneDistances[t] = std::min(nearPlaneDistances[t], planeDistances[u]);
+		}
+	}
+
+	// A lowered vertex takes the lowest of the faces around it, so does every point of those faces.
+	m_vertexInnerRadii.assign(m_vertices.size(), FLT_MAX);
+	for (size_t i = 0; i < m_indices.size(); i++)
+		m_vertexInnerRadii[m_indices[i]] = std::min(m_vertexInnerRadii[m_indices[i]], nearPlaneDistances[i / 3]);
+	TakeSharedMin(m_vertices, m_vertexInnerRadii);
+
+	m_vertexDirections.resize(m_vertices.size());
+	for (size_t v = 0; v < m_vertices.size(); v++)
+		XMStoreFloat3(&m_vertexDirections[v], XMVector3Normalize(XMLoadFloat3(&m_vertices[v])));
+
+	// A point of a lowered face is at least its lowest corner times the cosine of its cap from the origin,
+	// a ball of radius shrink around it spans no more than LOCAL_SHRINK_ANGLE up to this shrink.
+	const float minInnerRadius = m_vertexInnerRadii.empty() ?
+		0.0f : *std::min_element(m_vertexInnerRadii.begin(), m_vertexInnerRadii.end());
+	const float k = cosf(maxCapAngle) * sinf(LOCAL_SHRINK_ANGLE);
+	m_maxLocalShrink = minInnerRadius * k / (1.0f + k);
+}
+
+void OcclusionBuffer::CreateSphereOccluder(
+	uint32_t gridSize, float radius, std::vector<XMFLOAT3>& vertices, std::vector<uint32_t>& indices)
+{
+	vertices.clear();
+	indices.clear();
+
+	// Same cube face grid as the quad sphere, projected on the sphere.
+	for (uint32_t face = 0; face < 6; face++)
+	{
+		const uint32_t base = static_cast<uint32_t>(vertices.size());
+		for (uint32_t j = 0; j <= gridSize; j++)
+		{
+			for (uint32_t i = 0; i <= gridSize; i++)
+			{
+				const XMFLOAT3 point = GetCubeFacePoint(face, i, j, gridSize);
+
+				XMFLOAT3 position;
+				XMStoreFloat3(&position, XMVector3Normalize(XMLoadFloat3(&point)) * radius);
+				vertices.push_back(position);
+			}
+		}
+
+		for (uint32_t j = 0; j < gridSize; j++)
+		{
+			for (uint32_t i = 0; i < gridSize; i++)
+			{
+				const uint32_t i0 = base + j * (gridSize + 1) + i;
+				const uint32_t quad[2][3] = { { i0, i0 + 1, i0 + gridSize + 2 }, { i0, i0 + gridSize + 2, i0 + gridSize + 1 } };
+
+				// Wind every triangle so its normal points outward.
+				for (const auto& triangle : quad)
+				{
+					const XMVECTOR v0 = XMLoadFloat3(&vertices[triangle[0]]);
+					const XMVECTOR v1 = XMLoadFloat3(&vertices[triangle[1]]);
+					const XMVECTOR v2 = XMLoadFloat3(&vertices[triangle[2]]);
+					const bool outward = XMVectorGetX(XMVector3Dot(XMVector3Cross(v1 - v0, v2 - v0), v0)) > 0.0f;
+
+					indices.push_back(triangle[0]);
+					indices.push_back(outward ? triangle[1] : triangle[2]);
+					indices.push_back(outward ? triangle[2] : triangle[1]);
+				}
+			}
+		}
+	}
+}
+
+void OcclusionBuffer::CreateTerrainOccluder(
+	uint32_t gridSize, float radius, float displacement, const HeightMap& heightMap,
+	std::vector<XMFLOAT3>& vertices, std::vector<uint32_t>& indices)
+{
+	CreateSphereOccluder(gridSize, 1.0f, vertices, indices);
+
+	// Vertices of a face follow each other row by row, as CreateSphereOccluder emits them.
+	const uint32_t rowSize = gridSize + 1;
+	std::vector<float> minHeights(vertices.size(), FLT_MAX);
+	for (uint32_t face = 0; face < 6; face++)
+	{
+		const uint32_t base = face * rowSize * rowSize;
+		for (uint32_t j = 0; j < gridSize; j++)
+		{
+			for (uint32_t i = 0; i < gridSize; i++)
+			{
+				// Quad on the cube face, corner 3 opposite to corner 0.
+				const XMFLOAT3 corners[4] =
+				{
+					GetCubeFacePoint(face, i, j, gridSize), GetCubeFacePoint(face, i + 1, j, gridSize),
+					GetCubeFacePoint(face, i, j + 1, gridSize), GetCubeFacePoint(face, i + 1, j + 1, gridSize),
+				};
+
+				float minHeight;
+				float maxHeight;
+				heightMap.GetHeightRange(corners, minHeight, maxHeight);
+
+				const uint32_t i0 = base + j * rowSize + i;
+				for (uint32_t vertex : { i0, i0 + 1, i0 + rowSize, i0 + rowSize + 1 })
+					minHeights[vertex] = std::min(minHeights[vertex], minHeight);
+			}
+		}
+	}
+	TakeSharedMin(vertices, minHeights);
+
+	for (size_t v = 0; v < vertices.size(); v++)
+		XMStoreFloat3(&vertices[v], XMLoadFloat3(&vertices[v]) * (radius + displacement * minHeights[v]));
+}
+
+void OcclusionBuffer::Rasterize(
+	const XMFLOAT4X4& viewProj, const XMFLOAT3& cameraPosition, WorkerPool& workerPool, float shrink)
+{
+	const auto rasterizeStart = std::chrono::high_resolution_clock::now();
+
+	// Lowered vertices keep a ball of radius shrink around every point of their faces inside the full occluder.
+	// Past the local limit they all drop to the inner ball less shrink, every point of it is that far inside as well.
+	// Rays from a camera moved by shrink stay within shrink of the old ones up to their end, so they hit it too.
+	const bool local = shrink <= m_maxLocalShrink;
+
+	m_viewProj = viewProj;
+	for (size_t v = 0; v < m_vertices.size(); v++)
+	{
+		if (shrink > 0.0f)
+		{
+			const float radius = std::max((local ? m_vertexInnerRadii[v] : m_innerRadius) - shrink, 0.0f);
+			XMStoreFloat3(&m_frameVertices[v], XMLoadFloat3(&m_vertexDirections[v]) * radius);
+		}
+		else
+		{
+			m_frameVertices[v] = m_vertices[v];
+		}
+		m_clipVertices[v] = TransformClip(viewProj, m_frameVertices[v]);
+	}
+
+	// Clip and set up front facing triangles once, bands only read them.
+	m_triangles.clear();
+	for (size_t t = 0; t < m_indices.size() / 3; t++)
+	{
+		const XMVECTOR v0 = XMLoadFloat3(&m_frameVertices[m_indices[t * 3 + 0]]);
+		const XMVECTOR v1 = XMLoadFloat3(&m_frameVertices[m_indices[t * 3 + 1]]);
+		const XMVECTOR v2 = XMLoadFloat3(&m_frameVertices[m_indices[t * 3 + 2]]);
+		const float facing = XMVectorGetX(XMVector3Dot(XMVector3Cross(v1 - v0, v2 - v0), XMLoadFloat3(&cameraPosition) - v0));
+		if (facing <= 0.0f)
+			continue;
+
+		XMFLOAT3 clip[3];
+		for (int k = 0; k < 3; k++)
+			clip[k] = m_clipVertices[m_indices[t * 3 + k]];
+
+		// Reject triangles fully outside one clip plane.
+		auto isOutside = [&clip](float XMFLOAT3::* component, float sign)
+		{
+			return sign * (clip[0].*component) > clip[0].z &&
+				sign * (clip[1].*component) > clip[1].z &&
+				sign * (clip[2].*component) > clip[2].z;
+		};
+		if (isOutside(&XMFLOAT3::x, 1.0f) || isOutside(&XMFLOAT3::x, -1.0f) ||
+			isOutside(&XMFLOAT3::y, 1.0f) || isOutside(&XMFLOAT3::y, -1.0f))
+			continue;
+
+		if (clip[0].z >= NEAR_W && clip[1].z >= NEAR_W && clip[2].z >= NEAR_W)
+		{
+			SetupTriangle(clip);
+			continue;
+		}
+
+		// Clip against near plane, parts behind it are dropped which keeps the occluder conservative.
+		XMFLOAT3 polygon[4];
+		int polygonSize = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			const XMFLOAT3& a = clip[k];
+			const XMFLOAT3& b = clip[(k + 1) % 3];
+
+			if (a.z >= NEAR_W)
+				polygon[polygonSize++] = a;
+			if ((a.z >= NEAR_W) != (b.z >= NEAR_W))
+				polygon[polygonSize++] = LerpClip(a, b, (NEAR_W - a.z) / (b.z - a.z));
+		}
+
+		for (int k = 1; k + 1 < polygonSize; k++)
+		{
+			const XMFLOAT3 fan[3] = { polygon[0], polygon[k], polygon[k + 1] };
+			SetupTriangle(fan);
+		}
+	}
+
+	workerPool.ParallelFor(m_tileCountY, [this](uint32_t band) { RasterizeBand(band); });
+
+	m_rasterizeTime = std::chrono::duration<float, std::milli>(
+		std::chrono::high_resolution_clock::now() - rasterizeStart).count();
+}
+
+bool OcclusionBuffer::IsSphereOccluded(const XMFLOAT3& center, float radius) const
+{
+	// Project corners of the box around sphere, its screen rect and nearest depth bound the sphere.
+	const XMFLOAT3 clipCenter = TransformClip(m_viewProj, center);
+
+	float minW = clipCenter.z;
+	float minX = FLT_MAX, minY = FLT_MAX;
+	float maxX = -FLT_MAX, maxY = -FLT_MAX;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		const float dx = (corner & 1) ? radius : -radius;
+		const float dy = (corner & 2) ? radius : -radius;
+		const float dz = (corner & 4) ? radius : -radius;
+
+		const float x = clipCenter.x + dx * m_viewProj._11 + dy * m_viewProj._21 + dz * m_viewProj._31;
+		const float y = clipCenter.y + dx * m_viewProj._12 + dy * m_viewProj._22 + dz * m_viewProj._32;
+		const float w = clipCenter.z + dx * m_viewProj._14 + dy * m_viewProj._24 + dz * m_viewProj._34;
+		if (w < NEAR_W)
+			return false;
+
+		const float sx = (x / w * 0.5f + 0.5f) * m_width;
+		const float sy = (0.5f - y / w * 0.5f) * m_height;
+		minW = std::min(minW, w);
+		minX = std::min(minX, sx);
+		minY = std::min(minY, sy);
+		maxX = std::max(maxX, sx);
+		maxY = std::max(maxY, sy);
+	}
+
+	// Touched pixels grown by one, so pixel center samples of the occluder bound every point between them.
+	const float pixelMinX = floorf(minX) - 1.0f;
+	const float pixelMinY = floorf(minY) - 1.0f;
+	const float pixelMaxX = floorf(maxX) + 1.0f;
+	const float pixelMaxY = floorf(maxY) + 1.0f;
+	if (pixelMinX < 0.0f || pixelMinY < 0.0f || pixelMaxX >= m_width || pixelMaxY >= m_height)
+		return false;
+
+	const uint32_t x0 = static_cast<uint32_t>(pixelMinX);
+	const uint32_t y0 = static_cast<uint32_t>(pixelMinY);
+	const uint32_t x1 = static_cast<uint32_t>(pixelMaxX);
+	const uint32_t y1 = static_cast<uint32_t>(pixelMaxY);
+
+	// Occluded only where the occluder is strictly nearer than the nearest sphere point.
+	const float threshold = (1.0f / minW) * (1.0f + DEPTH_EPSILON);
+
+	for (uint32_t ty = y0 / TILE_SIZE; ty <= y1 / TILE_SIZE; ty++)
+	{
+		for (uint32_t tx = x0 / TILE_SIZE; tx <= x1 / TILE_SIZE; tx++)
+		{
+			// Whole tile is nearer, no need to look at its pixels.
+			if (m_tileDepth[ty * m_tileCountX + tx] > threshold)
+				continue;
+
+			const uint32_t rowBegin = std::max(y0, ty * TILE_SIZE);
+			const uint32_t rowEnd = std::min(y1, ty * TILE_SIZE + TILE_SIZE - 1);
+			const uint32_t columnBegin = std::max(x0, tx * TILE_SIZE);
+			const uint32_t columnEnd = std::min(x1, tx * TILE_SIZE + TILE_SIZE - 1);
+
+			for (uint32_t y = rowBegin; y <= rowEnd; y++)
+			{
+				for (uint32_t x = columnBegin; x <= columnEnd; x++)
+				{
+					if (m_depth[y * m_width + x] <= threshold)
+						return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+void OcclusionBuffer::SetupTriangle(const XMFLOAT3 clip[3])
+{
+	float x[3], y[3], z[3];
+	for (int k = 0; k < 3; k++)
+	{
+		z[k] = 1.0f / clip[k].z;
+		x[k] = (clip[k].x * z[k] * 0.5f + 0.5f) * m_width;
+		y[k] = (0.5f - clip[k].y * z[k] * 0.5f) * m_height;
+	}
+
+	const float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (fabsf(area) < 1e-6f)
+		return;
+
+	// Pixels whose centers fall inside bounds.
+	Triangle triangle;
+	triangle.minX = std::max(static_cast<int32_t>(ceilf(std::min({ x[0], x[1], x[2] }) - 0.5f)), 0);
+	triangle.minY = std::max(static_cast<int32_t>(ceilf(std::min({ y[0], y[1], y[2] }) - 0.5f)), 0);
+	triangle.maxX = std::min(static_cast<int32_t>(floorf(std::max({ x[0], x[1], x[2] }) - 0.5f)), static_cast<int32_t>(m_width) - 1);
+	triangle.maxY = std::min(static_cast<int32_t>(floorf(std::max({ y[0], y[1], y[2] }) - 0.5f)), static_cast<int32_t>(m_height) - 1);
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+		return;
+
+	// Edge functions, flipped by winding so inside is positive.
+	const float sign = area > 0.0f ? 1.0f : -1.0f;
+	for (int k = 0; k < 3; k++)
+	{
+		const int next = (k + 1) % 3;
+		triangle.edgeA[k] = -(y[next] - y[k]) * sign;
+		triangle.edgeB[k] = (x[next] - x[k]) * sign;
+		triangle.edgeC[k] = -(triangle.edgeA[k] * x[k] + triangle.edgeB[k] * y[k]);
+	}
+
+	// Reciprocal depth is linear in screen space.
+	const float dz1 = z[1] - z[0];
+	const float dz2 = z[2] - z[0];
+	triangle.depthA = (dz1 * (y[2] - y[0]) - dz2 * (y[1] - y[0])) / area;
+	triangle.depthB = (dz2 * (x[1] - x[0]) - dz1 * (x[2] - x[0])) / area;
+	triangle.depthC = z[0] - triangle.depthA * x[0] - triangle.depthB * y[0];
+
+	m_triangles.push_back(triangle);
+}
+
+void OcclusionBuffer::RasterizeBand(uint32_t band)
+{
+	const int32_t bandMinY = static_cast<int32_t>(band * TILE_SIZE);
+	const int32_t bandMaxY = bandMinY + static_cast<int32_t>(TILE_SIZE) - 1;
+
+	float* const bandDepth = m_depth.data() + static_cast<size_t>(bandMinY) * m_width;
+	std::fill(bandDepth, bandDepth + TILE_SIZE * m_width, 0.0f);
+
+	const __m128 laneOffset = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (const Triangle& triangle : m_triangles)
+	{
+		if (triangle.maxY < bandMinY || triangle.minY > bandMaxY)
+			continue;
+
+		const __m128 edgeA0 = _mm_set1_ps(triangle.edgeA[0]);
+		const __m128 edgeA1 = _mm_set1_ps(triangle.edgeA[1]);
+		const __m128 edgeA2 = _mm_set1_ps(triangle.edgeA[2]);
+		const __m128 depthA = _mm_set1_ps(triangle.depthA);
+
+		const int32_t rowBegin = std::max(triangle.minY, bandMinY);
+		const int32_t rowEnd = std::min(triangle.maxY, bandMaxY);
+		const int32_t columnBegin = triangle.minX & ~3;
+
+		for (int32_t y = rowBegin; y <= rowEnd; y++)
+		{
+			// Row terms are constant across the span.
+			const float py = y + 0.5f;
+			const __m128 rowEdge0 = _mm_set1_ps(triangle.edgeB[0] * py + triangle.edgeC[0]);
+			const __m128 rowEdge1 = _mm_set1_ps(triangle.edgeB[1] * py + triangle.edgeC[1]);
+			const __m128 rowEdge2 = _mm_set1_ps(triangle.edgeB[2] * py + triangle.edgeC[2]);
+			const __m128 rowDepth = _mm_set1_ps(triangle.depthB * py + triangle.depthC);
+
+			float* const row = m_depth.data() + static_cast<size_t>(y) * m_width;
+			for (int32_t x = columnBegin; x <= triangle.maxX; x += 4)
+			{
+				const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffset);
+
+				const __m128 inside = _mm_and_ps(
+					_mm_and_ps(
+						_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA0, px), rowEdge0), zero),
+						_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA1, px), rowEdge1), zero)),
+					_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA2, px), rowEdge2), zero));
+
+				// Keep nearest, which is the largest reciprocal depth.
+				const __m128 depth = _mm_add_ps(_mm_mul_ps(depthA, px), rowDepth);
+				const __m128 stored = _mm_loadu_ps(row + x);
+				const __m128 nearest = _mm_max_ps(stored, depth);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, stored)));
+			}
+		}
+	}
+
+	// Farthest pixel of every tile in this band.
+	for (uint32_t tx = 0; tx < m_tileCountX; tx++)
+	{
+		__m128 farthest = _mm_set1_ps(FLT_MAX);
+		for (uint32_t y = 0; y < TILE_SIZE; y++)
+		{
+			const float* const tileRow = bandDepth + y * m_width + tx * TILE_SIZE;
+			farthest = _mm_min_ps(farthest, _mm_min_ps(_mm_loadu_ps(tileRow), _mm_loadu_ps(tileRow + 4)));
+		}
+
+		m_tileDepth[band * m_tileCountX + tx] = HorizontalMin(farthest);
+	}
+}
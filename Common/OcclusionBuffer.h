@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <DirectXMath.h>
+
+class HeightMap;
+class WorkerPool;
+
+// Coarse software depth buffer for CPU occlusion tests.
+// Pixels store reciprocal view depth (1 / w), 0 means empty, larger is nearer.
+// Every 8x8 tile keeps its farthest pixel for hierarchical tests.
+class OcclusionBuffer
+{
+public:
+	static constexpr uint32_t TILE_SIZE = 8;
+
+	// Widest camera move a shrink is lowered locally for, as seen from the origin. Larger shrinks scale the whole occluder.
+	static constexpr float LOCAL_SHRINK_ANGLE = 0.02f;	// Radians.
+
+	// Width and height must be multiples of TILE_SIZE.
+	OcclusionBuffer(uint32_t width, uint32_t height);
+
+	// Occluder triangle list, must lie on or below the visible surface.
+	void SetOccluder(std::vector<DirectX::XMFLOAT3> vertices, std::vector<uint32_t> indices);
+
+	// Chord quads of a quad sphere with gridSize quads per face edge.
+	// Chords lie inside the sphere, so the proxy never covers surface at or above radius.
+	static void CreateSphereOccluder(
+		uint32_t gridSize, float radius,
+		std::vector<DirectX::XMFLOAT3>& vertices, std::vector<uint32_t>& indices);
+
+	// Same quads lifted to the displaced surface, radius + displacement * height. Every vertex takes the lowest height
+	// the domain shader can read in the quads around it, on every face it lies on, so chords stay under the surface
+	// and the proxy stays closed around the origin.
+	static void CreateTerrainOccluder(
+		uint32_t gridSize, float radius, float displacement, const HeightMap& heightMap,
+		std::vector<DirectX::XMFLOAT3>& vertices, std::vector<uint32_t>& indices);
+
+	// Rasterize front facing occluder triangles, rows are split in tile bands over the worker pool.
+	// With a shrink every vertex drops to the lowest triangle plane near it less shrink, so a ball of radius shrink
+	// around any point of the lowered occluder lies inside the full one. Past GetMaxLocalShrink every vertex drops to
+	// the ball the occluder encloses, that ball less shrink. Either way whatever it hides stays hidden behind the full
+	// occluder from any camera within shrink of cameraPosition.
+	// Shrinking needs a closed occluder that every ray from the origin leaves once.
+	void Rasterize(
+		const DirectX::XMFLOAT4X4& viewProj, const DirectX::XMFLOAT3& cameraPosition, WorkerPool& workerPool,
+		float shrink = 0.0f);
+
+	// True if sphere is behind the occluder in every pixel it may cover.
+	// Spheres crossing the near plane or the screen border are never occluded.
+	bool IsSphereOccluded(const DirectX::XMFLOAT3& center, float radius) const;
+
+	uint32_t								GetWidth() const { return m_width; }
+	uint32_t								GetHeight() const { return m_height; }
+	float									GetMaxLocalShrink() const { return m_maxLocalShrink; }
+	uint32_t								GetRasterizedTriangleCount() const { return static_cast<uint32_t>(m_triangles.size()); }
+	float									GetRasterizeTime() const { return m_rasterizeTime; }
+	const float*							GetDepth() const { return m_depth.data(); }
+
+private:
+	// Screen space triangle, edge functions are positive inside.
+	struct Triangle
+	{
+		float		edgeA[3];
+		float		edgeB[3];
+		float		edgeC[3];
+		float		depthA;
+		float		depthB;
+		float		depthC;
+		int32_t		minX;
+		int32_t		maxX;
+		int32_t		minY;
+		int32_t		maxY;
+	};
+
+	void SetupTriangle(const DirectX::XMFLOAT3 clip[3]);
+	void RasterizeBand(uint32_t band);
+
+	uint32_t								m_width;
+	uint32_t								m_height;
+	uint32_t								m_tileCountX;
+	uint32_t								m_tileCountY;
+
+	std::vector<float>						m_depth;
+	std::vector<float>						m_tileDepth;
+
+	// Occluder mesh, wound so face normals point outward.
+	std::vector<DirectX::XMFLOAT3>			m_vertices;
+	std::vector<uint32_t>					m_indices;
+
+	// Nearest face plane to the origin.
+	float									m_innerRadius = 0.0f;
+
+	// Direction of every vertex and the lowest face plane within LOCAL_SHRINK_ANGLE of the faces around it.
+	std::vector<DirectX::XMFLOAT3>			m_vertexDirections;
+	std::vector<float>						m_vertexInnerRadii;
+	float									m_maxLocalShrink = 0.0f;
+
+	// Per frame state.
+	DirectX::XMFLOAT4X4						m_viewProj;
+	std::vector<DirectX::XMFLOAT3>			m_frameVertices;	// Shrunk occluder.
+	std::vector<DirectX::XMFLOAT3>			m_clipVertices;	// x, y, w
+	std::vector<Triangle>					m_triangles;
+	float									m_rasterizeTime = 0.0f;
+};
@@ -1,47 +1,32 @@
 #include "pch.h"
 #include "QuadNode.h"
 
+#include <cfloat>
+
 using namespace DirectX;
 
-QuadNode::QuadNode(char level, uint32_t indexCount, uint32_t index[4], uint32_t baseAddress, float width)
+QuadNode::QuadNode(char level, uint32_t indexCount, const uint32_t index[4], uint32_t baseAddress, float width)
 {
 	m_level = level;
 	m_indexCount = indexCount;
 	memcpy(m_cornerIndex, index, sizeof(uint32_t) * 4);
 	m_baseAddress = baseAddress;
+	m_centerPosition = XMFLOAT3(0, 0, 0);
 	m_width = width;
 }
 
-QuadNode::~QuadNode()
+QuadNode QuadNode::CreateChild(int c, const std::vector<uint32_t>& indices) const
 {
-	for (const auto c : m_children)
-		delete c;
-}
+	const uint32_t qic = m_indexCount / 4;
+	const uint32_t qqic = qic / 4;
 
-void QuadNode::CreateChildren(
-	const char limit,
-	std::vector<VertexTess>& vertices, const std::vector<uint32_t>& indices)
-{
-	if (m_level + 1 > limit)
-		return;
+	uint32_t index[4];
+	index[0] = indices[0 * qqic + c * qic + m_baseAddress];
+	index[1] = indices[1 * qqic + c * qic + m_baseAddress];
+	index[2] = indices[2 * qqic + c * qic + m_baseAddress];
+	index[3] = indices[3 * qqic + c * qic + m_baseAddress];
 
-	for (int c = 0; c < 4; c++)
-	{
-		const uint32_t qic = m_indexCount / 4;
-		const uint32_t qqic = qic / 4;
-
-		uint32_t index[4];
-		index[0] = indices[0 * qqic + c * qic + m_baseAddress];
-		index[1] = indices[1 * qqic + c * qic + m_baseAddress];
-		index[2] = indices[2 * qqic + c * qic + m_baseAddress];
-		index[3] = indices[3 * qqic + c * qic + m_baseAddress];
-
-		const auto child = new QuadNode(m_level + 1, qic, index, c * qic + m_baseAddress, m_width / 2);
-		child->CalcCenter(vertices, indices);
-		child->CreateChildren(limit, vertices, indices);
-
-		m_children[c] = child;
-	}
+	return QuadNode(m_level + 1, qic, index, c * qic + m_baseAddress, m_width / 2);
 }
 
 void QuadNode::CalcCenter(
@@ -95,7 +80,7 @@ void QuadNode::CalcCenter(
 				}
 
 				const uint32_t base = m_baseAddress + step * (m_indexCount / 4);
-				for (int i = 0; i < m_indexCount / 4; i++)
+				for (uint32_t i = 0; i < m_indexCount / 4; i++)
 				{
 					XMStoreFloat3(&vertices[indices[base + i]].quadPos, subCenter);
 				}
@@ -103,63 +88,114 @@ void QuadNode::CalcCenter(
 		}
 	}
 
-	// Calculate height fit with sphere
-	float h = 150.0f * sin(acos(0.5f * m_width / 150.0f));
+	XMFLOAT3 corners[4];
+	for (int k = 0; k < 4; k++)
+		corners[k] = vertices[m_cornerIndex[k]].position;
 
-	// Calculate obb center position
-	XMFLOAT3 obbCenter;
-	XMStoreFloat3(&obbCenter, XMVector3Normalize(center) * h);
+	// Heights are unknown while building, bounds cover the whole displacement range and any slope.
+	CalcBounds(corners, 0.0f, MAX_HEIGHT_DISPLACEMENT, FLT_MAX, m_obb, m_sphere, m_normalCone);
+}
 
-	// Calculate TBN
-	auto n = SimpleMath::Vector3(XMVector3Normalize(center));
+void QuadNode::CalcBounds(
+	const XMFLOAT3 corners[4], float minHeight, float maxHeight, float maxSlope,
+	BoundingOrientedBox& obb, BoundingSphere& sphere, XMFLOAT4& normalCone)
+{
+	const XMVECTOR center = 0.25f * (
+		XMLoadFloat3(&corners[0]) + XMLoadFloat3(&corners[1]) +
+		XMLoadFloat3(&corners[2]) + XMLoadFloat3(&corners[3]));
 
-	const float theta = atan2(n.z, n.x);
-	auto t = SimpleMath::Vector3(-sin(theta), 0.0f, cos(theta));
-	t.Normalize();
+	const float minRadius = QUAD_SPHERE_RADIUS + minHeight;
+	const float maxRadius = QUAD_SPHERE_RADIUS + maxHeight;
 
-	auto b = n.Cross(t);
-	b.Normalize();
+	// Calculate TBN
+	const XMVECTOR n = XMVector3Normalize(center);
+
+	const float theta = atan2(XMVectorGetZ(n), XMVectorGetX(n));
+	const XMVECTOR t = XMVector3Normalize(XMVectorSet(-sin(theta), 0.0f, cos(theta), 0.0f));
+	const XMVECTOR b = XMVector3Normalize(XMVector3Cross(n, t));
 
 	// Calculate quaternion
-	const auto q = SimpleMath::Quaternion::CreateFromRotationMatrix(
-		SimpleMath::Matrix(
-			SimpleMath::Vector4(t), SimpleMath::Vector4(b),
-			SimpleMath::Vector4(n), SimpleMath::Vector4::Zero));
-
-	const auto quaternionVec = XMFLOAT4(q.x, q.y, q.z, q.w);
-
-	// Create OBB with little bigger size
-	m_obb = BoundingOrientedBox(
-		obbCenter,
-		XMFLOAT3(m_width * 0.6f, m_width * 0.6f, 0.1f),
-		quaternionVec);
-}
+	XMFLOAT4 quaternionVec;
+	XMStoreFloat4(&quaternionVec, XMQuaternionRotationMatrix(XMMATRIX(t, b, n, XMVectorZero())));
+
+	// Displaced surface lies between two spheres over the node.
+	// Node edges are great circle arcs, and no axis but n points into the node, so the extremes along t and b
+	// are on the edges at either radius. Along n the highest point is the center direction.
+	const XMVECTOR axes[3] = { t, b, n };
+	float lows[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float highs[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	float maxStepAngle = 0.0f;
+
+	const int edgeOrder[4][2] = { { 0, 1 }, { 1, 3 }, { 3, 2 }, { 2, 0 } };
+	for (const auto& edge : edgeOrder)
+	{
+		const XMVECTOR from = XMLoadFloat3(&corners[edge[0]]);
+		const XMVECTOR to = XMLoadFloat3(&corners[edge[1]]);
 
-void QuadNode::Render(
-	IN BoundingFrustum& frustum, IN const std::vector<uint32_t>& indices,
-	OUT std::vector<uint32_t>& retVec, OUT uint32_t& culledQuadCount) const
-{
-	const ContainmentType result = frustum.Contains(m_obb);
+		XMVECTOR prevDirection = XMVector3Normalize(from);
+		for (int s = 0; s <= BOUNDS_EDGE_STEP_COUNT; s++)
+		{
+			const XMVECTOR direction = XMVector3Normalize(XMVectorLerp(from, to, s / static_cast<float>(BOUNDS_EDGE_STEP_COUNT)));
+			maxStepAngle = std::max(maxStepAngle, XMVectorGetX(XMVector3AngleBetweenNormals(prevDirection, direction)));
+			prevDirection = direction;
 
-	// Do not cull in level 0
-	if (result <= 0 && m_level >= 1)
+			for (int k = 0; k < 3; k++)
+			{
+				const float d = XMVectorGetX(XMVector3Dot(direction, axes[k]));
+				lows[k] = std::min(lows[k], std::min(d * minRadius, d * maxRadius));
+				highs[k] = std::max(highs[k], std::max(d * minRadius, d * maxRadius));
+			}
+		}
+	}
+	highs[2] = maxRadius;
+
+	// Arcs between edge samples bulge out of their chords by at most this much.
+	const float bulge = maxRadius * (1.0f - cos(0.5f * maxStepAngle)) + 1e-3f;
+
+	XMVECTOR obbCenterVec = XMVectorZero();
+	XMFLOAT3 extents;
+	float* extentValues[3] = { &extents.x, &extents.y, &extents.z };
+	for (int k = 0; k < 3; k++)
 	{
-		culledQuadCount += m_indexCount / 4;
-		return;
+		obbCenterVec += axes[k] * (0.5f * (lows[k] + highs[k]));
+		*extentValues[k] = 0.5f * (highs[k] - lows[k]) + bulge;
 	}
 
-	// Try to render children
-	bool anyChildVisible = false;
-	for (const auto c : m_children)
+	XMFLOAT3 obbCenter;
+	XMStoreFloat3(&obbCenter, obbCenterVec);
+
+	obb = BoundingOrientedBox(obbCenter, extents, quaternionVec);
+
+	// Bounding sphere around obb center. Center is close to n, so the farthest point
+	// at either radius is on the edges as well.
+	float radius = 0.0f;
+	for (const auto& edge : edgeOrder)
 	{
-		if (c != nullptr)
+		const XMVECTOR from = XMLoadFloat3(&corners[edge[0]]);
+		const XMVECTOR to = XMLoadFloat3(&corners[edge[1]]);
+
+		for (int s = 0; s < BOUNDS_EDGE_STEP_COUNT; s++)
 		{
-			anyChildVisible = true;
-			c->Render(frustum, indices, retVec, culledQuadCount);
+			const XMVECTOR direction = XMVector3Normalize(XMVectorLerp(from, to, s / static_cast<float>(BOUNDS_EDGE_STEP_COUNT)));
+			radius = std::max(radius, XMVectorGetX(XMVector3Length(direction * minRadius - obbCenterVec)));
+			radius = std::max(radius, XMVectorGetX(XMVector3Length(direction * maxRadius - obbCenterVec)));
 		}
 	}
 
-	// If no child is visible, render this node
-	if (!anyChildVisible)
-		retVec.insert(retVec.end(), &indices[m_baseAddress], &indices[m_baseAddress] + m_indexCount);
+	sphere = BoundingSphere(obbCenter, (radius + bulge) * 1.001f);
+
+	// Normal cone, sphere normals of the patch spread up to the farthest corner direction.
+	const XMVECTOR axis = XMVector3Normalize(center);
+	float halfAngle = 0.0f;
+	for (int k = 0; k < 4; k++)
+	{
+		const XMVECTOR cornerDirection = XMVector3Normalize(XMLoadFloat3(&corners[k]));
+		halfAngle = std::max(halfAngle, XMVectorGetX(XMVector3AngleBetweenNormals(axis, cornerDirection)));
+	}
+
+	// Widen by the steepest surface slope. A flat triangle on that surface, with no angle above 120 degrees,
+	// tilts at most twice as far from its sphere normal.
+	halfAngle += atan(2.0f * maxSlope);
+
+	XMStoreFloat4(&normalCone, XMVectorSetW(axis, std::min(halfAngle, XM_PIDIV2)));
 }
\ No newline at end of file
@@ -3,8 +3,13 @@
 #define QUAD_NODE_MAX_LEVEL 4u
 #define TESS_GROUP_QUAD_LEVEL 5u	// DO NOT CHANGE THIS VALUE
 
+#define QUAD_SPHERE_RADIUS 150.0f
+#define MAX_HEIGHT_DISPLACEMENT 0.6f	// Height map scale in Shader.hlsli
+
+#include <cstdint>
+#include <vector>
+
 #include <DirectXCollision.h>
-#include <SimpleMath.h>
 
 struct VertexTess
 {
@@ -16,28 +21,33 @@ struct VertexTess
 		const DirectX::XMFLOAT3 quadPos = DirectX::XMFLOAT3(0, 0, 0)) : position(position), quadPos(quadPos) {}
 };
 
+// Quad tree node while building a face tree.
+// FaceTree keeps the resulting bounds in flattened arrays.
 class QuadNode
 {
 public:
-	QuadNode(char level, uint32_t indexCount, uint32_t index[4], uint32_t baseAddress, float width);
-	~QuadNode();
+	static constexpr int BOUNDS_EDGE_STEP_COUNT = 16;	// Edge samples for CalcBounds.
 
-	void CreateChildren(
-		const char limit,
-		std::vector<VertexTess>& vertices,
-		const std::vector<uint32_t>& indices);
+	QuadNode(char level, uint32_t indexCount, const uint32_t index[4], uint32_t baseAddress, float width);
+
+	QuadNode CreateChild(int c, const std::vector<uint32_t>& indices) const;
 
 	void CalcCenter(
 		std::vector<VertexTess>& vertices,
 		const std::vector<uint32_t>& indices);
 
-	void Render(
-		IN DirectX::BoundingFrustum& frustum, IN const std::vector<uint32_t>& indices,
-		OUT std::vector<uint32_t>& retVec, OUT uint32_t& culledQuadCount) const;
+	// Culling bounds of a node from its corners on cube face, enclosing the surface displaced by heights in given range.
+	// Normal cone takes the steepest rise over run of that surface, FLT_MAX if unknown.
+	static void CalcBounds(
+		const DirectX::XMFLOAT3 corners[4], float minHeight, float maxHeight, float maxSlope,
+		DirectX::BoundingOrientedBox& obb, DirectX::BoundingSphere& sphere, DirectX::XMFLOAT4& normalCone);
 
-	uint32_t	GetIndexCount() const { return m_indexCount; }
-	char		GetLevel() const { return m_level; }
-	float		GetWidth() const { return m_width; }
+	uint32_t								GetIndexCount() const { return m_indexCount; }
+	char									GetLevel() const { return m_level; }
+	float									GetWidth() const { return m_width; }
+	const DirectX::BoundingOrientedBox&		GetBounds() const { return m_obb; }
+	const DirectX::BoundingSphere&			GetBoundingSphere() const { return m_sphere; }
+	const DirectX::XMFLOAT4&				GetNormalCone() const { return m_normalCone; }
 
 private:
 	char									m_level;
@@ -46,6 +56,7 @@ private:
 	uint32_t								m_baseAddress;
 	DirectX::XMFLOAT3						m_centerPosition;
 	DirectX::BoundingOrientedBox			m_obb;
+	DirectX::BoundingSphere					m_sphere;
+	DirectX::XMFLOAT4						m_normalCone;	// xyz axis, w half angle
 	float									m_width;
-	QuadNode* m_children[4] = { nullptr, nullptr, nullptr, nullptr };
 };
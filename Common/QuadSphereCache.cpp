@@ -0,0 +1,209 @@
+#include "pch.h"
+#include "QuadSphereCache.h"
+
+#include <fstream>
+#include <string>
+
+using namespace DirectX;
+
+static_assert(sizeof(VertexTess) == 24, "Cache layout expects tightly packed VertexTess.");
+static_assert(sizeof(FaceTree::NodeBounds) == 72, "Cache layout expects tightly packed FaceTree::NodeBounds.");
+
+QuadSphereCache::~QuadSphereCache()
+{
+	Close();
+}
+
+bool QuadSphereCache::Open(const wchar_t* fileName, uint32_t subDivideCount)
+{
+	Close();
+
+	// Map whole file read-only.
+	m_file = CreateFileW(
+		fileName, GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize = {};
+	if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(Header)))
+	{
+		Close();
+		return false;
+	}
+
+	m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	m_view = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_view == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	// Check the header against what would be generated now.
+	Header header;
+	memcpy(&header, m_view, sizeof(Header));
+
+	const uint64_t size = static_cast<uint64_t>(fileSize.QuadPart);
+	const uint64_t indexCount = static_cast<uint64_t>(pow(4, subDivideCount + 1)) * 6;
+	const uint64_t vertexBytes = sizeof(VertexTess) * static_cast<uint64_t>(header.vertexCount);
+	const uint64_t indexBytes = sizeof(uint32_t) * static_cast<uint64_t>(header.indexCount);
+	const uint64_t nodeBytes = sizeof(FaceTree::NodeBounds) * 6 * static_cast<uint64_t>(header.faceNodeCount);
+
+	const bool valid =
+		header.magic == FILE_MAGIC &&
+		header.formatVersion == FORMAT_VERSION &&
+		header.generatorVersion == QuadSphereGenerator::GENERATOR_VERSION &&
+		header.subDivideCount == subDivideCount &&
+		header.indexCount == indexCount &&
+		header.faceNodeCount == GetFaceNodeCount(subDivideCount) &&
+		header.fileSize == size &&
+		header.vertexOffset == sizeof(Header) &&
+		header.indexOffset == header.vertexOffset + vertexBytes &&
+		header.nodeOffset == header.indexOffset + indexBytes &&
+		header.nodeOffset + nodeBytes == size;
+
+	if (!valid || Checksum(m_view + sizeof(Header), size - sizeof(Header)) != header.payloadChecksum)
+	{
+		Close();
+		return false;
+	}
+
+	m_subDivideCount = subDivideCount;
+	m_vertices = reinterpret_cast<const VertexTess*>(m_view + header.vertexOffset);
+	m_vertexCount = header.vertexCount;
+	m_indices = reinterpret_cast<const uint32_t*>(m_view + header.indexOffset);
+	m_indexCount = header.indexCount;
+	m_nodeBounds = reinterpret_cast<const FaceTree::NodeBounds*>(m_view + header.nodeOffset);
+	m_faceNodeCount = header.faceNodeCount;
+
+	return true;
+}
+
+void QuadSphereCache::Close()
+{
+	if (m_view != nullptr)
+		UnmapViewOfFile(m_view);
+	if (m_mapping != nullptr)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = nullptr;
+	m_view = nullptr;
+
+	m_vertices = nullptr;
+	m_vertexCount = 0;
+	m_indices = nullptr;
+	m_indexCount = 0;
+	m_nodeBounds = nullptr;
+	m_faceNodeCount = 0;
+}
+
+std::vector<FaceTree*> QuadSphereCache::CreateFaceTrees() const
+{
+	const uint32_t faceIndexCount = m_indexCount / 6;
+	const uint32_t maxLevel = std::min(m_subDivideCount, QUAD_NODE_MAX_LEVEL);
+
+	std::vector<FaceTree*> faceTrees;
+	for (int f = 0; f < 6; f++)
+	{
+		const FaceTree::NodeBounds* bounds = m_nodeBounds + f * m_faceNodeCount;
+
+		const auto faceTree = new FaceTree(f * faceIndexCount, faceIndexCount, maxLevel);
+		for (uint32_t node = 0; node < m_faceNodeCount; node++)
+			faceTree->SetNodeBounds(node, bounds[node]);
+
+		faceTrees.push_back(faceTree);
+	}
+
+	return faceTrees;
+}
+
+bool QuadSphereCache::Save(
+	const wchar_t* fileName, uint32_t subDivideCount, const QuadSphereGenerator::QuadSphereInfo& info)
+{
+	// Flatten node bounds of every face.
+	std::vector<FaceTree::NodeBounds> nodeBounds;
+	for (const FaceTree* faceTree : info.faceTrees)
+	{
+		for (uint32_t node = 0; node < faceTree->GetNodeCount(); node++)
+			nodeBounds.push_back(faceTree->GetNodeBounds(node));
+	}
+
+	const uint64_t vertexBytes = sizeof(VertexTess) * info.vertices.size();
+	const uint64_t indexBytes = sizeof(uint32_t) * info.indices.size();
+	const uint64_t nodeBytes = sizeof(FaceTree::NodeBounds) * nodeBounds.size();
+
+	Header header = {};
+	header.magic = FILE_MAGIC;
+	header.formatVersion = FORMAT_VERSION;
+	header.generatorVersion = QuadSphereGenerator::GENERATOR_VERSION;
+	header.subDivideCount = subDivideCount;
+	header.vertexCount = static_cast<uint32_t>(info.vertices.size());
+	header.indexCount = static_cast<uint32_t>(info.indices.size());
+	header.faceNodeCount = GetFaceNodeCount(subDivideCount);
+	header.vertexOffset = sizeof(Header);
+	header.indexOffset = header.vertexOffset + vertexBytes;
+	header.nodeOffset = header.indexOffset + indexBytes;
+	header.fileSize = header.nodeOffset + nodeBytes;
+
+	if (nodeBounds.size() != 6 * static_cast<size_t>(header.faceNodeCount))
+		return false;
+
+	// Checksum covers the payload as one contiguous block.
+	// Every block is a multiple of 8 bytes, so it can be chained block by block.
+	uint64_t checksum = Checksum(reinterpret_cast<const uint8_t*>(info.vertices.data()), vertexBytes);
+	checksum = Checksum(reinterpret_cast<const uint8_t*>(info.indices.data()), indexBytes, checksum);
+	checksum = Checksum(reinterpret_cast<const uint8_t*>(nodeBounds.data()), nodeBytes, checksum);
+	header.payloadChecksum = checksum;
+
+	// Write to temporary file first, so a crash never leaves a half written cache.
+	const std::wstring tempFileName = std::wstring(fileName) + L".tmp";
+	{
+		std::ofstream file(tempFileName, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+		file.write(reinterpret_cast<const char*>(info.vertices.data()), static_cast<std::streamsize>(vertexBytes));
+		file.write(reinterpret_cast<const char*>(info.indices.data()), static_cast<std::streamsize>(indexBytes));
+		file.write(reinterpret_cast<const char*>(nodeBounds.data()), static_cast<std::streamsize>(nodeBytes));
+		if (!file)
+			return false;
+	}
+
+	return MoveFileExW(tempFileName.c_str(), fileName, MOVEFILE_REPLACE_EXISTING) != FALSE;
+}
+
+uint32_t QuadSphereCache::GetFaceNodeCount(uint32_t subDivideCount)
+{
+	// Full quad tree down to the node level limit.
+	return FaceTree::GetNodeCount(std::min(subDivideCount, QUAD_NODE_MAX_LEVEL));
+}
+
+uint64_t QuadSphereCache::Checksum(const uint8_t* data, uint64_t size, uint64_t hash)
+{
+	// FNV-1a over 64-bit words, remaining bytes folded in one by one.
+	constexpr uint64_t prime = 0x100000001B3ull;
+
+	const uint64_t wordCount = size / sizeof(uint64_t);
+	for (uint64_t w = 0; w < wordCount; w++)
+	{
+		uint64_t word;
+		memcpy(&word, data + w * sizeof(uint64_t), sizeof(uint64_t));
+		hash = (hash ^ word) * prime;
+	}
+
+	for (uint64_t b = wordCount * sizeof(uint64_t); b < size; b++)
+		hash = (hash ^ data[b]) * prime;
+
+	return hash;
+}
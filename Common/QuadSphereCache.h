@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "QuadSphereGenerator.h"
+
+// Binary cache of a generated quad sphere.
+// Vertices, indices and flattened node bounds are memory-mapped on load,
+// so they can be copied straight into upload heaps.
+class QuadSphereCache
+{
+public:
+	QuadSphereCache() = default;
+	~QuadSphereCache();
+
+	QuadSphereCache(const QuadSphereCache&) = delete;
+	QuadSphereCache& operator=(const QuadSphereCache&) = delete;
+
+	// Map and validate cache file. Returns false if it is missing, stale or corrupt.
+	bool Open(const wchar_t* fileName, uint32_t subDivideCount);
+	void Close();
+
+	// Create face trees from the cached node bounds.
+	std::vector<FaceTree*> CreateFaceTrees() const;
+
+	const VertexTess*	GetVertices() const { return m_vertices; }
+	uint32_t			GetVertexCount() const { return m_vertexCount; }
+	const uint32_t*		GetIndices() const { return m_indices; }
+	uint32_t			GetIndexCount() const { return m_indexCount; }
+
+	// Write generated quad sphere to cache file. Failure is not fatal, returns false.
+	static bool Save(
+		const wchar_t* fileName, uint32_t subDivideCount,
+		const QuadSphereGenerator::QuadSphereInfo& info);
+
+private:
+	struct Header
+	{
+		uint32_t	magic;
+		uint32_t	formatVersion;
+		uint32_t	generatorVersion;
+		uint32_t	subDivideCount;
+		uint32_t	vertexCount;
+		uint32_t	indexCount;
+		uint32_t	faceNodeCount;
+		uint32_t	reserved;
+		uint64_t	vertexOffset;
+		uint64_t	indexOffset;
+		uint64_t	nodeOffset;
+		uint64_t	fileSize;
+		uint64_t	payloadChecksum;
+	};
+
+	static constexpr uint32_t FILE_MAGIC = 0x48505351u;	// 'QSPH'
+	static constexpr uint32_t FORMAT_VERSION = 4u;
+
+	static uint32_t	GetFaceNodeCount(uint32_t subDivideCount);
+	static uint64_t	Checksum(const uint8_t* data, uint64_t size, uint64_t hash = 0xCBF29CE484222325ull);
+
+	HANDLE								m_file = INVALID_HANDLE_VALUE;
+	HANDLE								m_mapping = nullptr;
+	const uint8_t*						m_view = nullptr;
+
+	uint32_t							m_subDivideCount = 0;
+	const VertexTess*					m_vertices = nullptr;
+	uint32_t							m_vertexCount = 0;
+	const uint32_t*						m_indices = nullptr;
+	uint32_t							m_indexCount = 0;
+	const FaceTree::NodeBounds*			m_nodeBounds = nullptr;
+	uint32_t							m_faceNodeCount = 0;
+};
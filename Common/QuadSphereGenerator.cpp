@@ -1,10 +1,11 @@
 #include "pch.h"
 #include "QuadSphereGenerator.h"
+#include "WorkerPool.h"
 
 using namespace DirectX;
 
 QuadSphereGenerator::QuadSphereInfo* QuadSphereGenerator::CreateQuadSphere(
-	float width, float height, float depth, std::uint32_t numSubdivisions)
+	float width, float height, float depth, std::uint32_t numSubdivisions, GenerateMode mode, WorkerPool* workerPool)
 {
 	MeshData meshData;
 
@@ -27,8 +28,6 @@ QuadSphereGenerator::QuadSphereInfo* QuadSphereGenerator::CreateQuadSphere(
 	v[6] = VertexTess(XMFLOAT3(-w2, +h2, +d2), XMFLOAT3(0, 0, 0));
 	v[7] = VertexTess(XMFLOAT3(-w2, -h2, +d2), XMFLOAT3(0, 0, 0));
 
-	meshData.vertices.assign(&v[0], &v[8]);
-
 	const uint32_t totalIndexCount = pow(4, numSubdivisions + 1) * 6;
 	const uint32_t faceIndexCount = totalIndexCount / 6;
 
@@ -53,75 +52,186 @@ QuadSphereGenerator::QuadSphereInfo* QuadSphereGenerator::CreateQuadSphere(
 	// Fill in the right face index data
 	i[20] = 3; i[21] = 2; i[22] = 4; i[23] = 5;
 
-	meshData.indices.assign(&i[0], &i[24]);
+	std::vector<FaceTree*> faceTrees(6);
+
+	if (mode == GenerateMode::Subdivide)
+	{
+		meshData.vertices.assign(&v[0], &v[8]);
+		meshData.indices.assign(&i[0], &i[24]);
+
+		// Subdivide.
+		for (uint32_t level = 0; level < numSubdivisions; ++level)
+			SubdivideQuad(meshData);
+
+		// Create Face Trees.
+		for (int f = 0; f < 6; f++)
+		{
+			faceTrees[f] = CreateFaceTree(
+				meshData, &i[f * 4], f * faceIndexCount, faceIndexCount, width, numSubdivisions);
+		}
+	}
+	else
+	{
+		const uint32_t gridSize = 1u << numSubdivisions;
+		const uint32_t faceVertexCount = (gridSize + 1) * (gridSize + 1);
+
+		meshData.vertices.resize(faceVertexCount * 6);
+		meshData.indices.resize(totalIndexCount);
+
+		// Each face writes only its own vertex and index ranges, so faces are built concurrently.
+		const auto buildFace = [&](uint32_t f)
+		{
+			const uint32_t vertexBase = f * faceVertexCount;
+
+			const XMFLOAT3 corners[3] =
+			{
+				v[i[0 + f * 4]].position,
+				v[i[1 + f * 4]].position,
+				v[i[2 + f * 4]].position
+			};
+			GenerateFaceGrid(meshData, corners, gridSize, vertexBase, f * faceIndexCount);
+
+			// Corners of the face on the grid, same order as cube face indices.
+			uint32_t index[4];
+			index[0] = vertexBase;
+			index[1] = vertexBase + gridSize;
+			index[2] = vertexBase + gridSize * (gridSize + 1);
+			index[3] = vertexBase + gridSize * (gridSize + 1) + gridSize;
+
+			faceTrees[f] = CreateFaceTree(
+				meshData, index, f * faceIndexCount, faceIndexCount, width, numSubdivisions);
+		};
+
+		if (workerPool)
+		{
+			workerPool->ParallelFor(6, buildFace);
+		}
+		else
+		{
+			for (uint32_t f = 0; f < 6; f++)
+				buildFace(f);
+		}
+	}
+
+	return new QuadSphereInfo(std::move(meshData.vertices), std::move(meshData.indices), faceTrees);
+}
 
-	// Subdivide.
-	for (char level = 0; level < numSubdivisions; ++level)
-		SubdivideQuad(meshData);
+FaceTree* QuadSphereGenerator::CreateFaceTree(
+	MeshData& meshData, const uint32_t corner[4],
+	uint32_t baseAddress, uint32_t faceIndexCount, float width, std::uint32_t numSubdivisions)
+{
+	const auto faceTree = new FaceTree(
+		baseAddress, faceIndexCount, std::min(numSubdivisions, QUAD_NODE_MAX_LEVEL));
+	faceTree->Build(corner, width, meshData.vertices, meshData.indices);
 
-	// Create Face Trees. 
-	std::vector<FaceTree*> faceTrees;
-	for (int f = 0; f < 6; f++)
+	return faceTree;
+}
+
+void QuadSphereGenerator::GenerateFaceGrid(
+	MeshData& meshData, const XMFLOAT3 corners[3],
+	uint32_t gridSize, uint32_t vertexBase, uint32_t indexBase)
+{
+	// Face spans corner 0 -> corner 1 (axis A) and corner 0 -> corner 2 (axis B).
+	const XMVECTOR origin = XMLoadFloat3(&corners[0]);
+	const XMVECTOR axisA = XMLoadFloat3(&corners[1]) - origin;
+	const XMVECTOR axisB = XMLoadFloat3(&corners[2]) - origin;
+	const float invGridSize = 1.0f / static_cast<float>(gridSize);
+
+	// Grid points are dyadic fractions of the face, so they are bit-identical
+	// to the midpoints produced by SubdivideQuad.
+	for (uint32_t b = 0; b <= gridSize; b++)
 	{
-		uint32_t index[4];
-		index[0] = i[0 + f * 4];
-		index[1] = i[1 + f * 4];
-		index[2] = i[2 + f * 4];
-		index[3] = i[3 + f * 4];
-
-		const auto root = new QuadNode(0, faceIndexCount, index, f * faceIndexCount, width);
-		root->CalcCenter(meshData.vertices, meshData.indices);
-		root->CreateChildren(
-			std::min(numSubdivisions, QUAD_NODE_MAX_LEVEL), 
-			meshData.vertices, 
-			meshData.indices);
-
-		faceTrees.push_back(new FaceTree(root, faceIndexCount));
+		for (uint32_t a = 0; a <= gridSize; a++)
+		{
+			const XMVECTOR pos =
+				origin + axisA * (static_cast<float>(a) * invGridSize) + axisB * (static_cast<float>(b) * invGridSize);
+
+			XMStoreFloat3(&meshData.vertices[vertexBase + b * (gridSize + 1) + a].position, pos);
+		}
 	}
 
-	return new QuadSphereInfo(meshData.vertices, meshData.indices, faceTrees);
+	// Emit quads in the same quadtree order as recursive subdivision.
+	GridQuad face;
+	face.origin[0] = 0;									face.origin[1] = 0;
+	face.axisA[0] = static_cast<int32_t>(gridSize);		face.axisA[1] = 0;
+	face.axisB[0] = 0;									face.axisB[1] = static_cast<int32_t>(gridSize);
+
+	uint32_t* out = &meshData.indices[indexBase];
+	EmitGridQuads(out, face, vertexBase, gridSize + 1);
+}
+
+void QuadSphereGenerator::EmitGridQuads(
+	uint32_t*& out, const GridQuad& quad, uint32_t vertexBase, uint32_t rowPitch)
+{
+	const auto gridIndex = [&](int32_t a, int32_t b)
+	{
+		return vertexBase + static_cast<uint32_t>(b) * rowPitch + static_cast<uint32_t>(a);
+	};
+
+	const int32_t oa = quad.origin[0], ob = quad.origin[1];
+	const int32_t aa = quad.axisA[0], ab = quad.axisA[1];
+	const int32_t ba = quad.axisB[0], bb = quad.axisB[1];
+
+	// Unit quad, write control points (origin, origin + A, origin + B, origin + A + B).
+	if (std::abs(aa) + std::abs(ab) == 1)
+	{
+		*out++ = gridIndex(oa, ob);
+		*out++ = gridIndex(oa + aa, ob + ab);
+		*out++ = gridIndex(oa + ba, ob + bb);
+		*out++ = gridIndex(oa + aa + ba, ob + ab + bb);
+		return;
+	}
+
+	// Children rotate the same way SubdivideQuad does.
+	const int32_t ha = aa / 2, hab = ab / 2;
+	const int32_t hba = ba / 2, hbb = bb / 2;
+
+	const GridQuad children[4] =
+	{
+		{ { oa, ob },						{ ha, hab },	{ hba, hbb } },
+		{ { oa + aa, ob + ab },				{ hba, hbb },	{ -ha, -hab } },
+		{ { oa + ba, ob + bb },				{ -hba, -hbb },	{ ha, hab } },
+		{ { oa + aa + ba, ob + ab + bb },	{ -ha, -hab },	{ -hba, -hbb } },
+	};
+
+	for (const GridQuad& child : children)
+		EmitGridQuads(out, child, vertexBase, rowPitch);
 }
 
 void QuadSphereGenerator::SubdivideQuad(MeshData& meshData)
 {
-	// Save a copy of the input geometry.
-	const MeshData inputCopy = meshData;
+	// Take the input indices out of mesh data.
+	// Vertices are only appended, so they don't need a copy.
+	std::vector<uint32_t> inputIndices;
+	inputIndices.swap(meshData.indices);
+
+	const uint32_t numQuads = static_cast<uint32_t>(inputIndices.size()) / 4;
 
-	// Reset only indices.
-	meshData.indices.resize(0);
+	// Each quad adds one center and shares its four edge midpoints with neighbours.
+	meshData.indices.reserve(inputIndices.size() * 4);
+	meshData.vertices.reserve(meshData.vertices.size() + numQuads * 3);
+
+	// Midpoints keyed by edge (lower vertex index owns the slot),
+	// so vertices on shared edges are created only once.
+	std::vector<EdgeSlot> edgeMidPoints(meshData.vertices.size());
 
-	const uint32_t numQuads = static_cast<uint32_t>(inputCopy.indices.size()) / 4;
 	for (uint32_t i = 0; i < numQuads; ++i)
 	{
-		const int v0i = inputCopy.indices[i*4+0];
-		const int v1i = inputCopy.indices[i*4+1];
-		const int v2i = inputCopy.indices[i*4+3];
-		const int v3i = inputCopy.indices[i*4+2];
-
-		VertexTess v0 = inputCopy.vertices[v0i];
-		VertexTess v1 = inputCopy.vertices[v1i];
-		VertexTess v2 = inputCopy.vertices[v2i];
-		VertexTess v3 = inputCopy.vertices[v3i];
-
-		// Generate the midpoints.
-		VertexTess m0 = MidPoint(v0, v1);
-		VertexTess m1 = MidPoint(v1, v2);
-		VertexTess m2 = MidPoint(v2, v3);
-		VertexTess m3 = MidPoint(v3, v0);
-		VertexTess m4 = MidPoint(m0, m2);
-
-		// Add midpoints to vector.
-		const int m0i = static_cast<int>(meshData.vertices.size());
-		const int m1i = m0i + 1;
-		const int m2i = m1i + 1;
-		const int m3i = m2i + 1;
-		const int m4i = m3i + 1;
-
-		meshData.vertices.push_back(m0);
-		meshData.vertices.push_back(m1);
-		meshData.vertices.push_back(m2);
-		meshData.vertices.push_back(m3);
-		meshData.vertices.push_back(m4);
+		const uint32_t v0i = inputIndices[i*4+0];
+		const uint32_t v1i = inputIndices[i*4+1];
+		const uint32_t v2i = inputIndices[i*4+3];
+		const uint32_t v3i = inputIndices[i*4+2];
+
+		// Get (or generate) the midpoints.
+		const uint32_t m0i = EdgeMidPoint(meshData.vertices, edgeMidPoints, v0i, v1i);
+		const uint32_t m1i = EdgeMidPoint(meshData.vertices, edgeMidPoints, v1i, v2i);
+		const uint32_t m2i = EdgeMidPoint(meshData.vertices, edgeMidPoints, v2i, v3i);
+		const uint32_t m3i = EdgeMidPoint(meshData.vertices, edgeMidPoints, v3i, v0i);
+
+		// Center point is never shared with other quads.
+		// It is the 4th control point, the one whose quadPos the hull shader reads.
+		const uint32_t m4i = static_cast<uint32_t>(meshData.vertices.size());
+		meshData.vertices.push_back(MidPoint(meshData.vertices[m0i], meshData.vertices[m2i]));
 
 		// Add indices to vector.
 		meshData.indices.push_back(v0i);
@@ -146,6 +256,35 @@ void QuadSphereGenerator::SubdivideQuad(MeshData& meshData)
 	}
 }
 
+uint32_t QuadSphereGenerator::EdgeMidPoint(
+	std::vector<VertexTess>& vertices, std::vector<EdgeSlot>& edgeMidPoints,
+	uint32_t v0i, uint32_t v1i)
+{
+	// Same slot regardless of the edge direction.
+	EdgeSlot& slot = edgeMidPoints[std::min(v0i, v1i)];
+	const uint32_t other = std::max(v0i, v1i);
+
+	// Every vertex of the quad sphere has at most 4 edges.
+	for (int e = 0; e < 4; e++)
+	{
+		if (slot.other[e] == other)
+			return slot.midPoint[e];
+
+		if (slot.other[e] == UINT32_MAX)
+		{
+			const uint32_t mi = static_cast<uint32_t>(vertices.size());
+			vertices.push_back(MidPoint(vertices[v0i], vertices[v1i]));
+
+			slot.other[e] = other;
+			slot.midPoint[e] = mi;
+
+			return mi;
+		}
+	}
+
+	throw std::runtime_error("Quad sphere vertex has more than 4 edges.");
+}
+
 VertexTess QuadSphereGenerator::MidPoint(const VertexTess& v0, const VertexTess& v1)
 {
 	const XMVECTOR p0 = XMLoadFloat3(&v0.position);
@@ -5,9 +5,15 @@
 
 #include "FaceTree.h"
 
+class WorkerPool;
+
 class QuadSphereGenerator
 {
 public:
+	// Bump whenever generated vertices, indices or node bounds change.
+	// Cached quad spheres with another version are regenerated.
+	static constexpr uint32_t GENERATOR_VERSION = 3u;
+
 	struct MeshData
 	{
 		std::vector<VertexTess> vertices;
@@ -21,20 +27,55 @@ public:
 		std::vector<FaceTree*> faceTrees;
 
 		QuadSphereInfo(
-			const std::vector<VertexTess>& vertices,
-			const std::vector<uint32_t>& indices,
+			std::vector<VertexTess>&& vertices,
+			std::vector<uint32_t>&& indices,
 			const std::vector<FaceTree*>& faceTrees)
 		{
-			this->vertices = vertices;
-			this->indices = indices;
+			this->vertices = std::move(vertices);
+			this->indices = std::move(indices);
 			this->faceTrees = faceTrees;
 		}
 	};
 
+	enum class GenerateMode
+	{
+		Subdivide,	// Subdivide the cube level by level on one thread.
+		DirectGrid,	// Write each face grid directly, one job per face.
+	};
+
 	static QuadSphereInfo* CreateQuadSphere(
 		float width, float height, float depth,
-		std::uint32_t numSubdivisions);
+		std::uint32_t numSubdivisions,
+		GenerateMode mode = GenerateMode::DirectGrid,
+		WorkerPool* workerPool = nullptr);
 private:
+	struct EdgeSlot
+	{
+		uint32_t other[4] = { UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX };
+		uint32_t midPoint[4] = { 0, 0, 0, 0 };
+	};
+
+	// Quad on a face grid: origin corner and the two edge vectors in grid units.
+	struct GridQuad
+	{
+		int32_t origin[2];
+		int32_t axisA[2];
+		int32_t axisB[2];
+	};
+
+	static FaceTree* CreateFaceTree(
+		MeshData& meshData, const uint32_t corner[4],
+		uint32_t baseAddress, uint32_t faceIndexCount, float width, std::uint32_t numSubdivisions);
+
+	static void GenerateFaceGrid(
+		MeshData& meshData, const DirectX::XMFLOAT3 corners[3],
+		uint32_t gridSize, uint32_t vertexBase, uint32_t indexBase);
+	static void EmitGridQuads(
+		uint32_t*& out, const GridQuad& quad, uint32_t vertexBase, uint32_t rowPitch);
+
 	static void SubdivideQuad(MeshData& meshData);
+	static uint32_t EdgeMidPoint(
+		std::vector<VertexTess>& vertices, std::vector<EdgeSlot>& edgeMidPoints,
+		uint32_t v0i, uint32_t v1i);
 	static VertexTess MidPoint(const VertexTess& v0, const VertexTess& v1);
 };
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "pch.h"
+#include "TessFactor.h"
+
+#include "QuadNode.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// Just enough HLSL for PatchTess.hlsli. Its functions land in this namespace, so abs, min and pow here hide the C ones.
+	namespace Hlsl
+	{
+		using uint = uint32_t;
+
+		struct float3
+		{
+			float x, y, z;
+
+			float3() = default;
+			float3(float x_, float y_, float z_) : x(x_), y(y_), z(z_) {}
+			float3(const XMFLOAT3& v) : x(v.x), y(v.y), z(v.z) {}
+		};
+
+		struct float4
+		{
+			float x, y, z, w;
+		};
+
+		float3 operator+(const float3& a, const float3& b) { return float3(a.x + b.x, a.y + b.y, a.z + b.z); }
+		float3 operator-(const float3& a, const float3& b) { return float3(a.x - b.x, a.y - b.y, a.z - b.z); }
+		float3 operator*(const float3& a, float s) { return float3(a.x * s, a.y * s, a.z * s); }
+		float3 operator*(float s, const float3& a) { return a * s; }
+
+		float abs(float value) { return fabsf(value); }
+		float floor(float value) { return floorf(value); }
+		float min(float a, float b) { return a < b ? a : b; }
+		float pow(float x, float y) { return powf(x, y); }
+		float saturate(float value) { return std::min(std::max(value, 0.0f), 1.0f); }
+		float sign(float value) { return static_cast<float>((value > 0.0f) - (value < 0.0f)); }
+		float dot(const float3& a, const float3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+		float3 normalize(const float3& v) { const float length = sqrtf(dot(v, v)); return float3(v.x / length, v.y / length, v.z / length); }
+		float distance(const float3& a, const float3& b) { return sqrtf(dot(a - b, a - b)); }
+
+		// Factor function stands in for the constant buffer term of CalcContextTessFactor.
+		struct TessContext
+		{
+			float4								parameters;
+			TessFactor::FactorFunction			factor;
+			const TessParameters*				tessParameters;
+		};
+
+#define UNROLL
+#define out
+#include "../Shaders/PatchTess.hlsli"
+#undef out
+#undef UNROLL
+
+		float CalcContextTessFactor(TessContext context, float3 planePos)
+		{
+			return context.factor(XMFLOAT3(planePos.x, planePos.y, planePos.z), *context.tessParameters);
+		}
+	}
+}
+
+float TessFactor::CalcDistanceFactor(const XMFLOAT3& planePos, const TessParameters& parameters)
+{
+	return Hlsl::CalcTessFactor(planePos, parameters.cameraPosition, parameters.tessMax);
+}
+
+PatchTess TessFactor::CalcPatchTess(
+	const VertexTess patch[4], uint32_t patchLod, const TessParameters& parameters, FactorFunction factor)
+{
+	Hlsl::float3 position[4] = { patch[0].position, patch[1].position, patch[2].position, patch[3].position };
+
+	Hlsl::TessContext context;
+	context.parameters = { parameters.quadWidth, parameters.unitCount, 0.0f, parameters.tessMax };
+	context.factor = factor;
+	context.tessParameters = &parameters;
+
+	return Hlsl::CalcPatchTess(position, patch[3].quadPos, patchLod, context);
+}
+
+uint32_t TessFactor::GetSegmentCount(float tess)
+{
+	return static_cast<uint32_t>(ceilf(std::min(std::max(tess, 1.0f), MAX_TESS_FACTOR)));
+}
+
+uint32_t TessFactor::CountTriangles(const PatchTess& tess)
+{
+	uint32_t edges[4];
+	for (uint32_t i = 0; i < 4; i++)
+		edges[i] = GetSegmentCount(tess.edgeTess[i]);
+
+	uint32_t insideU = GetSegmentCount(tess.insideTess[0]);
+	uint32_t insideV = GetSegmentCount(tess.insideTess[1]);
+
+	// All ones is the only case left as two triangles, otherwise inner factors below 2 act as 2.
+	if (insideU == 1 && insideV == 1 && edges[0] == 1 && edges[1] == 1 && edges[2] == 1 && edges[3] == 1)
+		return 2;
+
+	insideU = std::max(insideU, 2u);
+	insideV = std::max(insideV, 2u);
+
+	// Inner grid, then the outer ring stitches each edge to its inner edge one segment per triangle.
+	// Edges 0 and 2 lie at u = 0 and u = 1, so they run along v.
+	return 2 * (insideU - 2) * (insideV - 2) +
+		edges[0] + edges[2] + 2 * (insideV - 2) +
+		edges[1] + edges[3] + 2 * (insideU - 2);
+}
+
+uint64_t TessFactor::CountTriangles(
+	const VertexTess* vertices, const uint32_t* indices, uint32_t indexCount, uint32_t patchLod,
+	const TessParameters& parameters, FactorFunction factor)
+{
+	uint64_t triangleCount = 0;
+	for (uint32_t i = 0; i + 4 <= indexCount; i += 4)
+	{
+		const VertexTess patch[4] =
+		{
+			vertices[indices[i + 0]],
+			vertices[indices[i + 1]],
+			vertices[indices[i + 2]],
+			vertices[indices[i + 3]]
+		};
+		triangleCount += CountTriangles(CalcPatchTess(patch, patchLod, parameters, factor));
+	}
+
+	return triangleCount;
+}
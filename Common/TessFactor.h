@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+#include <DirectXMath.h>
+
+struct VertexTess;
+
+// Constant buffer terms ConstantHS reads, the same for opaque and shadow passes.
+struct TessParameters
+{
+	float					quadWidth;			// parameters.x
+	float					unitCount;			// parameters.y, truncated to uint like the shader does.
+	float					tessMax;			// parameters.w, log2 of the nearest tess factor.
+	DirectX::XMFLOAT3		cameraPosition;		// Light camera for the shadow pass.
+};
+
+// Output of ConstantHS.
+struct PatchTess
+{
+	float					edgeTess[4];
+	float					insideTess[2];
+};
+
+// CPU reference of the constant hull shader in Shader.hlsli and Shadow.hlsli, built from the same source:
+// both call CalcPatchTess of Shaders/PatchTess.hlsli, which compiles here as C++.
+// Factors match the shader bit for bit as long as pow agrees with the GPU one, which only matters where the distance
+// term lands right on an integer exponent. Has no graphics API dependency.
+class TessFactor
+{
+public:
+	// Tess factor of a position on cube face, the shader one is CalcDistanceFactor.
+	// Swap it to compare other formulas with the same border handling.
+	using FactorFunction = float (*)(const DirectX::XMFLOAT3& planePos, const TessParameters& parameters);
+
+	static constexpr float	MAX_TESS_FACTOR = 64.0f;	// Tessellator clamps above it.
+
+	// CalcTessFactor of the shader.
+	static float CalcDistanceFactor(const DirectX::XMFLOAT3& planePos, const TessParameters& parameters);
+
+	// ConstantHS for one patch drawn with given patch LOD constant.
+	static PatchTess CalcPatchTess(
+		const VertexTess patch[4], uint32_t patchLod, const TessParameters& parameters,
+		FactorFunction factor = CalcDistanceFactor);
+
+	// Segments of an edge with integer partitioning, evenly spaced.
+	static uint32_t GetSegmentCount(float tess);
+
+	// Triangles the fixed function tessellator emits for a quad domain with integer partitioning.
+	static uint32_t CountTriangles(const PatchTess& tess);
+
+	// Triangles of a draw over indexCount indices starting at indices, 4 per patch.
+	static uint64_t CountTriangles(
+		const VertexTess* vertices, const uint32_t* indices, uint32_t indexCount, uint32_t patchLod,
+		const TessParameters& parameters, FactorFunction factor = CalcDistanceFactor);
+};
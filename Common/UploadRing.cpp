@@ -0,0 +1,84 @@
+#include "pch.h"
+#include "UploadRing.h"
+
+void CpuUploadRingBackend::WaitForFenceValue(uint64_t value)
+{
+	m_completedFenceValue = std::max(m_completedFenceValue, value);
+	m_waitCount++;
+}
+
+UploadRing::UploadRing(std::unique_ptr<UploadRingBackend> backend) :
+	m_backend(std::move(backend)), m_size(m_backend->GetSize())
+{
+}
+
+UploadRing::Allocation UploadRing::Allocate(uint64_t size, uint64_t alignment)
+{
+	if (size == 0 || size > m_size)
+		return Allocation();
+
+	for (;;)
+	{
+		// Nothing live, restart at the beginning of the memory so the whole ring is usable.
+		if (m_head == m_tail)
+		{
+			m_head = (m_head + m_size - 1) / m_size * m_size;
+			m_tail = m_head;
+		}
+
+		// Align in memory, not in position, so GPU addresses keep the alignment of the backend base.
+		// An allocation never straddles the end, the rest of the lap is skipped instead.
+		const uint64_t offset = m_head % m_size;
+		const uint64_t alignedOffset = (offset + alignment - 1) & ~(alignment - 1);
+		const uint64_t start = alignedOffset + size <= m_size ? m_head + (alignedOffset - offset) : m_head + (m_size - offset);
+		const uint64_t end = start + size;
+
+		if (end - m_tail <= m_size)
+		{
+			m_head = end;
+			m_peakUsedSize = std::max(m_peakUsedSize, m_head - m_tail);
+
+			Allocation allocation;
+			allocation.offset = start % m_size;
+			allocation.cpuAddress = m_backend->GetCpuAddress() + allocation.offset;
+			allocation.gpuAddress = m_backend->GetGpuAddress() + allocation.offset;
+			allocation.size = size;
+			allocation.end = end;
+			return allocation;
+		}
+
+		// Current frame alone leaves no room.
+		if (m_frames.empty())
+			return Allocation();
+
+		Retire();
+		if (end - m_tail > m_size && !m_frames.empty() && m_frames.front().fenceValue > m_backend->GetCompletedFenceValue())
+		{
+			m_backend->WaitForFenceValue(m_frames.front().fenceValue);
+			m_waitCount++;
+			Retire();
+		}
+	}
+}
+
+void UploadRing::FinishFrame(uint64_t fenceValue)
+{
+	m_frames.push_back({ fenceValue, m_head });
+	Retire();
+}
+
+void UploadRing::FinishFrame(uint64_t fenceValue, const Allocation& last)
+{
+	m_frames.push_back({ fenceValue, last.end });
+	Retire();
+}
+
+void UploadRing::Retire()
+{
+	const uint64_t completedFenceValue = m_backend->GetCompletedFenceValue();
+	while (!m_frames.empty() && m_frames.front().fenceValue <= completedFenceValue)
+	{
+		m_tail = std::max(m_tail, m_frames.front().end);
+		m_frames.pop_front();
+	}
+}
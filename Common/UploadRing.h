@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+// Persistently mapped memory an UploadRing hands out, and the fence that tells when the GPU is done with it.
+class UploadRingBackend
+{
+public:
+	virtual ~UploadRingBackend() = default;
+
+	virtual uint8_t*						GetCpuAddress() const = 0;
+	virtual uint64_t						GetGpuAddress() const = 0;
+	virtual uint64_t						GetSize() const = 0;
+
+	virtual uint64_t						GetCompletedFenceValue() = 0;
+
+	// Block until fence reaches value.
+	virtual void							WaitForFenceValue(uint64_t value) = 0;
+};
+
+// Plain memory with a fence advanced by hand, for running the ring without a device.
+// Waiting completes the fence at once, as if the GPU caught up.
+class CpuUploadRingBackend : public UploadRingBackend
+{
+public:
+	explicit CpuUploadRingBackend(uint64_t size, uint64_t gpuAddress = 0x10000) :
+		m_memory(size), m_gpuAddress(gpuAddress) {}
+
+	uint8_t*								GetCpuAddress() const override { return const_cast<uint8_t*>(m_memory.data()); }
+	uint64_t								GetGpuAddress() const override { return m_gpuAddress; }
+	uint64_t								GetSize() const override { return m_memory.size(); }
+
+	uint64_t								GetCompletedFenceValue() override { return m_completedFenceValue; }
+	void									WaitForFenceValue(uint64_t value) override;
+
+	void									SetCompletedFenceValue(uint64_t value) { m_completedFenceValue = value; }
+	uint32_t								GetWaitCount() const { return m_waitCount; }
+
+private:
+	std::vector<uint8_t>					m_memory;
+	uint64_t								m_gpuAddress;
+	uint64_t								m_completedFenceValue = 0;
+	uint32_t								m_waitCount = 0;
+};
+
+// Ring allocator for per-frame dynamic upload data, so several frames can be in flight without a stall.
+// Allocations of a frame are tagged with the fence value signaled after it and retired once the fence completes.
+// A request that does not fit waits for the oldest frames in flight. Has no graphics API dependency, see UploadRingBackend.
+class UploadRing
+{
+public:
+	struct Allocation
+	{
+		uint8_t*							cpuAddress = nullptr;
+		uint64_t							gpuAddress = 0;
+		uint64_t							offset = 0;		// From start of backend memory.
+		uint64_t							size = 0;
+		uint64_t							end = 0;		// Ring position past it, see FinishFrame.
+
+		explicit operator bool() const { return cpuAddress != nullptr; }
+	};
+
+	explicit UploadRing(std::unique_ptr<UploadRingBackend> backend);
+
+	// Alignment must be a power of two. Returns an empty allocation if size can never fit,
+	// that is larger than the ring or than what is left beside allocations of the current frame.
+	Allocation Allocate(uint64_t size, uint64_t alignment);
+
+	// Allocations since last call belong to the frame signaled with fenceValue.
+	void FinishFrame(uint64_t fenceValue);
+
+	// Allocations up to last belong to the frame, later ones stay live for the frames after it.
+	// For rings allocated ahead of the frames that use them.
+	void FinishFrame(uint64_t fenceValue, const Allocation& last);
+
+	// Free memory of frames whose fence completed.
+	void Retire();
+
+	UploadRingBackend&						GetBackend() { return *m_backend; }
+	uint64_t								GetUsedSize() const { return m_head - m_tail; }
+	uint64_t								GetPeakUsedSize() const { return m_peakUsedSize; }
+	uint32_t								GetFramesInFlight() const { return static_cast<uint32_t>(m_frames.size()); }
+	uint32_t								GetWaitCount() const { return m_waitCount; }
+
+private:
+	struct Frame
+	{
+		uint64_t							fenceValue;
+		uint64_t							end;			// Head when frame finished.
+	};
+
+	std::unique_ptr<UploadRingBackend>		m_backend;
+	uint64_t								m_size;
+
+	// Positions grow without bound, memory offset is position modulo size.
+	// Live data is [m_tail, m_head), at most m_size apart.
+	uint64_t								m_head = 0;
+	uint64_t								m_tail = 0;
+	std::deque<Frame>						m_frames;
+
+	uint64_t								m_peakUsedSize = 0;
+	uint32_t								m_waitCount = 0;
+};
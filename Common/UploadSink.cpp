@@ -0,0 +1,57 @@
+#include "pch.h"
+#include "UploadSink.h"
+
+#include "FileName.h"
+
+uint8_t* SpanUploadSink::Reserve(uint64_t destinationOffset, uint64_t size)
+{
+	const uint64_t sourceOffset = (m_usedSize + m_alignment - 1) & ~(m_alignment - 1);
+	if (sourceOffset + size > m_capacity)
+		return nullptr;
+
+	Region* last = m_regions.empty() ? nullptr : &m_regions.back();
+	if (last && last->sourceOffset + last->size == sourceOffset && last->destinationOffset + last->size == destinationOffset)
+		last->size += size;
+	else
+		m_regions.push_back({ destinationOffset, sourceOffset, size });
+
+	m_usedSize = sourceOffset + size;
+	m_writtenBytes += size;
+	return m_data + sourceOffset;
+}
+
+uint8_t* CountingUploadSink::Reserve(uint64_t /*destinationOffset*/, uint64_t size)
+{
+	if (m_writtenBytes + size > m_capacity)
+		return nullptr;
+
+	if (m_scratch.size() < size)
+		m_scratch.resize(size);
+
+	m_reservationCount++;
+	m_writtenBytes += size;
+	return m_scratch.data();
+}
+
+FileUploadSink::FileUploadSink(const wchar_t* fileName, uint64_t capacity) :
+	m_file(FileName::ToNative(fileName), std::ios::out | std::ios::binary | std::ios::trunc), m_capacity(capacity)
+{
+}
+
+uint8_t* FileUploadSink::Reserve(uint64_t destinationOffset, uint64_t size)
+{
+	if (!m_file || m_writtenBytes + size > m_capacity)
+		return nullptr;
+
+	m_destinationOffset = destinationOffset;
+	m_scratch.resize(size);
+	m_writtenBytes += size;
+	return m_scratch.data();
+}
+
+void FileUploadSink::Commit()
+{
+	const uint64_t header[2] = { m_destinationOffset, m_scratch.size() };
+	m_file.write(reinterpret_cast<const char*>(header), sizeof(header));
+	m_file.write(reinterpret_cast<const char*>(m_scratch.data()), static_cast<std::streamsize>(m_scratch.size()));
+}
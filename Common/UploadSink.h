@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+// Destination memory data is emitted into, so the producer writes every byte once.
+// A reservation is for bytes landing at given offset of the destination buffer; it is written before the next call.
+// Sinks may run out of space, the producer keeps what was refused for later. Has no graphics API dependency.
+class UploadSink
+{
+public:
+	virtual ~UploadSink() = default;
+
+	// Memory for size bytes landing at destinationOffset, nullptr if the sink is full.
+	virtual uint8_t*						Reserve(uint64_t destinationOffset, uint64_t size) = 0;
+
+	// Reserved bytes are written.
+	virtual void							Commit() {}
+
+	// Bytes reserved since last reset, one frame for the per frame sinks.
+	uint64_t								GetWrittenBytes() const { return m_writtenBytes; }
+	void									ResetWrittenBytes() { m_writtenBytes = 0; }
+
+protected:
+	uint64_t								m_writtenBytes = 0;
+};
+
+// Packs reservations into caller provided memory, such as a mapped upload buffer, and keeps where each one goes.
+class SpanUploadSink : public UploadSink
+{
+public:
+	struct Region
+	{
+		uint64_t							destinationOffset;
+		uint64_t							sourceOffset;		// From start of the span.
+		uint64_t							size;
+	};
+
+	SpanUploadSink(uint8_t* data, uint64_t capacity, uint64_t alignment = 4) :
+		m_data(data), m_capacity(capacity), m_alignment(alignment) {}
+
+	uint8_t*								Reserve(uint64_t destinationOffset, uint64_t size) override;
+
+	// Consecutive reservations for consecutive destinations are merged.
+	const std::vector<Region>&				GetRegions() const { return m_regions; }
+	uint64_t								GetUsedSize() const { return m_usedSize; }
+
+private:
+	uint8_t*								m_data;
+	uint64_t								m_capacity;
+	uint64_t								m_alignment;
+	uint64_t								m_usedSize = 0;
+	std::vector<Region>						m_regions;
+};
+
+// Counts reservations into one scratch block, for benchmarks of the producer.
+class CountingUploadSink : public UploadSink
+{
+public:
+	explicit CountingUploadSink(uint64_t capacity = UINT64_MAX) : m_capacity(capacity) {}
+
+	uint8_t*								Reserve(uint64_t destinationOffset, uint64_t size) override;
+
+	uint64_t								GetReservationCount() const { return m_reservationCount; }
+
+private:
+	uint64_t								m_capacity;
+	uint64_t								m_reservationCount = 0;
+	std::vector<uint8_t>					m_scratch;
+};
+
+// Appends every reservation to a capture file as destination offset and size, 8 bytes each, then the data.
+class FileUploadSink : public UploadSink
+{
+public:
+	explicit FileUploadSink(const wchar_t* fileName, uint64_t capacity = UINT64_MAX);
+
+	bool									IsOpen() const { return m_file.is_open(); }
+
+	uint8_t*								Reserve(uint64_t destinationOffset, uint64_t size) override;
+	void									Commit() override;
+
+private:
+	std::ofstream							m_file;
+	uint64_t								m_capacity;
+	uint64_t								m_destinationOffset = 0;
+	std::vector<uint8_t>					m_scratch;
+};
@@ -0,0 +1,314 @@
+#include "pch.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+	// Pool and deque of the worker running on this thread.
+	thread_local const WorkerPool*	t_workerPool = nullptr;
+	thread_local uint32_t			t_worker = 0;
+}
+
+constexpr uint32_t WorkerPool::DEQUE_CAPACITY;
+constexpr uint32_t WorkerPool::SPIN_COUNT;
+constexpr uint32_t WorkerPool::NO_WORKER;
+
+bool WorkerPool::JobDeque::Push(Job* job)
+{
+	const int64_t bottom = m_bottom.load();
+	if (bottom - m_top.load() >= DEQUE_CAPACITY)
+		return false;
+
+	m_jobs[bottom % DEQUE_CAPACITY].store(job, std::memory_order_relaxed);
+	m_bottom.store(bottom + 1);
+	return true;
+}
+
+WorkerPool::Job* WorkerPool::JobDeque::Pop()
+{
+	// Bottom is lowered before top is read, so a thief reading the old bottom races for the last job through top.
+	const int64_t bottom = m_bottom.load() - 1;
+	m_bottom.store(bottom);
+
+	int64_t top = m_top.load();
+	if (top > bottom)
+	{
+		m_bottom.store(bottom + 1);
+		return nullptr;
+	}
+
+	Job* job = m_jobs[bottom % DEQUE_CAPACITY].load(std::memory_order_relaxed);
+	if (top == bottom)
+	{
+		if (!m_top.compare_exchange_strong(top, top + 1))
+			job = nullptr;
+		m_bottom.store(bottom + 1);
+	}
+	return job;
+}
+
+WorkerPool::Job* WorkerPool::JobDeque::Steal()
+{
+	int64_t top = m_top.load();
+	const int64_t bottom = m_bottom.load();
+	if (top >= bottom)
+		return nullptr;
+
+	// Slot is read before top moves on, owner only overwrites it after that.
+	Job* job = m_jobs[top % DEQUE_CAPACITY].load(std::memory_order_relaxed);
+	if (!m_top.compare_exchange_strong(top, top + 1))
+		return nullptr;
+	return job;
+}
+
+WorkerPool::WorkerPool(uint32_t workerCount) :
+	m_workerCount(workerCount),
+	m_deques(new JobDeque[std::max(workerCount, 1u)])
+{
+	for (uint32_t w = 0; w < workerCount; w++)
+		m_workers.emplace_back(&WorkerPool::WorkerMain, this, w);
+}
+
+WorkerPool::~WorkerPool()
+{
+	m_exit.store(true);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+	}
+	m_condition.notify_all();
+
+	for (std::thread& worker : m_workers)
+		worker.join();
+
+	// Jobs no thread took are dropped without running. Their counters still count them down,
+	// so jobs depending on those counters are released and dropped as well.
+	std::vector<Job*> droppedJobs(m_injectedJobs.begin(), m_injectedJobs.end());
+	m_injectedJobs.clear();
+	for (uint32_t w = 0; w < m_workerCount; w++)
+	{
+		while (Job* job = m_deques[w].Pop())
+			droppedJobs.push_back(job);
+	}
+
+	while (!droppedJobs.empty())
+	{
+		Job* job = droppedJobs.back();
+		droppedJobs.pop_back();
+
+		Counter& counter = *job->counter;
+		delete job;
+		if (counter.m_count.fetch_sub(1) == 1)
+		{
+			std::lock_guard<std::mutex> lock(counter.m_mutex);
+			droppedJobs.insert(droppedJobs.end(), counter.m_dependents.begin(), counter.m_dependents.end());
+			counter.m_dependents.clear();
+		}
+	}
+}
+
+void WorkerPool::Spawn(Counter& counter, std::function<void()> job, Counter* dependency)
+{
+	Job* queuedJob = new Job { std::move(job), &counter };
+	counter.m_count.fetch_add(1);
+	m_spawnedJobCount.fetch_add(1, std::memory_order_relaxed);
+
+	// Last job of the dependency takes its dependents under the same lock, after lowering the count.
+	if (dependency)
+	{
+		std::lock_guard<std::mutex> lock(dependency->m_mutex);
+		if (dependency->m_count.load() > 0)
+		{
+			dependency->m_dependents.push_back(queuedJob);
+			return;
+		}
+	}
+
+	Queue(queuedJob);
+}
+
+void WorkerPool::Wait(Counter& counter)
+{
+	const uint32_t worker = GetCurrentWorker();
+
+	uint32_t idleCount = 0;
+	while (!counter.IsDone())
+	{
+		if (Job* job = FindJob(worker))
+		{
+			Execute(job);
+			idleCount = 0;
+		}
+		else if (idleCount++ < SPIN_COUNT)
+		{
+			std::this_thread::yield();
+		}
+		else
+		{
+			Sleep([&]() { return counter.IsDone() || m_queuedJobCount.load() > 0; });
+			idleCount = 0;
+		}
+	}
+
+	// Every job is finished, nothing else touches the exception any more.
+	if (counter.m_exception)
+		std::rethrow_exception(std::exchange(counter.m_exception, nullptr));
+}
+
+void WorkerPool::ParallelFor(uint32_t count, const std::function<void(uint32_t)>& task, uint32_t grainSize)
+{
+	grainSize = std::max(grainSize, 1u);
+
+	Counter counter;
+	for (uint32_t first = 0; first < count; first += grainSize)
+	{
+		const uint32_t last = first + std::min(grainSize, count - first);
+		Spawn(counter, [&task, first, last]()
+		{
+			for (uint32_t i = first; i < last; i++)
+				task(i);
+		});
+	}
+	Wait(counter);
+}
+
+void WorkerPool::WorkerMain(uint32_t worker)
+{
+	t_workerPool = this;
+	t_worker = worker;
+
+	uint32_t idleCount = 0;
+	while (!m_exit.load())
+	{
+		if (Job* job = FindJob(worker))
+		{
+			Execute(job);
+			idleCount = 0;
+		}
+		else if (idleCount++ < SPIN_COUNT)
+		{
+			std::this_thread::yield();
+		}
+		else
+		{
+			Sleep([this]() { return m_queuedJobCount.load() > 0; });
+			idleCount = 0;
+		}
+	}
+}
+
+uint32_t WorkerPool::GetCurrentWorker() const
+{
+	return t_workerPool == this ? t_worker : NO_WORKER;
+}
+
+void WorkerPool::Queue(Job* job)
+{
+	// Raised first, so a thread taking the job right away never drops the count below zero.
+	m_queuedJobCount.fetch_add(1);
+
+	const uint32_t worker = GetCurrentWorker();
+	if (worker == NO_WORKER || !m_deques[worker].Push(job))
+	{
+		std::lock_guard<std::mutex> lock(m_injectedMutex);
+		m_injectedJobs.push_back(job);
+	}
+
+	Wake();
+}
+
+WorkerPool::Job* WorkerPool::FindJob(uint32_t worker)
+{
+	Job* job = nullptr;
+	if (worker != NO_WORKER)
+		job = m_deques[worker].Pop();
+
+	if (!job)
+	{
+		std::lock_guard<std::mutex> lock(m_injectedMutex);
+		if (!m_injectedJobs.empty())
+		{
+			job = m_injectedJobs.front();
+			m_injectedJobs.pop_front();
+		}
+	}
+
+	// Victims are tried from the next worker on, so thieves spread over deques.
+	const uint32_t firstVictim = worker == NO_WORKER ? 0 : worker + 1;
+	for (uint32_t v = 0; !job && v < m_workerCount; v++)
+	{
+		const uint32_t victim = (firstVictim + v) % m_workerCount;
+		if (victim == worker)
+			continue;
+
+		job = m_deques[victim].Steal();
+		if (job)
+			m_stolenJobCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	if (job)
+		m_queuedJobCount.fetch_sub(1);
+	return job;
+}
+
+void WorkerPool::Execute(Job* job)
+{
+	Counter& counter = *job->counter;
+	try
+	{
+		job->function();
+	}
+	catch (...)
+	{
+		std::lock_guard<std::mutex> lock(counter.m_mutex);
+		if (!counter.m_exception)
+			counter.m_exception = std::current_exception();
+	}
+
+	delete job;
+	Finish(counter);
+}
+
+void WorkerPool::Finish(Counter& counter)
+{
+	// Waiters see the counter done only once m_finishingCount drops too, so it stays alive until then.
+	counter.m_finishingCount.fetch_add(1);
+	if (counter.m_count.fetch_sub(1) == 1)
+	{
+		std::vector<Job*> dependents;
+		{
+			std::lock_guard<std::mutex> lock(counter.m_mutex);
+			dependents.swap(counter.m_dependents);
+		}
+		for (Job* job : dependents)
+			Queue(job);
+	}
+	counter.m_finishingCount.fetch_sub(1);
+
+	Wake();
+}
+
+template <typename Ready>
+void WorkerPool::Sleep(Ready ready)
+{
+	// Sleeping count is raised before ready is checked again under the mutex, and the waking thread reads it
+	// after changing what ready reads, so one of both always sees the other. Every access is sequentially consistent.
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_sleepingCount.fetch_add(1);
+	m_sleepCount.fetch_add(1, std::memory_order_relaxed);
+	m_condition.wait(lock, [&]() { return m_exit.load() || ready(); });
+	m_sleepingCount.fetch_sub(1);
+}
+
+void WorkerPool::Wake()
+{
+	if (m_sleepingCount.load() == 0)
+		return;
+
+	// Sleeping thread holds the mutex from its last check until it sleeps, taking it here cannot slip in between.
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+	}
+	m_condition.notify_all();
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker threads running jobs, with one work-stealing deque per worker.
+// A worker pushes and pops its own jobs at the bottom of its deque, idle threads steal from the top of others.
+// Threads outside the pool queue their jobs in a shared injection queue. Idle threads spin a little, then sleep.
+// Which thread runs a job is not fixed, so results only stay reproducible while every job writes state of its own;
+// sums over jobs are then added up by the waiting thread in a fixed order.
+class WorkerPool
+{
+	struct Job;
+
+public:
+	// Jobs of a group still to finish. Spawn raises it, a finished job lowers it.
+	// Wait for a counter before it is destroyed. A counter others depend on must not get new jobs.
+	class Counter
+	{
+	public:
+		Counter() = default;
+
+		Counter(const Counter&) = delete;
+		Counter& operator=(const Counter&) = delete;
+
+		// Its last job is finished and done with the counter.
+		bool								IsDone() const { return m_count.load() == 0 && m_finishingCount.load() == 0; }
+
+	private:
+		friend class WorkerPool;
+
+		std::atomic<uint32_t>				m_count { 0 };
+
+		// Finishing jobs still touching the counter, raised before m_count is lowered.
+		std::atomic<uint32_t>				m_finishingCount { 0 };
+
+		// Jobs started once m_count reaches zero, and the first exception of a job. Guarded by m_mutex.
+		std::mutex							m_mutex;
+		std::vector<Job*>					m_dependents;
+		std::exception_ptr					m_exception;
+	};
+
+	static constexpr uint32_t				DEQUE_CAPACITY = 4096;		// Jobs per worker, a full deque queues them for any thread.
+	static constexpr uint32_t				SPIN_COUNT = 64;			// Yields before an idle thread sleeps.
+
+	explicit WorkerPool(uint32_t workerCount);
+
+	// Jobs still queued, or waiting for a dependency, are dropped without running. Their counters must outlive the pool.
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	// Run job on any thread of the pool, counted on counter.
+	// With a dependency the job is only queued once every job counted on dependency is finished.
+	void Spawn(Counter& counter, std::function<void()> job, Counter* dependency = nullptr);
+
+	// Run queued jobs until counter is done, then throw the first exception of its jobs.
+	// Any thread may wait, jobs included.
+	void Wait(Counter& counter);
+
+	// Run task(i) for every i in [0, count) and wait until all are done.
+	// Indices are split into jobs of grainSize in a fixed way. Calling thread takes jobs too, so loops may nest.
+	// Every job is allocated and queued, which costs about 0.1 us, so tiny tasks need a larger grain size.
+	void ParallelFor(uint32_t count, const std::function<void(uint32_t)>& task, uint32_t grainSize = 1);
+
+	uint32_t								GetWorkerCount() const { return m_workerCount; }
+
+	// Totals since the pool was created.
+	uint64_t								GetSpawnedJobCount() const { return m_spawnedJobCount.load(std::memory_order_relaxed); }
+	uint64_t								GetStolenJobCount() const { return m_stolenJobCount.load(std::memory_order_relaxed); }
+	uint64_t								GetSleepCount() const { return m_sleepCount.load(std::memory_order_relaxed); }
+
+private:
+	static constexpr uint32_t				NO_WORKER = UINT32_MAX;
+
+	struct Job
+	{
+		std::function<void()>				function;
+		Counter*							counter;
+	};
+
+	// Fixed ring of jobs, Chase-Lev style. Push and Pop only on the owning worker, Steal on any thread.
+	// Every access to top and bottom is sequentially consistent, which covers the fences of the original.
+	class JobDeque
+	{
+	public:
+		bool Push(Job* job);
+		Job* Pop();
+		Job* Steal();
+
+	private:
+		// Queued jobs are [top, bottom). Counters grow without bound, slot is counter modulo capacity.
+		std::atomic<int64_t>				m_top { 0 };
+		std::atomic<int64_t>				m_bottom { 0 };
+		std::atomic<Job*>					m_jobs[DEQUE_CAPACITY];
+	};
+
+	void WorkerMain(uint32_t worker);
+	uint32_t GetCurrentWorker() const;
+
+	void Queue(Job* job);
+	Job* FindJob(uint32_t worker);
+	void Execute(Job* job);
+	void Finish(Counter& counter);
+
+	// Sleep until ready or exit holds.
+	template <typename Ready>
+	void Sleep(Ready ready);
+	void Wake();
+
+	// Fixed before workers start, they steal from every deque.
+	const uint32_t							m_workerCount;
+	std::unique_ptr<JobDeque[]>				m_deques;
+	std::vector<std::thread>				m_workers;
+
+	// Jobs queued by threads outside the pool, or by a worker with a full deque.
+	std::mutex								m_injectedMutex;
+	std::deque<Job*>						m_injectedJobs;
+
+	// Queued jobs not taken by any thread yet, in every deque and the injection queue.
+	std::atomic<uint32_t>					m_queuedJobCount { 0 };
+
+	// Idle threads sleep here until jobs are queued or a counter is done.
+	std::mutex								m_mutex;
+	std::condition_variable					m_condition;
+	std::atomic<uint32_t>					m_sleepingCount { 0 };
+	std::atomic<bool>						m_exit { false };
+
+	std::atomic<uint64_t>					m_spawnedJobCount { 0 };
+	std::atomic<uint64_t>					m_stolenJobCount { 0 };
+	std::atomic<uint64_t>					m_sleepCount { 0 };
+};
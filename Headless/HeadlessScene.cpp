@@ -0,0 +1,285 @@
+#include "pch.h"
+#include "HeadlessScene.h"
+
+#include "HeightMap.h"
+#include "QuadSphereGenerator.h"
+#include "WorkerPool.h"
+
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+	// Scene bounds of Apollo, the light volume encloses them.
+	const BoundingSphere c_sceneBounds(XMFLOAT3(0.0f, 0.0f, 0.0f), 160.0f);
+
+	BoundingOrientedBox GetLightVolume(FXMVECTOR lightDirection, XMFLOAT3& lightPosition)
+	{
+		const XMVECTOR lightPos = -2.0f * c_sceneBounds.Radius * lightDirection;
+		const XMVECTOR targetPos = XMLoadFloat3(&c_sceneBounds.Center);
+		const XMMATRIX lightView = XMMatrixLookAtLH(lightPos, targetPos, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		XMStoreFloat3(&lightPosition, lightPos);
+
+		XMFLOAT3 sphereCenterLS;
+		XMStoreFloat3(&sphereCenterLS, XMVector3TransformCoord(targetPos, lightView));
+
+		const BoundingOrientedBox lightSpaceVolume(
+			sphereCenterLS, XMFLOAT3(c_sceneBounds.Radius, c_sceneBounds.Radius, c_sceneBounds.Radius), XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+		BoundingOrientedBox lightVolume;
+		lightSpaceVolume.Transform(lightVolume, XMMatrixInverse(nullptr, lightView));
+		return lightVolume;
+	}
+}
+
+constexpr uint32_t HeadlessScene::CAMERA_VIEW;
+constexpr uint32_t HeadlessScene::SHADOW_VIEW;
+constexpr uint32_t HeadlessScene::VIEW_COUNT;
+
+HeadlessScene::HeadlessScene(uint32_t subDivideCount, WorkerPool* workerPool, const HeightMap* heightMap)
+{
+	std::unique_ptr<QuadSphereGenerator::QuadSphereInfo> geoInfo(QuadSphereGenerator::CreateQuadSphere(
+		300.0f, 300.0f, 300.0f, subDivideCount, QuadSphereGenerator::GenerateMode::DirectGrid, workerPool));
+	m_faceTrees = geoInfo->faceTrees;
+	m_vertices = std::move(geoInfo->vertices);
+	m_indices = std::move(geoInfo->indices);
+
+	// Coarse patches of inner nodes follow the base indices.
+	std::vector<uint32_t> coarseIndices;
+	for (FaceTree* faceTree : m_faceTrees)
+		faceTree->CreateCoarseIndices(m_indices, static_cast<uint32_t>(m_indices.size() + coarseIndices.size()), coarseIndices);
+	m_indices.insert(m_indices.end(), coarseIndices.begin(), coarseIndices.end());
+
+	const bool heightMapBuilt = heightMap && heightMap->IsBuilt();
+	for (FaceTree* faceTree : m_faceTrees)
+	{
+		faceTree->InitDetail(m_vertices.data(), m_indices);
+		faceTree->InitHeightBounds(heightMapBuilt ? heightMap : nullptr);
+		faceTree->Init(nullptr, VIEW_COUNT);
+	}
+
+	m_lodGrid.Init(m_faceTrees);
+
+	std::vector<XMFLOAT3> occluderVertices;
+	std::vector<uint32_t> occluderIndices;
+	if (heightMapBuilt)
+	{
+		OcclusionBuffer::CreateTerrainOccluder(
+			1u << QUAD_NODE_MAX_LEVEL, QUAD_SPHERE_RADIUS, MAX_HEIGHT_DISPLACEMENT, *heightMap, occluderVertices, occluderIndices);
+	}
+	else
+	{
+		OcclusionBuffer::CreateSphereOccluder(1u << QUAD_NODE_MAX_LEVEL, QUAD_SPHERE_RADIUS, occluderVertices, occluderIndices);
+	}
+
+	m_occlusionBuffer = std::make_unique<OcclusionBuffer>(256, 144);
+	m_occlusionBuffer->SetOccluder(std::move(occluderVertices), std::move(occluderIndices));
+}
+
+HeadlessScene::~HeadlessScene()
+{
+	for (FaceTree* faceTree : m_faceTrees)
+		delete faceTree;
+}
+
+FaceTree::BoundsReport HeadlessScene::ValidateBounds(const HeightMap& heightMap, uint32_t segmentCount) const
+{
+	const uint32_t mipCount = heightMap.GetSampledMipCount();
+	const uint32_t rowSize = segmentCount + 1;
+
+	FaceTree::BoundsReport report;
+	std::vector<XMFLOAT3> patchGrids;
+	for (const FaceTree* faceTree : m_faceTrees)
+	{
+		// Base patches of a face are the index range of its root.
+		const uint32_t baseAddress = faceTree->GetNodeBaseAddress(0);
+		const uint32_t patchCount = faceTree->GetNodeIndexCount(0) / 4;
+		patchGrids.resize(static_cast<size_t>(patchCount) * mipCount * rowSize * rowSize);
+
+		XMFLOAT3* point = patchGrids.data();
+		for (uint32_t patch = 0; patch < patchCount; patch++)
+		{
+			const uint32_t* patchIndices = &m_indices[baseAddress + 4 * patch];
+			const XMVECTOR corners[4] =
+			{
+				XMLoadFloat3(&m_vertices[patchIndices[0]].position), XMLoadFloat3(&m_vertices[patchIndices[1]].position),
+				XMLoadFloat3(&m_vertices[patchIndices[2]].position), XMLoadFloat3(&m_vertices[patchIndices[3]].position),
+			};
+
+			for (uint32_t mip = 0; mip < mipCount; mip++)
+			{
+				for (uint32_t j = 0; j < rowSize; j++)
+				{
+					const float v = static_cast<float>(j) / segmentCount;
+					for (uint32_t i = 0; i < rowSize; i++)
+					{
+						// Bilinear on cube face, then onto the sphere and out by the height.
+						const float u = static_cast<float>(i) / segmentCount;
+						const XMVECTOR position = XMVectorLerp(
+							XMVectorLerp(corners[0], corners[1], u), XMVectorLerp(corners[2], corners[3], u), v);
+
+						XMFLOAT3 direction;
+						XMStoreFloat3(&direction, XMVector3Normalize(position));
+						const float height = heightMap.Sample(direction, mip);
+						XMStoreFloat3(point++, XMLoadFloat3(&direction) * (QUAD_SPHERE_RADIUS + height * MAX_HEIGHT_DISPLACEMENT));
+					}
+				}
+			}
+		}
+
+		faceTree->ValidateBounds(patchGrids, segmentCount, mipCount, report);
+	}
+	return report;
+}
+
+uint32_t HeadlessScene::Cull(const Pose& pose, const Settings& settings, WorkerPool& workerPool)
+{
+	BoundingFrustum frustum;
+	XMFLOAT4X4 viewProjection;
+	GetCamera(pose, settings.aspectRatio, frustum, viewProjection);
+
+	XMFLOAT3 lightPosition;
+	const BoundingOrientedBox lightVolume = GetLightVolume(XMVector3Normalize(XMLoadFloat3(&pose.lightDirection)), lightPosition);
+
+	FrustumCulling::View views[VIEW_COUNT];
+	FrustumCulling::View& cameraView = views[CAMERA_VIEW];
+	cameraView.planes = FrustumCulling::ExpandPlanes(FrustumCulling::LoadPlanes(frustum), settings.margin);
+	cameraView.horizon = FrustumCulling::LoadHorizon(
+		pose.cameraPosition, QUAD_SPHERE_RADIUS - settings.margin, settings.horizonCulling);
+	cameraView.cone.enabled = settings.backFaceCulling;
+	cameraView.cone.cameraPosition = pose.cameraPosition;
+	cameraView.cone.margin = settings.margin;
+	cameraView.occlusion = settings.occlusionCulling ? m_occlusionBuffer.get() : nullptr;
+	cameraView.cameraPosition = pose.cameraPosition;
+
+	FrustumCulling::View& shadowView = views[SHADOW_VIEW];
+	shadowView.planes = FrustumCulling::ExpandPlanes(FrustumCulling::LoadPlanes(lightVolume), settings.margin);
+	shadowView.horizon.enabled = false;
+	shadowView.cone.enabled = false;
+	shadowView.occlusion = nullptr;
+	shadowView.cameraPosition = lightPosition;
+
+	const bool patchLod = settings.patchLod && settings.mode == CullingMode::Hierarchy;
+	LodView lodView;
+	lodView.enabled = patchLod;
+	lodView.metric = settings.lodMetric;
+	lodView.pixelThreshold = settings.lodPixelThreshold;
+	lodView.cameraPosition = pose.cameraPosition;
+	lodView.pixelsPerUnit = settings.outputHeight / (2.0f * tanf(XM_PIDIV4 / 2.0f));
+
+	WorkerPool::Counter lodCounter;
+	for (uint32_t i = 0; i < 6; i++)
+		workerPool.Spawn(lodCounter, [this, i, &lodView]() { m_faceTrees[i]->SelectLod(lodView); });
+
+	WorkerPool::Counter prepareCounter;
+	workerPool.Spawn(prepareCounter, [this, patchLod]()
+	{
+		if (patchLod)
+			m_lodGrid.Balance(m_faceTrees);
+	}, &lodCounter);
+
+	if (settings.occlusionCulling)
+	{
+		workerPool.Spawn(prepareCounter, [this, &viewProjection, &pose, &settings, &workerPool]()
+		{
+			m_occlusionBuffer->Rasterize(viewProjection, pose.cameraPosition, workerPool, settings.margin);
+		});
+	}
+
+	const uint32_t viewCount = settings.renderShadow ? VIEW_COUNT : 1;
+	WorkerPool::Counter cullCounter;
+	for (uint32_t i = 0; i < 6; i++)
+	{
+		workerPool.Spawn(cullCounter, [this, i, &views, viewCount, &settings]()
+		{
+			m_faceCulledQuadCounts[i] = m_faceTrees[i]->UpdateIndexRanges(views, viewCount, settings.kernel, settings.mode);
+		}, &prepareCounter);
+	}
+
+	workerPool.Wait(cullCounter);
+	workerPool.Wait(prepareCounter);
+	workerPool.Wait(lodCounter);
+
+	uint32_t culledQuadCount = 0;
+	for (uint32_t count : m_faceCulledQuadCounts)
+		culledQuadCount += count;
+	return culledQuadCount;
+}
+
+void HeadlessScene::GetCamera(const Pose& pose, float aspectRatio, BoundingFrustum& frustum, XMFLOAT4X4& viewProjection)
+{
+	const XMVECTOR camPosition = XMLoadFloat3(&pose.cameraPosition);
+	const XMMATRIX rotation = XMMatrixRotationRollPitchYaw(pose.pitch, pose.yaw, 0.0f);
+	const XMVECTOR forward = XMVector3Normalize(XMVector3TransformCoord(XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), rotation));
+	const XMVECTOR up = XMVector3TransformCoord(XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f), rotation);
+	const XMMATRIX view = XMMatrixLookAtLH(camPosition, camPosition + forward, up);
+	const XMMATRIX projection = XMMatrixPerspectiveFovLH(
+		XM_PIDIV4, aspectRatio, 0.01f, XMVectorGetX(XMVector3Length(camPosition)));
+
+	BoundingFrustum(projection).Transform(frustum, XMMatrixInverse(nullptr, view));
+	XMStoreFloat4x4(&viewProjection, view * projection);
+}
+
+HeadlessScene::Pose HeadlessScene::CreatePose(const XMFLOAT3& cameraPosition, const XMFLOAT3& forward, const XMFLOAT3& lightDirection)
+{
+	// Inverse of the forward vector Apollo rotates by pitch, then yaw.
+	XMFLOAT3 direction;
+	XMStoreFloat3(&direction, XMVector3Normalize(XMLoadFloat3(&forward)));
+
+	Pose pose;
+	pose.cameraPosition = cameraPosition;
+	pose.yaw = atan2f(direction.x, direction.z);
+	pose.pitch = asinf(std::min(std::max(-direction.y, -1.0f), 1.0f));
+	pose.lightDirection = lightDirection;
+	return pose;
+}
+
+std::vector<HeadlessScene::Pose> HeadlessScene::CreateRandomPoses(uint32_t count, uint32_t seed, float minAltitude, float maxAltitude)
+{
+	std::mt19937 random(seed);
+	std::normal_distribution<float> normal(0.0f, 1.0f);
+	std::uniform_real_distribution<float> logAltitude(logf(minAltitude), logf(maxAltitude));
+	std::uniform_real_distribution<float> tilt(0.0f, XM_PIDIV2);
+
+	std::vector<Pose> poses;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const XMVECTOR up = XMVector3Normalize(XMVectorSet(normal(random), normal(random), normal(random), 0.0f));
+		const XMVECTOR side = XMVector3Normalize(XMVector3Cross(up, XMVectorSet(normal(random), normal(random), normal(random), 0.0f)));
+		const float altitude = expf(logAltitude(random));
+		const float angle = tilt(random);
+
+		XMFLOAT3 position;
+		XMFLOAT3 forward;
+		XMFLOAT3 light;
+		XMStoreFloat3(&position, up * (QUAD_SPHERE_RADIUS + MAX_HEIGHT_DISPLACEMENT + altitude));
+		XMStoreFloat3(&forward, -up * cosf(angle) + side * sinf(angle));
+		XMStoreFloat3(&light, XMVector3Normalize(XMVectorSet(normal(random), normal(random), normal(random), 0.0f)));
+		poses.push_back(CreatePose(position, forward, light));
+	}
+	return poses;
+}
+
+uint32_t HeadlessScene::GetTestedNodeCount() const
+{
+	uint32_t count = 0;
+	for (const FaceTree* faceTree : m_faceTrees)
+		count += faceTree->GetTestedNodeCount();
+	return count;
+}
+
+uint32_t HeadlessScene::GetVisiblePatchCount() const
+{
+	uint32_t count = 0;
+	for (const FaceTree* faceTree : m_faceTrees)
+		count += faceTree->GetVisiblePatchCount();
+	return count;
+}
+
+uint32_t HeadlessScene::GetDrawRangeCount(uint32_t view) const
+{
+	uint32_t count = 0;
+	for (const FaceTree* faceTree : m_faceTrees)
+		count += faceTree->GetIndexRanges(view).GetRangeCount();
+	return count;
+}
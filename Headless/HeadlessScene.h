@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <DirectXMath.h>
+
+#include "FaceTree.h"
+#include "FrustumCulling.h"
+#include "LodGrid.h"
+#include "OcclusionBuffer.h"
+
+class HeightMap;
+class WorkerPool;
+
+// Quad sphere, face trees, LOD grid and occluder as Apollo::CreateDeviceDependentResources builds them,
+// culled with the job graph of Apollo::CullFaces. Lets benchmarks, tests and tools run the culling path without a device.
+class HeadlessScene
+{
+public:
+	static constexpr uint32_t				CAMERA_VIEW = 0;
+	static constexpr uint32_t				SHADOW_VIEW = 1;
+	static constexpr uint32_t				VIEW_COUNT = 2;
+
+	// Culling settings, defaults are those Apollo starts with.
+	struct Settings
+	{
+		bool								horizonCulling = true;
+		bool								backFaceCulling = true;
+		bool								occlusionCulling = true;
+		bool								patchLod = true;
+		bool								renderShadow = true;
+		LodErrorMetric						lodMetric = LodErrorMetric::Geometric;
+		float								lodPixelThreshold = 2.0f;
+		float								margin = 2.0f;
+		CullingKernel						kernel = FrustumCulling::GetBestKernel();
+		CullingMode							mode = CullingMode::Hierarchy;
+		float								outputHeight = 1080.0f;
+		float								aspectRatio = 16.0f / 9.0f;
+	};
+
+	// Camera and light of one cull, yaw and pitch as Apollo keeps them.
+	struct Pose
+	{
+		DirectX::XMFLOAT3					cameraPosition;
+		float								yaw;
+		float								pitch;
+		DirectX::XMFLOAT3					lightDirection;
+	};
+
+	// Without height map node bounds cover the whole displacement range, as in Apollo with an unsupported height format.
+	// Worker pool only speeds up generation, each cull takes its own.
+	HeadlessScene(uint32_t subDivideCount, WorkerPool* workerPool, const HeightMap* heightMap = nullptr);
+	~HeadlessScene();
+
+	HeadlessScene(const HeadlessScene&) = delete;
+	HeadlessScene& operator=(const HeadlessScene&) = delete;
+
+	// Select LOD, balance, rasterize the occluder and cull every face for camera and light.
+	// Returns quad count culled for the camera view.
+	uint32_t Cull(const Pose& pose, const Settings& settings, WorkerPool& workerPool);
+
+	// World space frustum and view projection of the camera, as Apollo::GetCullingPose builds them.
+	static void GetCamera(const Pose& pose, float aspectRatio, DirectX::BoundingFrustum& frustum, DirectX::XMFLOAT4X4& viewProjection);
+
+	// Camera looking at given direction from given position.
+	static Pose CreatePose(const DirectX::XMFLOAT3& cameraPosition, const DirectX::XMFLOAT3& forward, const DirectX::XMFLOAT3& lightDirection);
+
+	// Cameras in random directions, altitude above the highest surface log uniform in [minAltitude, maxAltitude],
+	// looking anywhere from straight down to the horizon. Same seed gives same poses.
+	static std::vector<Pose> CreateRandomPoses(uint32_t count, uint32_t seed, float minAltitude, float maxAltitude);
+
+	// Tessellate every base patch into a grid of given segment count, displace its points by their height at each sampled mip,
+	// as the domain shader does, and check them against bounds of tree and detail nodes. Height map must still hold its sources.
+	FaceTree::BoundsReport ValidateBounds(const HeightMap& heightMap, uint32_t segmentCount) const;
+
+	const std::vector<FaceTree*>&			GetFaceTrees() const { return m_faceTrees; }
+	LodGrid&								GetLodGrid() { return m_lodGrid; }
+	OcclusionBuffer&						GetOcclusionBuffer() { return *m_occlusionBuffer; }
+	const std::vector<VertexTess>&			GetVertices() const { return m_vertices; }
+	const std::vector<uint32_t>&			GetIndices() const { return m_indices; }		// Coarse indices included.
+
+	// Sums over faces of the last cull.
+	uint32_t								GetTestedNodeCount() const;
+	uint32_t								GetVisiblePatchCount() const;
+	uint32_t								GetDrawRangeCount(uint32_t view) const;
+
+private:
+	std::vector<FaceTree*>					m_faceTrees;
+	std::vector<VertexTess>					m_vertices;
+	std::vector<uint32_t>					m_indices;
+	LodGrid									m_lodGrid;
+	std::unique_ptr<OcclusionBuffer>		m_occlusionBuffer;
+	uint32_t								m_faceCulledQuadCounts[6] = {};
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+// Precompiled header of the CPU-only CMake targets, used in place of the root pch.h.
+// Common sources include "pch.h" by name and this directory comes first on their include path,
+// so they build without Windows and D3D12 headers. Graphics code of those sources is left out under APOLLO_HEADLESS.
+
+#include <DirectXMath.h>
+
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+#include <tuple>
+#include <unordered_map>
+
+// Parameter annotation of the Windows headers.
+#ifndef IN
+	#define IN
+#endif
+
+// Graphics types named in CPU-side declarations, laid out as in d3d12.h and dxgiformat.h.
+// Only the formats HeightMap reads are listed.
+struct ID3D12Device;
+struct ID3D12GraphicsCommandList;
+struct ID3D12Resource;
+struct ID3D12CommandSignature;
+
+enum DXGI_FORMAT
+{
+	DXGI_FORMAT_UNKNOWN = 0,
+	DXGI_FORMAT_R8G8B8A8_UNORM = 28,
+	DXGI_FORMAT_R32_FLOAT = 41,
+	DXGI_FORMAT_R16_FLOAT = 54,
+	DXGI_FORMAT_R16_UNORM = 56,
+	DXGI_FORMAT_R8_UNORM = 61,
+	DXGI_FORMAT_BC4_UNORM = 80,
+	DXGI_FORMAT_B8G8R8A8_UNORM = 87,
+};
+
+struct D3D12_SUBRESOURCE_DATA
+{
+	const void*		pData;
+	intptr_t		RowPitch;
+	intptr_t		SlicePitch;
+};
+
+struct D3D12_DRAW_INDEXED_ARGUMENTS
+{
+	uint32_t		IndexCountPerInstance;
+	uint32_t		InstanceCount;
+	uint32_t		StartIndexLocation;
+	int32_t			BaseVertexLocation;
+	uint32_t		StartInstanceLocation;
+};
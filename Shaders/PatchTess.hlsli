@@ -0,0 +1,181 @@
+//--------------------------------------------------------------------------------------
+// Patch Tess Factors
+//--------------------------------------------------------------------------------------
+// Shared by ConstantHS of Shader.hlsli and Shadow.hlsli, and compiled as C++ by Common/TessFactor.cpp,
+// so the CPU reference runs these same lines. Keep to what both languages read alike:
+// float3 / float4 members, no swizzles, and only the intrinsics TessFactor.cpp provides.
+//
+// Includer defines before including:
+//   PatchTess                                 edgeTess[4], insideTess[2]
+//   TessContext                               parameters and cameraPosition of the pass constant buffer
+//   CalcContextTessFactor(context, planePos)  tess factor of a position on cube face, after this file
+//   UNROLL                                    loop attribute, optional
+
+#ifndef UNROLL
+#define UNROLL [unroll(4)]
+#endif
+
+static const float tessNear = 10.0f;
+static const float tessFar = 150.0f;
+
+float CalcContextTessFactor(TessContext context, float3 planePos);
+
+// Calc tess factor based on distance between camera.
+// It will automatically convert to on sphere position.
+float CalcTessFactor(float3 planePos, float3 cameraPosition, float tessMax)
+{
+    float3 spherePos = normalize(planePos) * 150.0f;
+    float d = distance(spherePos, cameraPosition);
+    float s = saturate((d - tessNear) / (tessFar - tessNear));
+
+    return pow(2.0f, (int)(-tessMax * pow(s, 0.8f) + tessMax));
+}
+
+// Check which patch edges lie on border of its quad tree node.
+// Center is patch center on face axes.
+void GetNodeBorder(float centerR, float centerU, float patchWidth, uint nodeLevel, out bool nodeBorder[4])
+{
+    float nodeWidth = 300.0f / (1u << nodeLevel);
+    float offsetR = centerR + 150.0f - floor((centerR + 150.0f) / nodeWidth) * nodeWidth;
+    float offsetU = centerU + 150.0f - floor((centerU + 150.0f) / nodeWidth) * nodeWidth;
+
+    nodeBorder[0] = offsetU < patchWidth;               // bottom?
+    nodeBorder[1] = offsetR < patchWidth;               // left?
+    nodeBorder[2] = offsetU > nodeWidth - patchWidth;   // top?
+    nodeBorder[3] = offsetR > nodeWidth - patchWidth;   // right?
+}
+
+// Tess factors of one patch with given corners and patch LOD, see PatchLodCB for its bits.
+PatchTess CalcPatchTess(float3 position[4], float3 planeQuadPos, uint patchLod, TessContext context)
+{
+    PatchTess output;
+
+    uint coarseScale = patchLod & 0xF;
+    uint finerEdges = (patchLod >> 4) & 0xF;
+    uint coarserEdges = (patchLod >> 8) & 0xF;
+    uint nodeLevel = (patchLod >> 12) & 0xF;
+
+    // Calc center position of patch, quad position is on PLANE (face of cube).
+    float3 planeCenterPos = 0.25f * (position[0] + position[1] + position[2] + position[3]);
+
+    float tess = CalcContextTessFactor(context, planeQuadPos);
+
+    float width = context.parameters.x;
+    uint unitCount = (uint)context.parameters.y;
+    float unitWidth = width / unitCount;
+
+    float3 right;
+    float3 up;
+
+    // Face detection.
+    // Corners of coarse patches can be shared with other faces, so their quad position is not reliable.
+    float3 facePos = coarseScale > 0 ? planeCenterPos : planeQuadPos;
+    if (abs(abs(facePos.z) - 150.0f) <= 0.001f)
+    {
+        right = float3(-sign(facePos.z), 0, 0);
+        up = float3(0, 1, 0);
+    }
+    else if (abs(abs(facePos.x) - 150.0f) <= 0.001f)
+    {
+        right = float3(0, 0, sign(facePos.x));
+        up = float3(0, 1, 0);
+    }
+    else
+    {
+        right = float3(1, 0, 0);
+        up = float3(0, 0, sign(facePos.y));
+    }
+
+    float planeQuadPosR = dot(planeQuadPos, right);
+    float planeQuadPosU = dot(planeQuadPos, up);
+    float planeCenterPosR = dot(planeCenterPos, right);
+    float planeCenterPosU = dot(planeCenterPos, up);
+
+    // Calc rotation of patch.
+    float x0 = dot(position[0], right);
+    float y0 = dot(position[0], up);
+    float x1 = dot(position[1], right);
+    float y1 = dot(position[1], up);
+    uint rotation = (x0 == x1) ? (y0 < y1 ? 0 : 2) : (x0 < x1 ? 1 : 3);
+
+    // Patch of coarse node is drawn as one quad.
+    // Edges next to finer nodes are split once to meet corners of their patches.
+    if (coarseScale > 0)
+    {
+        bool coarseBorder[4];
+        GetNodeBorder(planeCenterPosR, planeCenterPosU, unitWidth * (1u << coarseScale), nodeLevel, coarseBorder);
+
+        UNROLL
+        for (uint i = 0; i < 4; i++)
+        {
+            uint side = (i + rotation) % 4;
+            output.edgeTess[i] = coarseBorder[side] && (finerEdges & (1u << side)) ? 2.0f : 1.0f;
+        }
+        output.insideTess[0] = 1.0f;
+        output.insideTess[1] = 1.0f;
+        return output;
+    }
+
+    // Check patch is on border or not.
+    // If not, use same tess factor. Unsigned, unit counts below 2 wrap and every patch is interior.
+    if (abs(planeQuadPosR - planeCenterPosR) <= unitWidth * (unitCount / 2 - 1) &&
+        abs(planeQuadPosU - planeCenterPosU) <= unitWidth * (unitCount / 2 - 1))
+    {
+        output.edgeTess[0] = tess;
+        output.edgeTess[1] = tess;
+        output.edgeTess[2] = tess;
+        output.edgeTess[3] = tess;
+        output.insideTess[0] = tess;
+        output.insideTess[1] = tess;
+        return output;
+    }
+
+    // Check which border is on.
+    bool border[4] =
+    {
+        planeCenterPosU - unitWidth < planeQuadPosU - width / 2,    // bottom?
+        planeCenterPosR - unitWidth < planeQuadPosR - width / 2,    // left?
+        planeCenterPosU + unitWidth > planeQuadPosU + width / 2,    // top?
+        planeCenterPosR + unitWidth > planeQuadPosR + width / 2     // right?
+    };
+
+    // Estimate tess factor of adjacent quad.
+    float estTess[4] =
+    {
+        CalcContextTessFactor(context, planeQuadPos - up * width),
+        CalcContextTessFactor(context, planeQuadPos - right * width),
+        CalcContextTessFactor(context, planeQuadPos + up * width),
+        CalcContextTessFactor(context, planeQuadPos + right * width)
+    };
+
+    // Check quad is on border or not.
+    bool quadBorder[4] =
+    {
+        border[0] && planeQuadPosU - width < -150.0f,
+        border[1] && planeQuadPosR - width < -150.0f,
+        border[2] && planeQuadPosU + width > 150.0f,
+        border[3] && planeQuadPosR + width > 150.0f
+    };
+
+    // Check patch is on border of a node next to coarser node.
+    bool nodeBorder[4];
+    GetNodeBorder(planeCenterPosR, planeCenterPosU, unitWidth, nodeLevel, nodeBorder);
+
+    // Set tess factor.
+    // Edges next to coarser nodes keep only patch corners, like the coarse side.
+    UNROLL
+    for (uint j = 0; j < 4; j++)
+    {
+        uint side = (j + rotation) % 4;
+        if (nodeBorder[side] && (coarserEdges & (1u << side)))
+            output.edgeTess[j] = 1.0f;
+        else if (quadBorder[side])
+            output.edgeTess[j] = CalcContextTessFactor(context, position[0]);
+        else
+            output.edgeTess[j] = border[side] ? min(estTess[side], tess) : tess;
+    }
+    output.insideTess[0] = tess;
+    output.insideTess[1] = tess;
+
+    return output;
+}
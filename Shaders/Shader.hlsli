@@ -17,6 +17,20 @@ struct OpaqueCBType
 
 ConstantBuffer<OpaqueCBType> cb : register(b0);
 
+// Patch LOD of current draw, written by indirect arguments.
+// Bits 0-3 coarse scale log2 (0 for base patches), 4-7 edges next to finer nodes,
+// 8-11 edges next to coarser nodes, 12-15 node level.
+// Edge bits are bottom, left, top, right on face axes.
+cbuffer PatchLodCB : register(b2)
+{
+    uint patchLod;
+};
+
+uint GetCoarseScale() { return patchLod & 0xF; }
+uint GetFinerEdges() { return (patchLod >> 4) & 0xF; }
+uint GetCoarserEdges() { return (patchLod >> 8) & 0xF; }
+uint GetNodeLevel() { return (patchLod >> 12) & 0xF; }
+
 
 //--------------------------------------------------------------------------------------
 // I/O Structures
@@ -81,120 +95,29 @@ VS_OUTPUT VS(VS_INPUT input)
 //--------------------------------------------------------------------------------------
 // Constant Hull Shader
 //--------------------------------------------------------------------------------------
-static const float near = 10.0f;
-static const float far = 150.0f;
-
-// Calc tess factor based on distance between camera.
-// It will automatically convert to on sphere position.
-float CalcTessFactor(float3 planePos)
+// Factors are computed in PatchTess.hlsli, which TessFactor.cpp also compiles as the CPU reference.
+struct TessContext
 {
-    float3 spherePos = normalize(planePos) * 150.0f;
-    float d = distance(spherePos, cb.cameraPosition.xyz);
-    float s = saturate((d - near) / (far - near));
+    float4 parameters;
+    float3 cameraPosition;
+};
+
+#include "PatchTess.hlsli"
 
-    return pow(2.0f, (int)(-cb.parameters.w * pow(s, 0.8f) + cb.parameters.w));
+float CalcContextTessFactor(TessContext context, float3 planePos)
+{
+    return CalcTessFactor(planePos, context.cameraPosition, context.parameters.w);
 }
 
 PatchTess ConstantHS(InputPatch<VS_OUTPUT, 4> patch, int patchID : SV_PrimitiveID)
 {
-    PatchTess output;
-
-    // Calc center position of patch and Get quad position on PLANE (face of cube).
-    float3 planeCenterPos = 0.25f * (patch[0].position.xyz + patch[1].position.xyz + patch[2].position.xyz + patch[3].position.xyz);
-    float3 planeQuadPos = patch[3].quadPos;
-
-    float tess = CalcTessFactor(planeQuadPos);
+    float3 position[4] = { patch[0].position.xyz, patch[1].position.xyz, patch[2].position.xyz, patch[3].position.xyz };
 
-    float width = cb.parameters.x;
-    uint unitCount = cb.parameters.y;
-    float unitWidth = width / unitCount;
+    TessContext context;
+    context.parameters = cb.parameters;
+    context.cameraPosition = cb.cameraPosition.xyz;
 
-    float3 right;
-    float3 up;
-
-    // Face detection.
-    if (abs(abs(planeQuadPos.z) - 150.0f) <= 0.001f)
-    {
-        right = float3(-sign(planeQuadPos.z), 0, 0);
-        up = float3(0, 1, 0);
-    }
-    else if (abs(abs(planeQuadPos.x) - 150.0f) <= 0.001f)
-    {
-        right = float3(0, 0, sign(planeQuadPos.x));
-        up = float3(0, 1, 0);
-    }
-    else
-    {
-        right = float3(1, 0, 0);
-        up = float3(0, 0, sign(planeQuadPos.y));
-    }
-
-    // Check patch is on border or not.
-    // If not, use same tess factor.
-    float planeQuadPosR = dot(planeQuadPos, right);
-    float planeQuadPosU = dot(planeQuadPos, up);
-    float planeCenterPosR = dot(planeCenterPos, right);
-    float planeCenterPosU = dot(planeCenterPos, up);
-
-    if (abs(planeQuadPosR - planeCenterPosR) <= unitWidth * (unitCount / 2 - 1) &&
-        abs(planeQuadPosU - planeCenterPosU) <= unitWidth * (unitCount / 2 - 1))
-    {
-        output.edgeTess[0] = tess;
-        output.edgeTess[1] = tess;
-        output.edgeTess[2] = tess;
-        output.edgeTess[3] = tess;
-        output.insideTess[0] = tess;
-        output.insideTess[1] = tess;
-        return output;
-    }
-
-    // Calc rotation of patch.
-    float x0 = dot(patch[0].position.xyz, right);
-    float y0 = dot(patch[0].position.xyz, up);
-    float x1 = dot(patch[1].position.xyz, right);
-    float y1 = dot(patch[1].position.xyz, up);
-    uint rotation = (x0 == x1) ? (y0 < y1 ? 0 : 2) : (x0 < x1 ? 1 : 3);
-
-    // Check which border is on.
-    bool border[4] =
-    {
-        planeCenterPosU - unitWidth < planeQuadPosU - width / 2, // bottom?
-    	planeCenterPosR - unitWidth < planeQuadPosR - width / 2, // left?
-    	planeCenterPosU + unitWidth > planeQuadPosU + width / 2, // top?
-    	planeCenterPosR + unitWidth > planeQuadPosR + width / 2  // right?
-    };
-
-	// Estimate tess factor of adjacent quad.
-    float estTess[4] =
-    {
-        CalcTessFactor(planeQuadPos - up * width),
-    	CalcTessFactor(planeQuadPos - right * width),
-    	CalcTessFactor(planeQuadPos + up * width),
-    	CalcTessFactor(planeQuadPos + right * width)
-    };
-
-    // Check quad is on borer or not.
-    bool quadBorder[4] =
-    {
-        border[0] && planeQuadPosU - width < -150.0f,
-        border[1] && planeQuadPosR - width < -150.0f,
-        border[2] && planeQuadPosU + width > 150.0f,
-        border[3] && planeQuadPosR + width > 150.0f
-    };
-
-	// Set tess factor.
-	[unroll(4)]
-    for (int i = 0; i < 4; i++)
-    {
-        if (quadBorder[(i + rotation) % 4])
-            output.edgeTess[i] = CalcTessFactor(patch[0].position);
-        else
-			output.edgeTess[i] = border[(i + rotation) % 4] ? min(estTess[(i + rotation) % 4], tess) : tess;
-    }
-    output.insideTess[0] = tess;
-    output.insideTess[1] = tess;
-
-    return output;
+    return CalcPatchTess(position, patch[3].quadPos, patchLod, context);
 }
 
 
@@ -245,6 +168,12 @@ DS_OUT DS(const OutputPatch<HS_OUT, 4> input, float2 uv : SV_DomainLocation, Pat
         level = uv.x == 0 ? CalcLevel(patch.edgeTess[0]) : uv.x == 1 ? CalcLevel(patch.edgeTess[2]) : level;
         level = uv.y == 0 ? CalcLevel(patch.edgeTess[1]) : uv.y == 1 ? CalcLevel(patch.edgeTess[3]) : level;
     }
+
+    // Vertices of coarse patches are shared with finer patch corners, which sample full detail.
+    if (GetCoarseScale() > 0)
+    {
+        level = 0;
+    }
     // both not, just use calculated level.
 
     // Get normalized cartesian position.
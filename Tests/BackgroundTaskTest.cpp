@@ -0,0 +1,80 @@
+#include "pch.h"
+#include "Test.h"
+
+#include "BackgroundTask.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+TEST(BackgroundTask, StartRunsTaskOnItsThread)
+{
+	BackgroundTask task;
+	std::thread::id taskThread;
+	task.Start([&]() { taskThread = std::this_thread::get_id(); });
+
+	CHECK(task.IsStarted());
+	CHECK(task.Wait());
+	CHECK(!task.IsStarted());
+	CHECK(taskThread != std::thread::id());
+	CHECK(taskThread != std::this_thread::get_id());
+}
+
+TEST(BackgroundTask, WaitBlocksUntilDoneAndOnlyOnce)
+{
+	BackgroundTask task;
+	CHECK(!task.Wait());
+
+	for (int repeat = 0; repeat < 100; repeat++)
+	{
+		std::atomic<bool> done { false };
+		task.Start([&]()
+		{
+			std::this_thread::yield();
+			done.store(true);
+		});
+
+		CHECK(task.Wait());
+		CHECK(done.load());
+		CHECK(!task.Wait());
+	}
+}
+
+TEST(BackgroundTask, WaitRethrowsTaskException)
+{
+	BackgroundTask task;
+	task.Start([]() { throw std::runtime_error("task failed"); });
+
+	bool thrown = false;
+	try
+	{
+		task.Wait();
+	}
+	catch (const std::runtime_error&)
+	{
+		thrown = true;
+	}
+	CHECK(thrown);
+
+	// Exception is thrown once, the next task starts clean.
+	bool ran = false;
+	task.Start([&]() { ran = true; });
+	CHECK(task.Wait());
+	CHECK(ran);
+}
+
+TEST(BackgroundTask, DestructionFinishesPendingTask)
+{
+	std::atomic<bool> finished { false };
+	{
+		BackgroundTask task;
+		task.Start([&]()
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			finished.store(true);
+		});
+	}
+
+	CHECK(finished.load());
+}
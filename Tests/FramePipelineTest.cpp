@@ -0,0 +1,176 @@
+#include "pch.h"
+#include "Test.h"
+
+#include "FramePipeline.h"
+
+#include <thread>
+
+namespace
+{
+	struct Packet
+	{
+		uint64_t	frame = 0;
+		uint64_t	payload[16] = {};
+	};
+
+	typedef FramePipeline<Packet, 3> Pipeline;
+
+	void Write(Packet& packet, uint64_t frame)
+	{
+		packet.frame = frame;
+		for (uint64_t& value : packet.payload)
+			value = frame * 31 + 7;
+	}
+
+	bool IsWritten(const Packet& packet, uint64_t frame)
+	{
+		bool written = packet.frame == frame;
+		for (uint64_t value : packet.payload)
+			written &= value == frame * 31 + 7;
+		return written;
+	}
+}
+
+TEST(FramePipeline, PacketsAreReadInPublishOrder)
+{
+	Pipeline pipeline;
+	CHECK(pipeline.TryAcquireRead() == nullptr);
+
+	for (uint64_t frame = 1; frame <= 2; frame++)
+	{
+		Packet* packet = pipeline.TryAcquireWrite();
+		CHECK(packet != nullptr);
+		Write(*packet, frame);
+		pipeline.Publish();
+	}
+	CHECK(pipeline.GetQueuedCount() == 2);
+
+	for (uint64_t frame = 1; frame <= 2; frame++)
+	{
+		const Packet* packet = pipeline.TryAcquireRead();
+		CHECK(packet != nullptr && IsWritten(*packet, frame));
+		pipeline.Release();
+	}
+	CHECK(pipeline.TryAcquireRead() == nullptr);
+	CHECK(pipeline.GetQueuedCount() == 0);
+}
+
+TEST(FramePipeline, FullRingRefusesWrites)
+{
+	Pipeline pipeline;
+	for (uint64_t frame = 1; frame <= 3; frame++)
+	{
+		Write(*pipeline.TryAcquireWrite(), frame);
+		pipeline.Publish();
+	}
+
+	CHECK(pipeline.TryAcquireWrite() == nullptr);
+	CHECK(pipeline.AcquireWrite(std::chrono::microseconds(1000)) == nullptr);
+	CHECK(pipeline.GetWriteWaitCount() == 1);
+
+	// Released slot is the one written first, it comes back to the producer.
+	const Packet* oldest = pipeline.TryAcquireRead();
+	pipeline.Release();
+	CHECK(pipeline.TryAcquireWrite() == oldest);
+}
+
+TEST(FramePipeline, EmptyRingTimesOutReads)
+{
+	Pipeline pipeline;
+	CHECK(pipeline.AcquireRead(std::chrono::microseconds(1000)) == nullptr);
+	CHECK(pipeline.GetReadWaitCount() == 1);
+}
+
+TEST(FramePipeline, CloseDrainsPublishedPackets)
+{
+	Pipeline pipeline;
+	for (uint64_t frame = 1; frame <= 2; frame++)
+	{
+		Write(*pipeline.AcquireWrite(), frame);
+		pipeline.Publish();
+	}
+	pipeline.Close();
+
+	CHECK(pipeline.IsClosed());
+	CHECK(pipeline.TryAcquireWrite() == nullptr);
+	CHECK(pipeline.AcquireWrite() == nullptr);
+
+	// Consumer still gets every packet published before Close, then nothing without blocking.
+	for (uint64_t frame = 1; frame <= 2; frame++)
+	{
+		const Packet* packet = pipeline.AcquireRead();
+		CHECK(packet != nullptr && IsWritten(*packet, frame));
+		pipeline.Release();
+	}
+	CHECK(pipeline.AcquireRead() == nullptr);
+}
+
+TEST(FramePipeline, CloseWakesParkedConsumer)
+{
+	Pipeline pipeline;
+	const Packet* result = reinterpret_cast<const Packet*>(&pipeline);
+	std::thread consumer([&]() { result = pipeline.AcquireRead(); });
+
+	// Consumer parks after spinning, or finds the ring closed right away.
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	pipeline.Close();
+	consumer.join();
+
+	CHECK(result == nullptr);
+}
+
+TEST(FramePipeline, ResetDropsUnreadPacketsAndReopens)
+{
+	Pipeline pipeline;
+	for (uint64_t frame = 1; frame <= 3; frame++)
+	{
+		Write(*pipeline.TryAcquireWrite(), frame);
+		pipeline.Publish();
+	}
+	pipeline.Close();
+	pipeline.Reset();
+
+	CHECK(!pipeline.IsClosed());
+	CHECK(pipeline.GetQueuedCount() == 0);
+	CHECK(pipeline.TryAcquireRead() == nullptr);
+
+	Packet* packet = pipeline.TryAcquireWrite();
+	CHECK(packet != nullptr);
+	Write(*packet, 4);
+	pipeline.Publish();
+	CHECK(IsWritten(*pipeline.TryAcquireRead(), 4));
+}
+
+TEST(FramePipeline, StagesOnTwoThreadsSeeWholePacketsInOrder)
+{
+	constexpr uint64_t FRAME_COUNT = 200000;
+
+	Pipeline pipeline;
+	std::thread producer([&]()
+	{
+		for (uint64_t frame = 1; frame <= FRAME_COUNT; frame++)
+		{
+			Packet* packet = pipeline.AcquireWrite();
+			if (!packet)
+				return;
+
+			Write(*packet, frame);
+			pipeline.Publish();
+		}
+		pipeline.Close();
+	});
+
+	// Every packet must be fully written when read, and never overwritten before it is released.
+	uint64_t readCount = 0;
+	uint32_t errorCount = 0;
+	while (const Packet* packet = pipeline.AcquireRead())
+	{
+		readCount++;
+		errorCount += IsWritten(*packet, readCount) ? 0 : 1;
+		pipeline.Release();
+	}
+	producer.join();
+
+	CHECK(readCount == FRAME_COUNT);
+	CHECK(errorCount == 0);
+}
@@ -0,0 +1,241 @@
+#include "pch.h"
+#include "Test.h"
+
+#include "FrustumCulling.h"
+
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	const CullingKernel c_kernels[] = { CullingKernel::Scalar, CullingKernel::SSE, CullingKernel::AVX };
+
+	// AVX is only run where the CPU and OS support it.
+	int GetKernelCount()
+	{
+		return FrustumCulling::GetBestKernel() == CullingKernel::AVX ? 3 : 2;
+	}
+
+	// Boxes whose center lies this close to a plane slab boundary, relative to their size, may go either way in float.
+	constexpr double c_boundaryTolerance = 1e-4;
+
+	XMVECTOR GetPlane(const FrustumCulling::Planes& planes, int p)
+	{
+		return XMVectorSet(planes.normalX[p], planes.normalY[p], planes.normalZ[p], planes.distance[p]);
+	}
+
+	// Every box inside this plane, stands in for planes left out by a plane mask.
+	XMVECTOR GetOpenPlane()
+	{
+		return XMVectorSet(0.0f, 0.0f, 0.0f, -1e30f);
+	}
+
+	BoundingOrientedBox CreateRandomBox(std::mt19937& random, float range)
+	{
+		std::uniform_real_distribution<float> position(-range, range);
+		std::uniform_real_distribution<float> extent(0.01f, 0.2f * range);
+		std::normal_distribution<float> quaternion(0.0f, 1.0f);
+
+		XMFLOAT4 orientation;
+		XMStoreFloat4(&orientation, XMQuaternionNormalize(
+			XMVectorSet(quaternion(random), quaternion(random), quaternion(random), quaternion(random))));
+
+		return BoundingOrientedBox(
+			XMFLOAT3(position(random), position(random), position(random)),
+			XMFLOAT3(extent(random), extent(random), extent(random)), orientation);
+	}
+
+	// Perspective frustum of a random camera looking at a random point near the origin.
+	FrustumCulling::Planes CreateRandomFrustum(std::mt19937& random, float range)
+	{
+		std::uniform_real_distribution<float> position(-2.0f * range, 2.0f * range);
+		std::uniform_real_distribution<float> fov(0.3f, 2.0f);
+		std::uniform_real_distribution<float> aspect(0.5f, 2.5f);
+
+		const XMVECTOR eye = XMVectorSet(position(random), position(random), position(random), 0.0f);
+		const XMVECTOR target = 0.25f * XMVectorSet(position(random), position(random), position(random), 0.0f);
+		const XMMATRIX view = XMMatrixLookAtLH(eye, target, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		const XMMATRIX projection = XMMatrixPerspectiveFovLH(fov(random), aspect(random), 0.1f, 4.0f * range);
+
+		BoundingFrustum frustum;
+		BoundingFrustum(projection).Transform(frustum, XMMatrixInverse(nullptr, view));
+		return FrustumCulling::LoadPlanes(frustum);
+	}
+
+	// Six planes in any direction, normals normalized like LoadPlanes gives them.
+	FrustumCulling::Planes CreateRandomPlanes(std::mt19937& random, float range)
+	{
+		std::normal_distribution<float> normal(0.0f, 1.0f);
+		std::uniform_real_distribution<float> distance(-range, range);
+
+		FrustumCulling::Planes planes;
+		for (int p = 0; p < 6; p++)
+		{
+			XMFLOAT3 n;
+			XMStoreFloat3(&n, XMVector3Normalize(XMVectorSet(normal(random), normal(random), normal(random), 0.0f)));
+			planes.normalX[p] = n.x;
+			planes.normalY[p] = n.y;
+			planes.normalZ[p] = n.z;
+			planes.distance[p] = distance(random);
+		}
+
+		return planes;
+	}
+
+	// True if center distance of box lies near +-radius on a tested plane, computed in double.
+	bool IsNearBoundary(const BoundingOrientedBox& box, const FrustumCulling::Planes& planes, uint8_t planeMask)
+	{
+		const XMMATRIX rotation = XMMatrixRotationQuaternion(XMLoadFloat4(&box.Orientation));
+		const double extents[3] = { box.Extents.x, box.Extents.y, box.Extents.z };
+
+		for (int p = 0; p < 6; p++)
+		{
+			if (!(planeMask & (1u << p)))
+				continue;
+
+			const double n[3] = { planes.normalX[p], planes.normalY[p], planes.normalZ[p] };
+			const double dist = n[0] * box.Center.x + n[1] * box.Center.y + n[2] * box.Center.z + planes.distance[p];
+
+			double radius = 0.0;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				XMFLOAT3 a;
+				XMStoreFloat3(&a, rotation.r[axis]);
+				radius += fabs(n[0] * a.x + n[1] * a.y + n[2] * a.z) * extents[axis];
+			}
+
+			const double tolerance = c_boundaryTolerance * (1.0 + fabs(dist) + radius);
+			if (fabs(dist - radius) < tolerance || fabs(dist + radius) < tolerance)
+				return true;
+		}
+
+		return false;
+	}
+
+	// Classify random boxes against plane sets with every kernel, compare with BoundingOrientedBox::ContainedBy.
+	// Boxes start at an odd offset and their count fills no batch, so both tails of the SIMD kernels run.
+	void CheckAgainstContainedBy(
+		const std::vector<FrustumCulling::Planes>& planeSets, std::mt19937& random, float range, bool randomMasks,
+		uint32_t& comparedCount, uint32_t& skippedCount)
+	{
+		constexpr uint32_t FIRST = 3;
+		constexpr uint32_t COUNT = 1021;
+
+		std::vector<BoundingOrientedBox> boxes(FIRST + COUNT);
+		OrientedBoxArray boxArray;
+		boxArray.Resize(FIRST + COUNT);
+
+		const int kernelCount = GetKernelCount();
+		std::uniform_int_distribution<int> maskDistribution(1, FrustumCulling::ALL_PLANES);
+		for (const FrustumCulling::Planes& planes : planeSets)
+		{
+			for (uint32_t b = 0; b < FIRST + COUNT; b++)
+			{
+				boxes[b] = CreateRandomBox(random, range);
+				boxArray.Set(b, boxes[b]);
+			}
+
+			const uint8_t planeMask = randomMasks ? static_cast<uint8_t>(maskDistribution(random)) : FrustumCulling::ALL_PLANES;
+			XMVECTOR p[6];
+			for (int i = 0; i < 6; i++)
+				p[i] = planeMask & (1u << i) ? GetPlane(planes, i) : GetOpenPlane();
+
+			uint8_t results[3][COUNT];
+			uint8_t insidePlanes[3][COUNT];
+			for (int k = 0; k < kernelCount; k++)
+				FrustumCulling::ClassifyBoxes(c_kernels[k], planes, boxArray, FIRST, COUNT, results[k], planeMask, insidePlanes[k]);
+
+			for (uint32_t b = 0; b < COUNT; b++)
+			{
+				const BoundingOrientedBox& box = boxes[FIRST + b];
+				if (IsNearBoundary(box, planes, planeMask))
+				{
+					skippedCount++;
+					continue;
+				}
+
+				const ContainmentType expected = box.ContainedBy(p[0], p[1], p[2], p[3], p[4], p[5]);
+
+				// Planes a box lies inside, one ContainedBy with the other five left open.
+				uint8_t expectedInside = 0;
+				for (int i = 0; i < 6; i++)
+				{
+					XMVECTOR single[6] = { GetOpenPlane(), GetOpenPlane(), GetOpenPlane(), GetOpenPlane(), GetOpenPlane(), GetOpenPlane() };
+					single[i] = p[i];
+					if ((planeMask & (1u << i)) && box.ContainedBy(single[0], single[1], single[2], single[3], single[4], single[5]) == CONTAINS)
+						expectedInside |= static_cast<uint8_t>(1u << i);
+				}
+
+				for (int k = 0; k < kernelCount; k++)
+				{
+					CHECK(results[k][b] == expected);
+					CHECK(insidePlanes[k][b] == expectedInside);
+				}
+				comparedCount++;
+			}
+		}
+	}
+}
+
+TEST(FrustumCulling, KernelsMatchContainedByForFrustums)
+{
+	std::mt19937 random(1);
+	std::vector<FrustumCulling::Planes> planeSets;
+	for (int i = 0; i < 64; i++)
+		planeSets.push_back(CreateRandomFrustum(random, 10.0f));
+
+	uint32_t comparedCount = 0;
+	uint32_t skippedCount = 0;
+	CheckAgainstContainedBy(planeSets, random, 10.0f, false, comparedCount, skippedCount);
+
+	// Boundary cases must stay rare, or the comparison says little.
+	CHECK(skippedCount * 100 < comparedCount);
+}
+
+TEST(FrustumCulling, KernelsMatchContainedByForRandomPlanesAndMasks)
+{
+	std::mt19937 random(2);
+	std::vector<FrustumCulling::Planes> planeSets;
+	for (int i = 0; i < 64; i++)
+		planeSets.push_back(CreateRandomPlanes(random, 10.0f));
+
+	uint32_t comparedCount = 0;
+	uint32_t skippedCount = 0;
+	CheckAgainstContainedBy(planeSets, random, 10.0f, true, comparedCount, skippedCount);
+	CHECK(skippedCount * 100 < comparedCount);
+}
+
+TEST(FrustumCulling, KernelsMatchContainedByForBoxPlanes)
+{
+	// Planes of an oriented box, as the shadow view uses them.
+	std::mt19937 random(3);
+	std::vector<FrustumCulling::Planes> planeSets;
+	for (int i = 0; i < 64; i++)
+		planeSets.push_back(FrustumCulling::LoadPlanes(CreateRandomBox(random, 10.0f)));
+
+	uint32_t comparedCount = 0;
+	uint32_t skippedCount = 0;
+	CheckAgainstContainedBy(planeSets, random, 10.0f, false, comparedCount, skippedCount);
+	CHECK(skippedCount * 100 < comparedCount);
+}
+
+TEST(FrustumCulling, BestKernelIsSupported)
+{
+	// Running it at all shows the CPU takes its instructions.
+	const CullingKernel kernel = FrustumCulling::GetBestKernel();
+	CHECK(kernel == CullingKernel::SSE || kernel == CullingKernel::AVX);
+
+	OrientedBoxArray boxes;
+	boxes.Resize(16);
+	for (uint32_t b = 0; b < 16; b++)
+		boxes.Set(b, BoundingOrientedBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(1.0f, 1.0f, 1.0f), XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f)));
+
+	const FrustumCulling::Planes planes = FrustumCulling::LoadPlanes(
+		BoundingOrientedBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(4.0f, 4.0f, 4.0f), XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f)));
+	uint8_t results[16];
+	FrustumCulling::ClassifyBoxes(kernel, planes, boxes, 0, 16, results);
+	for (uint8_t result : results)
+		CHECK(result == CONTAINS);
+}
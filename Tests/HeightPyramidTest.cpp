@@ -0,0 +1,182 @@
+#include "pch.h"
+#include "Test.h"
+
+#include "HeightPyramid.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+	// Heights of a sample grid, wavy over the map plus noise, so ranges of small rectangles stay well below the whole range.
+	struct SampleGrid
+	{
+		uint32_t				width;
+		uint32_t				height;
+		uint32_t				sampleSize;
+		std::vector<float>		heights;
+
+		SampleGrid(uint32_t width_, uint32_t height_, uint32_t sampleSize_, uint32_t seed) :
+			width(width_), height(height_), sampleSize(sampleSize_), heights(width_ * height_)
+		{
+			std::mt19937 random(seed);
+			std::uniform_real_distribution<float> noise(0.0f, 0.05f);
+			for (uint32_t y = 0; y < height; y++)
+			{
+				for (uint32_t x = 0; x < width; x++)
+				{
+					const float u = 6.2831853f * x / width;
+					const float v = 3.1415927f * y / height;
+					heights[y * width + x] = 0.5f + 0.2f * sinf(3.0f * u) * sinf(2.0f * v) + 0.2f * cosf(5.0f * u + v) + noise(random);
+				}
+			}
+		}
+
+		HeightPyramid Build(uint32_t tileSamples, WorkerPool* workerPool) const
+		{
+			HeightPyramid pyramid;
+			pyramid.Build(width, height, sampleSize, tileSamples, [this](uint32_t y, float* row)
+			{
+				std::copy(&heights[y * width], &heights[y * width] + width, row);
+			}, workerPool);
+			return pyramid;
+		}
+
+		// Range of every sample overlapping texel rectangle [x0, x1] x [y0, y1], columns wrap.
+		void GetRange(float x0, float x1, float y0, float y1, float& minHeight, float& maxHeight) const
+		{
+			minHeight = FLT_MAX;
+			maxHeight = -FLT_MAX;
+
+			const int64_t sx0 = static_cast<int64_t>(floorf(x0 / sampleSize));
+			const int64_t sx1 = std::min(static_cast<int64_t>(floorf(x1 / sampleSize)), sx0 + width - 1);
+			const int64_t sy0 = std::max(static_cast<int64_t>(floorf(y0 / sampleSize)), int64_t(0));
+			const int64_t sy1 = std::min(static_cast<int64_t>(floorf(y1 / sampleSize)), int64_t(height) - 1);
+			for (int64_t sy = sy0; sy <= sy1; sy++)
+			{
+				for (int64_t sx = sx0; sx <= sx1; sx++)
+				{
+					const int64_t column = ((sx % width) + width) % width;
+					const float h = heights[sy * width + column];
+					minHeight = std::min(minHeight, h);
+					maxHeight = std::max(maxHeight, h);
+				}
+			}
+		}
+	};
+
+	// Random rectangles of every size from a texel to the whole map, some past the right border or the poles.
+	void CreateRandomRectangle(std::mt19937& random, const SampleGrid& grid, float& x0, float& x1, float& y0, float& y1)
+	{
+		const float mapWidth = static_cast<float>(grid.width * grid.sampleSize);
+		const float mapHeight = static_cast<float>(grid.height * grid.sampleSize);
+
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		const float extent = exp2f(unit(random) * log2f(mapHeight));
+		x0 = unit(random) * 1.5f * mapWidth;
+		x1 = x0 + extent * (0.25f + 0.75f * unit(random));
+		y0 = unit(random) * mapHeight - 0.1f * extent;
+		y1 = y0 + extent * (0.25f + 0.75f * unit(random));
+	}
+
+	// Query must cover the samples under the rectangle, and stay inside the samples of the rectangle widened by
+	// one tile of the level it reads. That level has tiles of at most max(extent, base tile size), so the query reads
+	// a bounded number of tiles on one of log n levels.
+	void CheckQueries(const SampleGrid& grid, const HeightPyramid& pyramid, uint32_t queryCount, uint32_t seed, float tolerance)
+	{
+		std::mt19937 random(seed);
+		for (uint32_t q = 0; q < queryCount; q++)
+		{
+			float x0, x1, y0, y1;
+			CreateRandomRectangle(random, grid, x0, x1, y0, y1);
+
+			float minHeight = FLT_MAX;
+			float maxHeight = -FLT_MAX;
+			pyramid.AccumulateRange(x0, x1, y0, y1, minHeight, maxHeight);
+
+			float exactMin, exactMax;
+			grid.GetRange(x0, x1, y0, y1, exactMin, exactMax);
+			CHECK(minHeight <= exactMin);
+			CHECK(maxHeight >= exactMax);
+
+			const float margin = std::max(std::max(x1 - x0, y1 - y0), static_cast<float>(pyramid.GetBaseTileSize()));
+			float outerMin, outerMax;
+			grid.GetRange(x0 - margin, x1 + margin, y0 - margin, y1 + margin, outerMin, outerMax);
+			CHECK(minHeight >= outerMin - tolerance);
+			CHECK(maxHeight <= outerMax + tolerance);
+		}
+	}
+}
+
+TEST(HeightPyramid, QueryMatchesBruteForce)
+{
+	WorkerPool workerPool(2);
+
+	// Mip 0 and a coarser mip, with sizes that fill no tile.
+	const SampleGrid grids[] = { SampleGrid(512, 256, 1, 1), SampleGrid(200, 100, 4, 2), SampleGrid(37, 19, 2, 3) };
+	uint32_t seed = 10;
+	for (const SampleGrid& grid : grids)
+	{
+		const HeightPyramid pyramid = grid.Build(8, &workerPool);
+		CHECK(pyramid.GetBaseTileSize() == 8 * grid.sampleSize);
+		CHECK(pyramid.GetMinHeight() == *std::min_element(grid.heights.begin(), grid.heights.end()));
+		CheckQueries(grid, pyramid, 2000, seed++, 0.0f);
+	}
+}
+
+TEST(HeightPyramid, SmallRectanglesReadBaseTiles)
+{
+	const SampleGrid grid(256, 128, 1, 4);
+	const HeightPyramid pyramid = grid.Build(8, nullptr);
+
+	// A texel inside a base tile reads exactly that tile.
+	std::mt19937 random(5);
+	std::uniform_int_distribution<uint32_t> tileX(0, 31);
+	std::uniform_int_distribution<uint32_t> tileY(0, 15);
+	for (int i = 0; i < 200; i++)
+	{
+		const float x = 8.0f * tileX(random) + 3.5f;
+		const float y = 8.0f * tileY(random) + 3.5f;
+
+		float minHeight = FLT_MAX;
+		float maxHeight = -FLT_MAX;
+		pyramid.AccumulateRange(x, x, y, y, minHeight, maxHeight);
+
+		float tileMin, tileMax;
+		grid.GetRange(x - 3.5f, x + 4.0f, y - 3.5f, y + 4.0f, tileMin, tileMax);
+		CHECK(minHeight == tileMin);
+		CHECK(maxHeight == tileMax);
+	}
+}
+
+TEST(HeightPyramid, ReadBackStaysConservative)
+{
+	const SampleGrid grid(300, 150, 2, 6);
+	const HeightPyramid pyramid = grid.Build(8, nullptr);
+
+	std::vector<uint8_t> data;
+	pyramid.Write(data);
+
+	HeightPyramid readPyramid;
+	const uint8_t* cursor = data.data();
+	CHECK(readPyramid.Read(cursor, data.data() + data.size()));
+	CHECK(cursor == data.data() + data.size());
+
+	// Codes round outwards by at most one step of the 16 bit range.
+	float range[2] = { FLT_MAX, -FLT_MAX };
+	for (float h : grid.heights)
+	{
+		range[0] = std::min(range[0], h);
+		range[1] = std::max(range[1], h);
+	}
+	CheckQueries(grid, readPyramid, 2000, 7, 2.0f * (range[1] - range[0]) / 65535.0f);
+
+	// Truncated data is rejected.
+	HeightPyramid truncated;
+	cursor = data.data();
+	CHECK(!truncated.Read(cursor, data.data() + data.size() / 2));
+}
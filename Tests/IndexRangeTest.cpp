@@ -0,0 +1,107 @@
+#include "pch.h"
+#include "Test.h"
+
+#include "IndexRange.h"
+
+#include <vector>
+
+TEST(IndexRange, AdjacentRangesWithSameLodMerge)
+{
+	IndexRangeList list;
+	list.Append(0, 12);
+	list.Append(12, 24);
+	list.Append(36, 12);
+
+	CHECK(list.GetRangeCount() == 1);
+	CHECK(list.GetRanges()[0].start == 0);
+	CHECK(list.GetRanges()[0].count == 48);
+	CHECK(list.GetIndexCount() == 48);
+}
+
+TEST(IndexRange, GapsAndLodChangesStartNewRanges)
+{
+	IndexRangeList list;
+	list.Append(0, 12, 0);
+	list.Append(24, 12, 0);		// Gap.
+	list.Append(36, 12, 1);		// Adjacent, other LOD.
+	list.Append(48, 12, 1);
+	list.Append(12, 12, 1);		// Behind the last range.
+
+	const std::vector<IndexRange>& ranges = list.GetRanges();
+	CHECK(list.GetRangeCount() == 4);
+	CHECK(ranges[0].start == 0 && ranges[0].count == 12 && ranges[0].lod == 0);
+	CHECK(ranges[1].start == 24 && ranges[1].count == 12 && ranges[1].lod == 0);
+	CHECK(ranges[2].start == 36 && ranges[2].count == 24 && ranges[2].lod == 1);
+	CHECK(ranges[3].start == 12 && ranges[3].count == 12 && ranges[3].lod == 1);
+	CHECK(list.GetIndexCount() == 60);
+}
+
+TEST(IndexRange, ClearKeepsNothing)
+{
+	IndexRangeList list(8);
+	list.Append(0, 12);
+	list.Clear();
+	list.Append(12, 12);
+
+	CHECK(list.GetRangeCount() == 1);
+	CHECK(list.GetRanges()[0].start == 12);
+	CHECK(list.GetIndexCount() == 12);
+}
+
+TEST(IndexRange, UnchangedRangesHaveNoRuns)
+{
+	const std::vector<IndexRange> ranges = { { 0, 12, 0 }, { 24, 12, 1 }, { 48, 6, 0 } };
+	std::vector<IndexRange> runs = { { 5, 5, 0 } };
+	FindChangedRuns(ranges, ranges, runs);
+
+	CHECK(runs.empty());
+}
+
+TEST(IndexRange, ChangedPositionsSplitIntoRuns)
+{
+	const std::vector<IndexRange> previous = { { 0, 12, 0 }, { 24, 12, 0 }, { 48, 12, 0 }, { 72, 12, 0 }, { 96, 12, 0 }, { 120, 12, 0 } };
+	const std::vector<IndexRange> ranges = {
+		{ 0, 12, 0 },		// Same.
+		{ 24, 18, 0 },		// Count.
+		{ 36, 12, 0 },		// Start.
+		{ 72, 12, 0 },		// Same.
+		{ 96, 12, 2 },		// LOD.
+	};
+
+	std::vector<IndexRange> runs;
+	FindChangedRuns(ranges, previous, runs);
+
+	CHECK(runs.size() == 2);
+	CHECK(runs[0].start == 1 && runs[0].count == 2);
+	CHECK(runs[1].start == 4 && runs[1].count == 1);
+}
+
+TEST(IndexRange, GrownListDiffsAgainstClearedSlots)
+{
+	// Slots past the last upload hold empty ranges, as FaceTree keeps them.
+	const std::vector<IndexRange> previous = { { 0, 12, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 } };
+	const std::vector<IndexRange> ranges = { { 0, 12, 0 }, { 24, 12, 0 }, { 48, 12, 0 } };
+
+	std::vector<IndexRange> runs;
+	FindChangedRuns(ranges, previous, runs);
+
+	CHECK(runs.size() == 1);
+	CHECK(runs[0].start == 1 && runs[0].count == 2);
+}
+
+TEST(IndexRange, EveryPositionChangedIsOneRun)
+{
+	std::vector<IndexRange> previous;
+	std::vector<IndexRange> ranges;
+	for (uint32_t i = 0; i < 100; i++)
+	{
+		previous.push_back({ 24 * i, 12, 0 });
+		ranges.push_back({ 24 * i + 12, 12, 0 });
+	}
+
+	std::vector<IndexRange> runs;
+	FindChangedRuns(ranges, previous, runs);
+
+	CHECK(runs.size() == 1);
+	CHECK(runs[0].start == 0 && runs[0].count == 100);
+}
@@ -0,0 +1,237 @@
+#include "pch.h"
+#include "Test.h"
+
+#include "HeadlessScene.h"
+#include "WorkerPool.h"
+
+#include <cmath>
+#include <map>
+#include <random>
+#include <tuple>
+
+using namespace DirectX;
+
+namespace
+{
+	// Leaf of a face tree with its center projected on the cube, and face axes of the hull shader.
+	struct Leaf
+	{
+		uint32_t		face;
+		uint32_t		leaf;
+		XMFLOAT3		cubePos;
+		XMFLOAT3		right;
+		XMFLOAT3		up;
+	};
+
+	std::vector<Leaf> CreateLeaves(const std::vector<FaceTree*>& faceTrees)
+	{
+		const float cellWidth = 2.0f * QUAD_SPHERE_RADIUS / (1u << faceTrees[0]->GetMaxLevel());
+		auto snap = [cellWidth](float x) { return (floorf((x + QUAD_SPHERE_RADIUS) / cellWidth) + 0.5f) * cellWidth - QUAD_SPHERE_RADIUS; };
+
+		std::vector<Leaf> leaves;
+		for (uint32_t f = 0; f < faceTrees.size(); f++)
+		{
+			for (uint32_t leaf = 0; leaf < faceTrees[f]->GetLeafCount(); leaf++)
+			{
+				const XMFLOAT3& center = faceTrees[f]->GetLeafCenter(leaf);
+				const float c[3] = { center.x, center.y, center.z };
+				uint32_t axis = 0;
+				for (uint32_t k = 1; k < 3; k++)
+				{
+					if (fabsf(c[k]) > fabsf(c[axis]))
+						axis = k;
+				}
+				const float s = c[axis] < 0.0f ? -1.0f : 1.0f;
+
+				Leaf entry;
+				entry.face = f;
+				entry.leaf = leaf;
+				entry.right = axis == 0 ? XMFLOAT3(0, 0, s) : axis == 1 ? XMFLOAT3(1, 0, 0) : XMFLOAT3(-s, 0, 0);
+				entry.up = axis == 1 ? XMFLOAT3(0, 0, s) : XMFLOAT3(0, 1, 0);
+
+				// Bounds center lies above the cell, snap its projection to the cell center.
+				const XMVECTOR right = XMLoadFloat3(&entry.right);
+				const XMVECTOR up = XMLoadFloat3(&entry.up);
+				const XMVECTOR projected = XMLoadFloat3(&center) * (QUAD_SPHERE_RADIUS / fabsf(c[axis]));
+				const XMVECTOR normal = XMVector3Cross(up, right) * QUAD_SPHERE_RADIUS;
+				const float r = snap(XMVectorGetX(XMVector3Dot(projected, right)));
+				const float u = snap(XMVectorGetX(XMVector3Dot(projected, up)));
+				XMStoreFloat3(&entry.cubePos, normal + right * r + up * u);
+				leaves.push_back(entry);
+			}
+		}
+		return leaves;
+	}
+
+	// Edge of a leaf facing a neighbour: bottom, left, top, right.
+	uint32_t GetEdge(const Leaf& from, const Leaf& to)
+	{
+		const XMVECTOR d = XMLoadFloat3(&to.cubePos) - XMLoadFloat3(&from.cubePos);
+		const float r = XMVectorGetX(XMVector3Dot(d, XMLoadFloat3(&from.right)));
+		const float u = XMVectorGetX(XMVector3Dot(d, XMLoadFloat3(&from.up)));
+		if (fabsf(u) > fabsf(r))
+			return u < 0.0f ? 0 : 2;
+		return r < 0.0f ? 1 : 3;
+	}
+
+	// Leaves sharing an edge, found by geometry alone. Centers of cells sharing an edge are one cell width apart
+	// along the cube surface, also across cube edges; any other pair is at least two widths apart.
+	std::vector<std::pair<uint32_t, uint32_t>> FindNeighbors(const std::vector<Leaf>& leaves, float cellWidth)
+	{
+		std::vector<std::pair<uint32_t, uint32_t>> neighbors;
+		for (uint32_t a = 0; a < leaves.size(); a++)
+		{
+			for (uint32_t b = a + 1; b < leaves.size(); b++)
+			{
+				const XMFLOAT3& p = leaves[a].cubePos;
+				const XMFLOAT3& q = leaves[b].cubePos;
+				const float distance = fabsf(p.x - q.x) + fabsf(p.y - q.y) + fabsf(p.z - q.z);
+				if (fabsf(distance - cellWidth) < 0.01f * cellWidth)
+					neighbors.emplace_back(a, b);
+			}
+		}
+		return neighbors;
+	}
+
+	// Random cut of a face tree, each node stops with given chance.
+	void CreateRandomCut(
+		std::vector<uint8_t>& leafLevels, uint32_t maxLevel, uint32_t level, uint32_t node, float stopChance,
+		std::mt19937& random)
+	{
+		std::uniform_real_distribution<float> uniform;
+		if (level == maxLevel || uniform(random) < stopChance)
+		{
+			const uint32_t leafCount = 1u << (2 * (maxLevel - level));
+			std::fill_n(leafLevels.begin() + node * leafCount, leafCount, static_cast<uint8_t>(level));
+			return;
+		}
+
+		for (uint32_t c = 0; c < 4; c++)
+			CreateRandomCut(leafLevels, maxLevel, level + 1, 4 * node + c, stopChance, random);
+	}
+
+	// Balance the selected cut, then check it against neighbours found independently of LodGrid.
+	void CheckBalance(
+		HeadlessScene& scene, const std::vector<Leaf>& leaves, const std::vector<std::pair<uint32_t, uint32_t>>& neighbors)
+	{
+		const std::vector<FaceTree*>& faceTrees = scene.GetFaceTrees();
+		const uint32_t maxLevel = faceTrees[0]->GetMaxLevel();
+
+		std::vector<uint8_t> selectedLevels;
+		for (const Leaf& leaf : leaves)
+			selectedLevels.push_back(faceTrees[leaf.face]->GetLeafLodLevels()[leaf.leaf]);
+
+		scene.GetLodGrid().Balance(faceTrees);
+
+		// Balance only splits nodes.
+		std::vector<uint32_t> levels;
+		for (uint32_t i = 0; i < leaves.size(); i++)
+		{
+			levels.push_back(faceTrees[leaves[i].face]->GetLeafLodLevels()[leaves[i].leaf]);
+			CHECK(levels[i] >= selectedLevels[i]);
+		}
+
+		// Node of a leaf is the ancestor at its level, leaves of a node are contiguous.
+		auto getNode = [&](uint32_t i) { return std::make_tuple(leaves[i].face, levels[i], leaves[i].leaf >> (2 * (maxLevel - levels[i]))); };
+
+		uint32_t unbalancedCount = 0;
+		uint32_t unmirroredCount = 0;
+		std::map<std::tuple<uint32_t, uint32_t, uint32_t>, uint32_t> nodeEdges;
+		for (const auto& neighbor : neighbors)
+		{
+			const uint32_t a = neighbor.first;
+			const uint32_t b = neighbor.second;
+			if (levels[a] > levels[b] + 1 || levels[b] > levels[a] + 1)
+				unbalancedCount++;
+
+			if (getNode(a) == getNode(b))
+				continue;
+
+			const uint32_t edgeA = GetEdge(leaves[a], leaves[b]);
+			const uint32_t edgeB = GetEdge(leaves[b], leaves[a]);
+			const uint8_t edgesA = faceTrees[leaves[a].face]->GetLeafLodEdges()[leaves[a].leaf];
+			const uint8_t edgesB = faceTrees[leaves[b].face]->GetLeafLodEdges()[leaves[b].leaf];
+
+			// Finer side of an edge sees it coarser from the other side, and the other way round.
+			if (levels[a] > levels[b])
+			{
+				unmirroredCount += (edgesA >> (4 + edgeA)) & 1 ? 0 : 1;
+				unmirroredCount += (edgesB >> edgeB) & 1 ? 0 : 1;
+				nodeEdges[getNode(a)] |= 1u << (4 + edgeA);
+				nodeEdges[getNode(b)] |= 1u << edgeB;
+			}
+			else if (levels[b] > levels[a])
+			{
+				unmirroredCount += (edgesB >> (4 + edgeB)) & 1 ? 0 : 1;
+				unmirroredCount += (edgesA >> edgeA) & 1 ? 0 : 1;
+				nodeEdges[getNode(b)] |= 1u << (4 + edgeB);
+				nodeEdges[getNode(a)] |= 1u << edgeA;
+			}
+		}
+		CHECK(unbalancedCount == 0);
+		CHECK(unmirroredCount == 0);
+
+		// No edge bit without a finer or coarser neighbour behind it.
+		uint32_t wrongMaskCount = 0;
+		for (uint32_t i = 0; i < leaves.size(); i++)
+		{
+			const auto found = nodeEdges.find(getNode(i));
+			const uint32_t expected = found == nodeEdges.end() ? 0 : found->second;
+			wrongMaskCount += faceTrees[leaves[i].face]->GetLeafLodEdges()[leaves[i].leaf] == expected ? 0 : 1;
+		}
+		CHECK(wrongMaskCount == 0);
+	}
+}
+
+TEST(LodGrid, RandomCutsBalanceAcrossCubeEdges)
+{
+	WorkerPool workerPool(2);
+	HeadlessScene scene(7, &workerPool);
+	const std::vector<FaceTree*>& faceTrees = scene.GetFaceTrees();
+	const uint32_t maxLevel = faceTrees[0]->GetMaxLevel();
+
+	const std::vector<Leaf> leaves = CreateLeaves(faceTrees);
+	const std::vector<std::pair<uint32_t, uint32_t>> neighbors =
+		FindNeighbors(leaves, 2.0f * QUAD_SPHERE_RADIUS / (1u << maxLevel));
+
+	// Every leaf has four neighbours, each pair found once.
+	CHECK(neighbors.size() == 2 * leaves.size());
+
+	std::mt19937 random(7);
+	for (uint32_t cut = 0; cut < 200; cut++)
+	{
+		// Stop chances from coarse, widely unbalanced cuts to nearly full detail.
+		const float stopChance = 0.1f + 0.8f * (cut % 10) / 9.0f;
+		for (FaceTree* faceTree : faceTrees)
+			CreateRandomCut(faceTree->GetLeafLodLevels(), maxLevel, 0, 0, stopChance, random);
+
+		CheckBalance(scene, leaves, neighbors);
+	}
+}
+
+TEST(LodGrid, SelectedCutsBalanceAcrossCubeEdges)
+{
+	WorkerPool workerPool(2);
+	HeadlessScene scene(7, &workerPool);
+	const std::vector<FaceTree*>& faceTrees = scene.GetFaceTrees();
+
+	const std::vector<Leaf> leaves = CreateLeaves(faceTrees);
+	const std::vector<std::pair<uint32_t, uint32_t>> neighbors =
+		FindNeighbors(leaves, 2.0f * QUAD_SPHERE_RADIUS / (1u << faceTrees[0]->GetMaxLevel()));
+
+	const HeadlessScene::Settings settings;
+	LodView lodView;
+	lodView.enabled = true;
+	lodView.metric = settings.lodMetric;
+	lodView.pixelThreshold = settings.lodPixelThreshold;
+	lodView.pixelsPerUnit = settings.outputHeight / (2.0f * tanf(XM_PIDIV4 / 2.0f));
+
+	for (const HeadlessScene::Pose& pose : HeadlessScene::CreateRandomPoses(64, 11, 0.5f, 350.0f))
+	{
+		lodView.cameraPosition = pose.cameraPosition;
+		for (FaceTree* faceTree : faceTrees)
+			faceTree->SelectLod(lodView);
+
+		CheckBalance(scene, leaves, neighbors);
+	}
+}
@@ -0,0 +1,81 @@
+#include "pch.h"
+#include "Test.h"
+
+#include "HeadlessScene.h"
+#include "HeightMap.h"
+#include "WorkerPool.h"
+
+#include <cmath>
+#include <cstring>
+#include <random>
+
+namespace
+{
+	// R32_FLOAT half with every sampled mip, wavy heights plus noise that differ per mip, as a filtered map would.
+	// Coarser mips sit a little higher, so bounds that miss a mip miss points too.
+	HeightMap::Source CreateSource(uint32_t size, uint32_t seed)
+	{
+		std::mt19937 random(seed);
+		std::uniform_real_distribution<float> noise(0.0f, 0.1f);
+
+		HeightMap::Source source;
+		source.format = DXGI_FORMAT_R32_FLOAT;
+		source.width = size;
+		source.height = size;
+
+		size_t texelCount = 0;
+		for (uint32_t mip = 0; mip <= HeightMap::MAX_SAMPLED_MIP; mip++)
+			texelCount += static_cast<size_t>(size >> mip) * (size >> mip);
+		source.data.reset(new uint8_t[texelCount * sizeof(float)]);
+
+		float* texels = reinterpret_cast<float*>(source.data.get());
+		for (uint32_t mip = 0; mip <= HeightMap::MAX_SAMPLED_MIP; mip++)
+		{
+			const uint32_t mipSize = size >> mip;
+			for (uint32_t y = 0; y < mipSize; y++)
+			{
+				for (uint32_t x = 0; x < mipSize; x++)
+					texels[y * mipSize + x] = 0.45f + 0.015f * mip + 0.3f * sinf(0.1f * x * (1u << mip)) * cosf(0.07f * y * (1u << mip)) + noise(random);
+			}
+
+			D3D12_SUBRESOURCE_DATA mipData;
+			mipData.pData = texels;
+			mipData.RowPitch = mipSize * sizeof(float);
+			mipData.SlicePitch = mipData.RowPitch * mipSize;
+			source.mips.push_back(mipData);
+			texels += static_cast<size_t>(mipSize) * mipSize;
+		}
+
+		return source;
+	}
+}
+
+TEST(NodeBounds, DisplacedPatchesStayInsideNodeBounds)
+{
+	WorkerPool workerPool(2);
+
+	// Files that do not exist are never stamped, so nothing is cached.
+	const wchar_t* const sourceFileNames[2] = { L"missing_l.dds", L"missing_r.dds" };
+	HeightMap heightMap;
+	CHECK(heightMap.Init(CreateSource(512, 1), CreateSource(512, 2), sourceFileNames, L"missing.bin", &workerPool));
+	CHECK(heightMap.GetSampledMipCount() == HeightMap::MAX_SAMPLED_MIP + 1);
+
+	// Leaves of subdiv 7 hold 64 patches and split once, so detail nodes are checked too.
+	const HeadlessScene scene(7, &workerPool, &heightMap);
+	const FaceTree* faceTree = scene.GetFaceTrees()[0];
+	CHECK(faceTree->GetNodeIndexCount(faceTree->GetNodeCount() - 1) / 16 >= FaceTree::MIN_DETAIL_QUAD_COUNT);
+
+	// Corners, edge midpoints and centers of every patch, and of its 4 quarters, at every sampled mip.
+	const uint32_t segmentCount = 4;
+	const FaceTree::BoundsReport report = scene.ValidateBounds(heightMap, segmentCount);
+	const uint32_t patchCount = static_cast<uint32_t>(6 * faceTree->GetNodeIndexCount(0) / 4);
+	const uint32_t nodeLevelCount = QUAD_NODE_MAX_LEVEL + 2;
+	CHECK(report.pointCount == patchCount * nodeLevelCount * (HeightMap::MAX_SAMPLED_MIP + 1) * 25);
+
+	// Float rounding of the fit may leave a point a hair outside, never more.
+	CHECK(report.maxExcess <= 1e-3f);
+
+	// Slopes of the noise keep cones narrow enough to cull, yet every tessellated triangle faces inside its cone.
+	CHECK(report.triangleCount > 0);
+	CHECK(report.coneOutsideCount == 0);
+}
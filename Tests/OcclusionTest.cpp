@@ -0,0 +1,233 @@
+#include "pch.h"
+#include "Test.h"
+
+#include "HeadlessScene.h"
+#include "HeightMap.h"
+#include "OcclusionBuffer.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+	// R32_FLOAT half with every sampled mip, a few wide hills and valleys plus noise that differs per mip.
+	HeightMap::Source CreateSource(uint32_t size, uint32_t seed)
+	{
+		std::mt19937 random(seed);
+		std::uniform_real_distribution<float> noise(0.0f, 0.05f);
+
+		HeightMap::Source source;
+		source.format = DXGI_FORMAT_R32_FLOAT;
+		source.width = size;
+		source.height = size;
+
+		size_t texelCount = 0;
+		for (uint32_t mip = 0; mip <= HeightMap::MAX_SAMPLED_MIP; mip++)
+			texelCount += static_cast<size_t>(size >> mip) * (size >> mip);
+		source.data.reset(new uint8_t[texelCount * sizeof(float)]);
+
+		float* texels = reinterpret_cast<float*>(source.data.get());
+		for (uint32_t mip = 0; mip <= HeightMap::MAX_SAMPLED_MIP; mip++)
+		{
+			const uint32_t mipSize = size >> mip;
+			for (uint32_t y = 0; y < mipSize; y++)
+			{
+				for (uint32_t x = 0; x < mipSize; x++)
+				{
+					const float u = XM_2PI * (x + 0.5f) / mipSize;
+					const float v = XM_2PI * (y + 0.5f) / mipSize;
+					texels[y * mipSize + x] = 0.5f + 0.4f * sinf(4.0f * u) * cosf(3.0f * v) + noise(random);
+				}
+			}
+
+			D3D12_SUBRESOURCE_DATA mipData;
+			mipData.pData = texels;
+			mipData.RowPitch = mipSize * sizeof(float);
+			mipData.SlicePitch = mipData.RowPitch * mipSize;
+			source.mips.push_back(mipData);
+			texels += static_cast<size_t>(mipSize) * mipSize;
+		}
+
+		return source;
+	}
+
+	// True if the segment from camera to point stays above the surface the domain shader displaces at given mip.
+	bool IsVisible(const HeightMap& heightMap, uint32_t mip, FXMVECTOR camera, FXMVECTOR point)
+	{
+		constexpr float STEP = 0.05f;
+		const uint32_t stepCount = std::max(static_cast<uint32_t>(XMVectorGetX(XMVector3Length(point - camera)) / STEP), 1u);
+		for (uint32_t s = 0; s <= stepCount; s++)
+		{
+			const XMVECTOR position = XMVectorLerp(camera, point, static_cast<float>(s) / stepCount);
+
+			XMFLOAT3 direction;
+			XMStoreFloat3(&direction, position);
+			const float surfaceRadius = QUAD_SPHERE_RADIUS + heightMap.Sample(direction, mip) * MAX_HEIGHT_DISPLACEMENT;
+			if (XMVectorGetX(XMVector3Length(position)) < surfaceRadius)
+				return false;
+		}
+		return true;
+	}
+
+	XMVECTOR RandomUnit(std::mt19937& random)
+	{
+		std::normal_distribution<float> normal(0.0f, 1.0f);
+		return XMVector3Normalize(XMVectorSet(normal(random), normal(random), normal(random), 0.0f));
+	}
+}
+
+TEST(Occlusion, TerrainProxyStaysUnderSurface)
+{
+	WorkerPool workerPool(2);
+
+	// Files that do not exist are never stamped, so nothing is cached.
+	const wchar_t* const sourceFileNames[2] = { L"missing_l.dds", L"missing_r.dds" };
+	HeightMap heightMap;
+	CHECK(heightMap.Init(CreateSource(512, 1), CreateSource(512, 2), sourceFileNames, L"missing.bin", &workerPool));
+
+	std::vector<XMFLOAT3> vertices;
+	std::vector<uint32_t> indices;
+	OcclusionBuffer::CreateTerrainOccluder(
+		1u << QUAD_NODE_MAX_LEVEL, QUAD_SPHERE_RADIUS, MAX_HEIGHT_DISPLACEMENT, heightMap, vertices, indices);
+
+	// Random points of every triangle against the surface at every sampled mip.
+	std::mt19937 random(5);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	float minClearance = FLT_MAX;
+	for (size_t t = 0; t < indices.size(); t += 3)
+	{
+		for (uint32_t k = 0; k < 8; k++)
+		{
+			float a = unit(random);
+			float b = unit(random);
+			if (a + b > 1.0f)
+			{
+				a = 1.0f - a;
+				b = 1.0f - b;
+			}
+
+			XMFLOAT3 point;
+			XMStoreFloat3(&point,
+				XMLoadFloat3(&vertices[indices[t]]) * (1.0f - a - b) +
+				XMLoadFloat3(&vertices[indices[t + 1]]) * a + XMLoadFloat3(&vertices[indices[t + 2]]) * b);
+
+			const float pointRadius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&point)));
+			for (uint32_t mip = 0; mip < heightMap.GetSampledMipCount(); mip++)
+			{
+				const float surfaceRadius = QUAD_SPHERE_RADIUS + heightMap.Sample(point, mip) * MAX_HEIGHT_DISPLACEMENT;
+				minClearance = std::min(minClearance, surfaceRadius - pointRadius);
+			}
+		}
+	}
+	CHECK(minClearance >= 0.0f);
+}
+
+TEST(Occlusion, OccludedSpheresStayHiddenFromMovedCameras)
+{
+	WorkerPool workerPool(2);
+
+	const wchar_t* const sourceFileNames[2] = { L"missing_l.dds", L"missing_r.dds" };
+	HeightMap heightMap;
+	CHECK(heightMap.Init(CreateSource(512, 1), CreateSource(512, 2), sourceFileNames, L"missing.bin", &workerPool));
+
+	// Terrain proxy as Apollo builds it.
+	std::vector<XMFLOAT3> vertices;
+	std::vector<uint32_t> indices;
+	OcclusionBuffer occlusionBuffer(256, 144);
+	OcclusionBuffer::CreateTerrainOccluder(
+		1u << QUAD_NODE_MAX_LEVEL, QUAD_SPHERE_RADIUS, MAX_HEIGHT_DISPLACEMENT, heightMap, vertices, indices);
+	occlusionBuffer.SetOccluder(std::move(vertices), std::move(indices));
+
+	// Shrinks up to the default margin are lowered locally, larger ones drop everything to the inner ball.
+	constexpr uint32_t SHRINK_COUNT = 4;
+	const float shrinks[SHRINK_COUNT] = { 0.0f, 0.5f, 2.0f, 5.0f };
+	CHECK(occlusionBuffer.GetMaxLocalShrink() > 2.0f);
+	CHECK(occlusionBuffer.GetMaxLocalShrink() < 5.0f);
+
+	const uint32_t mips[] = { 0, heightMap.GetSampledMipCount() - 1 };
+	std::mt19937 random(11);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	uint32_t occludedCounts[SHRINK_COUNT] = {};
+	for (uint32_t poseIndex = 0; poseIndex < 64; poseIndex++)
+	{
+		// Low flight just above the highest surface, looking at the horizon.
+		const XMVECTOR up = RandomUnit(random);
+		const XMVECTOR side = XMVector3Normalize(XMVector3Cross(up, RandomUnit(random)));
+		const float pitch = 0.1f * unit(random);
+
+		XMFLOAT3 cameraPosition;
+		XMFLOAT3 cameraForward;
+		XMFLOAT3 lightDirection;
+		XMStoreFloat3(&cameraPosition, up * (QUAD_SPHERE_RADIUS + MAX_HEIGHT_DISPLACEMENT + 0.02f + 0.5f * unit(random)));
+		XMStoreFloat3(&cameraForward, side * cosf(pitch) - up * sinf(pitch));
+		XMStoreFloat3(&lightDirection, -up);
+		const HeadlessScene::Pose pose = HeadlessScene::CreatePose(cameraPosition, cameraForward, lightDirection);
+
+		BoundingFrustum frustum;
+		XMFLOAT4X4 viewProjection;
+		HeadlessScene::GetCamera(pose, 16.0f / 9.0f, frustum, viewProjection);
+
+		const XMVECTOR camera = XMLoadFloat3(&pose.cameraPosition);
+		const XMVECTOR forward = XMVector3Rotate(XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), XMLoadFloat4(&frustum.Orientation));
+
+		// Spheres resting on the surface ahead of the camera, from short of the horizon to far enough past it
+		// that even the most shrunk occluder hides some.
+		const float cameraRadius = XMVectorGetX(XMVector3Length(camera));
+		const float horizonDistance = sqrtf(cameraRadius * cameraRadius - QUAD_SPHERE_RADIUS * QUAD_SPHERE_RADIUS);
+		std::vector<BoundingSphere> spheres;
+		for (uint32_t i = 0; i < 400; i++)
+		{
+			const XMVECTOR ahead = camera + forward * horizonDistance * (0.5f + 5.5f * unit(random)) +
+				RandomUnit(random) * 0.2f * horizonDistance * unit(random);
+
+			XMFLOAT3 direction;
+			XMStoreFloat3(&direction, XMVector3Normalize(ahead));
+			const float surfaceRadius = QUAD_SPHERE_RADIUS + heightMap.Sample(direction, 0) * MAX_HEIGHT_DISPLACEMENT;
+
+			BoundingSphere sphere;
+			sphere.Radius = 0.05f + 0.3f * unit(random);
+			XMStoreFloat3(&sphere.Center, XMLoadFloat3(&direction) * (surfaceRadius + sphere.Radius));
+			spheres.push_back(sphere);
+		}
+
+		for (uint32_t s = 0; s < SHRINK_COUNT; s++)
+		{
+			occlusionBuffer.Rasterize(viewProjection, pose.cameraPosition, workerPool, shrinks[s]);
+
+			uint32_t checkedCount = 0;
+			for (const BoundingSphere& sphere : spheres)
+			{
+				if (!occlusionBuffer.IsSphereOccluded(sphere.Center, sphere.Radius))
+					continue;
+				occludedCounts[s]++;
+
+				// Ray march a few of them, from the camera and from cameras moved by the shrink. Rising sees furthest.
+				if (checkedCount++ >= 16)
+					continue;
+
+				for (uint32_t c = 0; c < 3; c++)
+				{
+					const XMVECTOR movement = c == 0 ? XMVectorZero() : c == 1 ? up : RandomUnit(random);
+					const XMVECTOR movedCamera = camera + movement * shrinks[s];
+					for (uint32_t p = 0; p < 6; p++)
+					{
+						const XMVECTOR point = XMLoadFloat3(&sphere.Center) +
+							(p == 0 ? XMVectorZero() : RandomUnit(random) * sphere.Radius * cbrtf(unit(random)));
+						for (uint32_t mip : mips)
+							CHECK(!IsVisible(heightMap, mip, movedCamera, point));
+					}
+				}
+			}
+		}
+	}
+
+	// Every shrink hides something, so every path was ray marched.
+	for (uint32_t s = 0; s < SHRINK_COUNT; s++)
+		CHECK(occludedCounts[s] > 0);
+}
@@ -0,0 +1,166 @@
+#include "pch.h"
+#include "Test.h"
+
+#include "QuadNode.h"
+#include "TessFactor.h"
+
+using namespace DirectX;
+
+namespace
+{
+	PatchTess CreateTess(float edge0, float edge1, float edge2, float edge3, float insideU, float insideV)
+	{
+		PatchTess tess;
+		tess.edgeTess[0] = edge0;
+		tess.edgeTess[1] = edge1;
+		tess.edgeTess[2] = edge2;
+		tess.edgeTess[3] = edge3;
+		tess.insideTess[0] = insideU;
+		tess.insideTess[1] = insideV;
+		return tess;
+	}
+
+	// Tessellation groups and patches of a level 7 sphere, as CrackSweep draws it.
+	TessParameters CreateParameters(const XMFLOAT3& cameraPosition)
+	{
+		TessParameters parameters;
+		parameters.quadWidth = 300.0f / (1u << TESS_GROUP_QUAD_LEVEL);
+		parameters.unitCount = 4.0f;
+		parameters.tessMax = 6.0f;
+		parameters.cameraPosition = cameraPosition;
+		return parameters;
+	}
+
+	// Patch of given width with its lower left corner at (r, u) on the z = -150 face, whose right axis is +x.
+	// Corners run 0, 1, 3, 2 around it, quad position is the center of its tessellation group.
+	void CreatePatch(float r, float u, float width, const XMFLOAT3& quadPos, VertexTess patch[4])
+	{
+		patch[0] = VertexTess(XMFLOAT3(r, u, -150.0f), quadPos);
+		patch[1] = VertexTess(XMFLOAT3(r, u + width, -150.0f), quadPos);
+		patch[2] = VertexTess(XMFLOAT3(r + width, u, -150.0f), quadPos);
+		patch[3] = VertexTess(XMFLOAT3(r + width, u + width, -150.0f), quadPos);
+	}
+
+	// Patch LOD constant, see PatchLodCB.
+	uint32_t GetPatchLod(uint32_t coarseScale, uint32_t finerEdges, uint32_t coarserEdges, uint32_t nodeLevel)
+	{
+		return coarseScale | (finerEdges << 4) | (coarserEdges << 8) | (nodeLevel << 12);
+	}
+}
+
+TEST(TessFactor, UniformFactorsGiveSquareGrid)
+{
+	CHECK(TessFactor::CountTriangles(CreateTess(1, 1, 1, 1, 1, 1)) == 2);
+	CHECK(TessFactor::CountTriangles(CreateTess(2, 2, 2, 2, 2, 2)) == 8);
+	CHECK(TessFactor::CountTriangles(CreateTess(3, 3, 3, 3, 3, 3)) == 18);
+	CHECK(TessFactor::CountTriangles(CreateTess(64, 64, 64, 64, 64, 64)) == 8192);
+
+	// Integer partitioning rounds up, the tessellator clamps at 64.
+	CHECK(TessFactor::CountTriangles(CreateTess(2.5f, 2.5f, 2.5f, 2.5f, 2.5f, 2.5f)) == 18);
+	CHECK(TessFactor::CountTriangles(CreateTess(100, 100, 100, 100, 100, 100)) == 8192);
+	CHECK(TessFactor::GetSegmentCount(0.5f) == 1);
+}
+
+TEST(TessFactor, MixedFactorsStitchEdgesToInnerGrid)
+{
+	// Inner grid of 1 x 3 quads, then every edge strip has a triangle per outer and per inner segment.
+	CHECK(TessFactor::CountTriangles(CreateTess(1, 2, 3, 4, 3, 5)) == 2 * 1 * 3 + (1 + 3 + 2 * 3) + (2 + 4 + 2 * 1));
+
+	// Inner factors below 2 act as 2 once any factor is above 1, leaving no inner grid.
+	CHECK(TessFactor::CountTriangles(CreateTess(2, 1, 1, 1, 1, 1)) == 5);
+	CHECK(TessFactor::CountTriangles(CreateTess(1, 1, 1, 1, 2, 2)) == 4);
+	CHECK(TessFactor::CountTriangles(CreateTess(1, 1, 1, 1, 4, 4)) == 2 * 2 * 2 + 2 * (1 + 1 + 2 * 2));
+}
+
+TEST(TessFactor, CoarsePatchSplitsEdgesNextToFinerNodes)
+{
+	// Coarse patch twice the unit width in the lower left corner of a level 4 node.
+	const TessParameters parameters = CreateParameters(XMFLOAT3(0.0f, 0.0f, -155.0f));
+	const float unitWidth = parameters.quadWidth / parameters.unitCount;
+
+	VertexTess patch[4];
+	CreatePatch(0.0f, 0.0f, 2.0f * unitWidth, XMFLOAT3(0.5f * parameters.quadWidth, 0.5f * parameters.quadWidth, -150.0f), patch);
+
+	const PatchTess alone = TessFactor::CalcPatchTess(patch, GetPatchLod(1, 0, 0, 4), parameters);
+	CHECK(TessFactor::CountTriangles(alone) == 2);
+
+	// Finer nodes below and left split those edges once, edges inside the node stay whole.
+	const PatchTess split = TessFactor::CalcPatchTess(patch, GetPatchLod(1, 0xF, 0, 4), parameters);
+	CHECK(split.edgeTess[0] == 2.0f);
+	CHECK(split.edgeTess[1] == 2.0f);
+	CHECK(split.edgeTess[2] == 1.0f);
+	CHECK(split.edgeTess[3] == 1.0f);
+	CHECK(split.insideTess[0] == 1.0f && split.insideTess[1] == 1.0f);
+	CHECK(TessFactor::CountTriangles(split) == 6);
+}
+
+TEST(TessFactor, BorderPatchMeetsNeighbours)
+{
+	// Camera right above, every factor near the patch is 2^tessMax.
+	const TessParameters parameters = CreateParameters(XMFLOAT3(0.0f, 0.0f, -155.0f));
+	const float unitWidth = parameters.quadWidth / parameters.unitCount;
+	const XMFLOAT3 quadPos(0.5f * parameters.quadWidth, 0.5f * parameters.quadWidth, -150.0f);
+
+	VertexTess patch[4];
+	CreatePatch(0.0f, 0.0f, unitWidth, quadPos, patch);
+
+	const PatchTess fine = TessFactor::CalcPatchTess(patch, GetPatchLod(0, 0, 0, 4), parameters);
+	for (uint32_t i = 0; i < 4; i++)
+		CHECK(fine.edgeTess[i] == 64.0f);
+	CHECK(TessFactor::CountTriangles(fine) == 8192);
+
+	// Coarser node on the left keeps only the corners of that edge.
+	const PatchTess coarser = TessFactor::CalcPatchTess(patch, GetPatchLod(0, 0, 0x2, 4), parameters);
+	CHECK(coarser.edgeTess[0] == 64.0f);
+	CHECK(coarser.edgeTess[1] == 1.0f);
+	CHECK(coarser.edgeTess[2] == 64.0f);
+	CHECK(coarser.insideTess[0] == 64.0f);
+	CHECK(TessFactor::CountTriangles(coarser) == 2 * 62 * 62 + (64 + 64 + 2 * 62) + (1 + 64 + 2 * 62));
+
+	// Interior patch of the group takes the group factor on every edge, whatever its node borders.
+	VertexTess interior[4];
+	CreatePatch(unitWidth, unitWidth, unitWidth, quadPos, interior);
+	const PatchTess inner = TessFactor::CalcPatchTess(interior, GetPatchLod(0, 0, 0xF, 4), parameters);
+	for (uint32_t i = 0; i < 4; i++)
+		CHECK(inner.edgeTess[i] == inner.insideTess[0]);
+
+	// Edges on a group border take the lower factor of both groups. Camera to the right leaves the left group coarser.
+	const TessParameters far = CreateParameters(XMFLOAT3(40.0f, 0.0f, -165.0f));
+	const PatchTess toFar = TessFactor::CalcPatchTess(patch, GetPatchLod(0, 0, 0, 4), far);
+	const XMFLOAT3 leftQuadPos(quadPos.x - parameters.quadWidth, quadPos.y, quadPos.z);
+	const float leftTess = TessFactor::CalcDistanceFactor(leftQuadPos, far);
+	CHECK(leftTess < toFar.insideTess[0]);
+	CHECK(toFar.edgeTess[1] == leftTess);
+	CHECK(toFar.edgeTess[3] == toFar.insideTess[0]);
+}
+
+TEST(TessFactor, DrawCountSumsPatches)
+{
+	const TessParameters parameters = CreateParameters(XMFLOAT3(0.0f, 0.0f, -155.0f));
+	const float unitWidth = parameters.quadWidth / parameters.unitCount;
+
+	std::vector<VertexTess> vertices;
+	std::vector<uint32_t> indices;
+	uint64_t expected = 0;
+	for (uint32_t j = 0; j < 4; j++)
+	{
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			VertexTess patch[4];
+			CreatePatch(i * unitWidth, j * unitWidth, unitWidth, XMFLOAT3(0.5f * parameters.quadWidth, 0.5f * parameters.quadWidth, -150.0f), patch);
+			for (uint32_t k = 0; k < 4; k++)
+			{
+				indices.push_back(static_cast<uint32_t>(vertices.size()));
+				vertices.push_back(patch[k]);
+			}
+			expected += TessFactor::CountTriangles(TessFactor::CalcPatchTess(patch, GetPatchLod(0, 0, 0, 4), parameters));
+		}
+	}
+
+	const uint32_t patchLod = GetPatchLod(0, 0, 0, 4);
+	CHECK(TessFactor::CountTriangles(vertices.data(), indices.data(), static_cast<uint32_t>(indices.size()), patchLod, parameters) == expected);
+
+	// Other formulas plug in through the factor function.
+	const TessFactor::FactorFunction flat = [](const XMFLOAT3&, const TessParameters&) { return 2.0f; };
+	CHECK(TessFactor::CountTriangles(vertices.data(), indices.data(), static_cast<uint32_t>(indices.size()), patchLod, parameters, flat) == 16 * 8);
+}
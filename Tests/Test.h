@@ -0,0 +1,19 @@
+#pragma once
+
+// Minimal test registry of the CPU test target. TEST defines a case of a suite, CHECK records a failure
+// and lets the case go on. ApolloTests runs every suite, or only suites named on its command line.
+namespace Test
+{
+	typedef void (*Function)();
+
+	bool Register(const char* suite, const char* name, Function function);
+	void Fail(const char* file, int line, const char* expression);
+}
+
+#define TEST(suite, name) \
+	static void suite##_##name(); \
+	static const bool suite##_##name##_registered = Test::Register(#suite, #name, &suite##_##name); \
+	static void suite##_##name()
+
+#define CHECK(expression) \
+	do { if (!(expression)) Test::Fail(__FILE__, __LINE__, #expression); } while (false)
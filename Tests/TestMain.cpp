@@ -0,0 +1,71 @@
+#include "Test.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <vector>
+
+namespace
+{
+	struct Case
+	{
+		const char*		suite;
+		const char*		name;
+		Test::Function	function;
+	};
+
+	// Filled by static initializers of the test files, so it must exist before the first of them runs.
+	std::vector<Case>& GetCases()
+	{
+		static std::vector<Case> cases;
+		return cases;
+	}
+
+	int g_failureCount = 0;
+}
+
+bool Test::Register(const char* suite, const char* name, Function function)
+{
+	GetCases().push_back({ suite, name, function });
+	return true;
+}
+
+void Test::Fail(const char* file, int line, const char* expression)
+{
+	printf("%s(%d): CHECK(%s) failed\n", file, line, expression);
+	g_failureCount++;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t caseCount = 0;
+	uint32_t failedCaseCount = 0;
+	for (const Case& testCase : GetCases())
+	{
+		bool selected = argc < 2;
+		for (int a = 1; a < argc; a++)
+			selected |= strcmp(argv[a], testCase.suite) == 0;
+		if (!selected)
+			continue;
+
+		const int previousFailureCount = g_failureCount;
+		try
+		{
+			testCase.function();
+		}
+		catch (const std::exception& e)
+		{
+			printf("%s.%s: exception %s\n", testCase.suite, testCase.name, e.what());
+			g_failureCount++;
+		}
+
+		const bool passed = g_failureCount == previousFailureCount;
+		printf("[%s] %s.%s\n", passed ? "  OK  " : "FAILED", testCase.suite, testCase.name);
+		caseCount++;
+		failedCaseCount += passed ? 0 : 1;
+	}
+
+	printf("%u of %u cases passed\n", caseCount - failedCaseCount, caseCount);
+	return caseCount > 0 && failedCaseCount == 0 ? 0 : 1;
+}
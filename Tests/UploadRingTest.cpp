@@ -0,0 +1,180 @@
+#include "pch.h"
+#include "Test.h"
+
+#include "UploadRing.h"
+
+namespace
+{
+	UploadRing CreateRing(uint64_t size)
+	{
+		return UploadRing(std::unique_ptr<UploadRingBackend>(new CpuUploadRingBackend(size)));
+	}
+
+	CpuUploadRingBackend& GetCpuBackend(UploadRing& ring)
+	{
+		return static_cast<CpuUploadRingBackend&>(ring.GetBackend());
+	}
+}
+
+TEST(UploadRing, AllocationsFollowEachOtherAligned)
+{
+	UploadRing ring = CreateRing(256);
+
+	const UploadRing::Allocation first = ring.Allocate(10, 4);
+	const UploadRing::Allocation second = ring.Allocate(16, 16);
+	CHECK(first && second);
+	CHECK(first.offset == 0);
+	CHECK(second.offset == 16);
+	CHECK(second.cpuAddress == ring.GetBackend().GetCpuAddress() + 16);
+	CHECK(second.gpuAddress == ring.GetBackend().GetGpuAddress() + 16);
+	CHECK(ring.GetUsedSize() == 32);
+}
+
+TEST(UploadRing, RestOfLapIsSkipped)
+{
+	UploadRing ring = CreateRing(256);
+	ring.Allocate(100, 4);
+	ring.FinishFrame(1);
+	ring.Allocate(100, 4);
+	ring.FinishFrame(2);
+	GetCpuBackend(ring).SetCompletedFenceValue(1);
+
+	// 56 bytes are left before the end, the allocation starts over at offset 0 instead of straddling it.
+	// Skipped bytes stay used until frame 2 retires.
+	const UploadRing::Allocation allocation = ring.Allocate(100, 4);
+	CHECK(allocation);
+	CHECK(allocation.offset == 0);
+	CHECK(ring.GetUsedSize() == 256);
+	CHECK(ring.GetWaitCount() == 0);
+	CHECK(ring.GetFramesInFlight() == 1);
+}
+
+TEST(UploadRing, EmptyRingRestartsAtStart)
+{
+	UploadRing ring = CreateRing(256);
+	ring.Allocate(10, 4);
+	ring.FinishFrame(1);
+	GetCpuBackend(ring).SetCompletedFenceValue(1);
+	ring.Retire();
+	CHECK(ring.GetUsedSize() == 0);
+	CHECK(ring.GetFramesInFlight() == 0);
+
+	// Nothing live, so the whole ring is free from offset 0 on, even for a request of its full size.
+	const UploadRing::Allocation allocation = ring.Allocate(256, 64);
+	CHECK(allocation);
+	CHECK(allocation.offset == 0);
+}
+
+TEST(UploadRing, FullRingWaitsForOldestFrameOnly)
+{
+	UploadRing ring = CreateRing(300);
+	for (uint64_t frame = 1; frame <= 3; frame++)
+	{
+		CHECK(ring.Allocate(100, 4));
+		ring.FinishFrame(frame);
+	}
+	CHECK(ring.GetFramesInFlight() == 3);
+
+	const UploadRing::Allocation allocation = ring.Allocate(50, 4);
+	CHECK(allocation);
+	CHECK(allocation.offset == 0);
+	CHECK(ring.GetWaitCount() == 1);
+	CHECK(GetCpuBackend(ring).GetWaitCount() == 1);
+	CHECK(ring.GetBackend().GetCompletedFenceValue() == 1);
+	CHECK(ring.GetFramesInFlight() == 2);
+}
+
+TEST(UploadRing, LargeRequestWaitsForSeveralFrames)
+{
+	UploadRing ring = CreateRing(300);
+	for (uint64_t frame = 1; frame <= 3; frame++)
+	{
+		ring.Allocate(100, 4);
+		ring.FinishFrame(frame);
+	}
+
+	// Needs the space of two frames, each is waited for in turn.
+	const UploadRing::Allocation allocation = ring.Allocate(200, 4);
+	CHECK(allocation);
+	CHECK(ring.GetWaitCount() == 2);
+	CHECK(GetCpuBackend(ring).GetWaitCount() == 2);
+	CHECK(ring.GetBackend().GetCompletedFenceValue() == 2);
+	CHECK(ring.GetFramesInFlight() == 1);
+}
+
+TEST(UploadRing, CompletedFramesAreRetiredWithoutWaiting)
+{
+	UploadRing ring = CreateRing(300);
+	for (uint64_t frame = 1; frame <= 3; frame++)
+	{
+		ring.Allocate(100, 4);
+		ring.FinishFrame(frame);
+	}
+	GetCpuBackend(ring).SetCompletedFenceValue(2);
+
+	CHECK(ring.Allocate(150, 4));
+	CHECK(ring.GetWaitCount() == 0);
+	CHECK(GetCpuBackend(ring).GetWaitCount() == 0);
+	CHECK(ring.GetFramesInFlight() == 1);
+}
+
+TEST(UploadRing, RequestNotFittingBesideCurrentFrameIsRefused)
+{
+	UploadRing ring = CreateRing(256);
+	CHECK(ring.Allocate(200, 4));
+
+	// Only the current frame is live, waiting would never free anything.
+	CHECK(!ring.Allocate(100, 4));
+	CHECK(ring.GetWaitCount() == 0);
+	CHECK(ring.GetUsedSize() == 200);
+
+	// What still fits is given out.
+	CHECK(ring.Allocate(56, 4));
+}
+
+TEST(UploadRing, RequestLargerThanRingIsRefused)
+{
+	UploadRing ring = CreateRing(256);
+	CHECK(!ring.Allocate(257, 4));
+	CHECK(!ring.Allocate(0, 4));
+	CHECK(ring.GetUsedSize() == 0);
+	CHECK(ring.GetWaitCount() == 0);
+}
+
+TEST(UploadRing, PeakTracksLargestUse)
+{
+	UploadRing ring = CreateRing(256);
+	ring.Allocate(100, 4);
+	ring.Allocate(60, 4);
+	ring.FinishFrame(1);
+	GetCpuBackend(ring).SetCompletedFenceValue(1);
+	ring.Retire();
+	ring.Allocate(20, 4);
+
+	CHECK(ring.GetUsedSize() == 20);
+	CHECK(ring.GetPeakUsedSize() == 160);
+}
+
+TEST(UploadRing, AllocationsAheadOfFinishedFrameStayLive)
+{
+	UploadRing ring = CreateRing(256);
+	const UploadRing::Allocation first = ring.Allocate(100, 4);
+	const UploadRing::Allocation second = ring.Allocate(60, 4);
+
+	// Second belongs to a later frame, it outlives the first one.
+	ring.FinishFrame(1, first);
+	GetCpuBackend(ring).SetCompletedFenceValue(1);
+	ring.Retire();
+	CHECK(ring.GetUsedSize() == 60);
+
+	// Room freed by the first frame is handed out after the second allocation.
+	ring.FinishFrame(2, second);
+	const UploadRing::Allocation third = ring.Allocate(96, 4);
+	CHECK(third.offset == 160);
+	CHECK(ring.GetWaitCount() == 0);
+	CHECK(ring.GetUsedSize() == 156);
+
+	GetCpuBackend(ring).SetCompletedFenceValue(2);
+	ring.Retire();
+	CHECK(ring.GetUsedSize() == 96);
+}
@@ -0,0 +1,117 @@
+#include "pch.h"
+#include "Test.h"
+
+#include "WorkerPool.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+TEST(WorkerPool, ParallelForRunsEveryIndexOnce)
+{
+	WorkerPool pool(3);
+	std::vector<std::atomic<uint32_t>> hits(1000);
+	for (std::atomic<uint32_t>& hit : hits)
+		hit.store(0);
+
+	pool.ParallelFor(1000, [&](uint32_t i) { hits[i].fetch_add(1); }, 7);
+
+	uint32_t wrongCount = 0;
+	for (const std::atomic<uint32_t>& hit : hits)
+		wrongCount += hit.load() == 1 ? 0 : 1;
+	CHECK(wrongCount == 0);
+}
+
+TEST(WorkerPool, ParallelForNests)
+{
+	WorkerPool pool(2);
+	std::atomic<uint32_t> sum { 0 };
+	pool.ParallelFor(8, [&](uint32_t i)
+	{
+		pool.ParallelFor(8, [&](uint32_t j) { sum.fetch_add(i * 8 + j); });
+	});
+
+	CHECK(sum.load() == 64 * 63 / 2);
+}
+
+TEST(WorkerPool, DependentStartsAfterDependency)
+{
+	WorkerPool pool(3);
+	for (int repeat = 0; repeat < 100; repeat++)
+	{
+		std::atomic<uint32_t> doneCount { 0 };
+		uint32_t seenCount = 0;
+
+		WorkerPool::Counter first;
+		for (int i = 0; i < 8; i++)
+			pool.Spawn(first, [&]() { doneCount.fetch_add(1); });
+
+		WorkerPool::Counter second;
+		pool.Spawn(second, [&]() { seenCount = doneCount.load(); }, &first);
+
+		pool.Wait(second);
+		pool.Wait(first);
+		CHECK(seenCount == 8);
+	}
+}
+
+TEST(WorkerPool, WaitRethrowsJobException)
+{
+	WorkerPool pool(2);
+	WorkerPool::Counter counter;
+	std::atomic<uint32_t> ranCount { 0 };
+	for (int i = 0; i < 4; i++)
+	{
+		pool.Spawn(counter, [&, i]()
+		{
+			ranCount.fetch_add(1);
+			if (i == 2)
+				throw std::runtime_error("job failed");
+		});
+	}
+
+	bool thrown = false;
+	try
+	{
+		pool.Wait(counter);
+	}
+	catch (const std::runtime_error&)
+	{
+		thrown = true;
+	}
+
+	CHECK(thrown);
+	CHECK(counter.IsDone());
+	CHECK(ranCount.load() == 4);
+}
+
+TEST(WorkerPool, PoolWithoutWorkersRunsJobsInWait)
+{
+	WorkerPool pool(0);
+	uint32_t sum = 0;
+	pool.ParallelFor(10, [&](uint32_t i) { sum += i; });
+	CHECK(sum == 45);
+	CHECK(pool.GetSpawnedJobCount() == 10);
+}
+
+TEST(WorkerPool, DestructionDropsQueuedJobs)
+{
+	// Counters outlive the pool, as the destructor asks.
+	WorkerPool::Counter queued;
+	WorkerPool::Counter dependent;
+	const std::shared_ptr<int> token = std::make_shared<int>(0);
+	bool ran = false;
+	{
+		// Nothing takes jobs of a pool without workers until someone waits.
+		WorkerPool pool(0);
+		for (int i = 0; i < 3; i++)
+			pool.Spawn(queued, [token, &ran]() { ran = true; });
+		pool.Spawn(dependent, [token, &ran]() { ran = true; }, &queued);
+		CHECK(token.use_count() == 5);
+	}
+
+	CHECK(!ran);
+	CHECK(token.use_count() == 1);
+	CHECK(queued.IsDone());
+	CHECK(dependent.IsDone());
+}
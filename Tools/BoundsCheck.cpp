@@ -0,0 +1,100 @@
+#include "pch.h"
+
+#include "HeadlessScene.h"
+#include "HeightMap.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <clocale>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+// Tessellates every base patch of the quad sphere into an n x n grid, displaces its points by their height at every
+// sampled mip and reports how many fall outside the bounds of their tree and detail nodes, and by how much, and how many
+// grid triangles face outside the normal cones.
+// Returns 1 if the worst point lies further out than c_tolerance, a few float roundings of the bounds fit
+// are reported but pass, or if any triangle misses its cone by more than c_coneTolerance.
+//
+//   BoundsCheck [--subdiv n] [--segments n] [left.dds right.dds [cache.bin]]
+namespace
+{
+	constexpr float c_tolerance = 1e-3f;
+	constexpr float c_coneTolerance = 1e-4f;	// Radians.
+
+	std::wstring ToWide(const char* argument)
+	{
+		std::wstring wide(strlen(argument) + 1, L'\0');
+		const size_t length = mbstowcs(&wide[0], argument, wide.size());
+		if (length == static_cast<size_t>(-1))
+			return std::wstring(argument, argument + strlen(argument));
+
+		wide.resize(length);
+		return wide;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	setlocale(LC_ALL, "");
+
+	uint32_t subDivideCount = 8;
+	uint32_t segmentCount = 4;
+	int first = 1;
+	while (argc > first + 1 && strncmp(argv[first], "--", 2) == 0)
+	{
+		const uint32_t value = static_cast<uint32_t>(std::max(atoi(argv[first + 1]), 0));
+		if (strcmp(argv[first], "--subdiv") == 0)
+			subDivideCount = std::min(9u, std::max(TESS_GROUP_QUAD_LEVEL + 1, value));
+		else if (strcmp(argv[first], "--segments") == 0)
+			segmentCount = std::min(64u, std::max(1u, value));
+		else
+			break;
+		first += 2;
+	}
+
+	const int fileCount = argc - first;
+	if (fileCount != 0 && fileCount != 2 && fileCount != 3)
+	{
+		printf("usage: %s [--subdiv n] [--segments n] [left.dds right.dds [cache.bin]]\n", argv[0]);
+		return 2;
+	}
+
+	const std::wstring sourceNames[2] =
+	{
+		fileCount > 0 ? ToWide(argv[first]) : L"Textures/displacement_l.dds",
+		fileCount > 0 ? ToWide(argv[first + 1]) : L"Textures/displacement_r.dds",
+	};
+	const std::wstring cacheName = fileCount > 2 ? ToWide(argv[first + 2]) : L"Cache/HeightPyramid.bin";
+
+	HeightMap::Source sources[2];
+	for (uint32_t half = 0; half < 2; half++)
+	{
+		if (!HeightMap::LoadSource(sourceNames[half].c_str(), sources[half]))
+		{
+			printf("failed to read %ls\n", sourceNames[half].c_str());
+			return 1;
+		}
+	}
+
+	WorkerPool workerPool(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+	const wchar_t* const sourceFileNames[2] = { sourceNames[0].c_str(), sourceNames[1].c_str() };
+
+	HeightMap heightMap;
+	if (!heightMap.Init(std::move(sources[0]), std::move(sources[1]), sourceFileNames, cacheName.c_str(), &workerPool))
+	{
+		printf("unsupported textures, node bounds would cover the whole displacement range\n");
+		return 1;
+	}
+
+	const HeadlessScene scene(subDivideCount, &workerPool, &heightMap);
+	const FaceTree::BoundsReport report = scene.ValidateBounds(heightMap, segmentCount);
+
+	printf("subdiv %u, %u segments, %u of %u point references outside node bounds, worst by %g\n",
+		subDivideCount, segmentCount, report.outsideCount, report.pointCount, report.maxExcess);
+	printf("%u of %u grid triangles outside normal cones, worst by %g rad\n",
+		report.coneOutsideCount, report.triangleCount, report.maxConeExcess);
+	return report.maxExcess <= c_tolerance && report.maxConeExcess <= c_coneTolerance ? 0 : 1;
+}
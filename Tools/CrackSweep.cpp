@@ -0,0 +1,112 @@
+#include "pch.h"
+
+#include "CrackCheck.h"
+#include "HeadlessScene.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+using namespace DirectX;
+
+// Sweeps camera poses over the quad sphere as the app builds it, and checks every shared patch edge for cracks
+// with the hull shader factors of TessFactor, at the tessMax of the opaque and the shadow pass.
+// Returns 1 if any crack is found.
+//
+//   CrackSweep [--subdiv n] [--random n] [--seed n] [--poses file]
+//
+// Recorded poses come from the "Record Crack Check Pose" button of the app, Cache/CrackPoses.txt by default.
+// An empty file name takes random poses only.
+namespace
+{
+	struct Options
+	{
+		uint32_t		subDivideCount = 8;
+		uint32_t		randomPoseCount = 8;
+		uint32_t		seed = 0;
+		std::wstring	poseFileName = L"Cache/CrackPoses.txt";
+	};
+
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		for (int a = 1; a + 1 < argc; a += 2)
+		{
+			const char* value = argv[a + 1];
+			if (strcmp(argv[a], "--subdiv") == 0)
+				options.subDivideCount = std::min(9u, std::max(TESS_GROUP_QUAD_LEVEL + 1, static_cast<uint32_t>(atoi(value))));
+			else if (strcmp(argv[a], "--random") == 0)
+				options.randomPoseCount = static_cast<uint32_t>(atoi(value));
+			else if (strcmp(argv[a], "--seed") == 0)
+				options.seed = static_cast<uint32_t>(atoi(value));
+			else if (strcmp(argv[a], "--poses") == 0)
+				options.poseFileName.assign(value, value + strlen(value));
+			else
+				return false;
+		}
+		return argc % 2 == 1;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		printf("usage: %s [--subdiv n] [--random n] [--seed n] [--poses file]\n", argv[0]);
+		return 2;
+	}
+
+	WorkerPool workerPool(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+	const auto start = std::chrono::steady_clock::now();
+
+	// Missing pose file only leaves the random poses.
+	std::vector<XMFLOAT3> poses;
+	if (!options.poseFileName.empty())
+		CrackCheck::LoadPoses(options.poseFileName.c_str(), poses);
+	const uint32_t recordedPoseCount = static_cast<uint32_t>(poses.size());
+	const std::vector<XMFLOAT3> randomPoses = CrackCheck::CreateRandomPoses(options.randomPoseCount, options.seed, 0.1f, 350.0f);
+	poses.insert(poses.end(), randomPoses.begin(), randomPoses.end());
+
+	HeadlessScene scene(options.subDivideCount, &workerPool);
+	const HeadlessScene::Settings settings;
+
+	// Parameters of Apollo, camera positions are set per pose.
+	LodView lodView;
+	lodView.enabled = settings.patchLod;
+	lodView.metric = settings.lodMetric;
+	lodView.pixelThreshold = settings.lodPixelThreshold;
+	lodView.cameraPosition = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	lodView.pixelsPerUnit = settings.outputHeight / (2.0f * tanf(XM_PIDIV4 / 2.0f));
+
+	constexpr float TESS_MAX = 8.0f;
+	TessParameters tessParameters;
+	tessParameters.quadWidth = 300.0f / powf(2.0f, TESS_GROUP_QUAD_LEVEL);
+	tessParameters.unitCount = powf(2.0f, static_cast<float>(options.subDivideCount - TESS_GROUP_QUAD_LEVEL));
+	tessParameters.tessMax = TESS_MAX;
+	tessParameters.cameraPosition = XMFLOAT3(0.0f, 0.0f, 0.0f);
+
+	CrackCheck crackCheck(scene.GetVertices().data(), scene.GetIndices(), &workerPool);
+	const CrackCheck::Report report = crackCheck.Sweep(
+		poses, scene.GetFaceTrees(), scene.GetLodGrid(), lodView, tessParameters, { TESS_MAX, TESS_MAX - 2.0f });
+
+	const double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("subdiv %u, %u recorded and %u random poses, %llu patches, %llu shared edges, %llu cracks, %.2f s\n",
+		options.subDivideCount, recordedPoseCount, options.randomPoseCount,
+		static_cast<unsigned long long>(report.patchCount), static_cast<unsigned long long>(report.sharedEdgeCount),
+		static_cast<unsigned long long>(report.crackCount), time);
+	for (const CrackCheck::Crack& crack : report.cracks)
+	{
+		printf("  %s at (%.3f, %.3f, %.3f), pose %u, tess 2^%.0f, patches %u and %u\n",
+			crack.type == CrackCheck::CrackType::TJunction ? "T-junction" : "Mip mismatch",
+			crack.position.x, crack.position.y, crack.position.z, crack.poseIndex, crack.tessMax,
+			crack.patches[0], crack.patches[1]);
+	}
+
+	return report.crackCount == 0 ? 0 : 1;
+}
@@ -0,0 +1,93 @@
+#include "pch.h"
+
+#include "FileName.h"
+#include "HeightMap.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <clocale>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+// Builds the height pyramids of displacement_l/r.dds and writes them to the cache the app loads at startup,
+// so the first launch after new textures does not pay for it. Stamps only match an app on the same platform.
+//
+//   HeightPyramidBuilder [left.dds right.dds [cache.bin]]
+//
+// Defaults are the files of the app, relative to the working directory.
+namespace
+{
+	std::wstring ToWide(const char* argument)
+	{
+		std::wstring wide(strlen(argument) + 1, L'\0');
+		const size_t length = mbstowcs(&wide[0], argument, wide.size());
+		if (length == static_cast<size_t>(-1))
+			return std::wstring(argument, argument + strlen(argument));
+
+		wide.resize(length);
+		return wide;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	setlocale(LC_ALL, "");
+	if (argc != 1 && argc != 3 && argc != 4)
+	{
+		printf("usage: %s [left.dds right.dds [cache.bin]]\n", argv[0]);
+		return 2;
+	}
+
+	const std::wstring sourceNames[2] =
+	{
+		argc > 1 ? ToWide(argv[1]) : L"Textures/displacement_l.dds",
+		argc > 1 ? ToWide(argv[2]) : L"Textures/displacement_r.dds",
+	};
+	const std::wstring cacheName = argc > 3 ? ToWide(argv[3]) : L"Cache/HeightPyramid.bin";
+
+	HeightMap::Source sources[2];
+	for (uint32_t half = 0; half < 2; half++)
+	{
+		if (!HeightMap::LoadSource(sourceNames[half].c_str(), sources[half]))
+		{
+			printf("failed to read %ls\n", sourceNames[half].c_str());
+			return 1;
+		}
+	}
+
+	const uint32_t width = sources[0].width;
+	const uint32_t height = sources[0].height;
+	const size_t mipCount = sources[0].mips.size();
+
+	// A cache left from older textures would be loaded instead of built.
+	FileName::Remove(cacheName.c_str());
+
+	WorkerPool workerPool(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+	const wchar_t* const sourceFileNames[2] = { sourceNames[0].c_str(), sourceNames[1].c_str() };
+
+	HeightMap heightMap;
+	const auto start = std::chrono::steady_clock::now();
+	if (!heightMap.Init(std::move(sources[0]), std::move(sources[1]), sourceFileNames, cacheName.c_str(), &workerPool))
+	{
+		printf("unsupported textures, halves must match in size and format, and sizes be a multiple of the coarsest sampled mip\n");
+		return 1;
+	}
+	const double buildTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	uint64_t cacheSize = 0;
+	uint64_t writeTime = 0;
+	if (!FileName::GetStamp(cacheName.c_str(), cacheSize, writeTime))
+	{
+		printf("failed to write %ls\n", cacheName.c_str());
+		return 1;
+	}
+
+	printf("%u x %u texels per half, %zu mips\n", width, height, mipCount);
+	printf("built in %.1f ms on %u workers, min height %.4f\n", buildTime, workerPool.GetWorkerCount(), heightMap.GetMinHeight());
+	printf("wrote %ls, %llu bytes\n", cacheName.c_str(), static_cast<unsigned long long>(cacheSize));
+	return 0;
+}
@@ -30,6 +30,8 @@
 #include <DirectXColors.h>
 
 #include <algorithm>
+#include <bitset>
+#include <chrono>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>